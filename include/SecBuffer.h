@@ -91,6 +91,12 @@ public:
         unsigned int extS[3];
     } size;
 
+    //! Capture time in ns on the SYSTEM_TIME_MONOTONIC base, 0 : unknown
+    long long timestamp;
+
+    //! Frame number the driver gave the buffer
+    unsigned int sequence;
+
     //! Constructor
     SecBuffer()
     {
@@ -100,6 +106,8 @@ public:
             reserved.extP[i] = 0;
             size.    extS[i] = 0;
         }
+        timestamp = 0;
+        sequence  = 0;
     }
 
     //! Constructor
@@ -111,6 +119,8 @@ public:
             reserved.extP[i] = other->reserved.extP[i];
             size.    extS[i] = other->size.extS[i];
         }
+        timestamp = other->timestamp;
+        sequence  = other->sequence;
     }
 
     //! Operator(=) override
@@ -122,6 +132,8 @@ public:
             reserved.extP[i] = other.reserved.extP[i];
             size.    extS[i] = other.size.extS[i];
         }
+        timestamp = other.timestamp;
+        sequence  = other.sequence;
         return *this;
     }
 
@@ -91,6 +91,7 @@ private:
 
     int                         mRealDev;
     int                         mFd;
+    int                         mClient;
     int                         mHwVersion;
     int                         mRotVal;
     bool                        mFlagGlobalAlpha;
@@ -118,6 +119,9 @@ public:
 
     int  getFd(void);
 
+    void setClient(int client);
+    int  dump(char *buf, int bufSize);
+
     SecBuffer * getMemAddr(int index = 0);
 
     int  getHWVersion(void);
@@ -133,6 +137,9 @@ public:
                       unsigned int *cropWidth, unsigned int *cropHeight,
                       int *colorFormat);
 
+    /* the node was set up by someone else, the next setSrcParams() does S_FMT again */
+    void invalidateSrcParams(void);
+
     virtual bool setSrcAddr(unsigned int physYAddr,
                     unsigned int physCbAddr = 0,
                     unsigned int physCrAddr = 0,
@@ -150,6 +157,7 @@ public:
                       int *colorFormat);
 
     virtual bool setDstAddr(unsigned int physYAddr, unsigned int physCbAddr = 0, unsigned int physCrAddr = 0, int buf_index = 0);
+    virtual bool updateDstAddr(unsigned int physYAddr, unsigned int physCbAddr = 0, unsigned int physCrAddr = 0, int buf_index = 0);
 
     virtual bool setRotVal(unsigned int rotVal);
     virtual bool setGlobalAlpha(bool enable = true, int alpha = 0xff);
@@ -158,6 +166,9 @@ public:
 
     virtual bool draw(int src_index, int dst_index);
 
+    virtual bool streamOn(void);
+    virtual bool streamOff(void);
+
 private:
     bool m_streamOn(void);
     bool m_checkSrcSize(unsigned int width, unsigned int height,
@@ -0,0 +1,117 @@
+/*
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      SecFimcBroker.h
+ * \brief     header file for Fimc instance broker
+ *
+ * The broker owns the FIMC nodes (/dev/video0 ~ /dev/video3) and leases
+ * them to clients. When every node a client may use is busy, the request
+ * is queued and served by client priority (camera > overlay > hdmi > csc),
+ * then by arrival order.
+ *
+ * There is one broker per process, it only orders the clients living in
+ * it, e.g. the camera and csc in mediaserver. Clients in other processes
+ * are not seen, the driver is all that keeps them apart.
+ */
+
+#ifndef __SEC_FIMC_BROKER_H__
+#define __SEC_FIMC_BROKER_H__
+
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+/* number of FIMC nodes, the same as SecFimc::DEV_MAX */
+#define FIMC_DEV_MAX              (4)
+#define FIMC_BROKER_MAX_WAITERS   (16)
+#define FIMC_DEV_MASK(dev)        (1 << (dev))
+
+namespace android {
+
+class SecFimcBroker
+{
+public:
+    /* lower value means higher priority */
+    enum CLIENT {
+        CLIENT_CAMERA = 0,
+        CLIENT_OVERLAY,
+        CLIENT_HDMI,
+        CLIENT_CSC,
+        CLIENT_MAX,
+    };
+
+    static SecFimcBroker *getInstance(void);
+
+    /*
+     * Lease one FIMC node out of devMask for client.
+     * timeoutMs < 0 waits forever, 0 only tries.
+     * Returns the leased node (0 ~ FIMC_DEV_MAX - 1), or -1.
+     */
+    int  acquire(enum CLIENT client, unsigned int devMask, int timeoutMs = -1);
+    bool release(int dev);
+
+    int  getOwner(int dev);
+    /* leases dev had so far, a holder comparing it finds who came between */
+    unsigned int getLeaseCount(int dev);
+    int  getUtilization(int dev);
+
+    int  dump(char *buf, int bufSize);
+
+private:
+    struct node_info {
+        int          owner;
+        nsecs_t      leaseStart;
+        nsecs_t      busyTime;
+        unsigned int leaseCount;
+        unsigned int waitCount;
+    };
+
+    struct client_info {
+        unsigned int acquireCount;
+        unsigned int waitCount;
+        unsigned int timeoutCount;
+        nsecs_t      waitTime;
+        nsecs_t      maxWaitTime;
+    };
+
+    struct waiter_info {
+        bool         inUse;
+        int          client;
+        unsigned int devMask;
+        unsigned int seq;
+    };
+
+    Mutex                       mLock;
+    Condition                   mCondition;
+
+    nsecs_t                     mStartTime;
+    unsigned int                mSeq;
+
+    struct node_info            mNode[FIMC_DEV_MAX];
+    struct client_info          mClient[CLIENT_MAX];
+    struct waiter_info          mWaiter[FIMC_BROKER_MAX_WAITERS];
+
+    SecFimcBroker();
+    ~SecFimcBroker();
+
+    int  m_findFreeDev(int client, unsigned int seq, int slot, unsigned int devMask);
+    bool m_isFirstInLine(int client, unsigned int seq, int slot, int dev);
+    void m_grant(int client, int dev);
+};
+
+}; // namespace android
+
+#endif //__SEC_FIMC_BROKER_H__
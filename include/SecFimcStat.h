@@ -0,0 +1,101 @@
+/*
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      SecFimcStat.h
+ * \brief     latency histograms for the FIMC V4L2 ioctls
+ *
+ * Every instrumented ioctl is timed and accounted to the (device, client)
+ * pair its fd was attached with. Bucket i counts calls that took less than
+ * (16 << i) us, the last bucket takes everything slower.
+ * Counting takes the lock of the fd alone, found by an index and not a
+ * search, so the stats cost ioctls on other fds nothing.
+ */
+
+#ifndef __SEC_FIMC_STAT_H__
+#define __SEC_FIMC_STAT_H__
+
+#include <stdint.h>
+#include <sys/ioctl.h>
+
+#include "utils/Timers.h"
+
+#define USE_FIMC_STAT
+
+#define FIMC_STAT_MAGIC         (0x46535431)    /* "FST1" */
+#define FIMC_STAT_VERSION       (1)
+#define FIMC_STAT_DEV_MAX       (4)
+#define FIMC_STAT_CLIENT_MAX    (5)             /* SecFimcBroker clients + unknown */
+#define FIMC_STAT_CLIENT_NONE   (FIMC_STAT_CLIENT_MAX - 1)
+#define FIMC_STAT_BUCKETS       (12)
+#define FIMC_STAT_MAX_FDS       (16)
+#define FIMC_STAT_FD_LIMIT      (1024)          /* fds past it aren't counted */
+
+enum FIMC_STAT_OP {
+    FIMC_STAT_S_FMT = 0,
+    FIMC_STAT_QBUF,
+    FIMC_STAT_DQBUF,
+    FIMC_STAT_STREAMON,
+    FIMC_STAT_S_CTRL,
+    FIMC_STAT_OP_MAX,
+};
+
+struct fimc_stat_entry {
+    uint32_t count;
+    uint32_t error;
+    uint32_t hist[FIMC_STAT_BUCKETS];
+    int64_t  total_ns;
+    int64_t  max_ns;
+};
+
+/* layout of the binary snapshot, entries follow the header */
+struct fimc_stat_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dev_max;
+    uint32_t client_max;
+    uint32_t op_max;
+    uint32_t buckets;
+    int64_t  timestamp;
+};
+
+struct fimc_stat_snapshot {
+    struct fimc_stat_header header;
+    struct fimc_stat_entry  entry[FIMC_STAT_DEV_MAX][FIMC_STAT_CLIENT_MAX][FIMC_STAT_OP_MAX];
+};
+
+void fimc_stat_attach(int fd, int dev, int client);
+void fimc_stat_detach(int fd);
+void fimc_stat_add(int fd, int op, nsecs_t latency, int error);
+void fimc_stat_reset(void);
+
+int  fimc_stat_dump(char *buf, int bufSize, int dev, int client);
+int  fimc_stat_snapshot(struct fimc_stat_snapshot *snapshot);
+int  fimc_stat_save(const char *path);
+
+static inline int fimc_stat_ioctl(int fd, int op, unsigned long request, void *arg)
+{
+#ifdef USE_FIMC_STAT
+    nsecs_t start = systemTime();
+    int ret = ioctl(fd, request, arg);
+    fimc_stat_add(fd, op, systemTime() - start, ret < 0);
+    return ret;
+#else
+    return ioctl(fd, request, arg);
+#endif
+}
+
+#endif //__SEC_FIMC_STAT_H__
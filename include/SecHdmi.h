@@ -40,6 +40,7 @@
 #include "s3c_lcd.h"
 #include "SecBuffer.h"
 #include "SecFimc.h"
+#include "SecFimcBroker.h"
 
 #include "../libhdmi/libsForhdmi/libedid/libedid.h"
 #include "../libhdmi/libsForhdmi/libcec/libcec.h"
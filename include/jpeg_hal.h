@@ -126,6 +126,9 @@ int jpeghal_set_outbuf(int fd, struct jpeg_buf *buf);
 int jpeghal_dec_exe(int fd, struct jpeg_buf *in_buf, struct jpeg_buf *out_buf);
 int jpeghal_enc_exe(int fd, struct jpeg_buf *in_buf, struct jpeg_buf *out_buf);
 
+int jpeghal_stop(int fd, struct jpeg_buf *in_buf, struct jpeg_buf *out_buf);
+int jpeghal_release_buf(int fd, struct jpeg_buf *buf);
+
 int jpeghal_deinit(int fd, struct jpeg_buf *in_buf, struct jpeg_buf *out_buf);
 
 int jpeghal_s_ctrl(int fd, int cid, int value);
@@ -53,6 +53,10 @@
 #ifndef SW_CONVERTOR_H_
 #define SW_CONVERTOR_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*--------------------------------------------------------------------------------*/
 /* Format Conversion API                                                          */
 /*--------------------------------------------------------------------------------*/
@@ -466,4 +470,63 @@ void csc_ARGB8888_to_YUV420SP_NEON(
     unsigned int width,
     unsigned int height);
 
+/* csc_YUV422I_to_YUV420 mode, one source order | one destination layout */
+#define CSC_YUV422I_YUYV        (0 << 0)
+#define CSC_YUV422I_UYVY        (1 << 0)
+#define CSC_YUV420_NV12         (0 << 1)
+#define CSC_YUV420_NV21         (1 << 1)
+#define CSC_YUV420_PLANAR       (2 << 1)
+#define CSC_YUV420_HALF         (1 << 3)
+
+/*
+ * Converts packed YUV422 (YUYV or UYVY) to YUV420 in a single pass.
+ * Chroma is the average of each line pair. With CSC_YUV420_HALF the
+ * destination is width/2 x height/2, every pixel a 2x2 box of the source.
+ *
+ * @param y_dst
+ *   Y plane address of YUV420[out]
+ *
+ * @param u_dst
+ *   UV plane address for NV12/NV21, U plane address for planar[out]
+ *
+ * @param v_dst
+ *   V plane address for planar, unused otherwise[out]
+ *
+ * @param src
+ *   Address of YUV422[in]
+ *
+ * @param width
+ *   Width of YUV422, even[in]
+ *
+ * @param height
+ *   Height of YUV422[in]
+ *
+ * @param src_stride
+ *   Line to line of YUV422 in bytes[in]
+ *
+ * @param y_stride
+ *   Line to line of the Y plane in bytes[in]
+ *
+ * @param uv_stride
+ *   Line to line of the chroma plane(s) in bytes[in]
+ *
+ * @param mode
+ *   CSC_YUV422I_* | CSC_YUV420_*[in]
+ */
+void csc_YUV422I_to_YUV420(
+    unsigned char *y_dst,
+    unsigned char *u_dst,
+    unsigned char *v_dst,
+    unsigned char *src,
+    unsigned int width,
+    unsigned int height,
+    unsigned int src_stride,
+    unsigned int y_stride,
+    unsigned int uv_stride,
+    unsigned int mode);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /*COLOR_SPACE_CONVERTOR_H_*/
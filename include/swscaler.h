@@ -35,12 +35,21 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
+enum SW_SCALE_FORMAT {
+    SW_SCALE_FMT_YUYV = 0,
+    SW_SCALE_FMT_NV21,
+};
+
 void SW_Scale_up(unsigned int srcImageWidth, unsigned int srcImageHeight, unsigned int dstImageWidth, unsigned int dstImageHeight, unsigned char *srcY, unsigned char *srcCbCr, unsigned char *dstY, unsigned char *dstCbCr);
 void SW_Scale_up_crop(unsigned int srcImageWidth, unsigned int
         srcImageHeight, unsigned int dstImageWidth, unsigned int
         dstImageHeight, unsigned char *srcY, unsigned char *srcCbCr, unsigned
         char *dstY, unsigned char *dstCbCr);
 void SW_Memcpy_NEON(unsigned int cropImageWidth, unsigned int  cropImageHeight, unsigned char *srcY, unsigned char *srcCbCr, unsigned char *dstY, unsigned char *dstCbCr);
+void SW_Copy_Plane(unsigned char *dst, unsigned int dstStride, unsigned char *src, unsigned int srcStride, unsigned int width, unsigned int height);
+void SW_Copy_Plane_NEON(unsigned char *dst, unsigned int dstStride, unsigned char *src, unsigned int srcStride, unsigned int width, unsigned int height);
+int SW_Scale_down_YUYV(unsigned int srcWidth, unsigned int srcHeight, unsigned char *src, unsigned int dstWidth, unsigned int dstHeight, unsigned char *dst, int dstFormat);
+void SW_Accumulate_Line_NEON(unsigned short *acc, unsigned char *src, unsigned int width, unsigned int weight, int first);
 #ifdef __cplusplus
 }
 #endif
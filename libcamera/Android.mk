@@ -9,13 +9,14 @@ LOCAL_C_INCLUDES += $(LOCAL_PATH)/../include
 
 ifeq ($(CAMERA_USE_DIGITALZOOM), true)
 LOCAL_SRC_FILES:= \
-	SecCamera_zoom.cpp SecCameraHWInterface_zoom.cpp
+	SecCamera_zoom.cpp SecCameraHWInterface_zoom.cpp SecVirtualSensor.cpp SecCameraBench.cpp
 else
 LOCAL_SRC_FILES:= \
-	SecCamera.cpp SecCameraHWInterface.cpp
+	SecCamera.cpp SecCameraHWInterface.cpp SecFrameQueue.cpp SecFrameTrace.cpp SecVirtualSensor.cpp SecCameraBench.cpp
 endif
 
-LOCAL_SHARED_LIBRARIES:= libutils libcutils libbinder liblog libcamera_client libhardware libswscaler
+LOCAL_SHARED_LIBRARIES:= libutils libcutils libbinder liblog libcamera_client libhardware libswscaler libfimc
+LOCAL_STATIC_LIBRARIES := libswconverter
 
 ifeq ($(TARGET_SOC), exynos4210)
 LOCAL_SHARED_LIBRARIES += libs5pjpeg
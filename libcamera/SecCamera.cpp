@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <sys/poll.h>
 #include "SecCamera.h"
+#include "SecVirtualSensor.h"
 #include "cutils/properties.h"
 
 using namespace android;
@@ -74,6 +75,65 @@ unsigned long measure_time_camera(struct timeval *start, struct timeval *stop)
 }
 #endif
 
+/*
+ * The capture nodes are only reached through these : a node opened by
+ * SecVirtualSensor (camera.virtual.enable) answers instead of the kernel.
+ */
+static int cam_open(const char *node)
+{
+    if (SecVirtualSensor::enabled())
+        return SecVirtualSensor::openNode(node);
+
+    return open(node, O_RDWR);
+}
+
+static int cam_close(int fd)
+{
+    if (SecVirtualSensor::find(fd) != NULL)
+        return SecVirtualSensor::closeNode(fd);
+
+    return close(fd);
+}
+
+static int cam_ioctl(int fd, unsigned long request, void *arg)
+{
+    SecVirtualSensor *sensor = SecVirtualSensor::find(fd);
+
+    if (sensor != NULL)
+        return sensor->ioctl(request, arg);
+
+    return ioctl(fd, request, arg);
+}
+
+static int cam_poll(struct pollfd *events, nfds_t nfds, int timeout)
+{
+    SecVirtualSensor *sensor = SecVirtualSensor::find(events->fd);
+
+    if (sensor != NULL && nfds == 1)
+        return sensor->poll(events, timeout);
+
+    return poll(events, nfds, timeout);
+}
+
+static void *cam_mmap(size_t length, int fd, off_t offset)
+{
+    SecVirtualSensor *sensor = SecVirtualSensor::find(fd);
+
+    if (sensor != NULL)
+        return sensor->mmap(length, offset);
+
+    return mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+}
+
+/* the virtual buffers go with their node */
+static int cam_munmap(void *addr, size_t length)
+{
+    if (SecVirtualSensor::owns(addr))
+        return 0;
+
+    return munmap(addr, length);
+}
+
 static int close_buffers(struct SecBuffer *buffers, int num_of_buf)
 {
     int ret;
@@ -81,7 +141,7 @@ static int close_buffers(struct SecBuffer *buffers, int num_of_buf)
     for (int i = 0; i < num_of_buf; i++) {
         for(int j = 0; j < MAX_PLANES; j++) {
             if (buffers[i].virt.extP[j]) {
-                ret = munmap(buffers[i].virt.extP[j], buffers[i].size.extS[j]);
+                ret = cam_munmap(buffers[i].virt.extP[j], buffers[i].size.extS[j]);
                 LOGV("munmap():buffers[%d].virt.extP[%d]: 0x%x size = %d",
                         i, j, (unsigned int) buffers[i].virt.extP[j],
                         buffers[i].size.extS[j]);
@@ -126,32 +186,56 @@ static int get_pixel_depth(unsigned int fmt)
     return depth;
 }
 
-static int fimc_poll(struct pollfd *events)
+static int get_num_planes(unsigned int fmt)
+{
+    switch (fmt) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV12T:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_NV16:
+    case V4L2_PIX_FMT_NV61:
+        return 2;
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YVU420:
+    case V4L2_PIX_FMT_YVU420M:
+    case V4L2_PIX_FMT_YUV422P:
+        return 3;
+    default:
+        return 1;
+    }
+}
+
+static int fimc_poll_timeout(struct pollfd *events, int timeout)
 {
     int ret;
 
-    /* 10 second delay is because sensor can take a long time
-     * to do auto focus and capture in dark settings
-     */
-    ret = poll(events, 1, 10000);
+    ret = cam_poll(events, 1, timeout);
     if (ret < 0) {
         LOGE("ERR(%s):poll error", __func__);
         return ret;
     }
 
     if (ret == 0) {
-        LOGE("ERR(%s):No data in 10 secs..", __func__);
+        LOGE("ERR(%s):No data in %d ms..", __func__, timeout);
         return ret;
     }
 
     return ret;
 }
 
+static int fimc_poll(struct pollfd *events)
+{
+    /* 10 second delay is because sensor can take a long time
+     * to do auto focus and capture in dark settings
+     */
+    return fimc_poll_timeout(events, 10000);
+}
+
 static int fimc_v4l2_querycap(int fp)
 {
     struct v4l2_capability cap;
 
-    if (ioctl(fp, VIDIOC_QUERYCAP, &cap) < 0) {
+    if (cam_ioctl(fp, VIDIOC_QUERYCAP, &cap) < 0) {
         LOGE("ERR(%s):VIDIOC_QUERYCAP failed", __func__);
         return -1;
     }
@@ -169,7 +253,7 @@ static const __u8* fimc_v4l2_enuminput(int fp, int index)
     static struct v4l2_input input;
 
     input.index = index;
-    if (ioctl(fp, VIDIOC_ENUMINPUT, &input) != 0) {
+    if (cam_ioctl(fp, VIDIOC_ENUMINPUT, &input) != 0) {
         LOGE("ERR(%s):No matching index found", __func__);
         return NULL;
     }
@@ -184,7 +268,7 @@ static int fimc_v4l2_s_input(int fp, int index)
 
     input.index = index;
 
-    if (ioctl(fp, VIDIOC_S_INPUT, &input) < 0) {
+    if (cam_ioctl(fp, VIDIOC_S_INPUT, &input) < 0) {
         LOGE("ERR(%s):VIDIOC_S_INPUT failed", __func__);
         return -1;
     }
@@ -212,7 +296,7 @@ static int fimc_v4l2_s_fmt(int fp, int width, int height, unsigned int fmt, enum
     LOGV("fimc_v4l2_s_fmt : width(%d) height(%d)", width, height);
 
     /* Set up for capture */
-    if (ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
+    if (cam_ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
         LOGE("ERR(%s):VIDIOC_S_FMT failed", __func__);
         return -1;
     }
@@ -239,7 +323,7 @@ static int fimc_v4l2_s_fmt_cap(int fp, int width, int height, unsigned int fmt)
     LOGV("fimc_v4l2_s_fmt_cap : width(%d) height(%d)", width, height);
 
     /* Set up for capture */
-    if (ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
+    if (cam_ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
         LOGE("ERR(%s):VIDIOC_S_FMT failed", __func__);
         return -1;
     }
@@ -265,7 +349,7 @@ int fimc_v4l2_s_fmt_is(int fp, int width, int height, unsigned int fmt, enum v4l
     LOGV("fimc_v4l2_s_fmt_is : width(%d) height(%d)", width, height);
 
     /* Set up for capture */
-    if (ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
+    if (cam_ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
         LOGE("ERR(%s):VIDIOC_S_FMT failed", __func__);
         return -1;
     }
@@ -281,7 +365,7 @@ static int fimc_v4l2_enum_fmt(int fp, unsigned int fmt)
     fmtdesc.type = V4L2_BUF_TYPE;
     fmtdesc.index = 0;
 
-    while (ioctl(fp, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
+    while (cam_ioctl(fp, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
         if (fmtdesc.pixelformat == fmt) {
             LOGV("passed fmt = %#x found pixel format[%d]: %s", fmt, fmtdesc.index, fmtdesc.description);
             found = 1;
@@ -307,7 +391,7 @@ static int fimc_v4l2_reqbufs(int fp, enum v4l2_buf_type type, int nr_bufs)
     req.type = type;
     req.memory = V4L2_MEMORY_TYPE;
 
-    if (ioctl(fp, VIDIOC_REQBUFS, &req) < 0) {
+    if (cam_ioctl(fp, VIDIOC_REQBUFS, &req) < 0) {
         LOGE("ERR(%s):VIDIOC_REQBUFS failed", __func__);
         return -1;
     }
@@ -325,7 +409,7 @@ static int fimc_v4l2_querybuf(int fp, struct SecBuffer *buffers, enum v4l2_buf_t
         v4l2_buf.memory = V4L2_MEMORY_TYPE;
         v4l2_buf.index = i;
 
-        ret = ioctl(fp, VIDIOC_QUERYBUF, &v4l2_buf);
+        ret = cam_ioctl(fp, VIDIOC_QUERYBUF, &v4l2_buf);
         if (ret < 0) {
             LOGE("ERR(%s):VIDIOC_QUERYBUF failed", __func__);
             return -1;
@@ -333,8 +417,7 @@ static int fimc_v4l2_querybuf(int fp, struct SecBuffer *buffers, enum v4l2_buf_t
 
         buffers[i].size.s = v4l2_buf.length;
 
-        if ((buffers[i].virt.p = (char *)mmap(0, v4l2_buf.length, PROT_READ | PROT_WRITE, MAP_SHARED,
-                    fp, v4l2_buf.m.offset)) < 0) {
+        if ((buffers[i].virt.p = (char *)cam_mmap(v4l2_buf.length, fp, v4l2_buf.m.offset)) < 0) {
             LOGE("%s %d] mmap() failed",__func__, __LINE__);
             return -1;
         }
@@ -348,7 +431,7 @@ static int fimc_v4l2_streamon(int fp)
     enum v4l2_buf_type type = V4L2_BUF_TYPE;
     int ret;
 
-    ret = ioctl(fp, VIDIOC_STREAMON, &type);
+    ret = cam_ioctl(fp, VIDIOC_STREAMON, &type);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_STREAMON failed", __func__);
         return ret;
@@ -363,7 +446,7 @@ static int fimc_v4l2_streamoff(int fp)
     int ret;
 
     LOGV("%s :", __func__);
-    ret = ioctl(fp, VIDIOC_STREAMOFF, &type);
+    ret = cam_ioctl(fp, VIDIOC_STREAMOFF, &type);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_STREAMOFF failed", __func__);
         return ret;
@@ -381,7 +464,7 @@ static int fimc_v4l2_qbuf(int fp, int width, int height, struct SecBuffer *vaddr
     v4l2_buf.memory = V4L2_MEMORY_TYPE;
     v4l2_buf.index = index;
 
-    ret = ioctl(fp, VIDIOC_QBUF, &v4l2_buf);
+    ret = cam_ioctl(fp, VIDIOC_QBUF, &v4l2_buf);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_QBUF failed", __func__);
         return ret;
@@ -390,22 +473,152 @@ static int fimc_v4l2_qbuf(int fp, int width, int height, struct SecBuffer *vaddr
     return 0;
 }
 
-static int fimc_v4l2_dqbuf(int fp, int num_plane)
+/*
+ * Capture time of a dequeued buffer on the SYSTEM_TIME_MONOTONIC base.
+ * Some fimc drivers stamp buffers with the wall clock, those are moved
+ * over by how far the two clocks are apart now. Nothing usable : now.
+ */
+static nsecs_t fimc_v4l2_timestamp(const struct timeval *tv)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t stamp = seconds(tv->tv_sec) + microseconds(tv->tv_usec);
+    nsecs_t real;
+
+    if (stamp == 0)
+        return now;
+
+    if (stamp <= now && now - stamp < seconds(1))
+        return stamp;
+
+    real = systemTime(SYSTEM_TIME_REALTIME);
+    if (stamp <= real && real - stamp < seconds(1))
+        return now - (real - stamp);
+
+    return now;
+}
+
+/* buffers, when given, gets the capture time and sequence at the index dequeued */
+static int fimc_v4l2_dqbuf(int fp, int num_plane, struct SecBuffer *buffers)
+{
+    struct v4l2_buffer v4l2_buf;
+    int ret;
+
+    memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+    v4l2_buf.type = V4L2_BUF_TYPE;
+    v4l2_buf.memory = V4L2_MEMORY_TYPE;
+
+    ret = cam_ioctl(fp, VIDIOC_DQBUF, &v4l2_buf);
+    if (ret < 0) {
+        LOGE("ERR(%s):VIDIOC_DQBUF failed, dropped frame", __func__);
+        return ret;
+    }
+
+    if (buffers != NULL && v4l2_buf.index < MAX_BUFFERS) {
+        buffers[v4l2_buf.index].timestamp = fimc_v4l2_timestamp(&v4l2_buf.timestamp);
+        buffers[v4l2_buf.index].sequence = v4l2_buf.sequence;
+    }
+
+    return v4l2_buf.index;
+}
+
+#ifdef ZERO_SHUTTER_LAG
+static int fimc_v4l2_dqbuf_timestamp(int fp, int num_plane, struct timeval *timestamp)
 {
     struct v4l2_buffer v4l2_buf;
     int ret;
 
+    memset(&v4l2_buf, 0, sizeof(v4l2_buf));
     v4l2_buf.type = V4L2_BUF_TYPE;
     v4l2_buf.memory = V4L2_MEMORY_TYPE;
 
-    ret = ioctl(fp, VIDIOC_DQBUF, &v4l2_buf);
+    ret = cam_ioctl(fp, VIDIOC_DQBUF, &v4l2_buf);
+    if (ret < 0) {
+        LOGE("ERR(%s):VIDIOC_DQBUF failed, dropped frame", __func__);
+        return ret;
+    }
+
+    *timestamp = v4l2_buf.timestamp;
+
+    return v4l2_buf.index;
+}
+#endif
+
+#ifdef USE_PREVIEW_USERPTR
+/*
+ * USERPTR on the FIMC nodes points to the physical address of each plane,
+ * laid out as the driver's struct fimc_buf (see libfimc).
+ */
+struct fimc_userptr_buf {
+    unsigned int base[3];
+    size_t       length[3];
+};
+
+static int fimc_v4l2_reqbufs_userptr(int fp, enum v4l2_buf_type type, int nr_bufs)
+{
+    struct v4l2_requestbuffers req;
+
+    req.count = nr_bufs;
+    req.type = type;
+    req.memory = V4L2_MEMORY_USERPTR;
+
+    if (cam_ioctl(fp, VIDIOC_REQBUFS, &req) < 0) {
+        LOGE("ERR(%s):VIDIOC_REQBUFS failed", __func__);
+        return -1;
+    }
+
+    return req.count;
+}
+
+static int fimc_v4l2_qbuf_userptr(int fp, struct SecBuffer *buffers, int index, int num_plane)
+{
+    struct v4l2_buffer v4l2_buf;
+    struct fimc_userptr_buf fimc_buf;
+    int ret;
+
+    for (int i = 0; i < 3; i++) {
+        fimc_buf.base[i]   = buffers[index].phys.extP[i];
+        fimc_buf.length[i] = buffers[index].size.extS[i];
+    }
+
+    memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+    v4l2_buf.type = V4L2_BUF_TYPE;
+    v4l2_buf.memory = V4L2_MEMORY_USERPTR;
+    v4l2_buf.index = index;
+    v4l2_buf.m.userptr = (unsigned long)&fimc_buf;
+    v4l2_buf.length = num_plane;
+
+    ret = cam_ioctl(fp, VIDIOC_QBUF, &v4l2_buf);
+    if (ret < 0) {
+        LOGE("ERR(%s):VIDIOC_QBUF failed", __func__);
+        return ret;
+    }
+
+    return 0;
+}
+
+static int fimc_v4l2_dqbuf_userptr(int fp, struct SecBuffer *buffers)
+{
+    struct v4l2_buffer v4l2_buf;
+    int ret;
+
+    memset(&v4l2_buf, 0, sizeof(v4l2_buf));
+    v4l2_buf.type = V4L2_BUF_TYPE;
+    v4l2_buf.memory = V4L2_MEMORY_USERPTR;
+
+    ret = cam_ioctl(fp, VIDIOC_DQBUF, &v4l2_buf);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_DQBUF failed, dropped frame", __func__);
         return ret;
     }
 
+    if (v4l2_buf.index < MAX_BUFFERS) {
+        buffers[v4l2_buf.index].timestamp = fimc_v4l2_timestamp(&v4l2_buf.timestamp);
+        buffers[v4l2_buf.index].sequence = v4l2_buf.sequence;
+    }
+
     return v4l2_buf.index;
 }
+#endif
 
 static int fimc_v4l2_g_ctrl(int fp, unsigned int id)
 {
@@ -414,7 +627,7 @@ static int fimc_v4l2_g_ctrl(int fp, unsigned int id)
 
     ctrl.id = id;
 
-    ret = ioctl(fp, VIDIOC_G_CTRL, &ctrl);
+    ret = cam_ioctl(fp, VIDIOC_G_CTRL, &ctrl);
     if (ret < 0) {
         LOGE("ERR(%s): VIDIOC_G_CTRL(id = 0x%x (%d)) failed, ret = %d",
              __func__, id, id-V4L2_CID_PRIVATE_BASE, ret);
@@ -432,7 +645,7 @@ static int fimc_v4l2_s_ctrl(int fp, unsigned int id, unsigned int value)
     ctrl.id = id;
     ctrl.value = value;
 
-    ret = ioctl(fp, VIDIOC_S_CTRL, &ctrl);
+    ret = cam_ioctl(fp, VIDIOC_S_CTRL, &ctrl);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_S_CTRL(id = %#x (%d), value = %d) failed ret = %d",
              __func__, id, id-V4L2_CID_PRIVATE_BASE, value, ret);
@@ -455,71 +668,282 @@ static int fimc_v4l2_s_ext_ctrl(int fp, unsigned int id, void *value)
     ctrls.count = 1;
     ctrls.controls = &ctrl;
 
-    ret = ioctl(fp, VIDIOC_S_EXT_CTRLS, &ctrls);
+    ret = cam_ioctl(fp, VIDIOC_S_EXT_CTRLS, &ctrls);
     if (ret < 0)
         LOGE("ERR(%s):VIDIOC_S_EXT_CTRLS failed", __func__);
 
     return ret;
 }
 
+/*
+ * Controls set by the thread between beginControls() and commitControls()
+ * are queued, a control set twice keeps its first place with the last
+ * value. The queue goes out as one VIDIOC_S_EXT_CTRLS per control class,
+ * the private controls and everything the driver refused control by
+ * control. commitControls() fails if any control of the batch did.
+ */
+int SecCamera::beginControls(void)
+{
+    Mutex::Autolock lock(m_ctrl_lock);
+
+    if (m_ctrl_depth > 0 && m_ctrl_owner != androidGetThreadId()) {
+        LOGW("WARN(%s):controls are batched by another thread", __func__);
+        return -1;
+    }
+
+    if (m_ctrl_depth++ == 0) {
+        m_ctrl_owner = androidGetThreadId();
+        m_ctrl_failed = false;
+    }
+
+    return 0;
+}
+
+int SecCamera::commitControls(void)
+{
+    Mutex::Autolock lock(m_ctrl_lock);
+    int ret;
+
+    if (m_ctrl_depth <= 0 || m_ctrl_owner != androidGetThreadId()) {
+        LOGE("ERR(%s):no batch was begun by this thread", __func__);
+        return -1;
+    }
+
+    if (--m_ctrl_depth > 0)
+        return 0;
+
+    ret = m_flushControls();
+    if (m_ctrl_failed)
+        ret = -1;
+    m_ctrl_failed = false;
+
+    return ret;
+}
+
+/* m_ctrl_lock is held */
+int SecCamera::m_flushControls(void)
+{
+    enum { CTRL_QUEUED = 0, CTRL_SENT, CTRL_SINGLE };
+
+    struct v4l2_ext_controls ctrls;
+    struct v4l2_ext_control ctrl[CTRL_BATCH_MAX];
+    int slot[CTRL_BATCH_MAX];
+    char state[CTRL_BATCH_MAX];
+    int count = m_ctrl_count;
+    int ret = 0;
+
+    m_ctrl_count = 0;
+    if (count == 0)
+        return 0;
+
+    if (m_cam_fd <= 0) {
+        LOGE("ERR(%s):Camera was closed, %d controls dropped", __func__, count);
+        m_ctrl_failed = true;
+        return -1;
+    }
+
+    m_ctrl_batches++;
+    memset(state, CTRL_QUEUED, sizeof(state));
+
+    /* VIDIOC_S_EXT_CTRLS takes one class, and never V4L2_CID_PRIVATE_BASE */
+    for (int first = 0; first < count; first++) {
+        unsigned int ctrl_class = V4L2_CTRL_ID2CLASS(m_ctrl_queue[first].id);
+        int n = 0;
+
+        if (state[first] != CTRL_QUEUED)
+            continue;
+
+        for (int i = first; i < count; i++) {
+            if (state[i] != CTRL_QUEUED || V4L2_CTRL_ID2CLASS(m_ctrl_queue[i].id) != ctrl_class)
+                continue;
+
+            ctrl[n].id = m_ctrl_queue[i].id;
+            ctrl[n].value = m_ctrl_queue[i].value;
+            ctrl[n].reserved2[0] = 0;
+            slot[n++] = i;
+            state[i] = CTRL_SINGLE;
+        }
+
+        if (m_ctrl_ext == 0 || ctrl_class == V4L2_CID_PRIVATE_BASE || n == 1)
+            continue;
+
+        memset(&ctrls, 0, sizeof(ctrls));
+        ctrls.ctrl_class = ctrl_class;
+        ctrls.count = n;
+        ctrls.controls = ctrl;
+
+        m_ctrl_ioctls++;
+        if (cam_ioctl(m_cam_fd, VIDIOC_S_EXT_CTRLS, &ctrls) >= 0) {
+            m_ctrl_ext = 1;
+            for (int i = 0; i < n; i++)
+                state[slot[i]] = CTRL_SENT;
+            continue;
+        }
+
+        if (m_ctrl_ext < 0 && (errno == EINVAL || errno == ENOTTY)) {
+            LOGW("WARN(%s):no VIDIOC_S_EXT_CTRLS, setting controls one by one", __func__);
+            m_ctrl_ext = 0;
+        } else {
+            LOGE("ERR(%s):VIDIOC_S_EXT_CTRLS(class %#x) failed at %d of %d, setting them one by one",
+                 __func__, ctrl_class, ctrls.error_idx, n);
+        }
+    }
+
+    /* the setters took their shadow for granted, undo the ones that failed */
+    for (int i = 0; i < count; i++) {
+        struct ctrl_entry *entry = &m_ctrl_queue[i];
+
+        if (state[i] == CTRL_SENT)
+            continue;
+
+        m_ctrl_ioctls++;
+        if (fimc_v4l2_s_ctrl(m_cam_fd, entry->id, entry->value) < 0) {
+            if (entry->shadow)
+                *entry->shadow = entry->old;
+            ret = -1;
+        }
+    }
+
+    if (ret < 0)
+        m_ctrl_failed = true;
+
+    return ret;
+}
+
+/* send what the calling thread queued so far, its batch stays open */
+int SecCamera::m_syncControls(void)
+{
+    Mutex::Autolock lock(m_ctrl_lock);
+
+    if (m_ctrl_depth <= 0 || m_ctrl_owner != androidGetThreadId())
+        return 0;
+
+    return m_flushControls();
+}
+
+/*
+ * fimc_v4l2_s_ctrl() on m_cam_fd, queued while the calling thread has a
+ * batch open. shadow is the cached value the caller updates on success.
+ */
+int SecCamera::m_setCtrl(unsigned int id, int value, int *shadow)
+{
+    {
+        Mutex::Autolock lock(m_ctrl_lock);
+
+        if (m_ctrl_depth > 0 && m_ctrl_owner == androidGetThreadId()) {
+            int i;
+
+            for (i = 0; i < m_ctrl_count; i++) {
+                if (m_ctrl_queue[i].id == id)
+                    break;
+            }
+
+            if (i < m_ctrl_count) {
+                m_ctrl_coalesced++;
+            } else {
+                if (m_ctrl_count == CTRL_BATCH_MAX && m_flushControls() < 0)
+                    LOGE("ERR(%s):Fail on flushing a full batch", __func__);
+
+                i = m_ctrl_count++;
+                m_ctrl_queue[i].id = id;
+                m_ctrl_queue[i].shadow = shadow;
+                m_ctrl_queue[i].old = shadow ? *shadow : 0;
+            }
+            m_ctrl_queue[i].value = value;
+
+            return value;
+        }
+    }
+
+    return fimc_v4l2_s_ctrl(m_cam_fd, id, value);
+}
+
+/* what the IS reports per face, V4L2_CID_IS_FD_GET_NEXT moves on to the next one */
+static const unsigned int fd_face_ctrl[FD_CTRLS_PER_FACE] = {
+    V4L2_CID_IS_FD_GET_FACE_FRAME_NUMBER,
+    V4L2_CID_IS_FD_GET_FACE_CONFIDENCE,
+    V4L2_CID_IS_FD_GET_FACE_SMILE_LEVEL,
+    V4L2_CID_IS_FD_GET_FACE_BLINK_LEVEL,
+    V4L2_CID_IS_FD_GET_FACE_TOPLEFT_X,
+    V4L2_CID_IS_FD_GET_FACE_TOPLEFT_Y,
+    V4L2_CID_IS_FD_GET_FACE_BOTTOMRIGHT_X,
+    V4L2_CID_IS_FD_GET_FACE_BOTTOMRIGHT_Y,
+    V4L2_CID_IS_FD_GET_LEFT_EYE_TOPLEFT_X,
+    V4L2_CID_IS_FD_GET_LEFT_EYE_TOPLEFT_Y,
+    V4L2_CID_IS_FD_GET_LEFT_EYE_BOTTOMRIGHT_X,
+    V4L2_CID_IS_FD_GET_LEFT_EYE_BOTTOMRIGHT_Y,
+    V4L2_CID_IS_FD_GET_RIGHT_EYE_TOPLEFT_X,
+    V4L2_CID_IS_FD_GET_RIGHT_EYE_TOPLEFT_Y,
+    V4L2_CID_IS_FD_GET_RIGHT_EYE_BOTTOMRIGHT_X,
+    V4L2_CID_IS_FD_GET_RIGHT_EYE_BOTTOMRIGHT_Y,
+    V4L2_CID_IS_FD_GET_MOUTH_TOPLEFT_X,
+    V4L2_CID_IS_FD_GET_MOUTH_TOPLEFT_Y,
+    V4L2_CID_IS_FD_GET_MOUTH_BOTTOMRIGHT_X,
+    V4L2_CID_IS_FD_GET_MOUTH_BOTTOMRIGHT_Y,
+    V4L2_CID_IS_FD_GET_ANGLE,
+    V4L2_CID_IS_FD_GET_NEXT,
+};
+
+/*
+ * Faces of the last frame into value, a camera_frame_metadata_t with room
+ * for FD_MAX_FACES. The count is read alone first : most frames have no
+ * face, and the rest read only the faces there are.
+ */
 static int fimc_v4l2_s_ext_ctrl_face_detection(int fp, unsigned int id, void *value)
 {
-    struct v4l2_ext_control ext_ctrl_fd[111];
+    struct v4l2_ext_control ext_ctrl_fd[1 + FD_CTRLS_PER_FACE * FD_MAX_FACES];
     struct v4l2_ext_controls ext_ctrls_fd;
-    struct v4l2_ext_controls *ctrls;
     camera_frame_metadata_t *facedata = (camera_frame_metadata_t *)value;
-    int i, ret;
+    struct v4l2_ext_control *ctrl;
+    int faces, i, j, ret;
 
-    ext_ctrl_fd[0].id = V4L2_CID_IS_FD_GET_FACE_COUNT;
-    for (i = 0; i < 5; i++) {
-        ext_ctrl_fd[22*i+1].id = V4L2_CID_IS_FD_GET_FACE_FRAME_NUMBER;
-        ext_ctrl_fd[22*i+2].id = V4L2_CID_IS_FD_GET_FACE_CONFIDENCE;
-        ext_ctrl_fd[22*i+3].id = V4L2_CID_IS_FD_GET_FACE_SMILE_LEVEL;
-        ext_ctrl_fd[22*i+4].id = V4L2_CID_IS_FD_GET_FACE_BLINK_LEVEL;
-        ext_ctrl_fd[22*i+5].id = V4L2_CID_IS_FD_GET_FACE_TOPLEFT_X;
-        ext_ctrl_fd[22*i+6].id = V4L2_CID_IS_FD_GET_FACE_TOPLEFT_Y;
-        ext_ctrl_fd[22*i+7].id = V4L2_CID_IS_FD_GET_FACE_BOTTOMRIGHT_X;
-        ext_ctrl_fd[22*i+8].id = V4L2_CID_IS_FD_GET_FACE_BOTTOMRIGHT_Y;
-        ext_ctrl_fd[22*i+9].id = V4L2_CID_IS_FD_GET_LEFT_EYE_TOPLEFT_X;
-        ext_ctrl_fd[22*i+10].id = V4L2_CID_IS_FD_GET_LEFT_EYE_TOPLEFT_Y;
-        ext_ctrl_fd[22*i+11].id = V4L2_CID_IS_FD_GET_LEFT_EYE_BOTTOMRIGHT_X;
-        ext_ctrl_fd[22*i+12].id = V4L2_CID_IS_FD_GET_LEFT_EYE_BOTTOMRIGHT_Y;
-        ext_ctrl_fd[22*i+13].id = V4L2_CID_IS_FD_GET_RIGHT_EYE_TOPLEFT_X;
-        ext_ctrl_fd[22*i+14].id = V4L2_CID_IS_FD_GET_RIGHT_EYE_TOPLEFT_Y;
-        ext_ctrl_fd[22*i+15].id = V4L2_CID_IS_FD_GET_RIGHT_EYE_BOTTOMRIGHT_X;
-        ext_ctrl_fd[22*i+16].id = V4L2_CID_IS_FD_GET_RIGHT_EYE_BOTTOMRIGHT_Y;
-        ext_ctrl_fd[22*i+17].id = V4L2_CID_IS_FD_GET_MOUTH_TOPLEFT_X;
-        ext_ctrl_fd[22*i+18].id = V4L2_CID_IS_FD_GET_MOUTH_TOPLEFT_Y;
-        ext_ctrl_fd[22*i+19].id = V4L2_CID_IS_FD_GET_MOUTH_BOTTOMRIGHT_X;
-        ext_ctrl_fd[22*i+20].id = V4L2_CID_IS_FD_GET_MOUTH_BOTTOMRIGHT_Y;
-        ext_ctrl_fd[22*i+21].id = V4L2_CID_IS_FD_GET_ANGLE;
-        ext_ctrl_fd[22*i+22].id = V4L2_CID_IS_FD_GET_NEXT;
-    }
+    facedata->number_of_faces = 0;
 
+    ext_ctrl_fd[0].id = V4L2_CID_IS_FD_GET_FACE_COUNT;
     ext_ctrls_fd.ctrl_class = V4L2_CTRL_CLASS_CAMERA;
-    ext_ctrls_fd.count = 111;
+    ext_ctrls_fd.count = 1;
     ext_ctrls_fd.controls = ext_ctrl_fd;
-    ctrls = &ext_ctrls_fd;
 
-    ret = ioctl(fp, VIDIOC_G_EXT_CTRLS, &ext_ctrls_fd);
+    ret = cam_ioctl(fp, VIDIOC_G_EXT_CTRLS, &ext_ctrls_fd);
+    if (ret < 0 || ext_ctrl_fd[0].value <= 0)
+        return ret;
+
+    faces = ext_ctrl_fd[0].value;
+    if (FD_MAX_FACES < faces)
+        faces = FD_MAX_FACES;
+
+    /* the count again in front, it starts the walk over the faces */
+    for (i = 0; i < faces; i++) {
+        for (j = 0; j < FD_CTRLS_PER_FACE; j++)
+            ext_ctrl_fd[FD_CTRLS_PER_FACE * i + j + 1].id = fd_face_ctrl[j];
+    }
+    ext_ctrls_fd.count = 1 + FD_CTRLS_PER_FACE * faces;
+
+    ret = cam_ioctl(fp, VIDIOC_G_EXT_CTRLS, &ext_ctrls_fd);
+    if (ret < 0)
+        return ret;
+
+    if (ext_ctrl_fd[0].value < faces)
+        faces = ext_ctrl_fd[0].value;
 
-    facedata->number_of_faces = ext_ctrls_fd.controls[0].value;
+    for (i = 0; i < faces; i++) {
+        ctrl = &ext_ctrl_fd[FD_CTRLS_PER_FACE * i];
 
-    for(i = 0; i < facedata->number_of_faces; i++) {
-        facedata->faces[i].rect[0]      = ext_ctrl_fd[22*i+5].value;
-        facedata->faces[i].rect[1]      = ext_ctrl_fd[22*i+6].value;
-        facedata->faces[i].rect[2]      = ext_ctrl_fd[22*i+7].value;
-        facedata->faces[i].rect[3]      = ext_ctrl_fd[22*i+8].value;
-        facedata->faces[i].score        = ext_ctrl_fd[22*i+2].value;
+        facedata->faces[i].rect[0]      = ctrl[5].value;
+        facedata->faces[i].rect[1]      = ctrl[6].value;
+        facedata->faces[i].rect[2]      = ctrl[7].value;
+        facedata->faces[i].rect[3]      = ctrl[8].value;
+        facedata->faces[i].score        = ctrl[2].value;
 /* TODO : id is unique value for each face. We need to suppot this. */
         facedata->faces[i].id           = 0;
-        facedata->faces[i].left_eye[0]  = (ext_ctrl_fd[22*i+9].value + ext_ctrl_fd[22*i+11].value) / 2;
-        facedata->faces[i].left_eye[1]  = (ext_ctrl_fd[22*i+10].value + ext_ctrl_fd[22*i+12].value) / 2;
-        facedata->faces[i].right_eye[0] = (ext_ctrl_fd[22*i+13].value + ext_ctrl_fd[22*i+15].value) / 2;
-        facedata->faces[i].right_eye[1] = (ext_ctrl_fd[22*i+14].value + ext_ctrl_fd[22*i+16].value) / 2;
-        facedata->faces[i].mouth[0]     = (ext_ctrl_fd[22*i+17].value + ext_ctrl_fd[22*i+19].value) / 2;
-        facedata->faces[i].mouth[1]     = (ext_ctrl_fd[22*i+18].value + ext_ctrl_fd[22*i+20].value) / 2;
+        facedata->faces[i].left_eye[0]  = (ctrl[9].value + ctrl[11].value) / 2;
+        facedata->faces[i].left_eye[1]  = (ctrl[10].value + ctrl[12].value) / 2;
+        facedata->faces[i].right_eye[0] = (ctrl[13].value + ctrl[15].value) / 2;
+        facedata->faces[i].right_eye[1] = (ctrl[14].value + ctrl[16].value) / 2;
+        facedata->faces[i].mouth[0]     = (ctrl[17].value + ctrl[19].value) / 2;
+        facedata->faces[i].mouth[1]     = (ctrl[18].value + ctrl[20].value) / 2;
     }
+    facedata->number_of_faces = faces < 0 ? 0 : faces;
 
     return ret;
 }
@@ -530,7 +954,7 @@ static int fimc_v4l2_g_parm(int fp, struct v4l2_streamparm *streamparm)
 
     streamparm->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
-    ret = ioctl(fp, VIDIOC_G_PARM, streamparm);
+    ret = cam_ioctl(fp, VIDIOC_G_PARM, streamparm);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_G_PARM failed", __func__);
         return -1;
@@ -549,7 +973,7 @@ static int fimc_v4l2_s_parm(int fp, struct v4l2_streamparm *streamparm)
 
     streamparm->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
-    ret = ioctl(fp, VIDIOC_S_PARM, streamparm);
+    ret = cam_ioctl(fp, VIDIOC_S_PARM, streamparm);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_S_PARM failed", __func__);
         return ret;
@@ -615,6 +1039,8 @@ SecCamera::SecCamera() :
             m_camera_af_flag(-1),
             m_flag_camera_create(0),
             m_flag_camera_start(0),
+            m_preview_userptr(0),
+            m_preview_sync_fd(-1),
             m_jpeg_thumbnail_width (0),
             m_jpeg_thumbnail_height(0),
             m_jpeg_thumbnail_quality(100),
@@ -633,6 +1059,49 @@ SecCamera::SecCamera() :
     memset(&m_events_c, 0, sizeof(m_events_c));
     memset(&m_events_c2, 0, sizeof(m_events_c2));
     memset(&m_events_c3, 0, sizeof(m_events_c3));
+    for (int i = 0; i < MAX_BUFFERS; i++)
+        m_buffers_preview[i] = SecBuffer();
+
+    memset(&m_preview_pool, 0, sizeof(m_preview_pool));
+    m_preview_pool_count = 0;
+    m_preview_pool_frame = 0;
+    m_preview_pool_size = 0;
+    m_preview_pool_allocs = 0;
+    m_preview_pool_reuses = 0;
+    m_preview_pool_restreams = 0;
+    m_preview_queued = 0;
+    m_preview_out = 0;
+    m_preview_keep_out = false;
+
+    char property[PROPERTY_VALUE_MAX];
+    property_get("ro.camera.watchdog_ms", property, "0");
+    m_watchdog_ms = atoi(property);
+    m_watchdog_step = -1;
+    m_watchdog_first = true;
+    m_watchdog_last = 0;
+    memset(m_watchdog_event, 0, sizeof(m_watchdog_event));
+    m_watchdog_head = 0;
+    m_watchdog_stalls = 0;
+    m_watchdog_starved = 0;
+    memset(m_watchdog_steps, 0, sizeof(m_watchdog_steps));
+    m_watchdog_worst_ms = 0;
+
+    m_ctrl_depth = 0;
+    m_ctrl_owner = 0;
+    m_ctrl_count = 0;
+    m_ctrl_ext = -1;
+    m_ctrl_failed = false;
+    m_ctrl_batches = 0;
+    m_ctrl_ioctls = 0;
+    m_ctrl_coalesced = 0;
+#ifdef ZERO_SHUTTER_LAG
+    m_zsl_select = ZSL_SELECT_NEAREST;
+    m_resetZsl();
+#endif
+#ifdef SAMSUNG_EXYNOS4x12
+    m_initJpegSession(&m_jpeg_main, "main");
+    m_initJpegSession(&m_jpeg_thumb, "thumbnail");
+#endif
 }
 
 SecCamera::~SecCamera()
@@ -674,7 +1143,7 @@ bool SecCamera::CreateCamera(int index)
         m_camera_id = index;
         m_recording_en = 0;
 
-        m_cam_fd = open(CAMERA_DEV_NAME, O_RDWR);
+        m_cam_fd = cam_open(CAMERA_DEV_NAME);
         if (m_cam_fd < 0) {
             LOGE("ERR(%s):Cannot open %s (error : %s)", __func__, CAMERA_DEV_NAME, strerror(errno));
             return -1;
@@ -710,7 +1179,7 @@ bool SecCamera::CreateCamera(int index)
 #ifdef SAMSUNG_EXYNOS4x12
 #ifdef ZERO_SHUTTER_LAG
         if (m_camera_use_ISP) {
-            m_cam_fd2 = open(CAMERA_DEV_NAME2, O_RDWR);
+            m_cam_fd2 = cam_open(CAMERA_DEV_NAME2);
             LOGV("%s: open(%s) --> m_cam_fd2 = %d", __func__, CAMERA_DEV_NAME2, m_cam_fd2);
             if (m_cam_fd2 < 0) {
                 LOGE("ERR(%s):Cannot open %s (error : %s)", __func__, CAMERA_DEV_NAME2, strerror(errno));
@@ -729,7 +1198,7 @@ bool SecCamera::CreateCamera(int index)
 #endif
 #endif
 
-        m_cam_fd3 = open(CAMERA_DEV_NAME3, O_RDWR);
+        m_cam_fd3 = cam_open(CAMERA_DEV_NAME3);
         LOGV("%s: open(%s) --> m_cam_fd3 = %d", __func__, CAMERA_DEV_NAME3, m_cam_fd3);
         if (m_cam_fd3 < 0) {
             LOGE("ERR(%s):Cannot open %s (error : %s)", __func__, CAMERA_DEV_NAME3, strerror(errno));
@@ -784,12 +1253,14 @@ bool SecCamera::DestroyCamera()
 
         stopRecord();
 
+        m_releasePreviewPool();
+
         /* close m_cam_fd after stopRecord() because stopRecord()
          * uses m_cam_fd to change frame rate
          */
         LOGI("DestroyCamera: m_cam_fd(%d)", m_cam_fd);
         if (m_cam_fd > -1) {
-            close(m_cam_fd);
+            cam_close(m_cam_fd);
             m_cam_fd = -1;
         }
 
@@ -797,7 +1268,7 @@ bool SecCamera::DestroyCamera()
         if (m_camera_use_ISP) {
             LOGI("DestroyCamera: m_cam_fd2(%d)", m_cam_fd2);
             if (m_cam_fd2 > -1) {
-                close(m_cam_fd2);
+                cam_close(m_cam_fd2);
                 m_cam_fd2 = -1;
             }
         }
@@ -805,10 +1276,15 @@ bool SecCamera::DestroyCamera()
 
         LOGI("DestroyCamera: m_cam_fd3(%d)", m_cam_fd3);
         if (m_cam_fd3 > -1) {
-            close(m_cam_fd3);
+            cam_close(m_cam_fd3);
             m_cam_fd3 = -1;
         }
 
+        if (m_preview_sync_fd > -1) {
+            close(m_preview_sync_fd);
+            m_preview_sync_fd = -1;
+        }
+
 #ifdef IS_FW_DEBUG
         if (m_camera_use_ISP) {
             munmap((void *)m_debug_paddr, FIMC_IS_FW_DEBUG_REGION_SIZE);
@@ -820,6 +1296,22 @@ bool SecCamera::DestroyCamera()
         }
 #endif
 
+        m_jpeg_lock.lock();
+        m_jpeg_thumb_lock.lock();
+#ifdef SAMSUNG_EXYNOS4210
+        if (m_jpeg_fd > 0) {
+            if (api_jpeg_encode_deinit(m_jpeg_fd) != JPEG_OK)
+                LOGE("ERR(%s):Fail on api_jpeg_encode_deinit", __func__);
+            m_jpeg_fd = 0;
+        }
+#endif
+#ifdef SAMSUNG_EXYNOS4x12
+        m_closeJpegSession(&m_jpeg_main);
+        m_closeJpegSession(&m_jpeg_thumb);
+#endif
+        m_jpeg_thumb_lock.unlock();
+        m_jpeg_lock.unlock();
+
         m_flagCreate = 0;
     } else
         LOGI("%s : already deinitialized", __func__);
@@ -924,8 +1416,39 @@ int SecCamera::startPreview(void)
     m_events_c.fd = m_cam_fd;
     m_events_c.events = POLLIN | POLLERR;
 
+    int ret;
+    int is_mode = m_recording_en ? IS_MODE_PREVIEW_VIDEO : IS_MODE_PREVIEW_STILL;
+    bool restream = false;
+
+#ifdef USE_PREVIEW_USERPTR
+    if (m_preview_userptr)
+        m_releasePreviewPool();
+    else
+#endif
+    if (m_preview_pool_count) {
+        int frame_size = FRAME_SIZE(V4L2_PIX_2_HAL_PIXEL_FORMAT(m_preview_v4lformat),
+                                    m_preview_width, m_preview_height);
+
+        if (m_preview_pool.width == m_preview_width &&
+            m_preview_pool.height == m_preview_height &&
+            m_preview_pool.v4lformat == m_preview_v4lformat &&
+            m_preview_pool.is_width == m_videosnapshot_width &&
+            m_preview_pool.is_height == m_videosnapshot_height &&
+            m_preview_pool.is_mode == is_mode)
+            restream = true;
+        else if (m_preview_pool_frame != frame_size)
+            m_releasePreviewPool();
+    }
+
+    if (restream) {
+        /* the driver still has this format and these buffers, only stream again */
+        LOGV("%s: restreaming %d preview buffers", __func__, m_preview_pool_count);
+        m_preview_pool_restreams++;
+        goto queue_buffers;
+    }
+
     /* enum_fmt, s_fmt sample */
-    int ret = fimc_v4l2_enum_fmt(m_cam_fd,m_preview_v4lformat);
+    ret = fimc_v4l2_enum_fmt(m_cam_fd,m_preview_v4lformat);
     CHECK(ret);
 
     LOGV("m_camera_use_ISP(%d), %s", m_camera_use_ISP, (const char*)getCameraSensorName());
@@ -940,6 +1463,11 @@ int SecCamera::startPreview(void)
     }
 
     ret = fimc_v4l2_s_fmt(m_cam_fd, m_preview_width, m_preview_height, m_preview_v4lformat, V4L2_FIELD_ANY, PREVIEW_NUM_PLANE);
+    if (ret < 0 && m_preview_pool_count) {
+        /* the driver won't change the format under mapped buffers */
+        m_releasePreviewPool();
+        ret = fimc_v4l2_s_fmt(m_cam_fd, m_preview_width, m_preview_height, m_preview_v4lformat, V4L2_FIELD_ANY, PREVIEW_NUM_PLANE);
+    }
     CHECK(ret);
 
     if (!m_camera_use_ISP) {
@@ -958,10 +1486,49 @@ int SecCamera::startPreview(void)
     ret = fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CACHEABLE, 1);
     CHECK(ret);
 
-    ret = fimc_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE, MAX_BUFFERS);
-    CHECK(ret);
+    m_preview_pool.width = m_preview_width;
+    m_preview_pool.height = m_preview_height;
+    m_preview_pool.v4lformat = m_preview_v4lformat;
+    m_preview_pool.is_width = m_videosnapshot_width;
+    m_preview_pool.is_height = m_videosnapshot_height;
+    m_preview_pool.is_mode = is_mode;
+
+queue_buffers:
+#ifdef USE_PREVIEW_USERPTR
+    if (m_preview_userptr) {
+        ret = fimc_v4l2_reqbufs_userptr(m_cam_fd, V4L2_BUF_TYPE, MAX_BUFFERS);
+        CHECK(ret);
 
-    ret = fimc_v4l2_querybuf(m_cam_fd, m_buffers_preview, V4L2_BUF_TYPE, MAX_BUFFERS, PREVIEW_NUM_PLANE);
+        if (m_previewBuffers() == 0) {
+            LOGE("ERR(%s):no preview buffer registered", __func__);
+            return -1;
+        }
+    } else
+#endif
+    {
+        if (m_preview_pool_count == 0) {
+            ret = m_allocPreviewPool();
+            CHECK(ret);
+        } else if (!restream) {
+            m_preview_pool_reuses++;
+        }
+    }
+
+    /* start with every buffer in queue, but those still out after a sensor reset */
+    m_preview_buf_lock.lock();
+    m_preview_queued = 0;
+    if (!m_preview_keep_out)
+        m_preview_out = 0;
+    m_preview_keep_out = false;
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        if (!(m_previewBuffers() & ~m_preview_out & (1 << i)))
+            continue;
+
+        ret = m_queuePreview(i);
+        if (ret < 0)
+            break;
+    }
+    m_preview_buf_lock.unlock();
     CHECK(ret);
 
     LOGV("%s : m_preview_width: %d m_preview_height: %d m_angle: %d",
@@ -969,15 +1536,13 @@ int SecCamera::startPreview(void)
 
     LOGV("m_camera_id : %d", m_camera_id);
 
-    /* start with all buffers in queue */
-    for (int i = 0; i < MAX_BUFFERS; i++) {
-        ret = fimc_v4l2_qbuf(m_cam_fd, m_preview_width, m_preview_height, m_buffers_preview, i, PREVIEW_NUM_PLANE, PREVIEW_MODE);
-        CHECK(ret);
-    }
-
     ret = fimc_v4l2_streamon(m_cam_fd);
     CHECK(ret);
 
+    m_watchdog_first = true;
+    if (m_watchdog_step < 0)
+        m_watchdog_last = systemTime(SYSTEM_TIME_MONOTONIC);
+
 #ifdef USE_FACE_DETECTION
     if (m_camera_use_ISP) {
         ret = fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CMD_FD, IS_FD_COMMAND_START);
@@ -992,6 +1557,8 @@ int SecCamera::startPreview(void)
     }
 #endif
 
+    m_prepareJpeg();
+
     m_flag_camera_start = 1;
 
     LOGV("%s: got the first frame of the preview", __func__);
@@ -1049,15 +1616,73 @@ int SecCamera::stopPreview(void)
     ret = fimc_v4l2_streamoff(m_cam_fd);
     CHECK(ret);
 
-    close_buffers(m_buffers_preview, MAX_BUFFERS);
+    m_preview_buf_lock.lock();
+    m_preview_queued = 0;
+    m_preview_buf_lock.unlock();
 
-    fimc_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE, 0);
+#ifdef USE_PREVIEW_USERPTR
+    if (m_preview_userptr) {
+        /* the registered buffers stay, the caller owns them */
+        fimc_v4l2_reqbufs_userptr(m_cam_fd, V4L2_BUF_TYPE, 0);
+    }
+#endif
+    /* mmap buffers stay mapped for the next startPreview() */
 
     m_flag_camera_start = 0;
 
     return ret;
 }
 
+/*
+ * MAX_BUFFERS mmap preview buffers. They outlive stopPreview(): a restart
+ * with the same format only streams them again, another format of the
+ * same frame size (a record hint switch) keeps them. The HAL maps the
+ * node as an array of frame sized buffers, so any other size gets new ones.
+ */
+int SecCamera::m_allocPreviewPool(void)
+{
+    int ret;
+
+    ret = fimc_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE, MAX_BUFFERS);
+    CHECK(ret);
+
+    ret = fimc_v4l2_querybuf(m_cam_fd, m_buffers_preview, V4L2_BUF_TYPE, MAX_BUFFERS, PREVIEW_NUM_PLANE);
+    if (ret < 0) {
+        close_buffers(m_buffers_preview, MAX_BUFFERS);
+        fimc_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE, 0);
+        return -1;
+    }
+
+    m_preview_pool_count = MAX_BUFFERS;
+    m_preview_pool_frame = FRAME_SIZE(V4L2_PIX_2_HAL_PIXEL_FORMAT(m_preview_v4lformat),
+                                      m_preview_width, m_preview_height);
+    m_preview_pool_size = m_buffers_preview[0].size.s;
+    for (int i = 1; i < MAX_BUFFERS; i++) {
+        if (m_buffers_preview[i].size.s < m_preview_pool_size)
+            m_preview_pool_size = m_buffers_preview[i].size.s;
+    }
+    m_preview_pool_allocs++;
+
+    LOGV("%s: %d buffers of %u bytes for %dx%d", __func__, m_preview_pool_count,
+         m_preview_pool_size, m_preview_width, m_preview_height);
+
+    return 0;
+}
+
+void SecCamera::m_releasePreviewPool(void)
+{
+    if (m_preview_pool_count == 0)
+        return;
+
+    close_buffers(m_buffers_preview, MAX_BUFFERS);
+    if (m_cam_fd > 0)
+        fimc_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE, 0);
+
+    m_preview_pool_count = 0;
+    m_preview_pool_frame = 0;
+    m_preview_pool_size = 0;
+}
+
 int SecCamera::startSnapshot(SecBuffer *yuv_buf)
 {
     LOGV("%s :", __func__);
@@ -1165,6 +1790,12 @@ int SecCamera::stopSnapshot(void)
         return -1;
     }
 
+#ifdef ZERO_SHUTTER_LAG
+    m_zsl_lock.lock();
+    m_resetZsl();
+    m_zsl_lock.unlock();
+#endif
+
     ret = fimc_v4l2_streamoff(m_cap_fd);
     CHECK(ret);
 
@@ -1193,6 +1824,12 @@ int SecCamera::startRecord(bool recordHint)
         return -1;
     }
 
+    /* the encoder takes physical addresses, a virtual node has none */
+    if (SecVirtualSensor::find(m_rec_fd) != NULL) {
+        LOGE("ERR(%s):No recording on a virtual sensor", __func__);
+        return -1;
+    }
+
     /* enum_fmt, s_fmt sample */
     ret = fimc_v4l2_enum_fmt(m_rec_fd, RECORD_PIX_FMT);
     CHECK(ret);
@@ -1304,6 +1941,22 @@ int SecCamera::getRecordAddr(int index, SecBuffer *buffer)
     CHECK((int)buffer->phys.extP[0]);
     buffer->phys.extP[1] = fimc_v4l2_s_ctrl(m_rec_fd, V4L2_CID_PADDR_CBCR, index);
     CHECK((int)buffer->phys.extP[1]);
+    buffer->timestamp = m_buffers_record[index].timestamp;
+    buffer->sequence = m_buffers_record[index].sequence;
+    return 0;
+}
+
+/* The preview buffer at index, with the capture time of the frame it holds */
+int SecCamera::getPreviewBuffer(int index, SecBuffer *buffer)
+{
+    if (index < 0 || MAX_BUFFERS <= index) {
+        LOGE("ERR(%s):invalid index(%d)", __func__, index);
+        return -1;
+    }
+
+    Mutex::Autolock lock(m_preview_buf_lock);
+    *buffer = m_buffers_preview[index];
+
     return 0;
 }
 
@@ -1339,42 +1992,281 @@ int SecCamera::getDebugAddr(unsigned int *vaddr)
 }
 #endif
 
+/*
+ * Buffers that can be queued : the whole mmap pool, or the ones the caller
+ * registered in userptr mode
+ */
+unsigned int SecCamera::m_previewBuffers(void)
+{
+    unsigned int mask = 0;
+
+#ifdef USE_PREVIEW_USERPTR
+    if (m_preview_userptr) {
+        for (int i = 0; i < MAX_BUFFERS; i++) {
+            if (m_buffers_preview[i].phys.extP[0] != 0)
+                mask |= 1 << i;
+        }
+        return mask;
+    }
+#endif
+    if (m_preview_pool_count)
+        mask = (1 << m_preview_pool_count) - 1;
+
+    return mask;
+}
+
+/* m_preview_buf_lock held */
+int SecCamera::m_queuePreview(int index)
+{
+    int ret;
+
+#ifdef USE_PREVIEW_USERPTR
+    if (m_preview_userptr)
+        ret = fimc_v4l2_qbuf_userptr(m_cam_fd, m_buffers_preview, index, get_num_planes(m_preview_v4lformat));
+    else
+#endif
+        ret = fimc_v4l2_qbuf(m_cam_fd, m_preview_width, m_preview_height, m_buffers_preview, index, PREVIEW_NUM_PLANE, PREVIEW_MODE);
+    CHECK(ret);
+
+    m_preview_queued |= 1 << index;
+    m_preview_out &= ~(1 << index);
+
+    return ret;
+}
+
+void SecCamera::setWatchdogTimeout(int msec)
+{
+    m_watchdog_ms = msec < 0 ? 0 : msec;
+}
+
+int SecCamera::m_watchdogTimeout(void)
+{
+    int fps = m_params->capture.timeperframe.denominator;
+    int msec = m_watchdog_ms;
+
+    if (msec == 0) {
+        /* the sensor may slow down to its floor when it picks the rate */
+        if (fps == FRAME_RATE_AUTO || fps < WATCHDOG_SLOW_FPS ||
+            m_params->scene_mode == SCENE_MODE_NIGHTSHOT)
+            fps = WATCHDOG_SLOW_FPS;
+
+        msec = WATCHDOG_STALL_FRAMES * 1000 / fps;
+        if (msec < WATCHDOG_MIN_MS)
+            msec = WATCHDOG_MIN_MS;
+    }
+
+    if (m_watchdog_first && msec < WATCHDOG_START_MS)
+        msec = WATCHDOG_START_MS;
+
+    return msec;
+}
+
+/*
+ * No frame for timeout ms. Takes the next step of the ladder, a step that
+ * can't be taken or fails goes on to the next one right away.
+ * Returns 0 to poll again, -1 when getPreview() should give up this time.
+ */
+int SecCamera::m_watchdogStall(int timeout)
+{
+    static const char *stepName[WATCHDOG_STEPS] = { "requeue", "restream", "reset" };
+    struct watchdog_event *event;
+    unsigned int lost;
+    int step;
+    int ret;
+
+    m_preview_buf_lock.lock();
+    lost = m_previewBuffers() & ~(m_preview_queued | m_preview_out);
+    if (m_preview_queued == 0 && lost == 0) {
+        m_preview_buf_lock.unlock();
+        /* the caller holds every buffer, the sensor has nothing to fill */
+        LOGW("%s: no preview buffer in queue, out(0x%x)", __func__, m_preview_out);
+        m_watchdog_starved++;
+        return -1;
+    }
+    m_preview_buf_lock.unlock();
+
+    if (m_watchdog_step < 0) {
+        m_watchdog_head = (m_watchdog_head + 1) % WATCHDOG_HISTORY;
+        event = &m_watchdog_event[m_watchdog_head];
+        event->stall = systemTime(SYSTEM_TIME_MONOTONIC);
+        event->timeout_ms = timeout;
+        event->step = -1;
+        event->outage_ms = -1;
+        m_watchdog_stalls++;
+        m_watchdog_step = WATCHDOG_REQUEUE;
+    }
+    event = &m_watchdog_event[m_watchdog_head];
+
+    do {
+        step = m_watchdog_step;
+        if (step == WATCHDOG_REQUEUE && lost == 0)
+            step = WATCHDOG_RESTREAM;
+        m_watchdog_step = (step < WATCHDOG_RESET) ? step + 1 : WATCHDOG_RESET;
+
+        LOGE("ERR(%s):no preview frame for %d ms, %s", __func__, timeout, stepName[step]);
+        event->step = step;
+        m_watchdog_steps[step]++;
+
+        switch (step) {
+        case WATCHDOG_REQUEUE:
+            ret = m_requeuePreview(lost);
+            break;
+        case WATCHDOG_RESTREAM:
+            ret = m_restreamPreview();
+            break;
+        default:
+            ret = m_resetSensor();
+            break;
+        }
+    } while (ret < 0 && step < WATCHDOG_RESET);
+
+    return ret;
+}
+
+/* Queue again the buffers that are neither in the driver nor out */
+int SecCamera::m_requeuePreview(unsigned int lost)
+{
+    Mutex::Autolock lock(m_preview_buf_lock);
+    int ret = 0;
+
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        /* given back while we were not looking */
+        if (!(lost & (1 << i)) || (m_preview_queued & (1 << i)))
+            continue;
+
+        ret = m_queuePreview(i);
+        CHECK(ret);
+    }
+
+    return ret;
+}
+
+/* Stream again with the buffers and format in place, the sensor keeps running */
+int SecCamera::m_restreamPreview(void)
+{
+    Mutex::Autolock lock(m_preview_buf_lock);
+    int ret;
+
+#ifdef USE_FACE_DETECTION
+    if (m_camera_use_ISP)
+        fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CMD_FD, IS_FD_COMMAND_STOP);
+#endif
+
+    /* fails while ae or awb is locked, the sensor reset handles that */
+    ret = fimc_v4l2_streamoff(m_cam_fd);
+    CHECK(ret);
+    m_preview_queued = 0;
+
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        if (!(m_previewBuffers() & ~m_preview_out & (1 << i)))
+            continue;
+
+        ret = m_queuePreview(i);
+        CHECK(ret);
+    }
+
+    ret = fimc_v4l2_streamon(m_cam_fd);
+    CHECK(ret);
+    m_watchdog_first = true;
+
+#ifdef USE_FACE_DETECTION
+    if (m_camera_use_ISP)
+        fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CMD_FD, IS_FD_COMMAND_START);
+#endif
+
+    return 0;
+}
+
+int SecCamera::m_resetSensor(void)
+{
+    int ret;
+
+    /*
+     * When there is no data from the camera we inform the FIMC driver
+     * by calling fimc_v4l2_s_input() with a special value = 1000.
+     * FIMC driver identify that there is something wrong with the camera
+     * and it restarts the sensor.
+     */
+    stopPreview();
+    /*
+     * The restarted sensor comes back without the format, scenario and
+     * cache setup : have startPreview() program them again instead of
+     * restreaming. The buffers stay if the driver lets S_FMT through.
+     */
+    memset(&m_preview_pool, 0, sizeof(m_preview_pool));
+    /* Reset Only Camera Device */
+    ret = fimc_v4l2_querycap(m_cam_fd);
+    CHECK(ret);
+    if (fimc_v4l2_enuminput(m_cam_fd, m_camera_id))
+        return -1;
+    ret = fimc_v4l2_s_input(m_cam_fd, 1000);
+    CHECK(ret);
+    /* the HAL and the display still hold what is out, they give it back later */
+    m_preview_buf_lock.lock();
+    m_preview_keep_out = true;
+    m_preview_buf_lock.unlock();
+    ret = startPreview();
+    if (ret < 0) {
+        LOGE("ERR(%s): startPreview() return %d", __func__, ret);
+        return -1;
+    }
+
+    return 0;
+}
+
 int SecCamera::getPreview(camera_frame_metadata_t *facedata)
 {
     int index;
+    int timeout;
     int ret;
 
-    if (m_flag_camera_start == 0 || fimc_poll(&m_events_c) == 0) {
+    if (m_flag_camera_start == 0) {
         LOGE("ERR(%s):Start Camera Device Reset", __func__);
-        /*
-         * When there is no data for more than 1 second from the camera we inform
-         * the FIMC driver by calling fimc_v4l2_s_input() with a special value = 1000
-         * FIMC driver identify that there is something wrong with the camera
-         * and it restarts the sensor.
-         */
-        stopPreview();
-        /* Reset Only Camera Device */
-        ret = fimc_v4l2_querycap(m_cam_fd);
+        ret = m_resetSensor();
         CHECK(ret);
-        if (fimc_v4l2_enuminput(m_cam_fd, m_camera_id))
-            return -1;
-        ret = fimc_v4l2_s_input(m_cam_fd, 1000);
+    }
+
+    for (;;) {
+        timeout = m_watchdogTimeout();
+        if (fimc_poll_timeout(&m_events_c, timeout) != 0)
+            break;
+
+        ret = m_watchdogStall(timeout);
         CHECK(ret);
-        ret = startPreview();
-        if (ret < 0) {
-            LOGE("ERR(%s): startPreview() return %d", __func__, ret);
-            return 0;
-        }
     }
 
-    index = fimc_v4l2_dqbuf(m_cam_fd, PREVIEW_NUM_PLANE);
+#ifdef USE_PREVIEW_USERPTR
+    if (m_preview_userptr)
+        index = fimc_v4l2_dqbuf_userptr(m_cam_fd, m_buffers_preview);
+    else
+#endif
+        index = fimc_v4l2_dqbuf(m_cam_fd, PREVIEW_NUM_PLANE, m_buffers_preview);
     if (!(0 <= index && index < MAX_BUFFERS)) {
         LOGE("ERR(%s):wrong index = %d", __func__, index);
         return -1;
     }
 
+    m_preview_buf_lock.lock();
+    m_preview_queued &= ~(1 << index);
+    m_preview_out |= 1 << index;
+    m_preview_buf_lock.unlock();
+
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (0 <= m_watchdog_step) {
+        struct watchdog_event *event = &m_watchdog_event[m_watchdog_head];
+
+        event->outage_ms = (int)ns2ms(now - m_watchdog_last);
+        if (m_watchdog_worst_ms < event->outage_ms)
+            m_watchdog_worst_ms = event->outage_ms;
+        LOGI("%s: preview back after %d ms", __func__, event->outage_ms);
+        m_watchdog_step = -1;
+    }
+    m_watchdog_last = now;
+    m_watchdog_first = false;
+
 #ifdef USE_FACE_DETECTION
-    if (m_camera_use_ISP) {
+    /* no facedata : nobody wants the faces of this frame */
+    if (m_camera_use_ISP && facedata != NULL) {
         fimc_v4l2_s_ext_ctrl_face_detection(m_cam_fd, 0, facedata);
     }
 #endif
@@ -1382,42 +2274,397 @@ int SecCamera::getPreview(camera_frame_metadata_t *facedata)
     return index;
 }
 
-int SecCamera::setPreviewFrame(int index)
+int SecCamera::setPreviewFrame(int index)
+{
+    Mutex::Autolock lock(m_preview_buf_lock);
+
+#ifdef USE_PREVIEW_USERPTR
+    if (m_preview_userptr && m_buffers_preview[index].phys.extP[0] == 0) {
+        LOGE("ERR(%s):no buffer registered at index(%d)", __func__, index);
+        return -1;
+    }
+#endif
+    /* the watchdog may have queued it again already */
+    m_preview_out &= ~(1 << index);
+
+    return m_queuePreview(index);
+}
+
+#ifdef USE_PREVIEW_USERPTR
+int SecCamera::setPreviewUserPtr(int enable)
+{
+    if (m_flag_camera_start > 0) {
+        LOGE("ERR(%s):Preview is running", __func__);
+        return -1;
+    }
+
+    /* a virtual node fills its own buffers, it cannot write to physical addresses */
+    if (enable && SecVirtualSensor::find(m_cam_fd) != NULL) {
+        LOGW("%s: no userptr preview on a virtual sensor", __func__);
+        return -1;
+    }
+
+    if (m_preview_userptr != enable) {
+        m_releasePreviewPool();
+        for (int i = 0; i < MAX_BUFFERS; i++)
+            m_buffers_preview[i] = SecBuffer();
+    }
+
+    m_preview_userptr = enable;
+
+    return 0;
+}
+
+int SecCamera::getPreviewUserPtr(void)
+{
+    return m_preview_userptr;
+}
+
+/*
+ * Register the buffer the sensor should write frame index into.
+ * While streaming it is queued right away, a NULL buffer only forgets it.
+ */
+int SecCamera::setPreviewUserFrame(int index, SecBuffer *buffer)
+{
+    int ret = 0;
+
+    if (!m_preview_userptr || index < 0 || MAX_BUFFERS <= index) {
+        LOGE("ERR(%s):invalid index(%d) or not in userptr mode", __func__, index);
+        return -1;
+    }
+
+    Mutex::Autolock lock(m_preview_buf_lock);
+
+    if (buffer == NULL) {
+        m_buffers_preview[index] = SecBuffer();
+        m_preview_out &= ~(1 << index);
+        return 0;
+    }
+
+    m_buffers_preview[index] = *buffer;
+
+    if (m_flag_camera_start > 0)
+        ret = m_queuePreview(index);
+
+    return ret;
+}
+
+/*
+ * The sensor wrote frame index behind the CPU cache. Drop the stale lines
+ * of its planes before the frame is read through a cached mapping, the
+ * same exynos-mem flush gralloc does on unlock.
+ */
+int SecCamera::syncPreviewFrame(int index)
+{
+    struct exynos_mem_flush_range mem;
+
+    if (!m_preview_userptr || index < 0 || MAX_BUFFERS <= index) {
+        LOGE("ERR(%s):invalid index(%d) or not in userptr mode", __func__, index);
+        return -1;
+    }
+
+    Mutex::Autolock lock(m_preview_buf_lock);
+
+    if (m_preview_sync_fd < 0) {
+        m_preview_sync_fd = open(PFX_NODE_MEM, O_RDWR);
+        if (m_preview_sync_fd < 0) {
+            LOGE("ERR(%s):Cannot open %s (error : %s)", __func__, PFX_NODE_MEM, strerror(errno));
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        if (m_buffers_preview[index].phys.extP[i] == 0 || m_buffers_preview[index].size.extS[i] == 0)
+            continue;
+
+        mem.start  = m_buffers_preview[index].phys.extP[i];
+        mem.length = m_buffers_preview[index].size.extS[i];
+        if (ioctl(m_preview_sync_fd, EXYNOS_MEM_PADDR_CACHE_FLUSH, &mem) < 0) {
+            LOGE("ERR(%s):EXYNOS_MEM_PADDR_CACHE_FLUSH failed, frame(%d)", __func__, index);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+int SecCamera::getSnapshot()
+{
+    int index;
+    int ret;
+
+    if (m_snapshot_state) {
+        fimc_poll(&m_events_c2);
+
+        index = fimc_v4l2_dqbuf(m_cap_fd, 1, NULL);
+        if (!(0 <= index && index < m_num_capbuf)) {
+            LOGE("ERR(%s):wrong index = %d", __func__, index);
+            return -1;
+        }
+        return index;
+    }
+
+    return -1;
+}
+
+int SecCamera::setSnapshotFrame(int index)
+{
+    int ret;
+    ret = fimc_v4l2_qbuf(m_cap_fd, m_snapshot_width, m_snapshot_height, m_capture_buf, index, PREVIEW_NUM_PLANE, CAPTURE_MODE);
+    CHECK(ret);
+
+    return ret;
+}
+
+#ifdef ZERO_SHUTTER_LAG
+/*
+ * Called for every snapshot frame, by the preview thread or the video
+ * snapshot stage. The frame is kept in the ring, and the oldest one goes
+ * back to fimc once the ring is full.
+ */
+int SecCamera::putZslFrame(int wait)
+{
+    struct zsl_frame frame;
+    int ret;
+
+    if (!m_snapshot_state)
+        return -1;
+
+    /* a blocking dqbuf would hold the caller for as long as the sensor stalls */
+    if (0 < wait)
+        ret = fimc_poll_timeout(&m_events_c2, wait);
+    else
+        ret = cam_poll(&m_events_c2, 1, 0);
+    if (ret <= 0)
+        return -1;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.index = fimc_v4l2_dqbuf_timestamp(m_cap_fd, 1, &frame.v4l2_timestamp);
+    if (!(0 <= frame.index && frame.index < m_num_capbuf)) {
+        LOGE("ERR(%s):wrong index = %d", __func__, frame.index);
+        return -1;
+    }
+    frame.timestamp = fimc_v4l2_timestamp(&frame.v4l2_timestamp);
+
+    if (m_camera_use_ISP) {
+        frame.exposure = fimc_v4l2_g_ctrl(m_cam_fd, V4L2_CID_CAMERA_EXIF_EXPTIME);
+        if (frame.exposure < 0)
+            frame.exposure = 0;
+    }
+
+    if (m_zsl_select == ZSL_SELECT_SHARPEST)
+        frame.focus = m_zslFocus(frame.index);
+
+    Mutex::Autolock lock(m_zsl_lock);
+
+    if (m_zsl_count == ZSL_RING_DEPTH) {
+        ret = setSnapshotFrame(m_zsl_ring[0].index);
+        memmove(&m_zsl_ring[0], &m_zsl_ring[1], sizeof(struct zsl_frame) * (ZSL_RING_DEPTH - 1));
+        m_zsl_count--;
+        if (ret < 0)
+            LOGE("ERR(%s):Fail to requeue the oldest frame", __func__);
+    }
+
+    m_zsl_ring[m_zsl_count++] = frame;
+    m_zsl_cond.broadcast();
+
+    return frame.index;
+}
+
+/*
+ * Take the frame the shutter meant out of the ring : the one dequeued
+ * closest to shutter, or the sharpest one near it. It stays out of fimc
+ * until unlockZslFrame().
+ */
+int SecCamera::lockZslFrame(nsecs_t shutter, struct zsl_frame *frame)
+{
+    nsecs_t delta;
+    nsecs_t best_delta = 0;
+    int best = -1;
+
+    Mutex::Autolock lock(m_zsl_lock);
+
+    /* preview just started : wait for the first frame */
+    while (m_zsl_count == 0) {
+        if (!m_snapshot_state
+            || m_zsl_cond.waitRelative(m_zsl_lock, milliseconds(ZSL_WAIT_MS)) != NO_ERROR) {
+            LOGE("ERR(%s):no frame in the ring", __func__);
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < m_zsl_count; i++) {
+        delta = m_zsl_ring[i].timestamp - shutter;
+        if (delta < 0)
+            delta = -delta;
+
+        if (best < 0 || delta < best_delta) {
+            best = i;
+            best_delta = delta;
+        }
+    }
+
+    if (m_zsl_select == ZSL_SELECT_SHARPEST) {
+        for (int i = 0; i < m_zsl_count; i++) {
+            delta = m_zsl_ring[i].timestamp - shutter;
+            if (delta < 0)
+                delta = -delta;
+
+            if (delta <= milliseconds(ZSL_SHARP_WINDOW_MS)
+                && m_zsl_ring[best].focus < m_zsl_ring[i].focus)
+                best = i;
+        }
+    }
+
+    LOGV("%s: frame(%d) %lld us from the shutter", __func__,
+         m_zsl_ring[best].index, ns2us(m_zsl_ring[best].timestamp - shutter));
+
+    return m_lockZsl(best, frame);
+}
+
+/*
+ * Burst : take the oldest frame dequeued after the previous shot,
+ * waiting for the sensor if there is none yet.
+ */
+int SecCamera::lockNextZslFrame(nsecs_t after, struct zsl_frame *frame)
+{
+    Mutex::Autolock lock(m_zsl_lock);
+
+    while (1) {
+        for (int i = 0; i < m_zsl_count; i++) {
+            if (after < m_zsl_ring[i].timestamp)
+                return m_lockZsl(i, frame);
+        }
+
+        if (!m_snapshot_state
+            || m_zsl_cond.waitRelative(m_zsl_lock, milliseconds(ZSL_WAIT_MS)) != NO_ERROR) {
+            LOGE("ERR(%s):no new frame in the ring", __func__);
+            return -1;
+        }
+    }
+}
+
+int SecCamera::unlockZslFrame(int index)
+{
+    int ret = 0;
+
+    Mutex::Autolock lock(m_zsl_lock);
+
+    if (index < 0 || CAP_BUFFERS <= index || !(m_zsl_locked & (1 << index))) {
+        LOGE("ERR(%s):frame(%d) is not locked", __func__, index);
+        return -1;
+    }
+
+    m_zsl_locked &= ~(1 << index);
+
+    if (m_snapshot_state)
+        ret = setSnapshotFrame(index);
+
+    return ret;
+}
+
+/* m_zsl_lock held : move ring entry slot out to the caller */
+int SecCamera::m_lockZsl(int slot, struct zsl_frame *frame)
+{
+    int index = m_zsl_ring[slot].index;
+    int locked = 0;
+
+    for (int i = 0; i < CAP_BUFFERS; i++) {
+        if (m_zsl_locked & (1 << i))
+            locked++;
+    }
+
+    if (ZSL_MAX_LOCKED <= locked) {
+        LOGE("ERR(%s):%d frames are locked already", __func__, locked);
+        return -1;
+    }
+
+    if (frame)
+        *frame = m_zsl_ring[slot];
+
+    m_zsl_locked |= 1 << index;
+
+    memmove(&m_zsl_ring[slot], &m_zsl_ring[slot + 1],
+            sizeof(struct zsl_frame) * (m_zsl_count - slot - 1));
+    m_zsl_count--;
+
+    return index;
+}
+
+void SecCamera::setZslSelect(int select)
+{
+    Mutex::Autolock lock(m_zsl_lock);
+
+    if (m_zsl_select == select)
+        return;
+
+    /* focus values of what is in the ring are meaningless now */
+    for (int i = 0; i < m_zsl_count; i++)
+        m_zsl_ring[i].focus = 0;
+
+    m_zsl_select = select;
+}
+
+/* fimc got all the buffers back, or is about to */
+void SecCamera::m_resetZsl(void)
 {
-    int ret;
-    ret = fimc_v4l2_qbuf(m_cam_fd, m_preview_width, m_preview_height, m_buffers_preview, index, PREVIEW_NUM_PLANE, PREVIEW_MODE);
-    CHECK(ret);
-
-    return ret;
+    memset(m_zsl_ring, 0, sizeof(m_zsl_ring));
+    m_zsl_count = 0;
+    m_zsl_locked = 0;
+    m_zsl_cond.broadcast();
 }
 
-int SecCamera::getSnapshot()
+/*
+ * Cheap focus measure : sum of absolute luma differences between
+ * neighbouring pixels, sampled over the centre of the frame.
+ */
+unsigned int SecCamera::m_zslFocus(int index)
 {
-    int index;
-    int ret;
+    unsigned char *base = (unsigned char *)m_capture_buf[index].virt.extP[0];
+    unsigned int focus = 0;
+    int width, height;
+    int step, offset;
 
-    if (m_snapshot_state) {
-        fimc_poll(&m_events_c2);
+    if (base == NULL)
+        return 0;
 
-        index = fimc_v4l2_dqbuf(m_cap_fd, 1);
-        if (!(0 <= index && index < m_num_capbuf)) {
-            LOGE("ERR(%s):wrong index = %d", __func__, index);
-            return -1;
-        }
-        return index;
+    if (!m_recording_en) {
+        width  = m_snapshot_width;
+        height = m_snapshot_height;
+    } else {
+        width  = m_videosnapshot_width;
+        height = m_videosnapshot_height;
     }
 
-    return -1;
-}
+    switch (m_snapshot_v4lformat) {
+    case V4L2_PIX_FMT_YUYV:
+        step = 2;
+        offset = 0;
+        break;
+    case V4L2_PIX_FMT_UYVY:
+        step = 2;
+        offset = 1;
+        break;
+    default:
+        /* planar and semi planar formats start with the luma plane */
+        step = 1;
+        offset = 0;
+        break;
+    }
 
-int SecCamera::setSnapshotFrame(int index)
-{
-    int ret;
-    ret = fimc_v4l2_qbuf(m_cap_fd, m_snapshot_width, m_snapshot_height, m_capture_buf, index, PREVIEW_NUM_PLANE, CAPTURE_MODE);
-    CHECK(ret);
+    for (int y = height / 4; y < height * 3 / 4; y += 16) {
+        unsigned char *line = base + y * width * step + offset;
 
-    return ret;
+        for (int x = width / 4; x < width * 3 / 4; x += 4) {
+            int diff = line[(x + 1) * step] - line[x * step];
+            focus += (diff < 0) ? -diff : diff;
+        }
+    }
+
+    return focus;
 }
+#endif
 
 int SecCamera::getRecordFrame()
 {
@@ -1427,7 +2674,7 @@ int SecCamera::getRecordFrame()
     }
 
     fimc_poll(&m_events_c3);
-    int index = fimc_v4l2_dqbuf(m_rec_fd, RECORD_NUM_PLANE);
+    int index = fimc_v4l2_dqbuf(m_rec_fd, RECORD_NUM_PLANE, m_buffers_record);
     if (!(0 <= index && index < MAX_BUFFERS)) {
         LOGE("ERR(%s):wrong index = %d", __func__, index);
         return -1;
@@ -1531,6 +2778,9 @@ int SecCamera::setSnapshotCmd(void)
         stopPreview();
     }
 
+    /* the capture takes the preview node's buffers */
+    m_releasePreviewPool();
+
     memset(&m_events_c, 0, sizeof(m_events_c));
     m_events_c.fd = m_cam_fd;
     m_events_c.events = POLLIN | POLLERR;
@@ -1591,7 +2841,7 @@ unsigned char* SecCamera::getJpeg(int *jpeg_size,
     CHECK_PTR(ret);
     ret = fimc_poll(&m_events_c);
     CHECK_PTR(ret);
-    index = fimc_v4l2_dqbuf(m_cam_fd, 1);
+    index = fimc_v4l2_dqbuf(m_cam_fd, 1, NULL);
 
     if (index != 0) {
         LOGE("ERR(%s):wrong index = %d", __func__, index);
@@ -1632,19 +2882,21 @@ unsigned char* SecCamera::getJpeg(int *jpeg_size,
     return addr;
 }
 
-int SecCamera::getExif(unsigned char *pExifDst, unsigned char *pThumbSrc, int thumbSize)
+int SecCamera::getExif(unsigned char *pExifDst, unsigned int exifMax, unsigned char *pThumbSrc, int thumbSize)
 {
+#ifdef SAMSUNG_EXYNOS4x12
+    Mutex::Autolock lock(m_jpeg_thumb_lock);
+#else
+    Mutex::Autolock lock(m_jpeg_lock);
+#endif
+
 #ifdef SAMSUNG_EXYNOS4210
-    /* JPEG encode for smdkv310 */
-    if (m_jpeg_fd > 0) {
-        if (api_jpeg_encode_deinit(m_jpeg_fd) != JPEG_OK)
-            LOGE("ERR(%s):Fail on api_jpeg_encode_deinit", __func__);
-        m_jpeg_fd = 0;
+    /* JPEG encode for smdkv310, the device stays open until DestroyCamera */
+    if (m_jpeg_fd <= 0) {
+        m_jpeg_fd = api_jpeg_encode_init();
+        LOGV("(%s):JPEG device open ID = %d", __func__, m_jpeg_fd);
     }
 
-    m_jpeg_fd = api_jpeg_encode_init();
-    LOGV("(%s):JPEG device open ID = %d", __func__, m_jpeg_fd);
-
     if (m_jpeg_fd <= 0) {
         if (m_jpeg_fd < 0) {
             m_jpeg_fd = 0;
@@ -1730,7 +2982,10 @@ int SecCamera::getExif(unsigned char *pExifDst, unsigned char *pThumbSrc, int th
     LOGV("%s : enableThumb set to true", __func__);
     mExifInfo.enableThumb = true;
 
-    makeExif(pExifDst, pOutBuf, outbuf_size, &mExifInfo, &exifSize, true);
+    if (makeExif(pExifDst, exifMax, pOutBuf, outbuf_size, &mExifInfo, &exifSize, true) < 0) {
+        LOGE("ERR(%s):Fail on makeExif", __func__);
+        return -1;
+    }
 #endif
 
 #ifdef SAMSUNG_EXYNOS4x12
@@ -1740,91 +2995,18 @@ int SecCamera::getExif(unsigned char *pExifDst, unsigned char *pThumbSrc, int th
     if (m_camera_use_ISP) {
         LOGV("%s : m_jpeg_thumbnail_width = %d, height = %d",
              __func__, m_jpeg_thumbnail_width, m_jpeg_thumbnail_height);
-        m_jpeg_fd = jpeghal_enc_init();
-        LOGV("(%s):JPEG device open ID = %d", __func__, m_jpeg_fd);
-
-        if (m_jpeg_fd <= 0) {
-            if (m_jpeg_fd < 0) {
-                m_jpeg_fd = 0;
-                LOGE("ERR(%s):Cannot open a jpeg device file", __func__);
-                return -1;
-            }
-            LOGE("ERR(%s):JPEG device was closed", __func__);
-            return -1;
-        }
-
-        if (m_snapshot_v4lformat == V4L2_PIX_FMT_RGB565) {
-            LOGE("ERR(%s):It doesn't support V4L2_PIX_FMT_RGB565", __func__);
-            return -1;
-        }
-
-        struct jpeg_config    enc_config;
-        int outFormat;
-
-        switch (m_snapshot_v4lformat) {
-        case V4L2_PIX_FMT_NV12:
-        case V4L2_PIX_FMT_NV21:
-        case V4L2_PIX_FMT_NV12T:
-        case V4L2_PIX_FMT_YUV420:
-            outFormat = V4L2_PIX_FMT_JPEG_420;
-            break;
-        case V4L2_PIX_FMT_YUYV:
-        case V4L2_PIX_FMT_UYVY:
-        case V4L2_PIX_FMT_YUV422P:
-        default:
-            outFormat = V4L2_PIX_FMT_JPEG_422;
-            break;
-        }
-
-        // set encode parameters //
-        enc_config.mode = JPEG_ENCODE;
-
-        if (m_jpeg_thumbnail_quality >= 90)
-            enc_config.enc_qual = QUALITY_LEVEL_1;
-        else if (m_jpeg_thumbnail_quality >= 80)
-            enc_config.enc_qual = QUALITY_LEVEL_2;
-        else if (m_jpeg_thumbnail_quality >= 70)
-            enc_config.enc_qual = QUALITY_LEVEL_3;
-        else
-            enc_config.enc_qual = QUALITY_LEVEL_4;
-
-        enc_config.width = m_jpeg_thumbnail_width;
-        enc_config.height = m_jpeg_thumbnail_height;
-        enc_config.pix.enc_fmt.in_fmt = m_snapshot_v4lformat;
-        enc_config.pix.enc_fmt.out_fmt = outFormat;
-
-        jpeghal_enc_setconfig(m_jpeg_fd, &enc_config);
-
-        jpeghal_s_ctrl(m_jpeg_fd, V4L2_CID_CACHEABLE, 1);
 
-        struct jpeg_buf    m_jpeg_inbuf;
-        m_jpeg_inbuf.memory = V4L2_MEMORY_MMAP;
-        m_jpeg_inbuf.num_planes = 1;
-
-        if (jpeghal_set_inbuf(m_jpeg_fd, &m_jpeg_inbuf) < 0) {
-            LOGE("ERR(%s):Fail to JPEG input buffer!!", __func__);
-            return -1;
-        }
-
-        struct jpeg_buf    m_jpeg_outbuf;
-        m_jpeg_outbuf.memory = V4L2_MEMORY_MMAP;
-        m_jpeg_outbuf.num_planes = 1;
-
-        if (jpeghal_set_outbuf(m_jpeg_fd, &m_jpeg_outbuf) < 0) {
-            LOGE("ERR(%s):Fail to JPEG output buffer!!", __func__);
+        if (m_setupJpegSession(&m_jpeg_thumb, m_jpeg_thumbnail_width, m_jpeg_thumbnail_height,
+                               m_jpeg_thumbnail_quality, V4L2_MEMORY_MMAP, 1) < 0) {
+            LOGE("ERR(%s):Fail to set up the thumbnail JPEG session", __func__);
             return -1;
         }
 
-        memcpy(m_jpeg_inbuf.start[0], pThumbSrc, m_jpeg_inbuf.length[0]);
-
-        if (jpeghal_enc_exe(m_jpeg_fd, &m_jpeg_inbuf, &m_jpeg_outbuf) < 0) {
-            LOGE("ERR(%s):encode failed", __func__);
-            return -1;
-        }
+        memcpy(m_jpeg_thumb.in_buf.start[0], pThumbSrc, m_jpeg_thumb.in_buf.length[0]);
 
-        int outbuf_size = jpeghal_g_ctrl(m_jpeg_fd, V4L2_CID_CAM_JPEG_ENCODEDSIZE);
+        int outbuf_size = m_encodeJpegSession(&m_jpeg_thumb);
         if (outbuf_size < 0) {
-            LOGE("ERR(%s): jpeghal_g_ctrl fail on V4L2_CID_CAM_JPEG_ENCODEDSIZE", __func__);
+            LOGE("ERR(%s):encode failed", __func__);
             return -1;
         }
 
@@ -1836,23 +3018,62 @@ int SecCamera::getExif(unsigned char *pExifDst, unsigned char *pThumbSrc, int th
         LOGV("%s : enableThumb set to true", __func__);
         mExifInfo.enableThumb = true;
 
-        makeExif(pExifDst, (unsigned char *)m_jpeg_outbuf.start[0], (unsigned int)outbuf_size, &mExifInfo, &exifSize, true);
-
-        if (m_jpeg_fd > 0) {
-            if (jpeghal_deinit(m_jpeg_fd, &m_jpeg_inbuf, &m_jpeg_outbuf) < 0)
-                LOGE("ERR(%s):Fail on api_jpeg_encode_deinit", __func__);
-            m_jpeg_fd = 0;
+        if (makeExif(pExifDst, exifMax, (unsigned char *)m_jpeg_thumb.out_buf.start[0], (unsigned int)outbuf_size, &mExifInfo, &exifSize, true) < 0) {
+            LOGE("ERR(%s):Fail on makeExif", __func__);
+            return -1;
         }
     } else {
         setExifChangedAttribute();
         mExifInfo.enableThumb = true;
-        makeExif(pExifDst, pThumbSrc, (unsigned int)thumbSize, &mExifInfo, &exifSize, true);
+        if (makeExif(pExifDst, exifMax, pThumbSrc, (unsigned int)thumbSize, &mExifInfo, &exifSize, true) < 0) {
+            LOGE("ERR(%s):Fail on makeExif", __func__);
+            return -1;
+        }
     }
 #endif
 
     return exifSize;
 }
 
+/*
+ * A picture is assembled in place in one buffer :
+ *   [0, 2)                 SOI
+ *   [2, 2 + exifSize)      APP1 from getExif()
+ *   [2 + exifSize, 2 + reserve)
+ *                          zero padding, counted in the APP1 length
+ *   [reserve, ...)         encoder output, its own SOI is overwritten
+ * so the encoder can write at reserve before the Exif size is known.
+ * The APP1 from getExif() ends before reserve, so the Exif and the main
+ * image can be written at the same time. A thumbnail that doesn't fit is
+ * left out of the APP1 rather than losing the picture.
+ */
+int SecCamera::getExifReserve(int thumbSize)
+{
+    return MIN(EXIF_FILE_SIZE + thumbSize + 2, JPEG_APP1_MAX_SIZE);
+}
+
+int SecCamera::assembleJpeg(unsigned char *jpeg, int exifSize, int reserve)
+{
+    unsigned char *app1 = jpeg + 2;
+    unsigned int length;
+
+    if (exifSize < 4 || reserve - 2 < exifSize || JPEG_APP1_MAX_SIZE < reserve) {
+        LOGE("ERR(%s):Exif(%d) does not fit in %d", __func__, exifSize, reserve);
+        return -1;
+    }
+
+    jpeg[0] = 0xff;
+    jpeg[1] = 0xd8;
+
+    memset(app1 + exifSize, 0, reserve - exifSize);
+
+    length = reserve - 2;    // APP1 Maker isn't counted
+    app1[2] = (length >> 8) & 0xFF;
+    app1[3] = length & 0xFF;
+
+    return 0;
+}
+
 void SecCamera::getPostViewConfig(int *width, int *height, int *size)
 {
     *width = m_snapshot_width;
@@ -1879,8 +3100,9 @@ int SecCamera::getSnapshotAndJpeg(SecBuffer *yuv_buf, int index, unsigned char *
 {
     LOGV("%s :", __func__);
 
+    Mutex::Autolock lock(m_jpeg_lock);
+
     int ret = 0;
-    int i;
 
 #ifdef ZERO_SHUTTER_LAG
     if (!m_camera_use_ISP){
@@ -1929,16 +3151,12 @@ int SecCamera::getSnapshotAndJpeg(SecBuffer *yuv_buf, int index, unsigned char *
 #endif
 
 #ifdef SAMSUNG_EXYNOS4210
-    /* JPEG encode for smdkv310 */
-    if (m_jpeg_fd > 0) {
-        if (api_jpeg_encode_deinit(m_jpeg_fd) != JPEG_OK)
-            LOGE("ERR(%s):Fail on api_jpeg_encode_deinit", __func__);
-        m_jpeg_fd = 0;
+    /* JPEG encode for smdkv310, the device stays open until DestroyCamera */
+    if (m_jpeg_fd <= 0) {
+        m_jpeg_fd = api_jpeg_encode_init();
+        LOGV("(%s):JPEG device open ID = %d", __func__, m_jpeg_fd);
     }
 
-    m_jpeg_fd = api_jpeg_encode_init();
-    LOGV("(%s):JPEG device open ID = %d", __func__, m_jpeg_fd);
-
     if (m_jpeg_fd <= 0) {
         if (m_jpeg_fd < 0) {
             m_jpeg_fd = 0;
@@ -2019,27 +3237,142 @@ int SecCamera::getSnapshotAndJpeg(SecBuffer *yuv_buf, int index, unsigned char *
 
 #ifdef SAMSUNG_EXYNOS4x12
     /* JPEG encode for smdk4x12 */
-    m_jpeg_fd = jpeghal_enc_init();
-    LOGV("(%s):JPEG device open ID = %d", __func__, m_jpeg_fd);
+    int width;
+    int height;
+
+    if (!m_recording_en) {
+        width = m_snapshot_width;
+        height = m_snapshot_height;
+    } else {
+        width = m_videosnapshot_width;
+        height = m_videosnapshot_height;
+    }
+
+    if ((unsigned int)width & (16 - 1)) {
+        LOGE("ERR(%s): Image width should be multiple of 16", __func__);
+        return -1;
+    }
+
+    if (m_setupJpegSession(&m_jpeg_main, width, height, m_jpeg_quality,
+                           V4L2_MEMORY_USERPTR, 3) < 0) {
+        LOGE("ERR(%s):Fail to set up the main JPEG session", __func__);
+        return -1;
+    }
+
+    /* the capture buffer itself is the input, only its address changes per shot */
+    ret = fimc_v4l2_s_ctrl(m_cap_fd, V4L2_CID_PADDR_Y, index);
+    if (ret == -1) {
+        LOGE("ERR(%s):No physical address for capture buffer(%d)", __func__, index);
+        return -1;
+    }
+    m_jpeg_main.in_buf.start[0] = (void *)ret;
+    m_jpeg_main.in_buf.length[0] = m_capture_buf[index].size.extS[0];
+
+    if ((unsigned int)m_jpeg_main.in_buf.start[0] & (SIZE_4K - 1)) {
+        LOGE("ERR(%s): JPEG start address should be aligned to 4 Kbytes", __func__);
+        return -1;
+    }
+
+    ret = m_encodeJpegSession(&m_jpeg_main);
+    if (ret < 0) {
+        LOGE("ERR(%s):encode failed", __func__);
+        return -1;
+    }
+    *output_size = (unsigned int)ret;
+
+    memcpy(jpeg_buf, m_jpeg_main.out_buf.start[0], *output_size);
+#endif
+
+    return 0;
+}
 
+void SecCamera::m_prepareJpeg(void)
+{
+    Mutex::Autolock lock(m_jpeg_lock);
+    Mutex::Autolock thumbLock(m_jpeg_thumb_lock);
+
+#ifdef SAMSUNG_EXYNOS4210
     if (m_jpeg_fd <= 0) {
-        if (m_jpeg_fd < 0) {
+        m_jpeg_fd = api_jpeg_encode_init();
+        if (m_jpeg_fd <= 0) {
+            LOGW("WARN(%s):Cannot open a jpeg device file, retry on the shot", __func__);
             m_jpeg_fd = 0;
-            LOGE("ERR(%s):Cannot open a jpeg device file", __func__);
-            return -1;
         }
-        LOGE("ERR(%s):JPEG device was closed", __func__);
+    }
+#endif
+
+#ifdef SAMSUNG_EXYNOS4x12
+    int width  = m_recording_en ? m_videosnapshot_width  : m_snapshot_width;
+    int height = m_recording_en ? m_videosnapshot_height : m_snapshot_height;
+
+    /* a failure here only costs the setup on the first shot */
+    if (0 < width && 0 < height)
+        m_setupJpegSession(&m_jpeg_main, width, height, m_jpeg_quality,
+                           V4L2_MEMORY_USERPTR, 3);
+    else
+        m_openJpegSession(&m_jpeg_main);
+
+    if (m_camera_use_ISP && 0 < m_jpeg_thumbnail_width && 0 < m_jpeg_thumbnail_height)
+        m_setupJpegSession(&m_jpeg_thumb, m_jpeg_thumbnail_width, m_jpeg_thumbnail_height,
+                           m_jpeg_thumbnail_quality, V4L2_MEMORY_MMAP, 1);
+#endif
+}
+
+#ifdef SAMSUNG_EXYNOS4x12
+void SecCamera::m_initJpegSession(struct jpeg_session *session, const char *name)
+{
+    memset(session, 0, sizeof(*session));
+    session->name = name;
+    session->fd = -1;
+}
+
+int SecCamera::m_openJpegSession(struct jpeg_session *session)
+{
+    if (session->fd > 0)
+        return 0;
+
+    session->fd = jpeghal_enc_init();
+    LOGV("(%s):%s JPEG device open ID = %d", __func__, session->name, session->fd);
+
+    if (session->fd <= 0) {
+        session->fd = -1;
+        LOGE("ERR(%s):Cannot open a jpeg device file", __func__);
         return -1;
     }
 
+    session->ready = false;
+
+    return 0;
+}
+
+void SecCamera::m_closeJpegSession(struct jpeg_session *session)
+{
+    if (session->fd <= 0)
+        return;
+
+    if (session->ready) {
+        if (jpeghal_deinit(session->fd, &session->in_buf, &session->out_buf) < 0)
+            LOGE("ERR(%s):Fail on jpeghal_deinit", __func__);
+    } else {
+        close(session->fd);
+    }
+
+    session->fd = -1;
+    session->ready = false;
+}
+
+int SecCamera::m_setupJpegSession(struct jpeg_session *session,
+                                  int width, int height, int quality,
+                                  enum v4l2_memory in_memory, int cacheable)
+{
+    struct jpeg_config config;
+    int outFormat;
+
     if (m_snapshot_v4lformat == V4L2_PIX_FMT_RGB565) {
         LOGE("ERR(%s):It doesn't support V4L2_PIX_FMT_RGB565", __func__);
         return -1;
     }
 
-    struct jpeg_config    enc_config;
-    int outFormat;
-
     switch (m_snapshot_v4lformat) {
     case V4L2_PIX_FMT_NV12:
     case V4L2_PIX_FMT_NV21:
@@ -2055,87 +3388,113 @@ int SecCamera::getSnapshotAndJpeg(SecBuffer *yuv_buf, int index, unsigned char *
         break;
     }
 
-    // set encode parameters //
-    enc_config.mode = JPEG_ENCODE;
+    memset(&config, 0, sizeof(config));
+    config.mode = JPEG_ENCODE;
 
-    if (m_jpeg_quality >= 90)
-        enc_config.enc_qual = QUALITY_LEVEL_1;
-    else if (m_jpeg_quality >= 80)
-        enc_config.enc_qual = QUALITY_LEVEL_2;
-    else if (m_jpeg_quality >= 70)
-        enc_config.enc_qual = QUALITY_LEVEL_3;
+    if (quality >= 90)
+        config.enc_qual = QUALITY_LEVEL_1;
+    else if (quality >= 80)
+        config.enc_qual = QUALITY_LEVEL_2;
+    else if (quality >= 70)
+        config.enc_qual = QUALITY_LEVEL_3;
     else
-        enc_config.enc_qual = QUALITY_LEVEL_4;
-
-    if (!m_recording_en) {
-        enc_config.width = m_snapshot_width;
-        enc_config.height = m_snapshot_height;
-    } else {
-        enc_config.width = m_videosnapshot_width;
-        enc_config.height = m_videosnapshot_height;
-    }
-    enc_config.pix.enc_fmt.in_fmt = m_snapshot_v4lformat;
-    enc_config.pix.enc_fmt.out_fmt = outFormat;
+        config.enc_qual = QUALITY_LEVEL_4;
+
+    config.width = width;
+    config.height = height;
+    config.num_planes = 1;
+    config.pix.enc_fmt.in_fmt = m_snapshot_v4lformat;
+    config.pix.enc_fmt.out_fmt = outFormat;
+
+    if (session->ready && session->fd > 0
+        && session->config.width == config.width
+        && session->config.height == config.height
+        && session->config.enc_qual == config.enc_qual
+        && session->config.pix.enc_fmt.in_fmt == config.pix.enc_fmt.in_fmt
+        && session->config.pix.enc_fmt.out_fmt == config.pix.enc_fmt.out_fmt
+        && session->in_buf.memory == in_memory
+        && session->cacheable == cacheable)
+        return 0;
 
-    jpeghal_enc_setconfig(m_jpeg_fd, &enc_config);
+    if (m_openJpegSession(session) < 0)
+        return -1;
 
-    ret = jpeghal_s_ctrl(m_jpeg_fd, V4L2_CID_CACHEABLE, 3);
-    CHECK(ret);
+    if (session->ready) {
+        jpeghal_release_buf(session->fd, &session->in_buf);
+        jpeghal_release_buf(session->fd, &session->out_buf);
+        session->ready = false;
+    }
 
-    struct jpeg_buf    m_jpeg_inbuf;
-    m_jpeg_inbuf.start[0] = (void *)fimc_v4l2_s_ctrl(m_cap_fd, V4L2_CID_PADDR_Y, index);
-    m_jpeg_inbuf.length[0] = m_capture_buf[index].size.extS[0];
-    m_jpeg_inbuf.memory = V4L2_MEMORY_USERPTR;
-    m_jpeg_inbuf.num_planes = 1;
+    LOGV("%s(%s): %dx%d in_fmt(0x%x) out_fmt(0x%x) quality(%d)", __func__, session->name,
+         width, height, config.pix.enc_fmt.in_fmt, outFormat, quality);
 
-    if (jpeghal_set_inbuf(m_jpeg_fd, &m_jpeg_inbuf) < 0) {
-        LOGE("ERR(%s):Fail to JPEG input buffer!!", __func__);
+    if (jpeghal_enc_setconfig(session->fd, &config) < 0) {
+        LOGE("ERR(%s):Fail on jpeghal_enc_setconfig", __func__);
         return -1;
     }
 
-    for (i = 0; i < m_jpeg_inbuf.num_planes; i++) {
-        if ((unsigned int)m_jpeg_inbuf.start[i] & (SIZE_4K - 1)) {
-            LOGE("ERR(%s): JPEG start address should be aligned to 4 Kbytes", __func__);
-            return -1;
-        } else if ((unsigned int)enc_config.width & (16 - 1)) {
-            LOGE("ERR(%s): Image width should be multiple of 16", __func__);
-            return -1;
-        }
+    if (jpeghal_s_ctrl(session->fd, V4L2_CID_CACHEABLE, cacheable) < 0) {
+        LOGE("ERR(%s):Fail on V4L2_CID_CACHEABLE", __func__);
+        return -1;
     }
 
-    struct jpeg_buf    m_jpeg_outbuf;
-    m_jpeg_outbuf.memory = V4L2_MEMORY_MMAP;
-    m_jpeg_outbuf.num_planes = 1;
+    memset(&session->in_buf, 0, sizeof(session->in_buf));
+    session->in_buf.memory = in_memory;
+    session->in_buf.num_planes = 1;
 
-    if (jpeghal_set_outbuf(m_jpeg_fd, &m_jpeg_outbuf) < 0) {
-        LOGE("ERR(%s):Fail to JPEG output buffer!!", __func__);
+    if (jpeghal_set_inbuf(session->fd, &session->in_buf) < 0) {
+        LOGE("ERR(%s):Fail to JPEG input buffer!!", __func__);
         return -1;
     }
 
-    if (jpeghal_enc_exe(m_jpeg_fd, &m_jpeg_inbuf, &m_jpeg_outbuf) < 0) {
-        LOGE("ERR(%s):encode failed", __func__);
+    memset(&session->out_buf, 0, sizeof(session->out_buf));
+    session->out_buf.memory = V4L2_MEMORY_MMAP;
+    session->out_buf.num_planes = 1;
+
+    if (jpeghal_set_outbuf(session->fd, &session->out_buf) < 0) {
+        LOGE("ERR(%s):Fail to JPEG output buffer!!", __func__);
+        jpeghal_release_buf(session->fd, &session->in_buf);
         return -1;
     }
 
-    ret = jpeghal_g_ctrl(m_jpeg_fd, V4L2_CID_CAM_JPEG_ENCODEDSIZE);
-    if (ret < 0) {
-        LOGE("ERR(%s): jpeghal_g_ctrl fail on V4L2_CID_CAM_JPEG_ENCODEDSIZE", __func__);
+    session->config = config;
+    session->cacheable = cacheable;
+    session->ready = true;
+    session->setups++;
+
+    return 0;
+}
+
+/* Returns the encoded size, the session is ready for the next frame */
+int SecCamera::m_encodeJpegSession(struct jpeg_session *session)
+{
+    int size;
+
+    if (!session->ready)
         return -1;
+
+    if (jpeghal_enc_exe(session->fd, &session->in_buf, &session->out_buf) < 0) {
+        size = -1;
     } else {
-        *output_size = (unsigned int)ret;
+        size = jpeghal_g_ctrl(session->fd, V4L2_CID_CAM_JPEG_ENCODEDSIZE);
+        if (size < 0)
+            LOGE("ERR(%s): jpeghal_g_ctrl fail on V4L2_CID_CAM_JPEG_ENCODEDSIZE", __func__);
     }
 
-    memcpy(jpeg_buf, m_jpeg_outbuf.start[0], *output_size);
+    if (jpeghal_stop(session->fd, &session->in_buf, &session->out_buf) < 0)
+        size = -1;
 
-    if (m_jpeg_fd > 0) {
-        if (jpeghal_deinit(m_jpeg_fd, &m_jpeg_inbuf, &m_jpeg_outbuf) < 0)
-            LOGE("ERR(%s):Fail on api_jpeg_encode_deinit", __func__);
-        m_jpeg_fd = 0;
+    if (size < 0) {
+        /* the queues are in an unknown state, start over on the next shot */
+        m_closeJpegSession(session);
+        return -1;
     }
-#endif
 
-    return 0;
+    session->encodes++;
+
+    return size;
 }
+#endif
 
 int SecCamera::setVideosnapshotSize(int width, int height)
 {
@@ -2251,59 +3610,29 @@ int SecCamera::initSetParams(void)
         return -1;
     }
 
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_ISO, ISO_AUTO) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_ISO", __func__);
-        return -1;
-    }
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_METERING, METERING_CENTER) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_METERING", __func__);
-        return -1;
-    }
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_SATURATION, SATURATION_DEFAULT) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_SATURATION", __func__);
-        return -1;
-    }
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_SCENE_MODE, SCENE_MODE_NONE) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_SCENE_MODE", __func__);
-        return -1;
-    }
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_SHARPNESS, SHARPNESS_DEFAULT) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_SHARPNESS", __func__);
-        return -1;
-    }
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_WHITE_BALANCE, WHITE_BALANCE_AUTO) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_WHITE_BALANCE", __func__);
-        return -1;
-    }
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_ANTI_BANDING, ANTI_BANDING_OFF) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_ANTI_BANDING", __func__);
-        return -1;
-    }
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CAMERA_CONTRAST, IS_CONTRAST_DEFAULT) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_IS_CAMERA_CONTRAST", __func__);
-        return -1;
-    }
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_EFFECT, IMAGE_EFFECT_NONE) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_EFFECT", __func__);
-        return -1;
-    }
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CAMERA_BRIGHTNESS, IS_BRIGHTNESS_DEFAULT) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_IS_CAMERA_BRIGHTNESS", __func__);
-        return -1;
-    }
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CAMERA_EXPOSURE, IS_EXPOSURE_DEFAULT) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_IS_CAMERA_EXPOSURE", __func__);
-        return -1;
-    }
+    /* one transaction instead of a sensor round trip per default */
+    bool batched = (beginControls() == 0);
+    m_setCtrl(V4L2_CID_CAMERA_ISO, ISO_AUTO, NULL);
+    m_setCtrl(V4L2_CID_CAMERA_METERING, METERING_CENTER, NULL);
+    m_setCtrl(V4L2_CID_CAMERA_SATURATION, SATURATION_DEFAULT, NULL);
+    m_setCtrl(V4L2_CID_CAMERA_SCENE_MODE, SCENE_MODE_NONE, NULL);
+    m_setCtrl(V4L2_CID_CAMERA_SHARPNESS, SHARPNESS_DEFAULT, NULL);
+    m_setCtrl(V4L2_CID_CAMERA_WHITE_BALANCE, WHITE_BALANCE_AUTO, NULL);
+    m_setCtrl(V4L2_CID_CAMERA_ANTI_BANDING, ANTI_BANDING_OFF, NULL);
+    m_setCtrl(V4L2_CID_IS_CAMERA_CONTRAST, IS_CONTRAST_DEFAULT, NULL);
+    m_setCtrl(V4L2_CID_CAMERA_EFFECT, IMAGE_EFFECT_NONE, NULL);
+    m_setCtrl(V4L2_CID_IS_CAMERA_BRIGHTNESS, IS_BRIGHTNESS_DEFAULT, NULL);
+    m_setCtrl(V4L2_CID_IS_CAMERA_EXPOSURE, IS_EXPOSURE_DEFAULT, NULL);
 /* TODO */
 /* This code is temporary implementation because *
  * hue value tuning was not complete             */
 #ifdef USE_HUE
-    if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CAMERA_HUE, IS_HUE_DEFAULT) < 0) {
-        LOGE("ERR(%s):Fail on V4L2_CID_IS_CAMERA_HUE", __func__);
+    m_setCtrl(V4L2_CID_IS_CAMERA_HUE, IS_HUE_DEFAULT, NULL);
+#endif
+    if (batched && commitControls() < 0) {
+        LOGE("ERR(%s):Fail on the default controls", __func__);
         return -1;
     }
-#endif
 
     initParameters(m_camera_use_ISP);
 
@@ -2497,7 +3826,7 @@ int SecCamera::setWhiteBalance(int white_balance)
     if (m_params->white_balance != white_balance) {
         if (m_flag_camera_create) {
             LOGE("%s(white_balance(%d))", __func__, white_balance);
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_WHITE_BALANCE, white_balance) < 0) {
+            if (m_setCtrl(V4L2_CID_CAMERA_WHITE_BALANCE, white_balance, &m_params->white_balance) < 0) {
                 LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_WHITE_BALANCE", __func__);
                 return -1;
             }
@@ -2531,7 +3860,7 @@ int SecCamera::setBrightness(int brightness)
 
     if (m_params->brightness != brightness) {
         if (m_flag_camera_create) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CAMERA_BRIGHTNESS, brightness) < EV_MINUS_4) {
+            if (m_setCtrl(V4L2_CID_IS_CAMERA_BRIGHTNESS, brightness, &m_params->brightness) < EV_MINUS_4) {
                 LOGE("ERR(%s):Fail on V4L2_CID_IS_CAMERA_BRIGHTNESS", __func__);
                 return -1;
             }
@@ -2569,12 +3898,12 @@ int SecCamera::setExposure(int exposure)
     if (m_params->exposure != exposure) {
         if (m_flag_camera_create) {
             if (m_camera_use_ISP) {
-                if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CAMERA_EXPOSURE, exposure) < 0) {
+                if (m_setCtrl(V4L2_CID_IS_CAMERA_EXPOSURE, exposure, &m_params->exposure) < 0) {
                     LOGE("ERR(%s):Fail on V4L2_CID_IS_CAMERA_EXPOSURE", __func__);
                     return -1;
                 }
             } else {
-                if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_BRIGHTNESS, exposure) < EV_MINUS_4) {
+                if (m_setCtrl(V4L2_CID_CAMERA_BRIGHTNESS, exposure, &m_params->exposure) < EV_MINUS_4) {
                     LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_BRIGHTNESS", __func__);
                     return -1;
                 }
@@ -2603,7 +3932,7 @@ int SecCamera::setImageEffect(int image_effect)
 
     if (m_params->effects != image_effect) {
         if (m_flag_camera_create) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_EFFECT, image_effect) < 0) {
+            if (m_setCtrl(V4L2_CID_CAMERA_EFFECT, image_effect, &m_params->effects) < 0) {
                 LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_EFFECT", __func__);
                 return -1;
             }
@@ -2631,7 +3960,7 @@ int SecCamera::setAntiBanding(int anti_banding)
 
     if (m_params->anti_banding != anti_banding) {
         if (m_flag_camera_create) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_ANTI_BANDING, anti_banding) < 0) {
+            if (m_setCtrl(V4L2_CID_CAMERA_ANTI_BANDING, anti_banding, &m_params->anti_banding) < 0) {
                  LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_ANTI_BANDING", __func__);
                  return -1;
             }
@@ -2654,7 +3983,7 @@ int SecCamera::setSceneMode(int scene_mode)
     if (m_params->scene_mode != scene_mode) {
         if (m_flag_camera_create) {
             LOGE("%s(scene_mode(%d))", __func__, scene_mode);
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_SCENE_MODE, scene_mode) < 0) {
+            if (m_setCtrl(V4L2_CID_CAMERA_SCENE_MODE, scene_mode, &m_params->scene_mode) < 0) {
                 LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_SCENE_MODE", __func__);
                 return -1;
             }
@@ -2681,7 +4010,7 @@ int SecCamera::setFlashMode(int flash_mode)
 
     if (m_params->flash_mode != flash_mode) {
         if (m_flag_camera_create) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_FLASH_MODE, flash_mode) < 0) {
+            if (m_setCtrl(V4L2_CID_CAMERA_FLASH_MODE, flash_mode, &m_params->flash_mode) < 0) {
                 LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_FLASH_MODE", __func__);
                 return -1;
             }
@@ -2746,7 +4075,7 @@ int SecCamera::setISO(int iso_value)
 
     if (m_params->iso != iso_value) {
         if (m_flag_camera_create) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_ISO, iso_value) < 0) {
+            if (m_setCtrl(V4L2_CID_CAMERA_ISO, iso_value, &m_params->iso) < 0) {
                 LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_ISO", __func__);
                 return -1;
             }
@@ -2781,12 +4110,12 @@ int SecCamera::setContrast(int contrast_value)
     if (m_params->contrast != contrast_value) {
         if (m_flag_camera_create) {
             if (m_camera_use_ISP) {
-                if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CAMERA_CONTRAST, contrast_value) < 0) {
+                if (m_setCtrl(V4L2_CID_IS_CAMERA_CONTRAST, contrast_value, &m_params->contrast) < 0) {
                     LOGE("ERR(%s):Fail on V4L2_CID_IS_CAMERA_CONTRAST", __func__);
                     return -1;
                 }
             } else {
-                if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_CONTRAST, contrast_value) < 0) {
+                if (m_setCtrl(V4L2_CID_CAMERA_CONTRAST, contrast_value, &m_params->contrast) < 0) {
                     LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_CONTRAST", __func__);
                     return -1;
                 }
@@ -2815,7 +4144,7 @@ int SecCamera::setSaturation(int saturation_value)
 
     if (m_params->saturation != saturation_value) {
         if (m_flag_camera_create) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_SATURATION, saturation_value) < 0) {
+            if (m_setCtrl(V4L2_CID_CAMERA_SATURATION, saturation_value, &m_params->saturation) < 0) {
                 LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_SATURATION", __func__);
                 return -1;
             }
@@ -2843,7 +4172,7 @@ int SecCamera::setSharpness(int sharpness_value)
 
     if (m_params->sharpness != sharpness_value) {
         if (m_flag_camera_create) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_SHARPNESS, sharpness_value) < 0) {
+            if (m_setCtrl(V4L2_CID_CAMERA_SHARPNESS, sharpness_value, &m_params->sharpness) < 0) {
                 LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_SHARPNESS", __func__);
                 return -1;
             }
@@ -2880,7 +4209,7 @@ int SecCamera::setHue(int hue_value)
 
     if (m_params->hue != hue_value) {
         if (m_flag_camera_create) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_CAMERA_HUE, hue_value) < 0) {
+            if (m_setCtrl(V4L2_CID_IS_CAMERA_HUE, hue_value, &m_params->hue) < 0) {
                 LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_HUE", __func__);
                 return -1;
             }
@@ -2916,12 +4245,12 @@ int SecCamera::setWDR(int wdr_value)
     if (m_wdr != wdr_value) {
         if (m_flag_camera_create) {
             if (m_camera_use_ISP) {
-                if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_IS_SET_DRC, wdr_value) < 0) {
+                if (m_setCtrl(V4L2_CID_IS_SET_DRC, wdr_value, &m_wdr) < 0) {
                     LOGE("ERR(%s):Fail on V4L2_CID_IS_SET_DRC", __func__);
                     return -1;
                 }
             } else {
-                if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_WDR, wdr_value) < 0) {
+                if (m_setCtrl(V4L2_CID_CAMERA_WDR, wdr_value, &m_wdr) < 0) {
                     LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_WDR", __func__);
                     return -1;
                 }
@@ -2949,7 +4278,7 @@ int SecCamera::setAntiShake(int anti_shake)
 
     if (m_anti_shake != anti_shake) {
         if (m_flag_camera_create) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_ANTI_SHAKE, anti_shake) < 0) {
+            if (m_setCtrl(V4L2_CID_CAMERA_ANTI_SHAKE, anti_shake, &m_anti_shake) < 0) {
                 LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_ANTI_SHAKE", __func__);
                 return -1;
             }
@@ -2976,7 +4305,7 @@ int SecCamera::setMetering(int metering_value)
 
     if (m_params->metering != metering_value) {
         if (m_flag_camera_create) {
-            if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_METERING, metering_value) < 0) {
+            if (m_setCtrl(V4L2_CID_CAMERA_METERING, metering_value, &m_params->metering) < 0) {
                 LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_METERING", __func__);
                 return -1;
             }
@@ -3213,6 +4542,9 @@ int SecCamera::setFocusMode(int focus_mode)
 
     if (m_params->focus_mode != focus_mode) {
         if (m_flag_camera_create) {
+            /* the AF sequence below must not overtake a queued scene mode */
+            m_syncControls();
+
             if (m_params->focus_mode == FOCUS_MODE_AUTO || m_params->focus_mode == FOCUS_MODE_MACRO) {
                 if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_SET_AUTO_FOCUS, AUTO_FOCUS_OFF) < 0) {
                         LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_SET_AUTO_FOCUS", __func__);
@@ -3393,7 +4725,7 @@ int SecCamera::setGamma(int gamma)
 
      if (m_video_gamma != gamma) {
          if (m_flag_camera_create) {
-             if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_SET_GAMMA, gamma) < 0) {
+             if (m_setCtrl(V4L2_CID_CAMERA_SET_GAMMA, gamma, &m_video_gamma) < 0) {
                  LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_SET_GAMMA", __func__);
                  return -1;
              }
@@ -3415,7 +4747,7 @@ int SecCamera::setSlowAE(int slow_ae)
 
      if (m_slow_ae!= slow_ae) {
          if (m_flag_camera_create) {
-             if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_SET_SLOW_AE, slow_ae) < 0) {
+             if (m_setCtrl(V4L2_CID_CAMERA_SET_SLOW_AE, slow_ae, &m_slow_ae) < 0) {
                  LOGE("ERR(%s):Fail on V4L2_CID_CAMERA_SET_SLOW_AE", __func__);
                  return -1;
              }
@@ -3899,6 +5231,7 @@ void SecCamera::setExifChangedAttribute()
 }
 
 int SecCamera::makeExif (unsigned char *exifOut,
+                                        unsigned int exifMax,
                                         unsigned char *thumb_buf,
                                         unsigned int thumb_size,
                                         exif_attribute_t *exifInfo,
@@ -3909,6 +5242,12 @@ int SecCamera::makeExif (unsigned char *exifOut,
     unsigned int tmp, LongerTagOffest = 0;
     pApp1Start = pCur = exifOut;
 
+    /* the tags take well under EXIF_FILE_SIZE, getExifReserve() keeps that much for them */
+    if (exifMax < EXIF_FILE_SIZE) {
+        LOGE("ERR(%s):%u is too small for the Exif tags", __func__, exifMax);
+        return -1;
+    }
+
     //2 Exif Identifier Code & TIFF Header
     pCur += 4;  // Skip 4 Byte for APP1 marker and length
     unsigned char ExifIdentifierCode[6] = { 0x45, 0x78, 0x69, 0x66, 0x00, 0x00 };
@@ -4077,6 +5416,14 @@ int SecCamera::makeExif (unsigned char *exifOut,
     unsigned char *thumbBuf = thumb_buf;
     unsigned int thumbSize = thumb_size;
 
+    /* the 1th IFD, its two resolutions and the thumbnail have to end before exifMax */
+    if (exifInfo->enableThumb && (thumbBuf != NULL) && (thumbSize > 0) &&
+        exifMax < 10 + LongerTagOffest + NUM_SIZE + NUM_1TH_IFD_TIFF*IFD_SIZE + OFFSET_SIZE +
+                  2 * sizeof(rational_t) + thumbSize) {
+        LOGW("%s: thumbnail(%u) does not fit in %u, dropped", __func__, thumbSize, exifMax);
+        thumbBuf = NULL;
+    }
+
     if (exifInfo->enableThumb && (thumbBuf != NULL) && (thumbSize > 0)) {
         tmp = LongerTagOffest;
         memcpy(pNextIfdOffset, &tmp, OFFSET_SIZE);  // NEXT IFD offset skipped on 0th IFD
@@ -4124,6 +5471,10 @@ int SecCamera::makeExif (unsigned char *exifOut,
     pApp1Start += 2;
 
     *size = 10 + LongerTagOffest;
+    if (exifMax < *size) {
+        LOGE("ERR(%s):Exif(%u) overran %u", __func__, *size, exifMax);
+        return -1;
+    }
     tmp = *size - 2;    // APP1 Maker isn't counted
     unsigned char size_mm[2] = {(tmp >> 8) & 0xFF, tmp & 0xFF};
     memcpy(pApp1Start, size_mm, 2);
@@ -4215,6 +5566,66 @@ status_t SecCamera::dump(int fd)
     String8 result;
     snprintf(buffer, 255, "dump(%d)\n", fd);
     result.append(buffer);
+    snprintf(buffer, 255, "preview pool: %d x %u bytes, allocs(%u) reuses(%u) restreams(%u)\n",
+             m_preview_pool_count, m_preview_pool_size, m_preview_pool_allocs,
+             m_preview_pool_reuses, m_preview_pool_restreams);
+    result.append(buffer);
+    snprintf(buffer, 255, "watchdog: timeout(%d ms) stalls(%u) starved(%u) requeue(%u) restream(%u) reset(%u) worst(%d ms)\n",
+             m_watchdogTimeout(), m_watchdog_stalls, m_watchdog_starved,
+             m_watchdog_steps[WATCHDOG_REQUEUE], m_watchdog_steps[WATCHDOG_RESTREAM],
+             m_watchdog_steps[WATCHDOG_RESET], m_watchdog_worst_ms);
+    result.append(buffer);
+    for (int i = 0; i < WATCHDOG_HISTORY && i < (int)m_watchdog_stalls; i++) {
+        struct watchdog_event *event =
+            &m_watchdog_event[(m_watchdog_head + WATCHDOG_HISTORY - i) % WATCHDOG_HISTORY];
+        snprintf(buffer, 255, " [%d] age(%lld ms) timeout(%d ms) step(%d) outage(%d ms)\n",
+                 i, ns2ms(systemTime(SYSTEM_TIME_MONOTONIC) - event->stall),
+                 event->timeout_ms, event->step, event->outage_ms);
+        result.append(buffer);
+    }
+    {
+        int nodes[3] = { m_cam_fd, m_cam_fd2, m_cam_fd3 };
+
+        for (int i = 0; i < 3; i++) {
+            SecVirtualSensor *sensor = SecVirtualSensor::find(nodes[i]);
+
+            if (sensor != NULL && sensor->dump(buffer, SIZE) > 0)
+                result.append(buffer);
+        }
+    }
+    m_ctrl_lock.lock();
+    snprintf(buffer, 255, "controls: ext(%d) batches(%u) ioctls(%u) coalesced(%u)\n",
+             m_ctrl_ext, m_ctrl_batches, m_ctrl_ioctls, m_ctrl_coalesced);
+    result.append(buffer);
+    m_ctrl_lock.unlock();
+#ifdef ZERO_SHUTTER_LAG
+    m_zsl_lock.lock();
+    snprintf(buffer, 255, "zsl ring(%d/%d) locked(0x%x) select(%s)\n",
+             m_zsl_count, ZSL_RING_DEPTH, m_zsl_locked,
+             m_zsl_select == ZSL_SELECT_SHARPEST ? "sharpest" : "nearest");
+    result.append(buffer);
+    for (int i = 0; i < m_zsl_count; i++) {
+        snprintf(buffer, 255, " [%d] index(%d) age(%lld ms) exposure(1/%d) focus(%u)\n",
+                 i, m_zsl_ring[i].index,
+                 ns2ms(systemTime(SYSTEM_TIME_MONOTONIC) - m_zsl_ring[i].timestamp),
+                 m_zsl_ring[i].exposure, m_zsl_ring[i].focus);
+        result.append(buffer);
+    }
+    m_zsl_lock.unlock();
+#endif
+#ifdef SAMSUNG_EXYNOS4x12
+    m_jpeg_lock.lock();
+    m_jpeg_thumb_lock.lock();
+    for (int i = 0; i < 2; i++) {
+        struct jpeg_session *session = (i == 0) ? &m_jpeg_main : &m_jpeg_thumb;
+        snprintf(buffer, 255, "jpeg %s: fd(%d) %dx%d ready(%d) setups(%u) encodes(%u)\n",
+                 session->name, session->fd, session->config.width, session->config.height,
+                 session->ready, session->setups, session->encodes);
+        result.append(buffer);
+    }
+    m_jpeg_thumb_lock.unlock();
+    m_jpeg_lock.unlock();
+#endif
     ::write(fd, result.string(), result.size());
     return NO_ERROR;
 }
@@ -34,12 +34,16 @@
 #include <sys/stat.h>
 
 #include <utils/RefBase.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
 #include <hardware/camera.h>
 #include <videodev2.h>
 #include <videodev2_samsung.h>
 #include "sec_utils_v4l2.h"
+#include "s5p_fimc.h"
 
 #include "SecBuffer.h"
+#include "exynos_mem.h"
 
 #include <utils/String8.h>
 
@@ -64,6 +68,7 @@ namespace android {
 #endif
 
 #define USE_FACE_DETECTION
+#define USE_PREVIEW_USERPTR
 //#define USE_TOUCH_AF
 
 #if defined(LOG_NDEBUG) && (LOG_NDEBUG == 0)
@@ -190,6 +195,38 @@ namespace android {
 #define CAP_BUFFERS     1
 #endif
 
+#ifdef ZERO_SHUTTER_LAG
+/* frames kept back for the shutter, the rest stay queued to fimc */
+#define ZSL_RING_DEPTH          (CAP_BUFFERS - 4)
+/* frames out for encoding at once, a burst thumbnails one while encoding another */
+#define ZSL_MAX_LOCKED          (2)
+/* how far from the shutter a sharper frame may be picked */
+#define ZSL_SHARP_WINDOW_MS     (100)
+#define ZSL_WAIT_MS             (500)
+#endif
+
+/* SOI, then APP1 marker and length : the length field is 16 bits */
+#define JPEG_APP1_MAX_SIZE      (2 + 0xFFFF)
+
+/* faces read from the IS per frame, camera_frame_metadata_t needs room for them */
+#define FD_MAX_FACES            (16)
+#define FD_CTRLS_PER_FACE       (22)
+
+/* controls sent in one VIDIOC_S_EXT_CTRLS */
+#define CTRL_BATCH_MAX          (32)
+
+/*
+ * Preview watchdog : no frame for WATCHDOG_STALL_FRAMES frame times is a
+ * stall, but never sooner than WATCHDOG_MIN_MS. An auto or night frame
+ * rate counts as WATCHDOG_SLOW_FPS, the first frame of a stream gets at
+ * least WATCHDOG_START_MS.
+ */
+#define WATCHDOG_STALL_FRAMES   (4)
+#define WATCHDOG_MIN_MS         (200)
+#define WATCHDOG_START_MS       (500)
+#define WATCHDOG_SLOW_FPS       (5)
+#define WATCHDOG_HISTORY        (8)
+
 #define MAX_PLANES      (1)
 #define V4L2_BUF_TYPE V4L2_BUF_TYPE_VIDEO_CAPTURE
 
@@ -340,6 +377,27 @@ public:
     int             stopSnapshot(void);
     int             getSnapshot(void);
     int             setSnapshotFrame(int index);
+#ifdef ZERO_SHUTTER_LAG
+    enum ZSL_SELECT {
+        ZSL_SELECT_NEAREST = 0,
+        ZSL_SELECT_SHARPEST,
+    };
+
+    struct zsl_frame {
+        int             index;
+        nsecs_t         timestamp;      /* dequeued, SYSTEM_TIME_MONOTONIC */
+        struct timeval  v4l2_timestamp;
+        int             exposure;       /* 1/x sec */
+        unsigned int    focus;          /* ZSL_SELECT_SHARPEST only */
+    };
+
+    /* ms to wait for a frame, 0 : only take one that is ready */
+    int             putZslFrame(int wait = ZSL_WAIT_MS);
+    int             lockZslFrame(nsecs_t shutter, struct zsl_frame *frame);
+    int             lockNextZslFrame(nsecs_t after, struct zsl_frame *frame);
+    int             unlockZslFrame(int index);
+    void            setZslSelect(int select);
+#endif
 
     int             startRecord(bool recordHint);
     int             stopRecord(void);
@@ -349,6 +407,7 @@ public:
     int             getRecordAddr(int index, SecBuffer *buffer);
 
     int             getPreview(camera_frame_metadata_t *facedata);
+    int             getPreviewBuffer(int index, SecBuffer *buffer);
     int             setPreviewSize(int width, int height, int pixel_format);
     int             getPreviewSize(int *width, int *height, int *frame_size);
     int             getPreviewMaxSize(int *width, int *height);
@@ -376,6 +435,13 @@ public:
 
     int             initSetParams(void);
 
+    /*
+     * Sensor controls set in between go out as one batch at the
+     * outermost commitControls(). Only the calling thread is batched.
+     */
+    int             beginControls(void);
+    int             commitControls(void);
+
     int             setAutofocus(void);
     int             setTouchAF(void);
 
@@ -493,6 +559,8 @@ public:
 #endif // ENABLE_ESD_PREVIEW_CHECK
 
     int setFrameRate(int frame_rate);
+    /* ms without a preview frame before recovering, 0 : from the frame rate */
+    void            setWatchdogTimeout(int msec);
     unsigned char*  getJpeg(int *jpeg_size,
                             int *thumb_size,
                             unsigned int *thumb_addr,
@@ -501,7 +569,9 @@ public:
                                        int index,
                                        unsigned char *jpeg_buf,
                                        int *output_size);
-    int             getExif(unsigned char *pExifDst, unsigned char *pThumbSrc, int thumbSize);
+    int             getExif(unsigned char *pExifDst, unsigned int exifMax, unsigned char *pThumbSrc, int thumbSize);
+    static int      getExifReserve(int thumbSize);
+    static int      assembleJpeg(unsigned char *jpeg, int exifSize, int reserve);
 
     void            getPostViewConfig(int*, int*, int*);
     void            getThumbnailConfig(int *width, int *height, int *size);
@@ -511,6 +581,12 @@ public:
     int             getJpegFd(void);
     void            SetJpgAddr(unsigned char *addr);
     int             getPreviewAddr(int index, SecBuffer *buffer);
+#ifdef USE_PREVIEW_USERPTR
+    int             setPreviewUserPtr(int enable);
+    int             getPreviewUserPtr(void);
+    int             setPreviewUserFrame(int index, SecBuffer *buffer);
+    int             syncPreviewFrame(int index);
+#endif
     int             getCaptureAddr(int index, SecBuffer *buffer);
 #ifdef IS_FW_DEBUG
     int             getDebugAddr(unsigned int *vaddr);
@@ -620,8 +696,130 @@ private:
 
     int             m_flag_camera_create;
     int             m_flag_camera_start;
+    int             m_preview_userptr;
+    int             m_preview_sync_fd;  /* exynos-mem, for syncPreviewFrame() */
+
+    /* mmap preview buffers kept across stopPreview() */
+    struct preview_pool_format {
+        int width;
+        int height;
+        int v4lformat;
+        int is_width;       /* the ISP side of the format */
+        int is_height;
+        int is_mode;
+    };
+
+    struct preview_pool_format m_preview_pool;
+    int             m_preview_pool_count;   /* buffers mapped, 0 : none */
+    int             m_preview_pool_frame;   /* FRAME_SIZE they were allocated for */
+    unsigned int    m_preview_pool_size;    /* bytes of the smallest one */
+    unsigned int    m_preview_pool_allocs;
+    unsigned int    m_preview_pool_reuses;
+    unsigned int    m_preview_pool_restreams;
+
+    int             m_allocPreviewPool(void);
+    void            m_releasePreviewPool(void);
+
+    /* who has each preview buffer, a bit per index */
+    Mutex           m_preview_buf_lock;
+    unsigned int    m_preview_queued;   /* in the driver */
+    unsigned int    m_preview_out;      /* dequeued, not given back yet */
+    bool            m_preview_keep_out; /* next startPreview() keeps m_preview_out */
+
+    unsigned int    m_previewBuffers(void);
+    int             m_queuePreview(int index);
+
+    /* preview watchdog, each stall climbs the steps until a frame comes */
+    enum WATCHDOG_STEP {
+        WATCHDOG_REQUEUE = 0,   /* queue again buffers nobody holds */
+        WATCHDOG_RESTREAM,      /* streamoff / streamon on the same buffers */
+        WATCHDOG_RESET,         /* s_input(1000) : the driver restarts the sensor */
+        WATCHDOG_STEPS,
+    };
+
+    struct watchdog_event {
+        nsecs_t         stall;      /* when the first timeout expired */
+        int             timeout_ms;
+        int             step;       /* highest step taken */
+        int             outage_ms;  /* last frame to the next one, -1 : none yet */
+    };
+
+    int             m_watchdog_ms;      /* 0 : from the frame rate */
+    int             m_watchdog_step;    /* next step, -1 : no stall */
+    bool            m_watchdog_first;   /* waiting for the first frame of a stream */
+    nsecs_t         m_watchdog_last;    /* last frame */
+    struct watchdog_event m_watchdog_event[WATCHDOG_HISTORY];
+    int             m_watchdog_head;
+    unsigned int    m_watchdog_stalls;
+    unsigned int    m_watchdog_starved;
+    unsigned int    m_watchdog_steps[WATCHDOG_STEPS];
+    int             m_watchdog_worst_ms;
+
+    int             m_watchdogTimeout(void);
+    int             m_watchdogStall(int timeout);
+    int             m_requeuePreview(unsigned int lost);
+    int             m_restreamPreview(void);
+    int             m_resetSensor(void);
+
+    /* controls queued by beginControls() */
+    struct ctrl_entry {
+        unsigned int    id;
+        int             value;
+        int            *shadow;     /* cached copy the setter updates */
+        int             old;        /* *shadow before the first set */
+    };
+
+    Mutex           m_ctrl_lock;
+    int             m_ctrl_depth;
+    android_thread_id_t m_ctrl_owner;
+    struct ctrl_entry m_ctrl_queue[CTRL_BATCH_MAX];
+    int             m_ctrl_count;
+    int             m_ctrl_ext;     /* VIDIOC_S_EXT_CTRLS works, -1 : not tried yet */
+    bool            m_ctrl_failed;  /* a control of the open batch was refused */
+    unsigned int    m_ctrl_batches;
+    unsigned int    m_ctrl_ioctls;
+    unsigned int    m_ctrl_coalesced;
+
+    int             m_setCtrl(unsigned int id, int value, int *shadow);
+    int             m_flushControls(void);
+    int             m_syncControls(void);
 
     int             m_jpeg_fd;
+    /* m_jpeg_lock serializes every encode, m_jpeg_fd is the 4210 device */
+    Mutex           m_jpeg_lock;
+    /* 4x12 only : getExif() has its own session, so it runs next to the main encode */
+    Mutex           m_jpeg_thumb_lock;
+
+#ifdef SAMSUNG_EXYNOS4x12
+    /*
+     * Opened at startPreview and kept until DestroyCamera, so a shot only
+     * queues its buffers. Format and buffers are set up again only when
+     * the size, format or quality of the encode changes.
+     */
+    struct jpeg_session {
+        const char         *name;
+        int                 fd;
+        bool                ready;      /* config, in_buf and out_buf are set */
+        int                 cacheable;
+        struct jpeg_config  config;
+        struct jpeg_buf     in_buf;
+        struct jpeg_buf     out_buf;
+        unsigned int        setups;
+        unsigned int        encodes;
+    };
+
+    struct jpeg_session m_jpeg_main;
+    struct jpeg_session m_jpeg_thumb;
+
+    void            m_initJpegSession(struct jpeg_session *session, const char *name);
+    int             m_openJpegSession(struct jpeg_session *session);
+    void            m_closeJpegSession(struct jpeg_session *session);
+    int             m_setupJpegSession(struct jpeg_session *session,
+                                       int width, int height, int quality,
+                                       enum v4l2_memory in_memory, int cacheable);
+    int             m_encodeJpegSession(struct jpeg_session *session);
+#endif
+    void            m_prepareJpeg(void);
     int             m_jpeg_thumbnail_width;
     int             m_jpeg_thumbnail_height;
     int             m_jpeg_thumbnail_quality;
@@ -635,6 +833,19 @@ private:
 
     exif_attribute_t mExifInfo;
 
+#ifdef ZERO_SHUTTER_LAG
+    /* the last frames of the snapshot node, oldest first */
+    Mutex            m_zsl_lock;
+    Condition        m_zsl_cond;
+    struct zsl_frame m_zsl_ring[ZSL_RING_DEPTH];
+    int              m_zsl_count;
+    unsigned int     m_zsl_locked;   /* mask of capture indexes */
+    int              m_zsl_select;
+    void             m_resetZsl(void);
+    int              m_lockZsl(int slot, struct zsl_frame *frame);
+    unsigned int     m_zslFocus(int index);
+#endif
+
     struct SecBuffer m_capture_buf[CAP_BUFFERS];
     struct SecBuffer m_buffers_preview[MAX_BUFFERS];
     struct SecBuffer m_buffers_record[MAX_BUFFERS];
@@ -667,6 +878,7 @@ private:
     void            setExifChangedAttribute();
     void            setExifFixedAttribute();
     int             makeExif (unsigned char *exifOut,
+                                        unsigned int exifMax,
                                         unsigned char *thumb_buf,
                                         unsigned int thumb_size,
                                         exif_attribute_t *exifInfo,
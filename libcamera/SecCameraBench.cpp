@@ -0,0 +1,330 @@
+/*
+**
+** Copyright 2010, Samsung Electronics Co. LTD
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SecCameraBench"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cutils/properties.h>
+
+#include "SecCameraBench.h"
+
+namespace android {
+
+static int compareTime(const void *a, const void *b)
+{
+    nsecs_t x = *(const nsecs_t *)a;
+    nsecs_t y = *(const nsecs_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+SecCameraBench::SecCameraBench(const char *variant, int cameraId)
+{
+    memset(mVariant, 0, sizeof(mVariant));
+    memset(mSensor, 0, sizeof(mSensor));
+    strncpy(mVariant, variant, sizeof(mVariant) - 1);
+    mCameraId = cameraId;
+
+    mCreated  = systemTime(SYSTEM_TIME_MONOTONIC);
+    mOpenTime = 0;
+
+    mPreviewStart = 0;
+    memset(&mFirstFrame, 0, sizeof(mFirstFrame));
+
+    mLastFrame = 0;
+    mFrames    = 0;
+    mFrameSpan = 0;
+    mIntervals = 0;
+
+    memset(&mShutterLag, 0, sizeof(mShutterLag));
+    memset(&mShotToShot, 0, sizeof(mShotToShot));
+    mLastPicture = 0;
+
+    mBursts     = 0;
+    mBurstShots = 0;
+    mBurstTime  = 0;
+
+    memset(mStage, 0, sizeof(mStage));
+}
+
+SecCameraBench::~SecCameraBench()
+{
+}
+
+nsecs_t SecCameraBench::threadTime(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) < 0)
+        return 0;
+
+    return s2ns(ts.tv_sec) + ts.tv_nsec;
+}
+
+void SecCameraBench::setSensor(const char *sensor)
+{
+    Mutex::Autolock lock(mLock);
+
+    if (sensor == NULL)
+        return;
+    strncpy(mSensor, sensor, sizeof(mSensor) - 1);
+}
+
+void SecCameraBench::setStageName(int stage, const char *name)
+{
+    if (stage < 0 || BENCH_STAGES <= stage)
+        return;
+
+    Mutex::Autolock lock(mLock);
+
+    strncpy(mStage[stage].name, name, sizeof(mStage[stage].name) - 1);
+}
+
+void SecCameraBench::opened(void)
+{
+    Mutex::Autolock lock(mLock);
+
+    mOpenTime = systemTime(SYSTEM_TIME_MONOTONIC) - mCreated;
+}
+
+void SecCameraBench::previewStart(void)
+{
+    Mutex::Autolock lock(mLock);
+
+    mPreviewStart = systemTime(SYSTEM_TIME_MONOTONIC);
+    /* the gap while preview was off is no frame interval */
+    mLastFrame = 0;
+}
+
+void SecCameraBench::previewFrame(void)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    Mutex::Autolock lock(mLock);
+
+    mFrames++;
+
+    if (mPreviewStart != 0) {
+        account(&mFirstFrame, now - mPreviewStart);
+        mPreviewStart = 0;
+    }
+
+    if (mLastFrame != 0) {
+        mInterval[mIntervals % BENCH_INTERVALS] = now - mLastFrame;
+        mIntervals++;
+        mFrameSpan += now - mLastFrame;
+    }
+    mLastFrame = now;
+}
+
+void SecCameraBench::shutter(nsecs_t pressed)
+{
+    if (pressed == 0)
+        return;
+
+    Mutex::Autolock lock(mLock);
+
+    account(&mShutterLag, systemTime(SYSTEM_TIME_MONOTONIC) - pressed);
+}
+
+/* back to back pictures : the time from one finished picture to the next */
+void SecCameraBench::pictureDone(void)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    Mutex::Autolock lock(mLock);
+
+    if (mLastPicture != 0)
+        account(&mShotToShot, now - mLastPicture);
+    mLastPicture = now;
+}
+
+void SecCameraBench::burstDone(int shots, nsecs_t time)
+{
+    if (shots <= 0 || time <= 0)
+        return;
+
+    Mutex::Autolock lock(mLock);
+
+    mBursts++;
+    mBurstShots += shots;
+    mBurstTime  += time;
+}
+
+void SecCameraBench::stageDone(int stage, nsecs_t cpu)
+{
+    if (stage < 0 || BENCH_STAGES <= stage)
+        return;
+
+    nsecs_t used = threadTime() - cpu;
+
+    Mutex::Autolock lock(mLock);
+
+    account(&mStage[stage].cpu, used);
+}
+
+/* mLock held, or the series is private to the caller */
+void SecCameraBench::account(struct series *series, nsecs_t value)
+{
+    if (series->count == 0 || value < series->min)
+        series->min = value;
+    if (series->max < value)
+        series->max = value;
+    series->sum += value;
+    series->count++;
+}
+
+int SecCameraBench::jsonSeries(char *buf, int bufSize, const char *name,
+                               const struct series *series)
+{
+    if (series->count == 0)
+        return snprintf(buf, bufSize, "\"%s\":{\"n\":0}", name);
+
+    return snprintf(buf, bufSize,
+                    "\"%s\":{\"n\":%u,\"avg\":%lld,\"min\":%lld,\"max\":%lld,\"sum\":%lld}",
+                    name, series->count, ns2us(series->sum) / series->count,
+                    ns2us(series->min), ns2us(series->max), ns2us(series->sum));
+}
+
+/*
+ * One JSON object on one line, all times in us. Preview jitter and
+ * percentiles cover the last BENCH_INTERVALS frame intervals, a late frame
+ * came more than half an interval after the median.
+ */
+int SecCameraBench::json(char *buf, int bufSize)
+{
+    char build[PROPERTY_VALUE_MAX];
+    nsecs_t sorted[BENCH_INTERVALS];
+    unsigned int n;
+    double mean = 0, var = 0;
+    unsigned int late = 0;
+    int len = 0;
+
+    if (buf == NULL || bufSize <= 0)
+        return 0;
+
+    property_get("ro.build.version.incremental", build, "unknown");
+
+    Mutex::Autolock lock(mLock);
+
+    n = mIntervals < BENCH_INTERVALS ? mIntervals : BENCH_INTERVALS;
+    memcpy(sorted, mInterval, n * sizeof(nsecs_t));
+    qsort(sorted, n, sizeof(nsecs_t), compareTime);
+
+    for (unsigned int i = 0; i < n; i++)
+        mean += sorted[i];
+    if (n)
+        mean /= n;
+    for (unsigned int i = 0; i < n; i++) {
+        var += (sorted[i] - mean) * (sorted[i] - mean);
+        if (sorted[n / 2] + sorted[n / 2] / 2 < sorted[i])
+            late++;
+    }
+    if (n)
+        var /= n;
+
+    len += snprintf(buf + len, bufSize - len,
+                    "{\"variant\":\"%s\",\"camera\":%d,\"sensor\":\"%s\",\"build\":\"%s\","
+                    "\"time\":%ld,\"open_us\":%lld,",
+                    mVariant, mCameraId, mSensor, build,
+                    (long)time(NULL), ns2us(mOpenTime));
+    if (len < bufSize)
+        len += jsonSeries(buf + len, bufSize - len, "first_frame_us", &mFirstFrame);
+
+    if (len < bufSize)
+        len += snprintf(buf + len, bufSize - len,
+                        ",\"preview\":{\"frames\":%u,\"fps\":%.2f,\"late\":%u,\"interval_us\":"
+                        "{\"n\":%u,\"avg\":%lld,\"stddev\":%lld",
+                        mFrames, mFrameSpan ? mIntervals * 1e9 / mFrameSpan : 0.0, late,
+                        n, (long long)(mean / 1000), (long long)(sqrt(var) / 1000));
+    if (n && len < bufSize)
+        len += snprintf(buf + len, bufSize - len,
+                        ",\"min\":%lld,\"p50\":%lld,\"p90\":%lld,\"p99\":%lld,\"max\":%lld",
+                        ns2us(sorted[0]), ns2us(sorted[n * 50 / 100]),
+                        ns2us(sorted[n * 90 / 100]), ns2us(sorted[n * 99 / 100]),
+                        ns2us(sorted[n - 1]));
+    if (len < bufSize)
+        len += snprintf(buf + len, bufSize - len, "}},");
+
+    if (len < bufSize)
+        len += jsonSeries(buf + len, bufSize - len, "shutter_lag_us", &mShutterLag);
+    if (len < bufSize)
+        len += snprintf(buf + len, bufSize - len, ",");
+    if (len < bufSize)
+        len += jsonSeries(buf + len, bufSize - len, "shot_to_shot_us", &mShotToShot);
+
+    if (len < bufSize)
+        len += snprintf(buf + len, bufSize - len,
+                        ",\"burst\":{\"bursts\":%u,\"shots\":%u,\"us\":%lld,\"fps\":%.2f}",
+                        mBursts, mBurstShots, ns2us(mBurstTime),
+                        mBurstTime ? mBurstShots * 1e9 / mBurstTime : 0.0);
+
+    if (len < bufSize)
+        len += snprintf(buf + len, bufSize - len, ",\"stage_cpu_us\":{");
+    for (int i = 0, first = 1; i < BENCH_STAGES && len < bufSize; i++) {
+        if (mStage[i].name[0] == '\0')
+            continue;
+        if (!first)
+            len += snprintf(buf + len, bufSize - len, ",");
+        if (len < bufSize)
+            len += jsonSeries(buf + len, bufSize - len, mStage[i].name, &mStage[i].cpu);
+        first = 0;
+    }
+    if (len < bufSize)
+        len += snprintf(buf + len, bufSize - len, "}}");
+
+    if (bufSize <= len)
+        return bufSize - 1;
+
+    return len;
+}
+
+void SecCameraBench::save(void)
+{
+    char path[PROPERTY_VALUE_MAX];
+    char report[BENCH_REPORT_SIZE];
+    int len;
+    int fd;
+
+    property_get("camera.bench.out", path, "");
+    if (path[0] == '\0')
+        return;
+
+    len = json(report, sizeof(report) - 1);
+    report[len++] = '\n';
+
+    fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        LOGE("ERR(%s):Fail on open %s", __func__, path);
+        return;
+    }
+    if (write(fd, report, len) != len)
+        LOGE("ERR(%s):Fail on write %s", __func__, path);
+    close(fd);
+
+    LOGV("%s: %s", __func__, report);
+}
+
+}; // namespace android
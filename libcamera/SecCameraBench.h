@@ -0,0 +1,128 @@
+/*
+**
+** Copyright 2010, Samsung Electronics Co. LTD
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*!
+ * \file      SecCameraBench.h
+ * \brief     benchmark figures of one camera session, written out as JSON
+ *
+ * Collects what a session of the HAL did, from open to release : open
+ * time, time to the first preview frame, preview rate and jitter, shutter
+ * lag, shot to shot time, burst rate and the CPU time each stage thread
+ * burnt. Both variants of the HAL fill one in, the variant name goes into
+ * the report so runs of SecCamera.cpp and SecCamera_zoom.cpp line up.
+ *
+ * Run against the virtual sensor (camera.virtual.*), with a pattern or a
+ * recorded raw file, the numbers don't depend on the scene or the light.
+ * The report then names the sensor "virtual". The zoom variant has no
+ * physical memory behind a virtual node : its fimc stages fail each frame
+ * and their figures mean nothing there.
+ *
+ * camera.bench.out   file a JSON line per session is appended to at release
+ */
+
+#ifndef ANDROID_HARDWARE_SEC_CAMERA_BENCH_H
+#define ANDROID_HARDWARE_SEC_CAMERA_BENCH_H
+
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+#define BENCH_INTERVALS     (512)
+#define BENCH_STAGES        (12)
+#define BENCH_REPORT_SIZE   (4096)
+
+namespace android {
+
+class SecCameraBench
+{
+public:
+    SecCameraBench(const char *variant, int cameraId);
+    ~SecCameraBench();
+
+    /* CPU time the calling thread used so far */
+    static nsecs_t threadTime(void);
+
+    void setSensor(const char *sensor);
+    void setStageName(int stage, const char *name);
+
+    /* The HAL is open, timed from the constructor */
+    void opened(void);
+
+    /* Preview is being started, the next frame is the first one */
+    void previewStart(void);
+    void previewFrame(void);
+
+    /* The shutter went for the picture asked at pressed */
+    void shutter(nsecs_t pressed);
+    void pictureDone(void);
+    void burstDone(int shots, nsecs_t time);
+
+    /* stage ran once, from a threadTime() taken at cpu */
+    void stageDone(int stage, nsecs_t cpu);
+
+    int  json(char *buf, int bufSize);
+
+    /* Append the report to camera.bench.out, if it is set */
+    void save(void);
+
+private:
+    struct series {
+        unsigned int    count;
+        nsecs_t         sum;
+        nsecs_t         min;
+        nsecs_t         max;
+    };
+
+    struct stage {
+        char            name[16];
+        struct series   cpu;
+    };
+
+    static void account(struct series *series, nsecs_t value);
+    static int  jsonSeries(char *buf, int bufSize, const char *name, const struct series *series);
+
+    Mutex               mLock;
+    char                mVariant[24];
+    char                mSensor[32];
+    int                 mCameraId;
+
+    nsecs_t             mCreated;
+    nsecs_t             mOpenTime;
+
+    nsecs_t             mPreviewStart;  /* 0 : first frame came */
+    struct series       mFirstFrame;
+
+    /* frame to frame, the last BENCH_INTERVALS for jitter and percentiles */
+    nsecs_t             mLastFrame;
+    unsigned int        mFrames;
+    nsecs_t             mFrameSpan;
+    nsecs_t             mInterval[BENCH_INTERVALS];
+    unsigned int        mIntervals;
+
+    struct series       mShutterLag;
+    struct series       mShotToShot;
+    nsecs_t             mLastPicture;
+
+    unsigned int        mBursts;
+    unsigned int        mBurstShots;
+    nsecs_t             mBurstTime;
+
+    struct stage        mStage[BENCH_STAGES];
+};
+
+}; // namespace android
+
+#endif // ANDROID_HARDWARE_SEC_CAMERA_BENCH_H
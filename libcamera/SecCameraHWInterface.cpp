@@ -22,9 +22,13 @@
 #include "SecCameraHWInterface.h"
 #include <utils/threads.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <sys/mman.h>
 #include <camera/Camera.h>
 #include <media/stagefright/MetadataBufferType.h>
+#include "swscaler.h"
+#include "swconverter.h"
+#include "SecVirtualSensor.h"
 
 #define VIDEO_COMMENT_MARKER_H          0xFFBE
 #define VIDEO_COMMENT_MARKER_L          0xFFBF
@@ -78,6 +82,7 @@ gralloc_module_t const* CameraHardwareSec::mGrallocHal;
 CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
         :
           mCaptureInProgress(false),
+          mShutterTime(0),
           mParameters(),
           mFrameSizeDelta(0),
           mCameraSensorName(NULL),
@@ -98,9 +103,12 @@ CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
           mHalDevice(dev)
 {
     LOGV("%s :", __func__);
-    memset(&mCapBuffer, 0, sizeof(struct SecBuffer));
+    mCapBuffer = SecBuffer();
     int ret = 0;
 
+    /* times the open from here */
+    mBench = new SecCameraBench("SecCamera", cameraId);
+
     mPreviewWindow = NULL;
     mSecCamera = SecCamera::createInstance();
 
@@ -109,6 +117,22 @@ CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
     for(int i = 0; i < BUFFER_COUNT_FOR_ARRAY; i++)
         mRecordHeap[i] = NULL;
 
+    memset(&mPreviewLayout, 0, sizeof(mPreviewLayout));
+
+    invalidateParameters();
+    mParamCalls = 0;
+    mParamApplied = 0;
+
+#ifdef USE_PREVIEW_USERPTR
+    mPreviewZeroCopy = false;
+    mPreviewBufCount = 0;
+    mPreviewMinUndequeued = 0;
+    for (int i = 0; i < MAX_BUFFERS; i++)
+        mPreviewBufHandle[i] = NULL;
+    mPreviewRefilling = 0;
+    memset(mPipeCopy, 0, sizeof(mPipeCopy));
+#endif
+
     if (!mGrallocHal) {
         ret = hw_get_module(GRALLOC_HARDWARE_MODULE_ID, (const hw_module_t **)&mGrallocHal);
         if (ret)
@@ -130,6 +154,69 @@ CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
      */
     mPreviewRunning = false;
     mPreviewStartDeferred = false;
+
+    memset(mPipeRef, 0, sizeof(mPipeRef));
+    mPipeStopping = false;
+    memset(mFaceSlot, 0, sizeof(mFaceSlot));
+    memset(mPipeFaceSlot, -1, sizeof(mPipeFaceSlot));
+    mFaceLastCount = -1;
+    mFaceDelivered = 0;
+    mFaceUnchanged = 0;
+    mFaceNoSlot = 0;
+    mFaceDataHeap = NULL;
+    /*
+     * The display only wants the latest frame and a slow application
+     * should see fresh ones, so both drop the oldest. A frame the
+     * encoder cannot take right away goes straight back to fimc.
+     */
+    mPipeQueue[PIPE_DISPLAY]  = new SecFrameQueue("display", 2, SecFrameQueue::DROP_OLDEST);
+    mPipeQueue[PIPE_CALLBACK] = new SecFrameQueue("callback", 2, SecFrameQueue::DROP_OLDEST);
+    mPipeQueue[PIPE_RECORD]   = new SecFrameQueue("record", MAX_BUFFERS, SecFrameQueue::DROP_NEWEST);
+    /* burst slots are handed on in order, these never fill up */
+    mPipeQueue[PIPE_BURST_ENCODE]  = new SecFrameQueue("encode", BURST_RING_DEPTH, SecFrameQueue::DROP_NEWEST);
+    mPipeQueue[PIPE_BURST_DELIVER] = new SecFrameQueue("deliver", BURST_RING_DEPTH, SecFrameQueue::DROP_NEWEST);
+    mPipeQueue[PIPE_THUMBNAIL]     = new SecFrameQueue("thumb", 1, SecFrameQueue::DROP_NEWEST);
+    /* a tick per record frame, only the latest matters */
+    mPipeQueue[PIPE_VIDEO_SNAPSHOT] = new SecFrameQueue("vsnap", 1, SecFrameQueue::DROP_OLDEST);
+    mPreviewTrace = new SecFrameTrace("preview");
+    mRecordTrace  = new SecFrameTrace("record");
+    {
+        static const char *stage[BENCH_STAGE_MAX] = {
+            "display", "callback", "record", "encode", "deliver", "thumb", "vsnap",
+            "preview", "picture",
+        };
+
+        for (int i = 0; i < BENCH_STAGE_MAX; i++)
+            mBench->setStageName(i, stage[i]);
+    }
+    for (int i = 0; i < PIPE_MAX; i++)
+        mStageThread[i] = new StageThread(this, i);
+    mStageThread[PIPE_DISPLAY]->run("CameraDisplayThread", PRIORITY_URGENT_DISPLAY);
+    mStageThread[PIPE_CALLBACK]->run("CameraCallbackThread", PRIORITY_DEFAULT);
+    mStageThread[PIPE_RECORD]->run("CameraRecordThread", PRIORITY_DISPLAY);
+    mStageThread[PIPE_BURST_ENCODE]->run("CameraEncodeThread", PRIORITY_DEFAULT);
+    mStageThread[PIPE_BURST_DELIVER]->run("CameraDeliverThread", PRIORITY_DEFAULT);
+    mStageThread[PIPE_THUMBNAIL]->run("CameraThumbThread", PRIORITY_DEFAULT);
+    mStageThread[PIPE_VIDEO_SNAPSHOT]->run("CameraVideoSnapshotThread", PRIORITY_DEFAULT);
+
+    memset(&mThumbJob, 0, sizeof(mThumbJob));
+    mThumbBusy = false;
+
+    mBurstCount = 0;
+    mBurstCancel = false;
+    mBurstJpeg = false;
+    mBurstExifReserve = 0;
+    mBurstJpegSize = 0;
+    mBurstThumbSize = 0;
+    mBurstShots = 0;
+    mBurstTime = 0;
+    memset(mBurstSlot, 0, sizeof(mBurstSlot));
+
+    mRecordPolicy = RECORD_DROP_NEWEST;
+    resetRecordOwners();
+    for (int i = 0; i < BURST_RING_DEPTH; i++)
+        mBurstThumbHeap[i] = NULL;
+
     mPreviewThread = new PreviewThread(this);
     mAutoFocusThread = new AutoFocusThread(this);
     mPictureThread = new PictureThread(this);
@@ -144,6 +231,12 @@ CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
         mDebugThread->run("debugThread", PRIORITY_DEFAULT);
     }
 #endif
+
+    if (SecVirtualSensor::enabled())
+        mBench->setSensor("virtual");
+    else if (mCameraSensorName != NULL)
+        mBench->setSensor((const char *)mCameraSensorName);
+    mBench->opened();
 }
 
 int CameraHardwareSec::getCameraId() const
@@ -238,7 +331,7 @@ void CameraHardwareSec::initDefaultParameters(int cameraId)
 
 #ifdef USE_FACE_DETECTION
     if (mUseInternalISP) {
-        p.set(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_HW, "5");
+        p.set(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_HW, FD_MAX_FACES);
     } else {
         p.set(CameraParameters::KEY_MAX_NUM_DETECTED_FACES_HW, "0");
     }
@@ -367,6 +460,15 @@ void CameraHardwareSec::initDefaultParameters(int cameraId)
     p.set("contrast", 0);
     p.set("iso", "auto");
     p.set("metering", "center");
+    /* 0 : single shot, N : N shots, -1 : until cancelPicture() */
+    p.set("burst-capture", 0);
+#ifdef ZERO_SHUTTER_LAG
+    p.set("zsl-frame-select", "nearest");
+    p.set("zsl-frame-select-values", "nearest,sharpest");
+#endif
+    /* what gives when the video encoder does not return its frames in time */
+    p.set("record-backpressure", "drop-newest");
+    p.set("record-backpressure-values", "drop-oldest,drop-newest,throttle");
     p.set("wdr", 0);
 
     ip.set("chk_dataline", 0);
@@ -479,6 +581,9 @@ status_t CameraHardwareSec::setPreviewWindow(preview_stream_ops *w)
         LOGE("%s: min undequeued buffer count %d is too high (expecting at most %d)", __func__,
              min_bufs, BUFFER_COUNT_FOR_GRALLOC - 1);
     }
+#ifdef USE_PREVIEW_USERPTR
+    mPreviewMinUndequeued = min_bufs;
+#endif
 
     LOGV("%s: setting buffer count to %d", __func__, BUFFER_COUNT_FOR_GRALLOC);
     if (w->set_buffer_count(w, BUFFER_COUNT_FOR_GRALLOC)) {
@@ -519,7 +624,7 @@ status_t CameraHardwareSec::setPreviewWindow(preview_stream_ops *w)
         return INVALID_OPERATION;
     }
 #else
-    if (w->set_usage(w, GRALLOC_USAGE_SW_WRITE_OFTEN
+    if (w->set_usage(w, GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_OFTEN
         | GRALLOC_USAGE_HW_FIMC1 | GRALLOC_USAGE_HWC_HWOVERLAY)) {
         LOGE("%s: could not set usage on gralloc buffer", __func__);
         return INVALID_OPERATION;
@@ -534,6 +639,13 @@ status_t CameraHardwareSec::setPreviewWindow(preview_stream_ops *w)
         return INVALID_OPERATION;
     }
 
+    /* gralloc pads yuv lines to 16 pixels, the first dequeue tells for sure */
+    if (hal_pixel_format == HAL_PIXEL_FORMAT_RGB_565
+        || hal_pixel_format == HAL_PIXEL_FORMAT_RGBA_8888)
+        negotiatePreviewLayout(preview_width);
+    else
+        negotiatePreviewLayout(ALIGN(preview_width, 16));
+
     if (mPreviewRunning && mPreviewStartDeferred) {
         LOGV("start/resume preview");
         status_t ret = startPreviewInternal();
@@ -609,7 +721,11 @@ int CameraHardwareSec::previewThreadWrapper()
         mPreviewLock.lock();
         while (!mPreviewRunning) {
             LOGI("%s: calling mSecCamera->stopPreview() and waiting", __func__);
+            stopPipeline();
             mSecCamera->stopPreview();
+#ifdef USE_PREVIEW_USERPTR
+            cancelPreviewBuffers();
+#endif
             /* signal that we're stopping */
             mPreviewStoppedCondition.signal();
             mPreviewCondition.wait(mPreviewLock);
@@ -619,30 +735,51 @@ int CameraHardwareSec::previewThreadWrapper()
 
         if (mExitPreviewThread) {
             LOGI("%s: exiting", __func__);
+            stopPipeline();
             mSecCamera->stopPreview();
+#ifdef USE_PREVIEW_USERPTR
+            cancelPreviewBuffers();
+#endif
             return 0;
         }
 
+        nsecs_t cpu = SecCameraBench::threadTime();
         previewThread();
+        mBench->stageDone(BENCH_PREVIEW, cpu);
     }
 }
 
+/*
+ * Capture stage : dequeue a sensor frame and fan it out to the display,
+ * callback and record stages. Nothing in here waits on the application.
+ */
 int CameraHardwareSec::previewThread()
 {
     int index;
+    int ret;
     nsecs_t timestamp;
-    SecBuffer previewAddr, recordAddr;
-    static int numArray = 0;
-    void *virAddr[3];
-    camera_frame_metadata_t fdmeta;
-    camera_face_t caface[5];
+    SecBuffer previewBuf;
+    SecBuffer recordAddr;
+    camera_frame_metadata_t *facedata = NULL;
+    bool faces = false;
+    bool copied = false;
+    int dropped;
 
     struct addrs *addrs;
 
-    fdmeta.faces = caface;
-    index = mSecCamera->getPreview(&fdmeta);
-
-    mFaceData = &fdmeta;
+#ifdef USE_FACE_DETECTION
+    /* the faces are only read out when somebody listens */
+    if (mUseInternalISP && (mMsgEnabled & CAMERA_MSG_PREVIEW_METADATA)) {
+        mFaceScan.number_of_faces = 0;
+        mFaceScan.faces = mFaceScanFace;
+        facedata = &mFaceScan;
+    } else {
+        mPipeLock.lock();
+        mFaceLastCount = -1;
+        mPipeLock.unlock();
+    }
+#endif
+    index = mSecCamera->getPreview(facedata);
 
     if (index < 0) {
         LOGE("ERR(%s):Fail on SecCamera->getPreview()", __func__);
@@ -650,16 +787,9 @@ int CameraHardwareSec::previewThread()
     }
 
 #ifdef ZERO_SHUTTER_LAG
-    if (mUseInternalISP && !mRecordHint) {
-        mCapIndex = mSecCamera->getSnapshot();
-
-        if (mCapIndex >= 0) {
-            if (mSecCamera->setSnapshotFrame(mCapIndex) < 0) {
-                LOGE("%s: Fail qbuf, index(%d)", __func__, mCapIndex);
-                return INVALID_OPERATION;
-            }
-        }
-    }
+    /* keep the full size frame around for a shutter press */
+    if (mUseInternalISP && !mRecordHint)
+        mSecCamera->putZslFrame();
 #endif
 
     mSkipFrameLock.lock();
@@ -675,103 +805,89 @@ int CameraHardwareSec::previewThread()
     }
     mSkipFrameLock.unlock();
 
-    timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
-
-    int width, height, frame_size, offset;
-
-    mSecCamera->getPreviewSize(&width, &height, &frame_size);
-
-    offset = frame_size * index;
-
-    if (mPreviewWindow && mGrallocHal && mPreviewRunning) {
-        if (0 != mPreviewWindow->dequeue_buffer(mPreviewWindow, &mBufferHandle[numArray], &mStride[numArray])) {
-            LOGE("%s: Could not dequeue gralloc buffer[%d]!!", __func__, numArray);
-            goto callbacks;
-        }
-
-        if (!mGrallocHal->lock(mGrallocHal,
-                               *mBufferHandle[numArray],
-                               GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_YUV_ADDR,
-                               0, 0, width, height, virAddr)) {
-            char *frame = ((char *)mPreviewHeap->data) + offset;
-
-            int total = frame_size + mFrameSizeDelta;
-            int h = 0;
-            char *src = frame;
-
-            /* TODO : Need to fix size of planes for supported color fmt.
-                      Currnetly we support only YV12(3 plane) and NV21(2 plane)*/
-            // Y
-            memcpy(virAddr[0],src, width * height);
-            src += width * height;
+    /* the capture time of the frame, the wake up of this thread jitters */
+    if (mSecCamera->getPreviewBuffer(index, &previewBuf) < 0 || previewBuf.timestamp == 0)
+        previewBuf.timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    timestamp = previewBuf.timestamp;
+    mPreviewTrace->begin(index, previewBuf.sequence, timestamp);
+    mBench->previewFrame();
+
+
+    /* one reference for us, one for every stage the frame is pushed to */
+    mPipeLock.lock();
+    mPipeRef[index] = 1;
+    mPipeFaceSlot[index] = -1;
+#ifdef USE_PREVIEW_USERPTR
+    /*
+     * The window buffer goes to the display as is, callbacks need their own
+     * copy of it. The display stage makes it before the enqueue and hands
+     * the frame on to the callback stage, this thread only captures.
+     */
+    mPipeCopy[index] = mPreviewZeroCopy && (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME)
+                       && mPreviewBufHandle[index] != NULL && mPreviewWindow && mPreviewRunning;
+    copied = mPipeCopy[index];
+#endif
+    mPipeLock.unlock();
 
-            if (mPreviewFmtPlane == PREVIEW_FMT_2_PLANE) {
-                memcpy(virAddr[1], src, width * height / 2);
-            } else if (mPreviewFmtPlane == PREVIEW_FMT_3_PLANE) {
-                // U
-                memcpy(virAddr[1], src, width * height / 4);
-                src += width * height / 4;
+    if (facedata != NULL)
+        faces = queueFaceData(index);
 
-                // V
-                memcpy(virAddr[2], src, width * height / 4);
-            }
+    if (mPreviewWindow && mPreviewRunning) {
+        mPipeLock.lock();
+        mPipeRef[index]++;
+        mPipeLock.unlock();
 
-            mGrallocHal->unlock(mGrallocHal, **mBufferHandle);
-        }
-        else
-            LOGE("%s: could not obtain gralloc buffer", __func__);
+        if (!mPipeQueue[PIPE_DISPLAY]->push(index, timestamp, &dropped))
+            releasePreviewFrame(index);
+        if (0 <= dropped)
+            releasePreviewFrame(dropped);
+    }
 
-        if (mSecCamera->setPreviewFrame(index) < 0) {
-            LOGE("%s: Fail qbuf, index(%d)", __func__, index);
-            goto callbacks;
-        }
+    if (mPreviewRunning && !copied && ((mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) || faces)) {
+        mPipeLock.lock();
+        mPipeRef[index]++;
+        mPipeLock.unlock();
 
-        index = 0;
-        if (0 != mPreviewWindow->enqueue_buffer(mPreviewWindow, *mBufferHandle)) {
-            LOGE("Could not enqueue gralloc buffer!");
-            goto callbacks;
-        }
+        if (!mPipeQueue[PIPE_CALLBACK]->push(index, timestamp, &dropped))
+            releasePreviewFrame(index);
+        if (0 <= dropped)
+            releasePreviewFrame(dropped);
     }
 
-callbacks:
-    // Notify the client of a new frame.
-    if (mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME && mPreviewRunning)
-        mDataCb(CAMERA_MSG_PREVIEW_FRAME, mPreviewHeap, index, NULL, mCallbackCookie);
-
-#ifdef USE_FACE_DETECTION
-    if (mUseInternalISP && (mMsgEnabled & CAMERA_MSG_PREVIEW_METADATA) && mPreviewRunning)
-        mDataCb(CAMERA_MSG_PREVIEW_METADATA, mFaceDataHeap, 0, mFaceData, mCallbackCookie);
-#endif
+    releasePreviewFrame(index);
 
     Mutex::Autolock lock(mRecordLock);
     if (mRecordRunning == true) {
-        int recordingIndex = 0;
+        /* the encoder holds them all : no frame can come, don't wait for one */
+        if (countRecordOwner(RECORD_DRIVER) == 0 && !makeRecordRoom(1)) {
+            LOGW("%s: every record buffer is out, frame dropped", __func__);
+            mRecordBufLock.lock();
+            mRecordDrops++;
+            mRecordBufLock.unlock();
+            return NO_ERROR;
+        }
 
         index = mSecCamera->getRecordFrame();
         if (index < 0) {
             LOGE("ERR(%s):Fail on SecCamera->getRecordFrame()", __func__);
             return UNKNOWN_ERROR;
         }
+        setRecordOwner(index, RECORD_HAL);
 
 #ifdef VIDEO_SNAPSHOT
-        if (mUseInternalISP && mRecordHint) {
-            mCapIndex = mSecCamera->getSnapshot();
-
-            if (mSecCamera->setSnapshotFrame(mCapIndex) < 0) {
-                LOGE("%s: Fail qbuf, index(%d)", __func__, mCapIndex);
-                return INVALID_OPERATION;
-            }
-        }
+        /* the snapshot node is served by its own stage, the encoder never waits on it */
+        if (mUseInternalISP && mRecordHint)
+            mPipeQueue[PIPE_VIDEO_SNAPSHOT]->push(0, timestamp, &dropped);
 #endif
 
-        recordingIndex = index;
-        mSecCamera->getRecordAddr(index, &recordAddr);
+        ret = mSecCamera->getRecordAddr(index, &recordAddr);
 
         LOGV("record PhyY(0x%08x) phyC(0x%08x) ", recordAddr.phys.extP[0], recordAddr.phys.extP[1]);
 
-        if (recordAddr.phys.extP[0] == 0xffffffff || recordAddr.phys.extP[1] == 0xffffffff) {
+        if (ret < 0) {
             LOGE("ERR(%s):Fail on SecCamera getRectPhyAddr Y addr = %0x C addr = %0x", __func__,
                  recordAddr.phys.extP[0], recordAddr.phys.extP[1]);
+            returnRecordFrame(index);
             return UNKNOWN_ERROR;
         }
 
@@ -782,1022 +898,2868 @@ callbacks:
         addrs[index].addr_cbcr = recordAddr.phys.extP[1];
         addrs[index].buf_index = index;
 
-        // Notify the client of a new frame.
-        if (mMsgEnabled & CAMERA_MSG_VIDEO_FRAME)
-            mDataCbTimestamp(timestamp, CAMERA_MSG_VIDEO_FRAME,
-                             mRecordHeap[numArray], recordingIndex, mCallbackCookie);
-        else
-            mSecCamera->releaseRecordFrame(index);
+        if (recordAddr.timestamp == 0)
+            recordAddr.timestamp = timestamp;
+        mRecordTrace->begin(index, recordAddr.sequence, recordAddr.timestamp);
+
+        if (!(mMsgEnabled & CAMERA_MSG_VIDEO_FRAME)) {
+            returnRecordFrame(index);
+            return NO_ERROR;
+        }
+
+        /* the sensor keeps a few buffers to write into, whatever the encoder does */
+        if (countRecordOwner(RECORD_DRIVER) < RECORD_MIN_QUEUED && !makeRecordRoom(RECORD_MIN_QUEUED)) {
+            LOGV("%s: encoder is behind, dropping record frame(%d)", __func__, index);
+            mRecordBufLock.lock();
+            mRecordDrops++;
+            mRecordBufLock.unlock();
+            returnRecordFrame(index);
+            return NO_ERROR;
+        }
+
+        /* the encoder never waits behind a slow preview callback */
+        if (!mPipeQueue[PIPE_RECORD]->push(index, recordAddr.timestamp, &dropped)) {
+            mRecordBufLock.lock();
+            mRecordDrops++;
+            mRecordBufLock.unlock();
+            returnRecordFrame(index);
+        }
     }
 
     return NO_ERROR;
 }
 
-#ifdef IS_FW_DEBUG
-bool CameraHardwareSec::debugThread()
+bool CameraHardwareSec::stageThread(int stage)
 {
-    sleep(20);
+    nsecs_t timestamp;
+    int index;
 
-    LOGD("++ Firmware debug message starting");
-    mCurrWp = mIs_debug_ctrl.write_point;
-    mCurrOffset = mCurrWp - FIMC_IS_FW_DEBUG_REGION_ADDR;
-    if (mCurrWp != mPrevWp) {
-        *(char *)(mDebugVaddr + mCurrOffset + 1) = '\0';
-        if ((mCurrWp - mPrevWp) > 0) {
-            LOGD("%s", mDebugVaddr + mPrevOffset);
-        } else {
-            *(char *)(mDebugVaddr + FIMC_IS_FW_DEBUG_REGION_SIZE - 1) = '\0';
-            LOGD("%s", mDebugVaddr + mPrevOffset);
-            LOGD("%s", mDebugVaddr);
-        }
-    }
+    /* only aborted on release() */
+    index = mPipeQueue[stage]->pop(&timestamp);
+    if (index < 0)
+        return false;
+
+    nsecs_t cpu = SecCameraBench::threadTime();
+
+    switch (stage) {
+    case PIPE_DISPLAY:
+        displayFrame(index, timestamp);
+        break;
+    case PIPE_CALLBACK:
+        deliverFrame(index);
+        break;
+    case PIPE_RECORD:
+        deliverRecordFrame(index, timestamp);
+        break;
+    case PIPE_BURST_ENCODE:
+        encodeBurstFrame(index);
+        break;
+    case PIPE_BURST_DELIVER:
+        deliverBurstFrame(index);
+        break;
+    case PIPE_THUMBNAIL:
+        thumbnailFrame();
+        break;
+    case PIPE_VIDEO_SNAPSHOT:
+        feedVideoSnapshot();
+        break;
+    default:
+        break;
+    }
+
+    mBench->stageDone(stage, cpu);
+    mPipeQueue[stage]->done();
 
-    mPrevWp = mIs_debug_ctrl.write_point;
-    mPrevOffset = mPrevWp - FIMC_IS_FW_DEBUG_REGION_ADDR;
-    LOGD("-- Firmware debug message stop");
     return true;
 }
-#endif
 
-status_t CameraHardwareSec::startPreview()
+/* display stage : hand the frame to the preview window */
+void CameraHardwareSec::displayFrame(int index, nsecs_t timestamp)
 {
-    int ret = 0;
+    int width, height, frame_size;
+    buffer_handle_t *buf_handle;
+    int stride;
+    void *virAddr[3];
 
-    LOGV("%s :", __func__);
+#ifdef USE_PREVIEW_USERPTR
+    if (mPreviewZeroCopy) {
+        bool copy;
+        int dropped;
+
+        mPipeLock.lock();
+        buf_handle = mPreviewBufHandle[index];
+        copy = mPipeCopy[index];
+        mPipeCopy[index] = false;
+        if (buf_handle != NULL && mPreviewWindow != NULL && !mPipeStopping) {
+            mPreviewBufHandle[index] = NULL;
+            mSecCamera->setPreviewUserFrame(index, NULL);
+            if (copy)
+                mPipeRef[index]++;
+        } else {
+            buf_handle = NULL;
+            copy = false;
+        }
+        mPipeLock.unlock();
 
-    Mutex::Autolock lock(mStateLock);
-    if (mCaptureInProgress) {
-        LOGE("%s : capture in progress, not allowed", __func__);
-        return INVALID_OPERATION;
-    }
+        if (buf_handle != NULL) {
+            /* the display owns the buffer once it is enqueued */
+            if (copy)
+                copyCallbackFrame(index, buf_handle);
 
-    mPreviewLock.lock();
-    if (mPreviewRunning) {
-        // already running
-        LOGE("%s : preview thread already running", __func__);
-        mPreviewLock.unlock();
-        return INVALID_OPERATION;
-    }
+            if (0 != mPreviewWindow->enqueue_buffer(mPreviewWindow, buf_handle))
+                LOGE("Could not enqueue gralloc buffer[%d]!", index);
+            else
+                mPreviewTrace->mark(index, SecFrameTrace::DISPLAYED);
+        }
 
-    mPreviewRunning = true;
-    mPreviewStartDeferred = false;
+        if (copy) {
+            if (!mPipeQueue[PIPE_CALLBACK]->push(index, timestamp, &dropped))
+                releasePreviewFrame(index);
+            if (0 <= dropped)
+                releasePreviewFrame(dropped);
+        }
 
-    if (!mPreviewWindow &&
-            !(mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) &&
-            !(mMsgEnabled & CAMERA_MSG_VIDEO_FRAME)) {
-        LOGI("%s : deferring", __func__);
-        mPreviewStartDeferred = true;
-        mPreviewLock.unlock();
-        return NO_ERROR;
+        releasePreviewFrame(index);
+        return;
     }
+#endif
 
-    ret = startPreviewInternal();
-    if (ret == OK)
-        mPreviewCondition.signal();
+    if (mPreviewWindow == NULL || mGrallocHal == NULL || !mPreviewRunning) {
+        releasePreviewFrame(index);
+        return;
+    }
 
-    mPreviewLock.unlock();
-    return ret;
-}
+    mSecCamera->getPreviewSize(&width, &height, &frame_size);
 
-status_t CameraHardwareSec::startPreviewInternal()
-{
-    LOGV("%s", __func__);
-    int width, height, frame_size;
+    if (0 != mPreviewWindow->dequeue_buffer(mPreviewWindow, &buf_handle, &stride)) {
+        LOGE("%s: Could not dequeue gralloc buffer!!", __func__);
+        releasePreviewFrame(index);
+        return;
+    }
 
-    mSecCamera->getPreviewSize(&width, &height, &frame_size);
-    LOGD("mPreviewHeap(fd(%d), size(%d), width(%d), height(%d))",
-         mSecCamera->getCameraFd(SecCamera::PREVIEW), frame_size + mFrameSizeDelta, width, height);
+    if (!mGrallocHal->lock(mGrallocHal, *buf_handle,
+                           GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_YUV_ADDR,
+                           0, 0, width, height, virAddr)) {
+        char *frame = ((char *)mPreviewHeap->data) + frame_size * index;
 
-    int ret  = mSecCamera->startPreview();
-    LOGV("%s : mSecCamera->startPreview() returned %d", __func__, ret);
+        if (mPreviewLayout.stride != stride
+            || mPreviewLayout.width != width
+            || mPreviewLayout.height != height
+            || mPreviewLayout.format != mSecCamera->getPreviewPixelFormat())
+            negotiatePreviewLayout(stride);
 
-    if (ret < 0) {
-        LOGE("ERR(%s):Fail on mSecCamera->startPreview()", __func__);
-        return UNKNOWN_ERROR;
+        copyPreviewFrame(frame, virAddr);
+
+        mGrallocHal->unlock(mGrallocHal, *buf_handle);
+        /* the buffer may be captured into again before the enqueue returns */
+        mPreviewTrace->mark(index, SecFrameTrace::DISPLAYED);
     }
+    else
+        LOGE("%s: could not obtain gralloc buffer", __func__);
 
-    setSkipFrame(INITIAL_SKIP_FRAME);
+    /* the copy is done, the sensor may have its buffer back */
+    releasePreviewFrame(index);
 
-    if (mPreviewHeap) {
-        mPreviewHeap->release(mPreviewHeap);
-        mPreviewHeap = 0;
-    }
+    if (0 != mPreviewWindow->enqueue_buffer(mPreviewWindow, buf_handle))
+        LOGE("Could not enqueue gralloc buffer!");
+}
 
-    for(int i=0; i<BUFFER_COUNT_FOR_ARRAY; i++){
-        if (mRecordHeap[i] != NULL) {
-            mRecordHeap[i]->release(mRecordHeap[i]);
-            mRecordHeap[i] = 0;
-        }
+/* callback stage : preview frame and face metadata to the application */
+void CameraHardwareSec::deliverFrame(int index)
+{
+    if ((mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) && mPreviewRunning) {
+        mDataCb(CAMERA_MSG_PREVIEW_FRAME, mPreviewHeap, index, NULL, mCallbackCookie);
+        mPreviewTrace->mark(index, SecFrameTrace::DELIVERED);
     }
 
-    mPreviewHeap = mGetMemoryCb((int)mSecCamera->getCameraFd(SecCamera::PREVIEW),
-                                frame_size + mFrameSizeDelta,
-                                MAX_BUFFERS,
-                                0); // no cookie
+#ifdef USE_FACE_DETECTION
+    int slot;
 
-    mFaceDataHeap = mGetMemoryCb(-1, 1, 1, 0);
+    mPipeLock.lock();
+    slot = mPipeFaceSlot[index];
+    mPipeFaceSlot[index] = -1;
+    mPipeLock.unlock();
 
-    mSecCamera->getPostViewConfig(&mPostViewWidth, &mPostViewHeight, &mPostViewSize);
-    LOGV("CameraHardwareSec: mPostViewWidth = %d mPostViewHeight = %d mPostViewSize = %d",
-         mPostViewWidth,mPostViewHeight,mPostViewSize);
+    if (0 <= slot) {
+        bool delivered = false;
 
-#ifdef IS_FW_DEBUG
-    if (mUseInternalISP) {
-        int ret = mSecCamera->getDebugAddr(&mDebugVaddr);
-        if (ret < 0) {
-            LOGE("ERR(%s):Fail on SecCamera->getDebugAddr()", __func__);
-            return UNKNOWN_ERROR;
+        /* the slot stays busy until the application is done with it */
+        if ((mMsgEnabled & CAMERA_MSG_PREVIEW_METADATA) && mPreviewRunning) {
+            mDataCb(CAMERA_MSG_PREVIEW_METADATA, mFaceDataHeap, 0,
+                    &mFaceSlot[slot].meta, mCallbackCookie);
+            delivered = true;
         }
 
-        mIs_debug_ctrl.write_point = *((unsigned int *)(mDebugVaddr + FIMC_IS_FW_DEBUG_REGION_SIZE));
-        mIs_debug_ctrl.assert_flag = *((unsigned int *)(mDebugVaddr + FIMC_IS_FW_DEBUG_REGION_SIZE + 4));
-        mIs_debug_ctrl.pabort_flag = *((unsigned int *)(mDebugVaddr + FIMC_IS_FW_DEBUG_REGION_SIZE + 8));
-        mIs_debug_ctrl.dabort_flag = *((unsigned int *)(mDebugVaddr + FIMC_IS_FW_DEBUG_REGION_SIZE + 12));
+        mPipeLock.lock();
+        mFaceSlot[slot].busy = false;
+        if (delivered)
+            mFaceDelivered++;
+        else
+            mFaceLastCount = -1;
+        mPipeLock.unlock();
     }
 #endif
 
-    return NO_ERROR;
+    releasePreviewFrame(index);
 }
 
-void CameraHardwareSec::stopPreviewInternal()
+/*
+ * Faces of the frame just dequeued into a free slot for the callback stage,
+ * false when they did not change or no slot is free. A frame that found no
+ * slot leaves mFaceLast alone, the next one tries again.
+ */
+bool CameraHardwareSec::queueFaceData(int index)
 {
-    LOGV("%s :", __func__);
+    int count = mFaceScan.number_of_faces;
+    int slot;
 
-    /* request that the preview thread stop. */
-    if (mPreviewRunning) {
-        mPreviewRunning = false;
-        if (!mPreviewStartDeferred) {
-            mPreviewCondition.signal();
-            /* wait until preview thread is stopped */
-            mPreviewStoppedCondition.wait(mPreviewLock);
+    if (count < 0)
+        count = 0;
+    if (FD_MAX_FACES < count)
+        count = FD_MAX_FACES;
 
-        }
-        else
-            LOGV("%s : preview running but deferred, doing nothing", __func__);
-    } else
-        LOGI("%s : preview not running, doing nothing", __func__);
+    Mutex::Autolock lock(mPipeLock);
+
+    if (count == mFaceLastCount &&
+        !memcmp(mFaceLast, mFaceScanFace, sizeof(camera_face_t) * count)) {
+        mFaceUnchanged++;
+        return false;
+    }
+
+    for (slot = 0; slot < FACE_META_SLOTS; slot++) {
+        if (!mFaceSlot[slot].busy)
+            break;
+    }
+    if (slot == FACE_META_SLOTS) {
+        mFaceNoSlot++;
+        return false;
+    }
+
+    memcpy(mFaceSlot[slot].face, mFaceScanFace, sizeof(camera_face_t) * count);
+    mFaceSlot[slot].meta.number_of_faces = count;
+    mFaceSlot[slot].meta.faces = mFaceSlot[slot].face;
+    mFaceSlot[slot].busy = true;
+    mPipeFaceSlot[index] = slot;
+
+    memcpy(mFaceLast, mFaceScanFace, sizeof(camera_face_t) * count);
+    mFaceLastCount = count;
+
+    return true;
 }
 
-void CameraHardwareSec::stopPreview()
+/* record stage : the encoder gets the frame, it returns it through releaseRecordingFrame() */
+void CameraHardwareSec::deliverRecordFrame(int index, nsecs_t timestamp)
 {
-    LOGV("%s :", __func__);
-
-    /* request that the preview thread stop. */
-    mPreviewLock.lock();
-    stopPreviewInternal();
-    mPreviewLock.unlock();
+    if (mRecordRunning && (mMsgEnabled & CAMERA_MSG_VIDEO_FRAME)) {
+        mRecordTrace->mark(index, SecFrameTrace::RECORDED);
+        setRecordOwner(index, RECORD_ENCODER);
+        mDataCbTimestamp(timestamp, CAMERA_MSG_VIDEO_FRAME,
+                         mRecordHeap[0], index, mCallbackCookie);
+    } else
+        returnRecordFrame(index);
 }
 
-bool CameraHardwareSec::previewEnabled()
+/* Record buffers all go to the driver with startRecord(), the stats start over */
+void CameraHardwareSec::resetRecordOwners(void)
 {
-    Mutex::Autolock lock(mPreviewLock);
-    LOGV("%s : %d", __func__, mPreviewRunning);
-    return mPreviewRunning;
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    Mutex::Autolock lock(mRecordBufLock);
+
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        mRecordOwner[i] = RECORD_DRIVER;
+        mRecordSince[i] = now;
+    }
+    memset(mRecordHold, 0, sizeof(mRecordHold));
+    mRecordDrops = 0;
+    mRecordThrottled = 0;
+    mRecordThrottleTime = 0;
 }
 
-status_t CameraHardwareSec::startRecording()
+/* Record buffer index moves to owner, the time with the last one is accounted */
+void CameraHardwareSec::setRecordOwner(int index, int owner)
 {
-    LOGV("%s :", __func__);
+    struct record_hold *hold;
+    nsecs_t now, held;
 
-    Mutex::Autolock lock(mRecordLock);
+    if (index < 0 || MAX_BUFFERS <= index)
+        return;
 
-    for(int i = 0; i<BUFFER_COUNT_FOR_ARRAY; i++){
-        if (mRecordHeap[i] != NULL) {
-            mRecordHeap[i]->release(mRecordHeap[i]);
-            mRecordHeap[i] = 0;
-        }
+    now = systemTime(SYSTEM_TIME_MONOTONIC);
 
-        mRecordHeap[i] = mGetMemoryCb(-1, sizeof(struct addrs), MAX_BUFFERS, NULL);
-        if (!mRecordHeap[i]) {
-            LOGE("ERR(%s): Record heap[%d] creation fail", __func__, i);
-            return UNKNOWN_ERROR;
-        }
-    }
+    Mutex::Autolock lock(mRecordBufLock);
 
-    LOGV("mRecordHeaps alloc done");
+    if (mRecordOwner[index] == owner)
+        return;
 
-    if (mRecordRunning == false) {
-        if (mSecCamera->startRecord(mRecordHint) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->startRecord()", __func__);
-            return UNKNOWN_ERROR;
-        }
-        mRecordRunning = true;
-    }
-    return NO_ERROR;
+    hold = &mRecordHold[mRecordOwner[index]];
+    held = now - mRecordSince[index];
+    hold->count++;
+    hold->sum += held;
+    if (hold->max < held)
+        hold->max = held;
+
+    mRecordOwner[index] = owner;
+    mRecordSince[index] = now;
+
+    if (owner == RECORD_DRIVER)
+        mRecordBufCondition.broadcast();
 }
 
-void CameraHardwareSec::stopRecording()
+int CameraHardwareSec::countRecordOwner(int owner)
 {
-    LOGV("%s :", __func__);
+    int count = 0;
 
-    Mutex::Autolock lock(mRecordLock);
+    Mutex::Autolock lock(mRecordBufLock);
 
-    if (mRecordRunning == true) {
-        if (mSecCamera->stopRecord() < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->stopRecord()", __func__);
-            return;
-        }
-        mRecordRunning = false;
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        if (mRecordOwner[i] == owner)
+            count++;
     }
-}
-
-bool CameraHardwareSec::recordingEnabled()
-{
-    LOGV("%s :", __func__);
-    LOGV("%s : %d", __func__, mPreviewRunning);
 
-    return mRecordRunning;
+    return count;
 }
 
-void CameraHardwareSec::releaseRecordingFrame(const void *opaque)
+/* Record buffer index goes back to the driver, from whoever had it */
+void CameraHardwareSec::returnRecordFrame(int index)
 {
-    struct addrs *addrs = (struct addrs *)opaque;
-    mSecCamera->releaseRecordFrame(addrs->buf_index);
+    if (mRecordTrace != NULL)
+        mRecordTrace->mark(index, SecFrameTrace::RELEASED);
+    mSecCamera->releaseRecordFrame(index);
+    setRecordOwner(index, RECORD_DRIVER);
 }
 
-int CameraHardwareSec::autoFocusThread()
+/*
+ * The driver is down to less than want record buffers because the
+ * encoder is behind. Applies mRecordPolicy, returns true when the driver
+ * has want buffers again. A false return leaves the new frame to be dropped.
+ */
+bool CameraHardwareSec::makeRecordRoom(int want)
 {
-    int count =0;
-    int af_status =0 ;
+    int index;
+    nsecs_t start;
+
+    switch (mRecordPolicy) {
+    case RECORD_DROP_OLDEST:
+        /* only frames still waiting for the record stage can be taken back */
+        while (countRecordOwner(RECORD_DRIVER) < want) {
+            if (mPipeQueue[PIPE_RECORD]->flush(&index, 1) == 0)
+                return false;
+
+            mRecordBufLock.lock();
+            mRecordDrops++;
+            mRecordBufLock.unlock();
+            returnRecordFrame(index);
+        }
+        return true;
 
-    LOGV("%s : starting", __func__);
+    case RECORD_THROTTLE: {
+        nsecs_t deadline;
 
-    /* block until we're told to start.  we don't want to use
-     * a restartable thread and requestExitAndWait() in cancelAutoFocus()
-     * because it would cause deadlock between our callbacks and the
-     * caller of cancelAutoFocus() which both want to grab the same lock
-     * in CameraServices layer.
-     */
-    mFocusLock.lock();
-    /* check early exit request */
-    if (mExitAutoFocusThread) {
-        mFocusLock.unlock();
-        LOGV("%s : exiting on request0", __func__);
-        return NO_ERROR;
-    }
-    mFocusCondition.wait(mFocusLock);
-    /* check early exit request */
-    if (mExitAutoFocusThread) {
-        mFocusLock.unlock();
-        LOGV("%s : exiting on request1", __func__);
-        return NO_ERROR;
-    }
-    mFocusLock.unlock();
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        deadline = start + milliseconds(RECORD_THROTTLE_MS);
 
-    /* TODO : Currently only possible auto focus at BACK caemra
-              We need to modify to check that sensor can support auto focus */
-    if (mCameraID == SecCamera::CAMERA_ID_BACK) {
-        LOGV("%s : calling setAutoFocus", __func__);
-        if (mTouched == 0) {
-            if (mSecCamera->setAutofocus() < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setAutofocus()", __func__);
-                return UNKNOWN_ERROR;
-            }
-        } else {
-            if (mSecCamera->setTouchAF() < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setAutofocus()", __func__);
-                return UNKNOWN_ERROR;
-            }
-        }
-    }
+        Mutex::Autolock lock(mRecordBufLock);
 
-    /* TODO */
-    /* This is temperary implementation.
-       When camera support AF blocking mode, this code will be removed
-       Continous AutoFocus is not need to success */
-    const char *focusModeStr = mParameters.get(CameraParameters::KEY_FOCUS_MODE);
-    int isContinousAF = !strncmp(focusModeStr, CameraParameters::FOCUS_MODE_CONTINUOUS_VIDEO, 7);
-    if (mUseInternalISP && !isContinousAF) {
-        int i, err = -1;
-        for (i = 0; i < 400; i++) {
-           usleep(10000);
+        mRecordThrottled++;
+        for (;;) {
+            int count = 0;
+            nsecs_t now;
 
-           af_status = mSecCamera->getAutoFocusResult();
+            for (int i = 0; i < MAX_BUFFERS; i++) {
+                if (mRecordOwner[i] == RECORD_DRIVER)
+                    count++;
+            }
 
-           if ((af_status & 0x2)) {
-               err = 0;
-               break;
-           }
-        }
-    } else {
-        af_status = mSecCamera->getAutoFocusResult();
-    }
+            now = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (want <= count || deadline <= now) {
+                mRecordThrottleTime += now - start;
+                return want <= count;
+            }
 
-    if (af_status == 0x01) {
-        LOGV("%s : AF Cancelled !!", __func__);
-        if (mMsgEnabled & CAMERA_MSG_FOCUS)
-            mNotifyCb(CAMERA_MSG_FOCUS, true, 0, mCallbackCookie);
-    } else if (af_status == 0x02) {
-        LOGV("%s : AF Success !!", __func__);
-        if (mMsgEnabled & CAMERA_MSG_FOCUS) {
-            /* CAMERA_MSG_FOCUS only takes a bool.  true for
-             * finished and false for failure.  cancel is still
-             * considered a true result.
-             */
-            mNotifyCb(CAMERA_MSG_FOCUS, true, 0, mCallbackCookie);
+            mRecordBufCondition.waitRelative(mRecordBufLock, deadline - now);
         }
-    } else {
-        LOGV("%s : AF Fail !!", __func__);
-        LOGV("%s : mMsgEnabled = 0x%x", __func__, mMsgEnabled);
-        if (mMsgEnabled & CAMERA_MSG_FOCUS)
-            mNotifyCb(CAMERA_MSG_FOCUS, false, 0, mCallbackCookie);
     }
 
-    LOGV("%s : exiting with no error", __func__);
-    return NO_ERROR;
+    case RECORD_DROP_NEWEST:
+    default:
+        return false;
+    }
 }
 
-status_t CameraHardwareSec::autoFocus()
+/*
+ * Video snapshot stage : move the full size frames of the snapshot node
+ * into the ZSL ring, where takePicture() picks the latest one. A tick
+ * that found the stage busy is gone, so it takes all frames that are ready.
+ */
+void CameraHardwareSec::feedVideoSnapshot(void)
 {
-    LOGV("%s :", __func__);
-    /* signal autoFocusThread to run once */
-    mFocusCondition.signal();
-    return NO_ERROR;
+#ifdef VIDEO_SNAPSHOT
+    if (!mRecordRunning || mSecCamera->putZslFrame() < 0)
+        return;
+
+    while (mRecordRunning && 0 <= mSecCamera->putZslFrame(0))
+        ;
+#endif
 }
 
-status_t CameraHardwareSec::cancelAutoFocus()
+/*
+ * Drop one reference on a preview buffer. The last one gives it back to
+ * the sensor, unless the pipeline is being torn down. What to do is decided
+ * under mPipeLock, the window and the driver calls, which may block, are
+ * made after it.
+ */
+void CameraHardwareSec::releasePreviewFrame(int index)
 {
-    LOGV("%s :", __func__);
+    bool requeue = false;
+    unsigned int refill = 0;
 
-    if (mSecCamera->cancelAutofocus() < 0) {
-        LOGE("ERR(%s):Fail on mSecCamera->cancelAutofocus()", __func__);
-        return UNKNOWN_ERROR;
+    mPipeLock.lock();
+
+    if (index < 0 || MAX_BUFFERS <= index || mPipeRef[index] <= 0) {
+        mPipeLock.unlock();
+        LOGE("%s: index(%d) is not in the pipeline", __func__, index);
+        return;
     }
 
-    return NO_ERROR;
-}
+    if (--mPipeRef[index] > 0) {
+        mPipeLock.unlock();
+        return;
+    }
 
-int CameraHardwareSec::save_jpeg( unsigned char *real_jpeg, int jpeg_size)
-{
-    FILE *yuv_fp = NULL;
-    char filename[100], *buffer = NULL;
+    /* the callback stage dropped it, publish the faces again with a later frame */
+    if (0 <= mPipeFaceSlot[index]) {
+        mFaceSlot[mPipeFaceSlot[index]].busy = false;
+        mPipeFaceSlot[index] = -1;
+        mFaceLastCount = -1;
+    }
 
-    /* file create/open, note to "wb" */
-    yuv_fp = fopen("/data/camera_dump.jpeg", "wb");
-    if (yuv_fp == NULL) {
-        LOGE("Save jpeg file open error");
-        return -1;
+    if (mPipeStopping) {
+        mPipeLock.unlock();
+        return;
     }
 
-    LOGV("[BestIQ]  real_jpeg size ========>  %d", jpeg_size);
-    buffer = (char *) malloc(jpeg_size);
-    if (buffer == NULL) {
-        LOGE("Save YUV] buffer alloc failed");
-        if (yuv_fp)
-            fclose(yuv_fp);
+    mPreviewTrace->mark(index, SecFrameTrace::RELEASED);
 
-        return -1;
+#ifdef USE_PREVIEW_USERPTR
+    /* no window buffer left in it : it was displayed, refill the empty slots */
+    if (mPreviewZeroCopy && mPreviewBufHandle[index] == NULL) {
+        for (int i = 0; i < mPreviewBufCount; i++) {
+            if (mPreviewBufHandle[i] == NULL && mPipeRef[i] == 0
+                && !(mPreviewRefilling & (1 << i)))
+                refill |= 1 << i;
+        }
+        /* another release must not dequeue a buffer for the same slot */
+        mPreviewRefilling |= refill;
+    } else
+#endif
+        requeue = true;
+
+    mPipeLock.unlock();
+
+    if (requeue && mSecCamera->setPreviewFrame(index) < 0)
+        LOGE("%s: Fail qbuf, index(%d)", __func__, index);
+
+#ifdef USE_PREVIEW_USERPTR
+    if (refill == 0)
+        return;
+
+    for (int i = 0; i < mPreviewBufCount; i++) {
+        if ((refill & (1 << i)) && queuePreviewBuffer(i) < 0)
+            break;
     }
 
-    memcpy(buffer, real_jpeg, jpeg_size);
+    mPipeLock.lock();
+    mPreviewRefilling &= ~refill;
+    mPipeLock.unlock();
+#endif
+}
 
-    fflush(stdout);
+/*
+ * Called by the preview thread before the sensor stops : empty the queues
+ * and wait for the frame each stage is working on, so no stage touches a
+ * buffer once the camera unmapped it.
+ */
+void CameraHardwareSec::stopPipeline(void)
+{
+    int index[FRAME_QUEUE_MAX_DEPTH];
+    int count;
 
-    fwrite(buffer, 1, jpeg_size, yuv_fp);
+    mPipeLock.lock();
+    mPipeStopping = true;
+    mPipeLock.unlock();
 
-    fflush(yuv_fp);
+    for (int stage = 0; stage < PIPE_PREVIEW_MAX; stage++) {
+        count = mPipeQueue[stage]->flush(index, FRAME_QUEUE_MAX_DEPTH);
 
-    if (yuv_fp)
-            fclose(yuv_fp);
-    if (buffer)
-            free(buffer);
+        for (int i = 0; i < count; i++) {
+            if (stage == PIPE_RECORD)
+                returnRecordFrame(index[i]);
+            else
+                releasePreviewFrame(index[i]);
+        }
 
-    return 0;
+        mPipeQueue[stage]->waitIdle();
+    }
+
+    mPipeLock.lock();
+    memset(mPipeRef, 0, sizeof(mPipeRef));
+#ifdef USE_PREVIEW_USERPTR
+    memset(mPipeCopy, 0, sizeof(mPipeCopy));
+#endif
+    for (int i = 0; i < FACE_META_SLOTS; i++)
+        mFaceSlot[i].busy = false;
+    memset(mPipeFaceSlot, -1, sizeof(mPipeFaceSlot));
+    mFaceLastCount = -1;
+    mPipeStopping = false;
+    mPipeLock.unlock();
 }
 
-void CameraHardwareSec::save_postview(const char *fname, uint8_t *buf, uint32_t size)
+/*
+ * Work out once per configuration how each plane of a camera frame, packed
+ * line after line, lands in a window buffer of the given stride.
+ */
+void CameraHardwareSec::negotiatePreviewLayout(int stride)
 {
-    int nw;
-    int cnt = 0;
-    uint32_t written = 0;
+    struct preview_layout *layout = &mPreviewLayout;
+    int width, height, frame_size;
+    int y_size;
 
-    LOGD("opening file [%s]", fname);
-    int fd = open(fname, O_RDWR | O_CREAT);
-    if (fd < 0) {
-        LOGE("failed to create file [%s]: %s", fname, strerror(errno));
+    mSecCamera->getPreviewSize(&width, &height, &frame_size);
+
+    memset(layout, 0, sizeof(*layout));
+    layout->width  = width;
+    layout->height = height;
+    layout->format = mSecCamera->getPreviewPixelFormat();
+    layout->stride = stride;
+
+    y_size = width * height;
+
+    layout->plane[0].src_offset = 0;
+    layout->plane[0].src_stride = width;
+    layout->plane[0].dst_stride = stride;
+    layout->plane[0].line       = width;
+    layout->plane[0].lines      = height;
+
+    switch (layout->format) {
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_NV12:
+        layout->planes = 2;
+        layout->plane[1].src_offset = y_size;
+        layout->plane[1].src_stride = width;
+        layout->plane[1].dst_stride = stride;
+        layout->plane[1].line       = width;
+        layout->plane[1].lines      = height / 2;
+        break;
+    case V4L2_PIX_FMT_YVU420:
+    case V4L2_PIX_FMT_YUV420:
+        /* YV12 : chroma lines are half the luma stride, aligned to 16 */
+        layout->planes = 3;
+        for (int i = 1; i < 3; i++) {
+            layout->plane[i].src_offset = y_size + (i - 1) * (y_size / 4);
+            layout->plane[i].src_stride = width / 2;
+            layout->plane[i].dst_stride = ALIGN(stride / 2, 16);
+            layout->plane[i].line       = width / 2;
+            layout->plane[i].lines      = height / 2;
+        }
+        break;
+    case V4L2_PIX_FMT_YUV422P:
+        layout->planes = 3;
+        for (int i = 1; i < 3; i++) {
+            layout->plane[i].src_offset = y_size + (i - 1) * (y_size / 2);
+            layout->plane[i].src_stride = width / 2;
+            layout->plane[i].dst_stride = ALIGN(stride / 2, 16);
+            layout->plane[i].line       = width / 2;
+            layout->plane[i].lines      = height;
+        }
+        break;
+    case V4L2_PIX_FMT_YUYV:
+        /* yuv422i previews into a YV12 window, converted while copying */
+        layout->planes  = 3;
+        layout->convert = 1;
+        layout->plane[0].src_stride = width * 2;
+        for (int i = 1; i < 3; i++)
+            layout->plane[i].dst_stride = ALIGN(stride / 2, 16);
+        break;
+    case V4L2_PIX_FMT_RGB565:
+        layout->planes = 1;
+        layout->plane[0].src_stride = width * 2;
+        layout->plane[0].dst_stride = stride * 2;
+        layout->plane[0].line       = width * 2;
+        break;
+    case V4L2_PIX_FMT_RGB32:
+        layout->planes = 1;
+        layout->plane[0].src_stride = width * 4;
+        layout->plane[0].dst_stride = stride * 4;
+        layout->plane[0].line       = width * 4;
+        break;
+    default:
+        /* tiled and friends have no line layout to follow */
+        layout->planes = 0;
+        break;
+    }
+
+    LOGV("%s: %dx%d format(0x%x) stride(%d) planes(%d)",
+         __func__, width, height, layout->format, stride, layout->planes);
+}
+
+void CameraHardwareSec::copyPreviewFrame(char *frame, void **virAddr)
+{
+    struct preview_layout *layout = &mPreviewLayout;
+
+    if (layout->planes == 0) {
+        memcpy(virAddr[0], frame, layout->width * layout->height);
         return;
     }
 
-    LOGD("writing %d bytes to file [%s]", size, fname);
-    while (written < size) {
-        nw = ::write(fd, buf + written, size - written);
-        if (nw < 0) {
-            LOGE("failed to write to file %d [%s]: %s",written,fname, strerror(errno));
-            break;
-        }
-        written += nw;
-        cnt++;
+    /* YV12 : Cr plane first */
+    if (layout->convert) {
+        csc_YUV422I_to_YUV420((unsigned char *)virAddr[0],
+                              (unsigned char *)virAddr[2], (unsigned char *)virAddr[1],
+                              (unsigned char *)frame, layout->width, layout->height,
+                              layout->plane[0].src_stride, layout->plane[0].dst_stride,
+                              layout->plane[1].dst_stride,
+                              CSC_YUV422I_YUYV | CSC_YUV420_PLANAR);
+        return;
+    }
+
+    for (int i = 0; i < layout->planes; i++) {
+        struct preview_plane *plane = &layout->plane[i];
+
+        SW_Copy_Plane((unsigned char *)virAddr[i], plane->dst_stride,
+                      (unsigned char *)frame + plane->src_offset, plane->src_stride,
+                      plane->line, plane->lines);
     }
-    LOGD("done writing %d bytes to file [%s] in %d passes",size, fname, cnt);
-    ::close(fd);
 }
 
-bool CameraHardwareSec::scaleDownYuv422(char *srcBuf, uint32_t srcWidth, uint32_t srcHeight,
-                                        char *dstBuf, uint32_t dstWidth, uint32_t dstHeight)
+#ifdef USE_PREVIEW_USERPTR
+/*
+ * Hand the window buffers to the camera as capture buffers so preview
+ * frames are never copied. Needs physically contiguous, tightly packed
+ * NV21 or YV12 buffers; anything else keeps the copying path.
+ */
+bool CameraHardwareSec::registerPreviewBuffers(void)
 {
-    int32_t step_x, step_y;
-    int32_t iXsrc, iXdst;
-    int32_t x, y, src_y_start_pos, dst_pos, src_pos;
+    int fmt = mSecCamera->getPreviewPixelFormat();
 
-    if (dstWidth % 2 != 0 || dstHeight % 2 != 0) {
-        LOGE("scale_down_yuv422: invalid width, height for scaling");
+    mPreviewZeroCopy = false;
+    mPreviewBufCount = 0;
+
+    if (mPreviewWindow == NULL || mGrallocHal == NULL || mGrallocHal->getphys == NULL
+        || (fmt != V4L2_PIX_FMT_NV21 && fmt != V4L2_PIX_FMT_YVU420)
+        || BUFFER_COUNT_FOR_GRALLOC - mPreviewMinUndequeued < 2) {
+        mSecCamera->setPreviewUserPtr(0);
         return false;
     }
 
-    step_x = srcWidth / dstWidth;
-    step_y = srcHeight / dstHeight;
-
-    dst_pos = 0;
-    for (uint32_t y = 0; y < dstHeight; y++) {
-        src_y_start_pos = (y * step_y * (srcWidth * 2));
+    if (mSecCamera->setPreviewUserPtr(1) < 0)
+        return false;
 
-        for (uint32_t x = 0; x < dstWidth; x += 2) {
-            src_pos = src_y_start_pos + (x * (step_x * 2));
+    mPreviewBufCount = BUFFER_COUNT_FOR_GRALLOC - mPreviewMinUndequeued;
 
-            dstBuf[dst_pos++] = srcBuf[src_pos    ];
-            dstBuf[dst_pos++] = srcBuf[src_pos + 1];
-            dstBuf[dst_pos++] = srcBuf[src_pos + 2];
-            dstBuf[dst_pos++] = srcBuf[src_pos + 3];
+    for (int i = 0; i < mPreviewBufCount; i++) {
+        if (queuePreviewBuffer(i) < 0) {
+            LOGW("%s: window buffers unusable, copying preview frames", __func__);
+            cancelPreviewBuffers();
+            mSecCamera->setPreviewUserPtr(0);
+            mPreviewBufCount = 0;
+            return false;
         }
     }
 
+    mPreviewZeroCopy = true;
+
     return true;
 }
 
-bool CameraHardwareSec::YUY2toNV21(void *srcBuf, void *dstBuf, uint32_t srcWidth, uint32_t srcHeight)
+int CameraHardwareSec::queuePreviewBuffer(int index)
 {
-    int32_t        x, y, src_y_start_pos, dst_cbcr_pos, dst_pos, src_pos;
-    unsigned char *srcBufPointer = (unsigned char *)srcBuf;
-    unsigned char *dstBufPointer = (unsigned char *)dstBuf;
+    struct preview_layout *layout = &mPreviewLayout;
+    buffer_handle_t *buf_handle;
+    int stride;
+    void *paddr[3];
+    SecBuffer buf;
+    int width, height, frame_size;
+    bool packed;
+
+    mSecCamera->getPreviewSize(&width, &height, &frame_size);
 
-    dst_pos = 0;
-    dst_cbcr_pos = srcWidth*srcHeight;
-    for (uint32_t y = 0; y < srcHeight; y++) {
-        src_y_start_pos = (y * (srcWidth * 2));
+    if (0 != mPreviewWindow->dequeue_buffer(mPreviewWindow, &buf_handle, &stride)) {
+        LOGE("%s: Could not dequeue gralloc buffer[%d]!!", __func__, index);
+        return -1;
+    }
 
-        for (uint32_t x = 0; x < (srcWidth * 2); x += 2) {
-            src_pos = src_y_start_pos + x;
+    if (layout->stride != stride
+        || layout->width != width
+        || layout->height != height
+        || layout->format != mSecCamera->getPreviewPixelFormat())
+        negotiatePreviewLayout(stride);
 
-            dstBufPointer[dst_pos++] = srcBufPointer[src_pos];
-        }
+    /*
+     * The camera writes every plane packed, line after line, into contiguous
+     * memory. The window must lay them out the same, YV12 chroma lines are
+     * aligned to 16 and only fit when width / 2 already is.
+     */
+    packed = (layout->planes != 0 && !layout->convert);
+    for (int i = 0; i < layout->planes; i++) {
+        if (layout->plane[i].dst_stride != layout->plane[i].src_stride)
+            packed = false;
+    }
+
+    if (!packed
+        || mGrallocHal->getphys(mGrallocHal, *buf_handle, paddr) != 0
+        || paddr[0] == NULL) {
+        LOGE("%s: gralloc buffer[%d] can not be captured into (stride %d, width %d)",
+             __func__, index, stride, width);
+        mPreviewWindow->cancel_buffer(mPreviewWindow, buf_handle);
+        return -1;
     }
-    for (uint32_t y = 0; y < srcHeight; y += 2) {
-        src_y_start_pos = (y * (srcWidth * 2));
 
-        for (uint32_t x = 0; x < (srcWidth * 2); x += 4) {
-            src_pos = src_y_start_pos + x;
+    buf.phys.extP[0] = (unsigned int)paddr[0];
+    buf.phys.extP[1] = (unsigned int)paddr[1];
+    buf.size.extS[0] = width * height;
 
-            dstBufPointer[dst_cbcr_pos++] = srcBufPointer[src_pos + 3];
-            dstBufPointer[dst_cbcr_pos++] = srcBufPointer[src_pos + 1];
-        }
+    if (mSecCamera->getPreviewPixelFormat() == V4L2_PIX_FMT_NV21) {
+        buf.size.extS[1] = width * height / 2;
+    } else {
+        buf.phys.extP[2] = (unsigned int)paddr[2];
+        buf.size.extS[1] = width * height / 4;
+        buf.size.extS[2] = width * height / 4;
     }
 
-    return true;
+    mPreviewBufHandle[index] = buf_handle;
+
+    if (mSecCamera->setPreviewUserFrame(index, &buf) < 0) {
+        LOGE("%s: Fail qbuf, index(%d)", __func__, index);
+        mPreviewBufHandle[index] = NULL;
+        mSecCamera->setPreviewUserFrame(index, NULL);
+        mPreviewWindow->cancel_buffer(mPreviewWindow, buf_handle);
+        return -1;
+    }
+
+    return 0;
 }
 
-int CameraHardwareSec::pictureThread()
+/* the preview frame in the window buffer, copied packed to the callback heap */
+void CameraHardwareSec::copyCallbackFrame(int index, buffer_handle_t *buf_handle)
 {
-    LOGV("%s :", __func__);
+    struct preview_layout *layout = &mPreviewLayout;
+    int width, height, frame_size;
+    void *virAddr[3];
 
-    int jpeg_size = 0;
-    int ret = NO_ERROR;
-    unsigned char *jpeg_data = NULL;
-    int postview_offset = 0;
-    unsigned char *postview_data = NULL;
+    mSecCamera->getPreviewSize(&width, &height, &frame_size);
 
-    unsigned char *addr = NULL;
-    int mPostViewWidth, mPostViewHeight, mPostViewSize;
-    int mThumbWidth, mThumbHeight, mThumbSize;
-    int cap_width, cap_height, cap_frame_size;
+    /* gralloc only flushes on unlock, what the sensor wrote may be behind old lines */
+    if (mSecCamera->syncPreviewFrame(index) < 0) {
+        LOGE("%s: could not sync frame[%d], no callback copy", __func__, index);
+        return;
+    }
 
-    int JpegImageSize = 0;
+    if (mGrallocHal->lock(mGrallocHal, *buf_handle,
+                          GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_YUV_ADDR,
+                          0, 0, width, height, virAddr)) {
+        LOGE("%s: could not lock gralloc buffer[%d]", __func__, index);
+        return;
+    }
 
-    mSecCamera->getPostViewConfig(&mPostViewWidth, &mPostViewHeight, &mPostViewSize);
-    mSecCamera->getThumbnailConfig(&mThumbWidth, &mThumbHeight, &mThumbSize);
-    int postviewHeapSize = mPostViewSize;
-    if (!mRecordRunning)
-        mSecCamera->getSnapshotSize(&cap_width, &cap_height, &cap_frame_size);
-    else
-        mSecCamera->getVideosnapshotSize(&cap_width, &cap_height, &cap_frame_size);
-    int mJpegHeapSize;
-    if (!mUseInternalISP)
-        mJpegHeapSize = cap_frame_size * SecCamera::getJpegRatio();
-    else
-        mJpegHeapSize = cap_frame_size;
-
-    LOGV("[5B] mPostViewWidth = %d mPostViewHeight = %d\n",mPostViewWidth,mPostViewHeight);
+    char *dst = ((char *)mPreviewHeap->data) + frame_size * index;
 
-    camera_memory_t *JpegHeap = mGetMemoryCb(-1, mJpegHeapSize, 1, 0);
-    mThumbnailHeap = new MemoryHeapBase(mThumbSize);
+    /* the window strides, as queuePreviewBuffer() found them */
+    for (int i = 0; i < layout->planes; i++) {
+        struct preview_plane *plane = &layout->plane[i];
 
-    if (mMsgEnabled & CAMERA_MSG_RAW_IMAGE) {
-        int picture_size, picture_width, picture_height;
-        mSecCamera->getSnapshotSize(&picture_width, &picture_height, &picture_size);
-        int picture_format = mSecCamera->getSnapshotPixelFormat();
+        SW_Copy_Plane((unsigned char *)dst, plane->src_stride,
+                      (unsigned char *)virAddr[i], plane->dst_stride,
+                      plane->line, plane->lines);
+        dst += plane->src_stride * plane->lines;
+    }
 
-        unsigned int thumb_addr, phyAddr;
+    mGrallocHal->unlock(mGrallocHal, *buf_handle);
+}
 
-        // Modified the shutter sound timing for Jpeg capture
-        if (!mUseInternalISP) {
-            mSecCamera->setSnapshotCmd();
+void CameraHardwareSec::cancelPreviewBuffers(void)
+{
+    for (int i = 0; i < MAX_BUFFERS; i++) {
+        if (mPreviewBufHandle[i] == NULL)
+            continue;
 
-            if (mMsgEnabled & CAMERA_MSG_SHUTTER)
-                mNotifyCb(CAMERA_MSG_SHUTTER, 0, 0, mCallbackCookie);
+        if (mPreviewWindow)
+            mPreviewWindow->cancel_buffer(mPreviewWindow, mPreviewBufHandle[i]);
 
-            jpeg_data = mSecCamera->getJpeg(&JpegImageSize, &mThumbSize, &thumb_addr, &phyAddr);
-            if (jpeg_data == NULL) {
-                LOGE("ERR(%s):Fail on SecCamera->getJpeg()", __func__);
-                ret = UNKNOWN_ERROR;
-            }
+        mPreviewBufHandle[i] = NULL;
+        mSecCamera->setPreviewUserFrame(i, NULL);
+    }
 
-            memcpy((unsigned char *)mThumbnailHeap->base(), (unsigned char *)thumb_addr, mThumbSize);
-            memcpy(JpegHeap->data, jpeg_data, JpegImageSize);
-        } else {
-            if (mMsgEnabled & CAMERA_MSG_SHUTTER)
-                mNotifyCb(CAMERA_MSG_SHUTTER, 0, 0, mCallbackCookie);
+    mPreviewZeroCopy = false;
+}
+#endif
 
-#ifdef ZERO_SHUTTER_LAG
-            mSecCamera->getCaptureAddr(mCapIndex, &mCapBuffer);
+#ifdef IS_FW_DEBUG
+bool CameraHardwareSec::debugThread()
+{
+    sleep(20);
 
-            if (mCapBuffer.virt.extP[0] == NULL) {
-                LOGE("ERR(%s):Fail on SecCamera getCaptureAddr = %0x ",
-                     __func__, mCapBuffer.virt.extP[0]);
-                return UNKNOWN_ERROR;
-            }
+    LOGD("++ Firmware debug message starting");
+    mCurrWp = mIs_debug_ctrl.write_point;
+    mCurrOffset = mCurrWp - FIMC_IS_FW_DEBUG_REGION_ADDR;
+    if (mCurrWp != mPrevWp) {
+        *(char *)(mDebugVaddr + mCurrOffset + 1) = '\0';
+        if ((mCurrWp - mPrevWp) > 0) {
+            LOGD("%s", mDebugVaddr + mPrevOffset);
+        } else {
+            *(char *)(mDebugVaddr + FIMC_IS_FW_DEBUG_REGION_SIZE - 1) = '\0';
+            LOGD("%s", mDebugVaddr + mPrevOffset);
+            LOGD("%s", mDebugVaddr);
+        }
+    }
 
-            scaleDownYuv422((char *)mCapBuffer.virt.extP[0], cap_width, cap_height,
-                            (char *)mThumbnailHeap->base(), mThumbWidth, mThumbHeight);
+    mPrevWp = mIs_debug_ctrl.write_point;
+    mPrevOffset = mPrevWp - FIMC_IS_FW_DEBUG_REGION_ADDR;
+    LOGD("-- Firmware debug message stop");
+    return true;
+}
 #endif
 
-            if (mSecCamera->getSnapshotAndJpeg(&mCapBuffer, mCapIndex,
-                    (unsigned char*)JpegHeap->data, &JpegImageSize) < 0) {
-                mStateLock.lock();
-                mCaptureInProgress = false;
-                mStateLock.unlock();
-                JpegHeap->release(JpegHeap);
-                return UNKNOWN_ERROR;
-            }
-            LOGI("snapshotandjpeg done");
+status_t CameraHardwareSec::startPreview()
+{
+    int ret = 0;
 
-#ifdef ZERO_SHUTTER_LAG
-            if (!mRecordRunning)
-                stopPreview();
-            memset(&mCapBuffer, 0, sizeof(struct SecBuffer));
-#else
-            scaleDownYuv422((char *)mCapBuffer.virt.extP[0], cap_width, cap_height,
-                            (char *)mThumbnailHeap->base(), mThumbWidth, mThumbHeight);
-#endif
-        }
+    LOGV("%s :", __func__);
+
+    Mutex::Autolock lock(mStateLock);
+    if (mCaptureInProgress) {
+        LOGE("%s : capture in progress, not allowed", __func__);
+        return INVALID_OPERATION;
     }
 
-    int rawHeapSize = cap_frame_size;
-    LOGV("mRawHeap : MemoryHeapBase(previewHeapSize(%d))", rawHeapSize);
-    mRawHeap = mGetMemoryCb((int)mSecCamera->getCameraFd(SecCamera::PICTURE), rawHeapSize, 1, 0);
-    if (!mRawHeap)
-        LOGE("ERR(%s): Raw heap creation fail", __func__);
+    mPreviewLock.lock();
+    if (mPreviewRunning) {
+        // already running
+        LOGE("%s : preview thread already running", __func__);
+        mPreviewLock.unlock();
+        return INVALID_OPERATION;
+    }
 
-    if (mMsgEnabled & CAMERA_MSG_RAW_IMAGE)
-        mDataCb(CAMERA_MSG_RAW_IMAGE, mRawHeap, 0, NULL, mCallbackCookie);
-    mStateLock.lock();
-    mCaptureInProgress = false;
-    mStateLock.unlock();
+    mPreviewRunning = true;
+    mPreviewStartDeferred = false;
 
-    if (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE) {
-        camera_memory_t *ExifHeap =
-            mGetMemoryCb(-1, EXIF_FILE_SIZE + mThumbSize, 1, 0);
+    if (!mPreviewWindow &&
+            !(mMsgEnabled & CAMERA_MSG_PREVIEW_FRAME) &&
+            !(mMsgEnabled & CAMERA_MSG_VIDEO_FRAME)) {
+        LOGI("%s : deferring", __func__);
+        mPreviewStartDeferred = true;
+        mPreviewLock.unlock();
+        return NO_ERROR;
+    }
 
-        int JpegExifSize = mSecCamera->getExif((unsigned char *)ExifHeap->data,
-                                           (unsigned char *)mThumbnailHeap->base(),
-                                            mThumbSize);
-        LOGV("JpegExifSize=%d", JpegExifSize);
+    ret = startPreviewInternal();
+    if (ret == OK)
+        mPreviewCondition.signal();
 
-        if (JpegExifSize < 0) {
-            ret = UNKNOWN_ERROR;
-            goto out;
-        }
+    mPreviewLock.unlock();
+    return ret;
+}
 
-        int mJpegHeapSize_out = JpegImageSize + JpegExifSize;
-        camera_memory_t *JpegHeap_out = mGetMemoryCb(-1, mJpegHeapSize_out, 1, 0);
+status_t CameraHardwareSec::startPreviewInternal()
+{
+    LOGV("%s", __func__);
+    int width, height, frame_size;
 
-        unsigned char *ExifStart = (unsigned char *)JpegHeap_out->data + 2;
-        unsigned char *ImageStart = ExifStart + JpegExifSize;
+    mBench->previewStart();
 
-        memcpy(JpegHeap_out->data, JpegHeap->data, 2);
-        memcpy(ExifStart, ExifHeap->data, JpegExifSize);
-        memcpy(ImageStart, JpegHeap->data + 2, JpegImageSize - 2);
+    mSecCamera->getPreviewSize(&width, &height, &frame_size);
+    LOGD("mPreviewHeap(fd(%d), size(%d), width(%d), height(%d))",
+         mSecCamera->getCameraFd(SecCamera::PREVIEW), frame_size + mFrameSizeDelta, width, height);
 
-        mDataCb(CAMERA_MSG_COMPRESSED_IMAGE, JpegHeap_out, 0, NULL, mCallbackCookie);
+#ifdef USE_PREVIEW_USERPTR
+    registerPreviewBuffers();
+#endif
 
-        if (ExifHeap) {
-            ExifHeap->release(ExifHeap);
-            ExifHeap = 0;
-        }
+    int ret  = mSecCamera->startPreview();
+    LOGV("%s : mSecCamera->startPreview() returned %d", __func__, ret);
 
-        if (JpegHeap_out) {
-            JpegHeap_out->release(JpegHeap_out);
-            JpegHeap_out = 0;
-        }
+    if (ret < 0) {
+        LOGE("ERR(%s):Fail on mSecCamera->startPreview()", __func__);
+#ifdef USE_PREVIEW_USERPTR
+        cancelPreviewBuffers();
+#endif
+        return UNKNOWN_ERROR;
     }
 
-    LOGV("%s : pictureThread end", __func__);
+    setSkipFrame(INITIAL_SKIP_FRAME);
 
-out:
-    if (JpegHeap) {
-        JpegHeap->release(JpegHeap);
-        JpegHeap = 0;
+    if (mPreviewHeap) {
+        mPreviewHeap->release(mPreviewHeap);
+        mPreviewHeap = 0;
     }
 
-    if (mRawHeap) {
-        mRawHeap->release(mRawHeap);
-        mRawHeap = 0;
+    for(int i=0; i<BUFFER_COUNT_FOR_ARRAY; i++){
+        if (mRecordHeap[i] != NULL) {
+            mRecordHeap[i]->release(mRecordHeap[i]);
+            mRecordHeap[i] = 0;
+        }
     }
 
-    if (!mUseInternalISP && !mRecordRunning)
-        mSecCamera->endSnapshot();
-
-    return ret;
-}
+#ifdef USE_PREVIEW_USERPTR
+    /* nothing to map from the camera, callback copies land in plain memory */
+    if (mPreviewZeroCopy)
+        mPreviewHeap = mGetMemoryCb(-1,
+                                    frame_size + mFrameSizeDelta,
+                                    MAX_BUFFERS,
+                                    0); // no cookie
+    else
+#endif
+    mPreviewHeap = mGetMemoryCb((int)mSecCamera->getCameraFd(SecCamera::PREVIEW),
+                                frame_size + mFrameSizeDelta,
+                                MAX_BUFFERS,
+                                0); // no cookie
 
-status_t CameraHardwareSec::takePicture()
-{
-    LOGV("%s :", __func__);
+    /* only there because mDataCb wants a heap with the metadata, one is enough */
+    if (mFaceDataHeap == NULL)
+        mFaceDataHeap = mGetMemoryCb(-1, 1, 1, 0);
 
-#ifdef ZERO_SHUTTER_LAG
-    if (!mUseInternalISP) {
-        stopPreview();
-    }
-#else
-    stopPreview();
-#endif
+    mSecCamera->getPostViewConfig(&mPostViewWidth, &mPostViewHeight, &mPostViewSize);
+    LOGV("CameraHardwareSec: mPostViewWidth = %d mPostViewHeight = %d mPostViewSize = %d",
+         mPostViewWidth,mPostViewHeight,mPostViewSize);
 
-    Mutex::Autolock lock(mStateLock);
-    if (mCaptureInProgress) {
-        LOGE("%s : capture already in progress", __func__);
-        return INVALID_OPERATION;
-    }
+#ifdef IS_FW_DEBUG
+    if (mUseInternalISP) {
+        int ret = mSecCamera->getDebugAddr(&mDebugVaddr);
+        if (ret < 0) {
+            LOGE("ERR(%s):Fail on SecCamera->getDebugAddr()", __func__);
+            return UNKNOWN_ERROR;
+        }
 
-    if (mPictureThread->run("CameraPictureThread", PRIORITY_DEFAULT) != NO_ERROR) {
-        LOGE("%s : couldn't run picture thread", __func__);
-        return INVALID_OPERATION;
+        mIs_debug_ctrl.write_point = *((unsigned int *)(mDebugVaddr + FIMC_IS_FW_DEBUG_REGION_SIZE));
+        mIs_debug_ctrl.assert_flag = *((unsigned int *)(mDebugVaddr + FIMC_IS_FW_DEBUG_REGION_SIZE + 4));
+        mIs_debug_ctrl.pabort_flag = *((unsigned int *)(mDebugVaddr + FIMC_IS_FW_DEBUG_REGION_SIZE + 8));
+        mIs_debug_ctrl.dabort_flag = *((unsigned int *)(mDebugVaddr + FIMC_IS_FW_DEBUG_REGION_SIZE + 12));
     }
-    mCaptureInProgress = true;
+#endif
 
     return NO_ERROR;
 }
 
-status_t CameraHardwareSec::cancelPicture()
+void CameraHardwareSec::stopPreviewInternal()
 {
-    LOGV("%s", __func__);
+    LOGV("%s :", __func__);
 
-    if (mPictureThread.get()) {
-        LOGV("%s: waiting for picture thread to exit", __func__);
-        mPictureThread->requestExitAndWait();
-        LOGV("%s: picture thread has exited", __func__);
-    }
+    /* request that the preview thread stop. */
+    if (mPreviewRunning) {
+        mPreviewRunning = false;
+        if (!mPreviewStartDeferred) {
+            mPreviewCondition.signal();
+            /* wait until preview thread is stopped */
+            mPreviewStoppedCondition.wait(mPreviewLock);
 
-    return NO_ERROR;
+        }
+        else
+            LOGV("%s : preview running but deferred, doing nothing", __func__);
+    } else
+        LOGI("%s : preview not running, doing nothing", __func__);
 }
 
-bool CameraHardwareSec::CheckVideoStartMarker(unsigned char *pBuf)
+void CameraHardwareSec::stopPreview()
 {
-    if (!pBuf) {
-        LOGE("CheckVideoStartMarker() => pBuf is NULL");
-        return false;
-    }
+    LOGV("%s :", __func__);
 
-    if (HIBYTE(VIDEO_COMMENT_MARKER_H) == * pBuf      && LOBYTE(VIDEO_COMMENT_MARKER_H) == *(pBuf + 1) &&
-        HIBYTE(VIDEO_COMMENT_MARKER_L) == *(pBuf + 2) && LOBYTE(VIDEO_COMMENT_MARKER_L) == *(pBuf + 3))
-        return true;
+    /* request that the preview thread stop. */
+    mPreviewLock.lock();
+    stopPreviewInternal();
+    mPreviewLock.unlock();
+}
 
-    return false;
+bool CameraHardwareSec::previewEnabled()
+{
+    Mutex::Autolock lock(mPreviewLock);
+    LOGV("%s : %d", __func__, mPreviewRunning);
+    return mPreviewRunning;
 }
 
-bool CameraHardwareSec::CheckEOIMarker(unsigned char *pBuf)
+status_t CameraHardwareSec::startRecording()
 {
-    if (!pBuf) {
-        LOGE("CheckEOIMarker() => pBuf is NULL");
-        return false;
-    }
+    LOGV("%s :", __func__);
 
-    // EOI marker [FF D9]
-    if (HIBYTE(JPEG_EOI_MARKER) == *pBuf && LOBYTE(JPEG_EOI_MARKER) == *(pBuf + 1))
+    Mutex::Autolock lock(mRecordLock);
+
+    for(int i = 0; i<BUFFER_COUNT_FOR_ARRAY; i++){
+        if (mRecordHeap[i] != NULL) {
+            mRecordHeap[i]->release(mRecordHeap[i]);
+            mRecordHeap[i] = 0;
+        }
+
+        mRecordHeap[i] = mGetMemoryCb(-1, sizeof(struct addrs), MAX_BUFFERS, NULL);
+        if (!mRecordHeap[i]) {
+            LOGE("ERR(%s): Record heap[%d] creation fail", __func__, i);
+            return UNKNOWN_ERROR;
+        }
+    }
+
+    LOGV("mRecordHeaps alloc done");
+
+    if (mRecordRunning == false) {
+        if (mSecCamera->startRecord(mRecordHint) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->startRecord()", __func__);
+            return UNKNOWN_ERROR;
+        }
+        resetRecordOwners();
+        mRecordRunning = true;
+    }
+    return NO_ERROR;
+}
+
+void CameraHardwareSec::stopRecording()
+{
+    LOGV("%s :", __func__);
+
+    Mutex::Autolock lock(mRecordLock);
+
+    if (mRecordRunning == true) {
+        int index[FRAME_QUEUE_MAX_DEPTH];
+        int count = mPipeQueue[PIPE_RECORD]->flush(index, FRAME_QUEUE_MAX_DEPTH);
+
+        for (int i = 0; i < count; i++)
+            returnRecordFrame(index[i]);
+        mPipeQueue[PIPE_RECORD]->waitIdle();
+
+        /* stopRecord() takes the snapshot node down under the stage */
+        mPipeQueue[PIPE_VIDEO_SNAPSHOT]->flush(index, FRAME_QUEUE_MAX_DEPTH);
+        mPipeQueue[PIPE_VIDEO_SNAPSHOT]->waitIdle();
+
+        if (mSecCamera->stopRecord() < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->stopRecord()", __func__);
+            return;
+        }
+        mRecordRunning = false;
+    }
+}
+
+bool CameraHardwareSec::recordingEnabled()
+{
+    LOGV("%s :", __func__);
+    LOGV("%s : %d", __func__, mPreviewRunning);
+
+    return mRecordRunning;
+}
+
+void CameraHardwareSec::releaseRecordingFrame(const void *opaque)
+{
+    struct addrs *addrs = (struct addrs *)opaque;
+    returnRecordFrame(addrs->buf_index);
+}
+
+int CameraHardwareSec::autoFocusThread()
+{
+    int count =0;
+    int af_status =0 ;
+
+    LOGV("%s : starting", __func__);
+
+    /* block until we're told to start.  we don't want to use
+     * a restartable thread and requestExitAndWait() in cancelAutoFocus()
+     * because it would cause deadlock between our callbacks and the
+     * caller of cancelAutoFocus() which both want to grab the same lock
+     * in CameraServices layer.
+     */
+    mFocusLock.lock();
+    /* check early exit request */
+    if (mExitAutoFocusThread) {
+        mFocusLock.unlock();
+        LOGV("%s : exiting on request0", __func__);
+        return NO_ERROR;
+    }
+    mFocusCondition.wait(mFocusLock);
+    /* check early exit request */
+    if (mExitAutoFocusThread) {
+        mFocusLock.unlock();
+        LOGV("%s : exiting on request1", __func__);
+        return NO_ERROR;
+    }
+    mFocusLock.unlock();
+
+    /* TODO : Currently only possible auto focus at BACK caemra
+              We need to modify to check that sensor can support auto focus */
+    if (mCameraID == SecCamera::CAMERA_ID_BACK) {
+        LOGV("%s : calling setAutoFocus", __func__);
+        if (mTouched == 0) {
+            if (mSecCamera->setAutofocus() < 0) {
+                LOGE("ERR(%s):Fail on mSecCamera->setAutofocus()", __func__);
+                return UNKNOWN_ERROR;
+            }
+        } else {
+            if (mSecCamera->setTouchAF() < 0) {
+                LOGE("ERR(%s):Fail on mSecCamera->setAutofocus()", __func__);
+                return UNKNOWN_ERROR;
+            }
+        }
+    }
+
+    /* TODO */
+    /* This is temperary implementation.
+       When camera support AF blocking mode, this code will be removed
+       Continous AutoFocus is not need to success */
+    const char *focusModeStr = mParameters.get(CameraParameters::KEY_FOCUS_MODE);
+    int isContinousAF = !strncmp(focusModeStr, CameraParameters::FOCUS_MODE_CONTINUOUS_VIDEO, 7);
+    if (mUseInternalISP && !isContinousAF) {
+        int i, err = -1;
+        for (i = 0; i < 400; i++) {
+           usleep(10000);
+
+           af_status = mSecCamera->getAutoFocusResult();
+
+           if ((af_status & 0x2)) {
+               err = 0;
+               break;
+           }
+        }
+    } else {
+        af_status = mSecCamera->getAutoFocusResult();
+    }
+
+    if (af_status == 0x01) {
+        LOGV("%s : AF Cancelled !!", __func__);
+        if (mMsgEnabled & CAMERA_MSG_FOCUS)
+            mNotifyCb(CAMERA_MSG_FOCUS, true, 0, mCallbackCookie);
+    } else if (af_status == 0x02) {
+        LOGV("%s : AF Success !!", __func__);
+        if (mMsgEnabled & CAMERA_MSG_FOCUS) {
+            /* CAMERA_MSG_FOCUS only takes a bool.  true for
+             * finished and false for failure.  cancel is still
+             * considered a true result.
+             */
+            mNotifyCb(CAMERA_MSG_FOCUS, true, 0, mCallbackCookie);
+        }
+    } else {
+        LOGV("%s : AF Fail !!", __func__);
+        LOGV("%s : mMsgEnabled = 0x%x", __func__, mMsgEnabled);
+        if (mMsgEnabled & CAMERA_MSG_FOCUS)
+            mNotifyCb(CAMERA_MSG_FOCUS, false, 0, mCallbackCookie);
+    }
+
+    LOGV("%s : exiting with no error", __func__);
+    return NO_ERROR;
+}
+
+status_t CameraHardwareSec::autoFocus()
+{
+    LOGV("%s :", __func__);
+    /* signal autoFocusThread to run once */
+    mFocusCondition.signal();
+    return NO_ERROR;
+}
+
+status_t CameraHardwareSec::cancelAutoFocus()
+{
+    LOGV("%s :", __func__);
+
+    if (mSecCamera->cancelAutofocus() < 0) {
+        LOGE("ERR(%s):Fail on mSecCamera->cancelAutofocus()", __func__);
+        return UNKNOWN_ERROR;
+    }
+
+    return NO_ERROR;
+}
+
+int CameraHardwareSec::save_jpeg( unsigned char *real_jpeg, int jpeg_size)
+{
+    FILE *yuv_fp = NULL;
+    char filename[100], *buffer = NULL;
+
+    /* file create/open, note to "wb" */
+    yuv_fp = fopen("/data/camera_dump.jpeg", "wb");
+    if (yuv_fp == NULL) {
+        LOGE("Save jpeg file open error");
+        return -1;
+    }
+
+    LOGV("[BestIQ]  real_jpeg size ========>  %d", jpeg_size);
+    buffer = (char *) malloc(jpeg_size);
+    if (buffer == NULL) {
+        LOGE("Save YUV] buffer alloc failed");
+        if (yuv_fp)
+            fclose(yuv_fp);
+
+        return -1;
+    }
+
+    memcpy(buffer, real_jpeg, jpeg_size);
+
+    fflush(stdout);
+
+    fwrite(buffer, 1, jpeg_size, yuv_fp);
+
+    fflush(yuv_fp);
+
+    if (yuv_fp)
+            fclose(yuv_fp);
+    if (buffer)
+            free(buffer);
+
+    return 0;
+}
+
+void CameraHardwareSec::save_postview(const char *fname, uint8_t *buf, uint32_t size)
+{
+    int nw;
+    int cnt = 0;
+    uint32_t written = 0;
+
+    LOGD("opening file [%s]", fname);
+    int fd = open(fname, O_RDWR | O_CREAT);
+    if (fd < 0) {
+        LOGE("failed to create file [%s]: %s", fname, strerror(errno));
+        return;
+    }
+
+    LOGD("writing %d bytes to file [%s]", size, fname);
+    while (written < size) {
+        nw = ::write(fd, buf + written, size - written);
+        if (nw < 0) {
+            LOGE("failed to write to file %d [%s]: %s",written,fname, strerror(errno));
+            break;
+        }
+        written += nw;
+        cnt++;
+    }
+    LOGD("done writing %d bytes to file [%s] in %d passes",size, fname, cnt);
+    ::close(fd);
+}
+
+/* area filtered, so any ratio keeps the aspect and does not alias */
+bool CameraHardwareSec::scaleDownYuv422(char *srcBuf, uint32_t srcWidth, uint32_t srcHeight,
+                                        char *dstBuf, uint32_t dstWidth, uint32_t dstHeight)
+{
+    if (dstWidth % 2 != 0 || dstHeight % 2 != 0) {
+        LOGE("scale_down_yuv422: invalid width, height for scaling");
+        return false;
+    }
+
+    if (SW_Scale_down_YUYV(srcWidth, srcHeight, (unsigned char *)srcBuf,
+                           dstWidth, dstHeight, (unsigned char *)dstBuf, SW_SCALE_FMT_YUYV) < 0) {
+        LOGE("scale_down_yuv422: fail %dx%d -> %dx%d", srcWidth, srcHeight, dstWidth, dstHeight);
+        return false;
+    }
+
+    return true;
+}
+
+bool CameraHardwareSec::scaleDownYuv422toNV21(char *srcBuf, uint32_t srcWidth, uint32_t srcHeight,
+                                              char *dstBuf, uint32_t dstWidth, uint32_t dstHeight)
+{
+    /* 1:1 and 2:1 need no filter, the single pass converter does both */
+    if ((dstWidth == srcWidth && dstHeight == srcHeight)
+        || (dstWidth * 2 == srcWidth && dstHeight * 2 == srcHeight)) {
+        csc_YUV422I_to_YUV420((unsigned char *)dstBuf,
+                              (unsigned char *)dstBuf + dstWidth * dstHeight, NULL,
+                              (unsigned char *)srcBuf, srcWidth, srcHeight,
+                              srcWidth * 2, dstWidth, dstWidth,
+                              CSC_YUV422I_YUYV | CSC_YUV420_NV21
+                              | (dstWidth == srcWidth ? 0 : CSC_YUV420_HALF));
+        return true;
+    }
+
+    if (SW_Scale_down_YUYV(srcWidth, srcHeight, (unsigned char *)srcBuf,
+                           dstWidth, dstHeight, (unsigned char *)dstBuf, SW_SCALE_FMT_NV21) < 0) {
+        LOGE("%s: fail %dx%d -> %dx%d", __func__, srcWidth, srcHeight, dstWidth, dstHeight);
+        return false;
+    }
+
+    return true;
+}
+
+bool CameraHardwareSec::YUY2toNV21(void *srcBuf, void *dstBuf, uint32_t srcWidth, uint32_t srcHeight)
+{
+    return scaleDownYuv422toNV21((char *)srcBuf, srcWidth, srcHeight,
+                                 (char *)dstBuf, srcWidth, srcHeight);
+}
+
+int CameraHardwareSec::pictureThreadWrapper()
+{
+    nsecs_t cpu = SecCameraBench::threadTime();
+    int ret = pictureThread();
+
+    mBench->stageDone(BENCH_PICTURE, cpu);
+
+    return ret;
+}
+
+int CameraHardwareSec::pictureThread()
+{
+    LOGV("%s :", __func__);
+
+#ifdef ZERO_SHUTTER_LAG
+    if (mUseInternalISP && mBurstCount != 0)
+        return burstCapture();
+#endif
+
+    int jpeg_size = 0;
+    int ret = NO_ERROR;
+    unsigned char *jpeg_data = NULL;
+    int postview_offset = 0;
+    unsigned char *postview_data = NULL;
+
+    unsigned char *addr = NULL;
+    int mPostViewWidth, mPostViewHeight, mPostViewSize;
+    int mThumbWidth, mThumbHeight, mThumbSize;
+    int cap_width, cap_height, cap_frame_size;
+
+    int JpegImageSize = 0;
+    int JpegExifSize = -1;
+    bool exifDone = false;
+
+    mSecCamera->getPostViewConfig(&mPostViewWidth, &mPostViewHeight, &mPostViewSize);
+    mSecCamera->getThumbnailConfig(&mThumbWidth, &mThumbHeight, &mThumbSize);
+    int postviewHeapSize = mPostViewSize;
+    if (!mRecordRunning)
+        mSecCamera->getSnapshotSize(&cap_width, &cap_height, &cap_frame_size);
+    else
+        mSecCamera->getVideosnapshotSize(&cap_width, &cap_height, &cap_frame_size);
+    int mJpegHeapSize;
+    if (!mUseInternalISP)
+        mJpegHeapSize = cap_frame_size * SecCamera::getJpegRatio();
+    else
+        mJpegHeapSize = cap_frame_size;
+
+    LOGV("[5B] mPostViewWidth = %d mPostViewHeight = %d\n",mPostViewWidth,mPostViewHeight);
+
+    /*
+     * The picture is put together in JpegHeap itself : the encoder writes
+     * behind room for the Exif, see SecCamera::assembleJpeg().
+     */
+    int exifReserve = SecCamera::getExifReserve(mThumbSize);
+    sp<MemoryHeapBase> JpegHeap = new MemoryHeapBase(exifReserve + mJpegHeapSize);
+    if (JpegHeap->getHeapID() < 0) {
+        LOGE("ERR(%s): Jpeg heap creation fail", __func__);
+        mStateLock.lock();
+        mCaptureInProgress = false;
+        mStateLock.unlock();
+        return UNKNOWN_ERROR;
+    }
+    unsigned char *JpegFile = (unsigned char *)JpegHeap->base();
+
+    mThumbnailHeap = new MemoryHeapBase(mThumbSize);
+
+    if (mMsgEnabled & CAMERA_MSG_RAW_IMAGE) {
+        int picture_size, picture_width, picture_height;
+        mSecCamera->getSnapshotSize(&picture_width, &picture_height, &picture_size);
+        int picture_format = mSecCamera->getSnapshotPixelFormat();
+
+        unsigned int thumb_addr, phyAddr;
+
+        // Modified the shutter sound timing for Jpeg capture
+        if (!mUseInternalISP) {
+            mSecCamera->setSnapshotCmd();
+
+            if (mMsgEnabled & CAMERA_MSG_SHUTTER)
+                mNotifyCb(CAMERA_MSG_SHUTTER, 0, 0, mCallbackCookie);
+            mBench->shutter(mShutterTime);
+
+            jpeg_data = mSecCamera->getJpeg(&JpegImageSize, &mThumbSize, &thumb_addr, &phyAddr);
+            if (jpeg_data == NULL) {
+                LOGE("ERR(%s):Fail on SecCamera->getJpeg()", __func__);
+                ret = UNKNOWN_ERROR;
+            }
+
+            memcpy((unsigned char *)mThumbnailHeap->base(), (unsigned char *)thumb_addr, mThumbSize);
+            memcpy(JpegFile + exifReserve, jpeg_data, JpegImageSize);
+        } else {
+            if (mMsgEnabled & CAMERA_MSG_SHUTTER)
+                mNotifyCb(CAMERA_MSG_SHUTTER, 0, 0, mCallbackCookie);
+            mBench->shutter(mShutterTime);
+
+#ifdef ZERO_SHUTTER_LAG
+            struct SecCamera::zsl_frame zsl;
+
+            mCapIndex = mSecCamera->lockZslFrame(mShutterTime, &zsl);
+            if (mCapIndex < 0) {
+                LOGE("ERR(%s):no ZSL frame for the shutter", __func__);
+                mStateLock.lock();
+                mCaptureInProgress = false;
+                mStateLock.unlock();
+                return UNKNOWN_ERROR;
+            }
+            LOGV("%s: ZSL frame(%d) %lld us from the shutter, exposure(1/%d)",
+                 __func__, mCapIndex, ns2us(zsl.timestamp - mShutterTime), zsl.exposure);
+
+            mSecCamera->getCaptureAddr(mCapIndex, &mCapBuffer);
+
+            if (mCapBuffer.virt.extP[0] == NULL) {
+                LOGE("ERR(%s):Fail on SecCamera getCaptureAddr = %0x ",
+                     __func__, mCapBuffer.virt.extP[0]);
+                mSecCamera->unlockZslFrame(mCapIndex);
+                mStateLock.lock();
+                mCaptureInProgress = false;
+                mStateLock.unlock();
+                return UNKNOWN_ERROR;
+            }
+
+            /* the thumbnail and its Exif are made while the main image is encoded */
+            struct thumb_job thumb;
+            thumb.src          = (char *)mCapBuffer.virt.extP[0];
+            thumb.src_width    = cap_width;
+            thumb.src_height   = cap_height;
+            thumb.thumb        = (char *)mThumbnailHeap->base();
+            thumb.thumb_width  = mThumbWidth;
+            thumb.thumb_height = mThumbHeight;
+            thumb.thumb_size   = mThumbSize;
+            thumb.exif         = (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE) ? JpegFile + 2 : NULL;
+            thumb.exif_max     = exifReserve - 2;
+            startThumbnail(&thumb);
+#endif
+
+            if (mSecCamera->getSnapshotAndJpeg(&mCapBuffer, mCapIndex,
+                    JpegFile + exifReserve, &JpegImageSize) < 0) {
+#ifdef ZERO_SHUTTER_LAG
+                waitThumbnail();
+                mSecCamera->unlockZslFrame(mCapIndex);
+#endif
+                mStateLock.lock();
+                mCaptureInProgress = false;
+                mStateLock.unlock();
+                return UNKNOWN_ERROR;
+            }
+            LOGI("snapshotandjpeg done");
+
+#ifdef ZERO_SHUTTER_LAG
+            JpegExifSize = waitThumbnail();
+            exifDone = (thumb.exif != NULL);
+
+            /* preview kept running, the frame goes back to the ring */
+            mSecCamera->unlockZslFrame(mCapIndex);
+            mCapBuffer = SecBuffer();
+#else
+            scaleDownYuv422((char *)mCapBuffer.virt.extP[0], cap_width, cap_height,
+                            (char *)mThumbnailHeap->base(), mThumbWidth, mThumbHeight);
+#endif
+        }
+    }
+
+    int rawHeapSize = cap_frame_size;
+    LOGV("mRawHeap : MemoryHeapBase(previewHeapSize(%d))", rawHeapSize);
+    mRawHeap = mGetMemoryCb((int)mSecCamera->getCameraFd(SecCamera::PICTURE), rawHeapSize, 1, 0);
+    if (!mRawHeap)
+        LOGE("ERR(%s): Raw heap creation fail", __func__);
+
+    if (mMsgEnabled & CAMERA_MSG_RAW_IMAGE)
+        mDataCb(CAMERA_MSG_RAW_IMAGE, mRawHeap, 0, NULL, mCallbackCookie);
+    mStateLock.lock();
+    mCaptureInProgress = false;
+    mStateLock.unlock();
+
+    if (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE) {
+        if (!exifDone)
+            JpegExifSize = mSecCamera->getExif(JpegFile + 2, exifReserve - 2,
+                                               (unsigned char *)mThumbnailHeap->base(),
+                                               mThumbSize);
+        LOGV("JpegExifSize=%d", JpegExifSize);
+
+        if (JpegExifSize < 0 ||
+            SecCamera::assembleJpeg(JpegFile, JpegExifSize, exifReserve) < 0) {
+            ret = UNKNOWN_ERROR;
+            goto out;
+        }
+
+        /* the application gets the head of JpegHeap, sized to the picture */
+        camera_memory_t *JpegHeap_out =
+            mGetMemoryCb(JpegHeap->getHeapID(), exifReserve + JpegImageSize, 1, 0);
+        if (JpegHeap_out) {
+            mDataCb(CAMERA_MSG_COMPRESSED_IMAGE, JpegHeap_out, 0, NULL, mCallbackCookie);
+            JpegHeap_out->release(JpegHeap_out);
+            JpegHeap_out = 0;
+            mBench->pictureDone();
+        } else {
+            LOGE("ERR(%s): Jpeg out heap creation fail", __func__);
+            ret = UNKNOWN_ERROR;
+        }
+    }
+
+    LOGV("%s : pictureThread end", __func__);
+
+out:
+    JpegHeap.clear();
+
+    if (mRawHeap) {
+        mRawHeap->release(mRawHeap);
+        mRawHeap = 0;
+    }
+
+    if (!mUseInternalISP && !mRecordRunning)
+        mSecCamera->endSnapshot();
+
+    return ret;
+}
+
+/* thumbnail stage : downscale, then the thumbnail JPEG and the Exif around it */
+void CameraHardwareSec::makeThumbnail(struct thumb_job *job)
+{
+    if (job->src != NULL)
+        scaleDownYuv422(job->src, job->src_width, job->src_height,
+                        job->thumb, job->thumb_width, job->thumb_height);
+
+    if (job->exif != NULL) {
+        job->exif_size = mSecCamera->getExif(job->exif, job->exif_max, (unsigned char *)job->thumb,
+                                             job->thumb_size);
+        if (job->exif_size < 0)
+            LOGE("ERR(%s):Fail on getExif()", __func__);
+    } else
+        job->exif_size = 0;
+}
+
+/* one job at a time, the caller joins with waitThumbnail() before the next */
+void CameraHardwareSec::startThumbnail(const struct thumb_job *job)
+{
+    int dropped;
+
+    mThumbLock.lock();
+    mThumbJob = *job;
+    mThumbJob.exif_size = -1;
+    mThumbBusy = true;
+    mThumbLock.unlock();
+
+    if (!mPipeQueue[PIPE_THUMBNAIL]->push(0, systemTime(SYSTEM_TIME_MONOTONIC), &dropped)) {
+        LOGW("%s: thumbnail stage is busy, doing it here", __func__);
+        thumbnailFrame();
+    }
+}
+
+int CameraHardwareSec::waitThumbnail(void)
+{
+    Mutex::Autolock lock(mThumbLock);
+
+    while (mThumbBusy)
+        mThumbCondition.wait(mThumbLock);
+
+    return mThumbJob.exif_size;
+}
+
+void CameraHardwareSec::thumbnailFrame(void)
+{
+    makeThumbnail(&mThumbJob);
+
+    mThumbLock.lock();
+    mThumbBusy = false;
+    mThumbCondition.broadcast();
+    mThumbLock.unlock();
+}
+
+/*
+ * Burst capture stage, on the picture thread. For every shot it takes
+ * the next ZSL frame and scales the thumbnail while the previous shot
+ * is in the JPEG block, hands the slot to the encode stage, then builds
+ * the Exif while the main image is encoded.
+ */
+int CameraHardwareSec::burstCapture(void)
+{
+#ifdef ZERO_SHUTTER_LAG
+    int cap_width, cap_height, cap_frame_size;
+    int thumb_width, thumb_height, thumb_size;
+    struct SecCamera::zsl_frame zsl;
+    SecBuffer capBuffer;
+    nsecs_t last = 0;
+    int shots = 0;
+    int exif_size;
+    int dropped;
+
+    mSecCamera->getThumbnailConfig(&thumb_width, &thumb_height, &thumb_size);
+    if (!mRecordRunning)
+        mSecCamera->getSnapshotSize(&cap_width, &cap_height, &cap_frame_size);
+    else
+        mSecCamera->getVideosnapshotSize(&cap_width, &cap_height, &cap_frame_size);
+
+    if (!allocBurstHeaps(cap_frame_size, thumb_size)) {
+        mStateLock.lock();
+        mCaptureInProgress = false;
+        mStateLock.unlock();
+        return UNKNOWN_ERROR;
+    }
+
+    mBurstShots = 0;
+    mBurstTime = 0;
+
+    while (mBurstCount < 0 || shots < mBurstCount) {
+        int slot = shots % BURST_RING_DEPTH;
+
+        mBurstLock.lock();
+        while (mBurstSlot[slot].busy && !mBurstCancel)
+            mBurstCondition.wait(mBurstLock);
+        if (mBurstCancel) {
+            mBurstLock.unlock();
+            break;
+        }
+        mBurstSlot[slot].busy = true;
+        mBurstLock.unlock();
+
+        mBurstJpegHeap[slot] = new MemoryHeapBase(mBurstExifReserve + mBurstJpegSize);
+        if (mBurstJpegHeap[slot]->getHeapID() < 0) {
+            LOGE("ERR(%s):picture heap creation fail for shot %d", __func__, shots);
+            mBurstJpegHeap[slot].clear();
+            mBurstLock.lock();
+            mBurstSlot[slot].busy = false;
+            mBurstLock.unlock();
+            break;
+        }
+
+        if (shots == 0)
+            mBurstSlot[slot].cap_index = mSecCamera->lockZslFrame(mShutterTime, &zsl);
+        else
+            mBurstSlot[slot].cap_index = mSecCamera->lockNextZslFrame(last, &zsl);
+
+        if (mBurstSlot[slot].cap_index < 0) {
+            LOGE("ERR(%s):no frame for shot %d", __func__, shots);
+            mBurstJpegHeap[slot].clear();
+            mBurstLock.lock();
+            mBurstSlot[slot].busy = false;
+            mBurstLock.unlock();
+            break;
+        }
+
+        last = zsl.timestamp;
+        mBurstSlot[slot].timestamp = zsl.timestamp;
+        mBurstSlot[slot].jpeg_size = 0;
+        mBurstSlot[slot].exif_done = false;
+        mBurstSlot[slot].exif_size = -1;
+
+        if (mMsgEnabled & CAMERA_MSG_SHUTTER)
+            mNotifyCb(CAMERA_MSG_SHUTTER, 0, 0, mCallbackCookie);
+        if (shots == 0)
+            mBench->shutter(mShutterTime);
+
+        mSecCamera->getCaptureAddr(mBurstSlot[slot].cap_index, &capBuffer);
+        if (capBuffer.virt.extP[0] != NULL)
+            scaleDownYuv422((char *)capBuffer.virt.extP[0], cap_width, cap_height,
+                            (char *)mBurstThumbHeap[slot]->data, thumb_width, thumb_height);
+
+        mPipeQueue[PIPE_BURST_ENCODE]->push(slot, zsl.timestamp, &dropped);
+
+        /* the Exif is written in front of the body while the JPEG block runs */
+        exif_size = 0;
+        if (mBurstJpeg)
+            exif_size = mSecCamera->getExif((unsigned char *)mBurstJpegHeap[slot]->base() + 2,
+                                            mBurstExifReserve - 2,
+                                            (unsigned char *)mBurstThumbHeap[slot]->data,
+                                            mBurstThumbSize);
+
+        mBurstLock.lock();
+        mBurstSlot[slot].exif_size = exif_size;
+        mBurstSlot[slot].exif_done = true;
+        mBurstCondition.broadcast();
+        mBurstLock.unlock();
+
+        shots++;
+    }
+
+    /* let the encode and deliver stages drain */
+    mBurstLock.lock();
+    for (int i = 0; i < BURST_RING_DEPTH; i++) {
+        while (mBurstSlot[i].busy)
+            mBurstCondition.wait(mBurstLock);
+    }
+    mBurstLock.unlock();
+
+    LOGV("%s: %d of %d shots delivered in %lld ms", __func__,
+         mBurstShots, shots, ns2ms(mBurstTime));
+    mBench->burstDone(mBurstShots, mBurstTime);
+#endif
+
+    mStateLock.lock();
+    mCaptureInProgress = false;
+    mStateLock.unlock();
+
+    return NO_ERROR;
+}
+
+/* burst encode stage : main image through the JPEG block */
+void CameraHardwareSec::encodeBurstFrame(int slot)
+{
+    struct burst_slot *burst = &mBurstSlot[slot];
+    unsigned char *jpeg = (unsigned char *)mBurstJpegHeap[slot]->base();
+    SecBuffer capBuffer;
+    int dropped;
+
+    if (mSecCamera->getSnapshotAndJpeg(&capBuffer, burst->cap_index,
+            jpeg + mBurstExifReserve, &burst->jpeg_size) < 0) {
+        LOGE("ERR(%s):Fail to encode frame(%d)", __func__, burst->cap_index);
+        burst->jpeg_size = 0;
+    }
+
+#ifdef ZERO_SHUTTER_LAG
+    mSecCamera->unlockZslFrame(burst->cap_index);
+#endif
+
+    mPipeQueue[PIPE_BURST_DELIVER]->push(slot, burst->timestamp, &dropped);
+}
+
+/* burst deliver stage : joins the Exif from the capture stage, then the application */
+void CameraHardwareSec::deliverBurstFrame(int slot)
+{
+    struct burst_slot *burst = &mBurstSlot[slot];
+    int exif_size;
+
+    mBurstLock.lock();
+    while (!burst->exif_done)
+        mBurstCondition.wait(mBurstLock);
+    exif_size = burst->exif_size;
+    mBurstLock.unlock();
+
+    if (0 < burst->jpeg_size && mBurstJpeg) {
+        unsigned char *jpeg = (unsigned char *)mBurstJpegHeap[slot]->base();
+
+        if (0 <= exif_size &&
+            SecCamera::assembleJpeg(jpeg, exif_size, mBurstExifReserve) == 0) {
+            /* the application takes the heap size as the picture size */
+            camera_memory_t *out = mGetMemoryCb(mBurstJpegHeap[slot]->getHeapID(),
+                                                mBurstExifReserve + burst->jpeg_size, 1, 0);
+            if (out != NULL) {
+                mDataCb(CAMERA_MSG_COMPRESSED_IMAGE, out, 0, NULL, mCallbackCookie);
+                out->release(out);
+            }
+        } else
+            LOGE("ERR(%s):Fail on getExif()", __func__);
+    }
+
+    mBurstJpegHeap[slot].clear();
+
+    mBurstLock.lock();
+    if (0 < burst->jpeg_size) {
+        mBurstShots++;
+        mBurstTime = systemTime(SYSTEM_TIME_MONOTONIC) - mShutterTime;
+    }
+    burst->busy = false;
+    mBurstCondition.broadcast();
+    mBurstLock.unlock();
+}
+
+/* the thumbnail ring is kept from burst to burst while the sizes stay the same */
+bool CameraHardwareSec::allocBurstHeaps(int jpegSize, int thumbSize)
+{
+    if (mBurstThumbHeap[0] != NULL && mBurstJpegSize == jpegSize && mBurstThumbSize == thumbSize)
+        return true;
+
+    freeBurstHeaps();
+
+    for (int i = 0; i < BURST_RING_DEPTH; i++) {
+        mBurstThumbHeap[i] = mGetMemoryCb(-1, thumbSize, 1, 0);
+
+        if (!mBurstThumbHeap[i]) {
+            LOGE("ERR(%s):burst heap[%d] creation fail", __func__, i);
+            freeBurstHeaps();
+            return false;
+        }
+    }
+
+    mBurstExifReserve = SecCamera::getExifReserve(thumbSize);
+    mBurstJpegSize = jpegSize;
+    mBurstThumbSize = thumbSize;
+
+    return true;
+}
+
+void CameraHardwareSec::freeBurstHeaps(void)
+{
+    for (int i = 0; i < BURST_RING_DEPTH; i++) {
+        mBurstJpegHeap[i].clear();
+        if (mBurstThumbHeap[i]) {
+            mBurstThumbHeap[i]->release(mBurstThumbHeap[i]);
+            mBurstThumbHeap[i] = NULL;
+        }
+    }
+
+    mBurstExifReserve = 0;
+    mBurstJpegSize = 0;
+    mBurstThumbSize = 0;
+}
+
+status_t CameraHardwareSec::takePicture()
+{
+    LOGV("%s :", __func__);
+
+    mShutterTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    /* bursts are served from the ZSL ring, and need the internal ISP */
+    mBurstCount = mParameters.getInt("burst-capture");
+    if (mBurstCount == 1 || mBurstCount < -1)
+        mBurstCount = 0;
+#ifdef ZERO_SHUTTER_LAG
+    if (mBurstCount != 0 && !mUseInternalISP) {
+        LOGW("%s : burst needs the internal ISP, taking one picture", __func__);
+        mBurstCount = 0;
+    }
+#else
+    mBurstCount = 0;
+#endif
+    mBurstCancel = false;
+    /*
+     * The camera service turns CAMERA_MSG_COMPRESSED_IMAGE off once the
+     * first picture came, the rest of the burst goes by what was asked here.
+     */
+    mBurstJpeg = (mMsgEnabled & CAMERA_MSG_COMPRESSED_IMAGE) != 0;
+
+#ifdef ZERO_SHUTTER_LAG
+    if (!mUseInternalISP) {
+        stopPreview();
+    }
+#else
+    stopPreview();
+#endif
+
+    Mutex::Autolock lock(mStateLock);
+    if (mCaptureInProgress) {
+        LOGE("%s : capture already in progress", __func__);
+        return INVALID_OPERATION;
+    }
+
+    if (mPictureThread->run("CameraPictureThread", PRIORITY_DEFAULT) != NO_ERROR) {
+        LOGE("%s : couldn't run picture thread", __func__);
+        return INVALID_OPERATION;
+    }
+    mCaptureInProgress = true;
+
+    return NO_ERROR;
+}
+
+status_t CameraHardwareSec::cancelPicture()
+{
+    LOGV("%s", __func__);
+
+    mBurstLock.lock();
+    mBurstCancel = true;
+    mBurstCondition.broadcast();
+    mBurstLock.unlock();
+
+    if (mPictureThread.get()) {
+        LOGV("%s: waiting for picture thread to exit", __func__);
+        mPictureThread->requestExitAndWait();
+        LOGV("%s: picture thread has exited", __func__);
+    }
+
+    return NO_ERROR;
+}
+
+bool CameraHardwareSec::CheckVideoStartMarker(unsigned char *pBuf)
+{
+    if (!pBuf) {
+        LOGE("CheckVideoStartMarker() => pBuf is NULL");
+        return false;
+    }
+
+    if (HIBYTE(VIDEO_COMMENT_MARKER_H) == * pBuf      && LOBYTE(VIDEO_COMMENT_MARKER_H) == *(pBuf + 1) &&
+        HIBYTE(VIDEO_COMMENT_MARKER_L) == *(pBuf + 2) && LOBYTE(VIDEO_COMMENT_MARKER_L) == *(pBuf + 3))
+        return true;
+
+    return false;
+}
+
+bool CameraHardwareSec::CheckEOIMarker(unsigned char *pBuf)
+{
+    if (!pBuf) {
+        LOGE("CheckEOIMarker() => pBuf is NULL");
+        return false;
+    }
+
+    // EOI marker [FF D9]
+    if (HIBYTE(JPEG_EOI_MARKER) == *pBuf && LOBYTE(JPEG_EOI_MARKER) == *(pBuf + 1))
+        return true;
+
+    return false;
+}
+
+/*
+ * Every marker of both interleave formats starts with 0xFF, so the scans
+ * jump from one 0xFF to the next with memchr and only look closer there.
+ * Returns the offset of the 0xFF of [0xFF second], -1 if there is none.
+ */
+static int findMarker(const unsigned char *pBuf, int size, unsigned char second)
+{
+    const unsigned char *p = pBuf;
+    const unsigned char *pEnd = pBuf + size;
+
+    while (p + 1 < pEnd) {
+        p = (const unsigned char *)memchr(p, 0xFF, pEnd - p - 1);
+        if (p == NULL)
+            return -1;
+
+        if (*(p + 1) == second)
+            return p - pBuf;
+
+        p++;
+    }
+
+    return -1;
+}
+
+bool CameraHardwareSec::FindEOIMarkerInJPEG(unsigned char *pBuf, int dwBufSize, int *pnJPEGsize)
+{
+    if (NULL == pBuf || 0 >= dwBufSize) {
+        LOGE("FindEOIMarkerInJPEG() => There is no contents.");
+        return false;
+    }
+
+    int offset = findMarker(pBuf, dwBufSize, LOBYTE(JPEG_EOI_MARKER));
+
+    if (offset < 0) {
+        *pnJPEGsize += dwBufSize;
+        return false;
+    }
+
+    *pnJPEGsize += offset;
+
+    return true;
+}
+
+void CameraHardwareSec::addSegment(Vector<interleave_segment> *segments, int *total,
+                                   int offset, int size)
+{
+    if (size <= 0)
+        return;
+
+    *total += size;
+
+    if (!segments->isEmpty()) {
+        interleave_segment &last = segments->editItemAt(segments->size() - 1);
+
+        if (last.offset + last.size == offset) {
+            last.size += size;
+            return;
+        }
+    }
+
+    interleave_segment segment;
+    segment.offset = offset;
+    segment.size   = size;
+    segments->push(segment);
+}
+
+int CameraHardwareSec::gatherSegments(unsigned char *pBase,
+                                      const Vector<interleave_segment> &segments,
+                                      void *pDst)
+{
+    unsigned char *p = (unsigned char *)pDst;
+
+    for (size_t i = 0; i < segments.size(); i++) {
+        memcpy(p, pBase + segments[i].offset, segments[i].size);
+        p += segments[i].size;
+    }
+
+    return p - (unsigned char *)pDst;
+}
+
+/* the JPEG where it lies when it is in one piece, gathered into pJpegData otherwise */
+unsigned char *CameraHardwareSec::mapInterleaveJpeg(unsigned char *pBase,
+                                                    struct interleave_map *map,
+                                                    void *pJpegData)
+{
+    if (map->jpeg.size() == 1)
+        return pBase + map->jpeg[0].offset;
+
+    if (pJpegData == NULL)
+        return NULL;
+
+    gatherSegments(pBase, map->jpeg, pJpegData);
+
+    return (unsigned char *)pJpegData;
+}
+
+/*
+ * JPEG lines of dwJPEGLineLength up to the EOI, with video lines of
+ * dwVideoLineLength behind a VIDEO_COMMENT_MARKER in between
+ */
+bool CameraHardwareSec::demuxSplitFrame(unsigned char *pFrame, int dwSize,
+                                        int dwJPEGLineLength, int dwVideoLineLength,
+                                        struct interleave_map *map)
+{
+    int pos = 0;
+    int len, eoi;
+    bool lastFF = false;
+
+    map->jpeg.clear();
+    map->yuv.clear();
+    map->jpeg_size = 0;
+    map->yuv_size  = 0;
+
+    if (NULL == pFrame || 0 >= dwSize) {
+        LOGE("There is no contents (pFrame=%p, dwSize=%d", pFrame, dwSize);
+        return false;
+    }
+
+    if (0 == dwJPEGLineLength || 0 == dwVideoLineLength) {
+        LOGE("There in no input information for decoding interleaved jpeg");
+        return false;
+    }
+
+    while (pos < dwSize) {
+        if (pos + VIDEO_COMMENT_MARKER_LENGTH <= dwSize && CheckVideoStartMarker(pFrame + pos)) {
+            if (pos + dwVideoLineLength <= dwSize)
+                len = dwVideoLineLength;
+            else
+                len = dwSize - pos - VIDEO_COMMENT_MARKER_LENGTH;
+
+            addSegment(&map->yuv, &map->yuv_size, pos + VIDEO_COMMENT_MARKER_LENGTH, len);
+            pos += len + VIDEO_COMMENT_MARKER_LENGTH;
+            continue;
+        }
+
+        len = dwJPEGLineLength <= dwSize - pos ? dwJPEGLineLength : dwSize - pos;
+
+        /* EOI split over two JPEG lines */
+        if (lastFF && pFrame[pos] == LOBYTE(JPEG_EOI_MARKER))
+            eoi = -1;
+        else {
+            eoi = findMarker(pFrame + pos, len, LOBYTE(JPEG_EOI_MARKER));
+            if (eoi < 0) {
+                addSegment(&map->jpeg, &map->jpeg_size, pos, len);
+                lastFF = pFrame[pos + len - 1] == HIBYTE(JPEG_EOI_MARKER);
+                pos += len;
+                continue;
+            }
+        }
+
+        addSegment(&map->jpeg, &map->jpeg_size, pos, eoi + 2);
         return true;
+    }
+
+    LOGE("%s: Can not find EOI", __func__);
+
+    return false;
+}
+
+bool CameraHardwareSec::SplitFrame(unsigned char *pFrame, int dwSize,
+                    int dwJPEGLineLength, int dwVideoLineLength, int dwVideoHeight,
+                    void *pJPEG, int *pdwJPEGSize,
+                    void *pVideo, int *pdwVideoSize)
+{
+    struct interleave_map map;
+    bool bRet;
+
+    LOGV("===========SplitFrame Start==============");
+
+    bRet = demuxSplitFrame(pFrame, dwSize, dwJPEGLineLength, dwVideoLineLength, &map);
+    if (bRet) {
+        if (pJPEG)
+            gatherSegments(pFrame, map.jpeg, pJPEG);
+        if (pVideo)
+            gatherSegments(pFrame, map.yuv, pVideo);
+    }
+
+    if (pdwJPEGSize)
+        *pdwJPEGSize = bRet ? map.jpeg_size : 0;
+    if (pdwVideoSize)
+        *pdwVideoSize = bRet && pVideo ? map.yuv_size : 0;
+
+    LOGV("===========SplitFrame end==============");
+
+    return bRet;
+}
+
+/*
+ * 32 bit words of JPEG and padding, with YUV lines framed by 0xFF05 and
+ * 0xFF06 in between. Words are aligned from the end of the last YUV line.
+ */
+bool CameraHardwareSec::demuxInterleaveData(unsigned char *pInterleaveData,
+                                            int interleaveDataSize,
+                                            int yuvWidth,
+                                            struct interleave_map *map)
+{
+    unsigned char *p = pInterleaveData;
+    unsigned char *ff;
+    int lineSize = yuvWidth * 2;
+    int grid = 0;   /* word alignment */
+    int run = 0;    /* start of the current JPEG run */
+    int pos = 0;
+
+    map->jpeg.clear();
+    map->yuv.clear();
+    map->jpeg_size = 0;
+    map->yuv_size  = 0;
+
+    if (p == NULL)
+        return false;
+
+    while (pos < interleaveDataSize) {
+        ff = (unsigned char *)memchr(p + pos, 0xFF, interleaveDataSize - pos);
+        if (ff == NULL)
+            break;
+
+        pos = ff - p;
+
+        /* only a word starting with 0xFF is a marker */
+        if ((pos - grid) & 3) {
+            pos += 4 - ((pos - grid) & 3);
+            continue;
+        }
+
+        if (interleaveDataSize - pos < 4)
+            break;
+
+        if (p[pos + 1] == 0xFF
+            && ((p[pos + 2] == 0xFF && (p[pos + 3] == 0xFF || p[pos + 3] == 0x02))
+                || (p[pos + 2] == 0x02 && p[pos + 3] == 0xFF))) {
+            // Padding Data
+            addSegment(&map->jpeg, &map->jpeg_size, run, pos - run);
+            pos += 4;
+            run = pos;
+        } else if (p[pos + 1] == 0x05) {
+            // Start-code of YUV Data
+            addSegment(&map->jpeg, &map->jpeg_size, run, pos - run);
+
+            // Check End-code of YUV Data
+            if (interleaveDataSize < pos + lineSize + 4
+                || p[pos + lineSize + 2] != 0xFF || p[pos + lineSize + 3] != 0x06) {
+                LOGE("%s: no end code for the YUV line at %d", __func__, pos);
+                return false;
+            }
+
+            addSegment(&map->yuv, &map->yuv_size, pos + 2, lineSize);
+            pos += lineSize + 4;
+            grid = pos;
+            run = pos;
+        } else
+            pos += 4;
+    }
+
+    addSegment(&map->jpeg, &map->jpeg_size, run, interleaveDataSize - run);
+
+    // Remove Padding after EOI
+    for (int i = 0; i < 3 && !map->jpeg.isEmpty(); i++) {
+        interleave_segment &last = map->jpeg.editItemAt(map->jpeg.size() - 1);
+
+        if (p[last.offset + last.size - 1] != 0xFF)
+            break;
+
+        last.size--;
+        map->jpeg_size--;
+        if (last.size == 0)
+            map->jpeg.removeAt(map->jpeg.size() - 1);
+    }
+
+    return true;
+}
+
+int CameraHardwareSec::decodeInterleaveData(unsigned char *pInterleaveData,
+                                                 int interleaveDataSize,
+                                                 int yuvWidth,
+                                                 int yuvHeight,
+                                                 int *pJpegSize,
+                                                 void *pJpegData,
+                                                 void *pYuvData)
+{
+    struct interleave_map map;
+    bool ret;
+
+    LOGV("decodeInterleaveData Start~~~");
+
+    ret = demuxInterleaveData(pInterleaveData, interleaveDataSize, yuvWidth, &map);
+    if (ret) {
+        if (pJpegData != NULL)
+            *pJpegSize = gatherSegments(pInterleaveData, map.jpeg, pJpegData);
+
+        // Check YUV Data Size
+        if (pYuvData != NULL) {
+            gatherSegments(pInterleaveData, map.yuv, pYuvData);
+            if (map.yuv_size != (yuvWidth * yuvHeight * 2))
+                ret = false;
+        }
+    }
+
+    LOGV("decodeInterleaveData End~~~");
+
+    return ret;
+}
+
+status_t CameraHardwareSec::dump(int fd) const
+{
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    char trace[2048];
+    String8 result;
+    const Vector<String16> args;
+
+    if (mSecCamera != 0) {
+        mSecCamera->dump(fd);
+        mParameters.dump(fd, args);
+        mInternalParameters.dump(fd, args);
+        snprintf(buffer, 255, " preview running(%s)\n", mPreviewRunning?"true": "false");
+        result.append(buffer);
+        snprintf(buffer, 255, " setParameters: %u calls, %u fields applied\n",
+                 mParamCalls, mParamApplied);
+        result.append(buffer);
+#ifdef USE_PREVIEW_USERPTR
+        snprintf(buffer, 255, " preview zero copy(%s) buffers(%d)\n",
+                 mPreviewZeroCopy ? "true" : "false", mPreviewBufCount);
+        result.append(buffer);
+#endif
+        result.append(" preview pipeline:\n");
+        for (int i = 0; i < PIPE_MAX; i++) {
+            if (mPipeQueue[i] != NULL && mPipeQueue[i]->dump(buffer, SIZE) > 0)
+                result.append(buffer);
+        }
+        mRecordBufLock.lock();
+        {
+            static const char *owner[RECORD_OWNER_MAX] = { "driver", "hal", "encoder" };
+            static const char *policy[] = { "drop-oldest", "drop-newest", "throttle" };
+            int count[RECORD_OWNER_MAX] = { 0, };
+            nsecs_t oldest = 0;
+            nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+            for (int i = 0; i < MAX_BUFFERS; i++) {
+                count[mRecordOwner[i]]++;
+                if (mRecordOwner[i] == RECORD_ENCODER && oldest < now - mRecordSince[i])
+                    oldest = now - mRecordSince[i];
+            }
+            snprintf(buffer, 255, " record buffers: driver(%d) hal(%d) encoder(%d, oldest %lld ms)"
+                     " policy(%s) encoder drops(%u) throttled(%u, %lld ms)\n",
+                     count[RECORD_DRIVER], count[RECORD_HAL], count[RECORD_ENCODER],
+                     ns2ms(oldest), policy[mRecordPolicy], mRecordDrops,
+                     mRecordThrottled, ns2ms(mRecordThrottleTime));
+            result.append(buffer);
+            for (int i = 0; i < RECORD_OWNER_MAX; i++) {
+                const struct record_hold *hold = &mRecordHold[i];
+
+                if (hold->count == 0)
+                    continue;
+                snprintf(buffer, 255, "  held by %-7s: n(%u) avg(%lld us) max(%lld us)\n",
+                         owner[i], hold->count, ns2us(hold->sum) / hold->count, ns2us(hold->max));
+                result.append(buffer);
+            }
+        }
+        mRecordBufLock.unlock();
+#ifdef USE_FACE_DETECTION
+        mPipeLock.lock();
+        {
+            int busy = 0;
+
+            for (int i = 0; i < FACE_META_SLOTS; i++)
+                busy += mFaceSlot[i].busy;
+            snprintf(buffer, 255, " face metadata: delivered(%u) unchanged(%u) no slot(%u)"
+                     " slots busy(%d/%d) last faces(%d)\n",
+                     mFaceDelivered, mFaceUnchanged, mFaceNoSlot,
+                     busy, FACE_META_SLOTS, mFaceLastCount);
+            result.append(buffer);
+        }
+        mPipeLock.unlock();
+#endif
+        result.append(" frame trace, ms after capture:\n");
+        if (mPreviewTrace != NULL && mPreviewTrace->dump(trace, sizeof(trace)) > 0)
+            result.append(trace);
+        if (mRecordTrace != NULL && mRecordTrace->dump(trace, sizeof(trace)) > 0)
+            result.append(trace);
+        if (mBurstTime > 0) {
+            snprintf(buffer, 255, " last burst: %d shots in %lld ms (%lld.%02lld fps)\n",
+                     mBurstShots, ns2ms(mBurstTime),
+                     (mBurstShots * 1000000000LL) / mBurstTime,
+                     ((mBurstShots * 100000000000LL) / mBurstTime) % 100);
+            result.append(buffer);
+        }
+        if (mBench != NULL) {
+            char report[BENCH_REPORT_SIZE];
+
+            if (mBench->json(report, sizeof(report)) > 0) {
+                result.append(" bench: ");
+                result.append(report);
+                result.append("\n");
+            }
+        }
+    } else
+        result.append("No camera client yet.\n");
+    write(fd, result.string(), result.size());
+    return NO_ERROR;
+}
+
+bool CameraHardwareSec::isSupportedPreviewSize(const int width,
+                                               const int height) const
+{
+    unsigned int i;
+
+    for (i = 0; i < mSupportedPreviewSizes.size(); i++) {
+        if (mSupportedPreviewSizes[i].width == width &&
+                mSupportedPreviewSizes[i].height == height)
+            return true;
+    }
 
     return false;
 }
 
-bool CameraHardwareSec::FindEOIMarkerInJPEG(unsigned char *pBuf, int dwBufSize, int *pnJPEGsize)
+bool CameraHardwareSec::getVideosnapshotSize(int *width, int *height)
 {
-    if (NULL == pBuf || 0 >= dwBufSize) {
-        LOGE("FindEOIMarkerInJPEG() => There is no contents.");
-        return false;
+    unsigned int i;
+    Vector<Size> pictureSizes, videoSizes;
+    int ratio = FRM_RATIO(*width, *height);
+
+    mParameters.getSupportedPictureSizes(pictureSizes);
+    mParameters.getSupportedVideoSizes(videoSizes);
+
+    for (i = 0; i < pictureSizes.size(); i++) {
+        if (FRM_RATIO(pictureSizes[i].width, pictureSizes[i].height) == ratio) {
+            if (mRecordHint) {
+                if (pictureSizes[i].width <= videoSizes[0].width) {
+                    *width = pictureSizes[i].width;
+                    *height = pictureSizes[i].height;
+                    LOGV("%s(width(%d), height(%d))", __func__, *width, *height);
+                    return true;
+                }
+            } else {
+                *width = pictureSizes[i].width;
+                *height = pictureSizes[i].height;
+                LOGV("%s(width(%d), height(%d))", __func__, *width, *height);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/* string values of setParameters() and what they mean to the driver */
+struct param_map {
+    const char *str;
+    int         value;
+    int         isp_value;      /* with the internal ISP, -1 : not supported */
+};
+
+#define PARAM_MAP_SIZE(map)     (int)(sizeof(map) / sizeof((map)[0]))
+#define PARAM_UNKNOWN           (-2)
+/* a hal_params field the call didn't give, any int is a value for the others */
+#define PARAM_UNSET             (INT_MIN)
+
+static const struct param_map sPreviewFormats[] = {
+    { CameraParameters::PIXEL_FORMAT_RGB565,   V4L2_PIX_FMT_RGB565,  V4L2_PIX_FMT_RGB565  },
+    { CameraParameters::PIXEL_FORMAT_RGBA8888, V4L2_PIX_FMT_RGB32,   V4L2_PIX_FMT_RGB32   },
+    { CameraParameters::PIXEL_FORMAT_YUV420SP, V4L2_PIX_FMT_NV21,    V4L2_PIX_FMT_NV21    },
+    { CameraParameters::PIXEL_FORMAT_YUV420P,  V4L2_PIX_FMT_YVU420,  V4L2_PIX_FMT_YVU420  },
+    { "yuv420sp_custom",                       V4L2_PIX_FMT_NV12T,   V4L2_PIX_FMT_NV12T   },
+    { "yuv422i",                               V4L2_PIX_FMT_YUYV,    V4L2_PIX_FMT_YUYV    },
+    { "yuv422p",                               V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV422P },
+};
+
+static const struct param_map sPictureFormats[] = {
+    { CameraParameters::PIXEL_FORMAT_RGB565,   V4L2_PIX_FMT_RGB565,  V4L2_PIX_FMT_RGB565  },
+    { CameraParameters::PIXEL_FORMAT_RGBA8888, V4L2_PIX_FMT_RGB32,   V4L2_PIX_FMT_RGB32   },
+    { CameraParameters::PIXEL_FORMAT_YUV420SP, V4L2_PIX_FMT_NV21,    V4L2_PIX_FMT_NV21    },
+    { "yuv420sp_custom",                       V4L2_PIX_FMT_NV12T,   V4L2_PIX_FMT_NV12T   },
+    { "yuv420p",                               V4L2_PIX_FMT_YUV420,  V4L2_PIX_FMT_YUV420  },
+    { "yuv422i",                               V4L2_PIX_FMT_YUYV,    V4L2_PIX_FMT_YUYV    },
+    { "uyv422i_custom",                        V4L2_PIX_FMT_UYVY,    V4L2_PIX_FMT_UYVY    }, //Zero copy UYVY format
+    { "uyv422i",                               V4L2_PIX_FMT_UYVY,    V4L2_PIX_FMT_UYVY    }, //Non-zero copy UYVY format
+    { CameraParameters::PIXEL_FORMAT_JPEG,     V4L2_PIX_FMT_YUYV,    V4L2_PIX_FMT_YUYV    },
+    { "yuv422p",                               V4L2_PIX_FMT_YUV422P, V4L2_PIX_FMT_YUV422P },
+};
+
+static const struct param_map sIsoModes[] = {
+    { "auto", ISO_AUTO, ISO_AUTO },
+    { "50",   ISO_50,   ISO_50   },
+    { "100",  ISO_100,  ISO_100  },
+    { "200",  ISO_200,  ISO_200  },
+    { "400",  ISO_400,  ISO_400  },
+    { "800",  ISO_800,  ISO_800  },
+    { "1600", ISO_1600, ISO_1600 },
+};
+
+static const struct param_map sMeteringModes[] = {
+    { "center", METERING_CENTER, METERING_CENTER },
+    { "spot",   METERING_SPOT,   METERING_SPOT   },
+    { "matrix", METERING_MATRIX, METERING_MATRIX },
+};
+
+static const struct param_map sAntibandingModes[] = {
+    { CameraParameters::ANTIBANDING_AUTO, ANTI_BANDING_AUTO, IS_AFC_AUTO        },
+    { CameraParameters::ANTIBANDING_50HZ, ANTI_BANDING_50HZ, IS_AFC_MANUAL_50HZ },
+    { CameraParameters::ANTIBANDING_60HZ, ANTI_BANDING_60HZ, IS_AFC_MANUAL_60HZ },
+    { CameraParameters::ANTIBANDING_OFF,  ANTI_BANDING_OFF,  IS_AFC_DISABLE     },
+};
+
+//action, night-portrait, theatre, steadyphoto are not supported
+static const struct param_map sSceneModes[] = {
+    { CameraParameters::SCENE_MODE_AUTO,        SCENE_MODE_NONE,         SCENE_MODE_NONE         },
+    { CameraParameters::SCENE_MODE_PORTRAIT,    SCENE_MODE_PORTRAIT,     SCENE_MODE_PORTRAIT     },
+    { CameraParameters::SCENE_MODE_LANDSCAPE,   SCENE_MODE_LANDSCAPE,    SCENE_MODE_LANDSCAPE    },
+    { CameraParameters::SCENE_MODE_SPORTS,      SCENE_MODE_SPORTS,       SCENE_MODE_SPORTS       },
+    { CameraParameters::SCENE_MODE_PARTY,       SCENE_MODE_PARTY_INDOOR, SCENE_MODE_PARTY_INDOOR },
+    { CameraParameters::SCENE_MODE_BEACH,       SCENE_MODE_BEACH_SNOW,   SCENE_MODE_BEACH_SNOW   },
+    { CameraParameters::SCENE_MODE_SNOW,        SCENE_MODE_BEACH_SNOW,   SCENE_MODE_BEACH_SNOW   },
+    { CameraParameters::SCENE_MODE_SUNSET,      SCENE_MODE_SUNSET,       SCENE_MODE_SUNSET       },
+    { CameraParameters::SCENE_MODE_NIGHT,       SCENE_MODE_NIGHTSHOT,    SCENE_MODE_NIGHTSHOT    },
+    { CameraParameters::SCENE_MODE_FIREWORKS,   SCENE_MODE_FIREWORKS,    SCENE_MODE_FIREWORKS    },
+    { CameraParameters::SCENE_MODE_CANDLELIGHT, SCENE_MODE_CANDLE_LIGHT, SCENE_MODE_CANDLE_LIGHT },
+};
+
+static const struct param_map sFocusModes[] = {
+    { CameraParameters::FOCUS_MODE_AUTO,               FOCUS_MODE_AUTO,      FOCUS_MODE_AUTO      },
+    { CameraParameters::FOCUS_MODE_MACRO,              FOCUS_MODE_MACRO,     FOCUS_MODE_MACRO     },
+    { CameraParameters::FOCUS_MODE_INFINITY,           FOCUS_MODE_INFINITY,  FOCUS_MODE_INFINITY  },
+    { CameraParameters::FOCUS_MODE_CONTINUOUS_VIDEO,   FOCUS_MODE_CONTINOUS, FOCUS_MODE_CONTINOUS },
+    { CameraParameters::FOCUS_MODE_CONTINUOUS_PICTURE, FOCUS_MODE_CONTINOUS, FOCUS_MODE_CONTINOUS },
+};
+
+//red-eye is not supported
+static const struct param_map sFlashModes[] = {
+    { CameraParameters::FLASH_MODE_OFF,   FLASH_MODE_OFF,   FLASH_MODE_OFF   },
+    { CameraParameters::FLASH_MODE_AUTO,  FLASH_MODE_AUTO,  FLASH_MODE_AUTO  },
+    { CameraParameters::FLASH_MODE_ON,    FLASH_MODE_ON,    FLASH_MODE_ON    },
+    { CameraParameters::FLASH_MODE_TORCH, FLASH_MODE_TORCH, FLASH_MODE_TORCH },
+};
+
+//twilight, shade, warm_flourescent are not supported
+static const struct param_map sWhiteBalances[] = {
+    { CameraParameters::WHITE_BALANCE_AUTO,             WHITE_BALANCE_AUTO,        WHITE_BALANCE_AUTO        },
+    { CameraParameters::WHITE_BALANCE_DAYLIGHT,         WHITE_BALANCE_SUNNY,       WHITE_BALANCE_SUNNY       },
+    { CameraParameters::WHITE_BALANCE_CLOUDY_DAYLIGHT,  WHITE_BALANCE_CLOUDY,      WHITE_BALANCE_CLOUDY      },
+    { CameraParameters::WHITE_BALANCE_FLUORESCENT,      WHITE_BALANCE_FLUORESCENT, WHITE_BALANCE_FLUORESCENT },
+    { CameraParameters::WHITE_BALANCE_INCANDESCENT,     WHITE_BALANCE_TUNGSTEN,    WHITE_BALANCE_TUNGSTEN    },
+};
+
+//posterize, whiteboard, blackboard, solarize are not supported
+static const struct param_map sImageEffects[] = {
+    { CameraParameters::EFFECT_NONE,     IMAGE_EFFECT_NONE,     IMAGE_EFFECT_NONE     },
+    { CameraParameters::EFFECT_MONO,     IMAGE_EFFECT_BNW,      IMAGE_EFFECT_BNW      },
+    { CameraParameters::EFFECT_SEPIA,    IMAGE_EFFECT_SEPIA,    IMAGE_EFFECT_SEPIA    },
+    { CameraParameters::EFFECT_AQUA,     IMAGE_EFFECT_AQUA,     IMAGE_EFFECT_AQUA     },
+    { CameraParameters::EFFECT_NEGATIVE, IMAGE_EFFECT_NEGATIVE, IMAGE_EFFECT_NEGATIVE },
+};
+
+static const struct param_map sContrasts[] = {
+    { "auto", -1,               IS_CONTRAST_AUTO    },
+    { "-2",   CONTRAST_MINUS_2, IS_CONTRAST_MINUS_2 },
+    { "-1",   CONTRAST_MINUS_1, IS_CONTRAST_MINUS_1 },
+    { "0",    CONTRAST_DEFAULT, IS_CONTRAST_DEFAULT },
+    { "1",    CONTRAST_PLUS_1,  IS_CONTRAST_PLUS_1  },
+    { "2",    CONTRAST_PLUS_2,  IS_CONTRAST_PLUS_2  },
+};
+
+static const struct param_map sGammas[] = {
+    { "off", GAMMA_OFF, GAMMA_OFF },
+    { "on",  GAMMA_ON,  GAMMA_ON  },
+};
+
+static const struct param_map sSlowAEs[] = {
+    { "off", SLOW_AE_OFF, SLOW_AE_OFF },
+    { "on",  SLOW_AE_ON,  SLOW_AE_ON  },
+};
+
+/* PARAM_UNKNOWN when str is not in the map */
+static int lookupParam(const struct param_map *map, int count, const char *str, bool isp)
+{
+    for (int i = 0; i < count; i++) {
+        if (!strcmp(map[i].str, str))
+            return isp ? map[i].isp_value : map[i].value;
+    }
+
+    return PARAM_UNKNOWN;
+}
+
+static const char *paramString(const struct param_map *map, int count, int value)
+{
+    for (int i = 0; i < count; i++) {
+        if (map[i].value == value)
+            return map[i].str;
+    }
+
+    return NULL;
+}
+
+/* hal_params is all ints */
+static void clearParams(void *params, size_t size)
+{
+    int *field = (int *)params;
+
+    for (unsigned int i = 0; i < size / sizeof(int); i++)
+        field[i] = PARAM_UNSET;
+}
+
+/* PARAM_UNSET in a parsed field : nothing to do for it */
+static inline bool isDirty(int next, int current)
+{
+    return next != PARAM_UNSET && next != current;
+}
+
+/*
+ * CameraParameters to driver values, without touching the driver.
+ * Malformed focus areas fail the whole call, other bad values only
+ * leave their field alone.
+ */
+status_t CameraHardwareSec::parseParameters(const CameraParameters& params,
+                                            struct hal_params *p)
+{
+    status_t ret = NO_ERROR;
+    const char *str;
+    int value, min, max;
+
+    clearParams(p, sizeof(*p));
+
+    str = params.get(CameraParameters::KEY_RECORDING_HINT);
+    LOGV("new_record_hint_str: %s", str);
+    if (str)
+        p->record_hint = !strncmp(str, "true", 4);
+
+    // preview size
+    int new_preview_width  = 0;
+    int new_preview_height = 0;
+    params.getPreviewSize(&new_preview_width, &new_preview_height);
+    str = params.getPreviewFormat();
+    LOGV("%s : new_preview_width x new_preview_height = %dx%d, format = %s",
+         __func__, new_preview_width, new_preview_height, str);
+
+    if (0 < new_preview_width && 0 < new_preview_height &&
+            str != NULL &&
+            isSupportedPreviewSize(new_preview_width, new_preview_height)) {
+        p->preview_width  = new_preview_width;
+        p->preview_height = new_preview_height;
+        p->preview_format = lookupParam(sPreviewFormats, PARAM_MAP_SIZE(sPreviewFormats), str, false);
+        if (p->preview_format < 0)
+            p->preview_format = V4L2_PIX_FMT_NV21; //for 3rd party
+    } else {
+        LOGE("%s: Invalid preview size(%dx%d)",
+                __func__, new_preview_width, new_preview_height);
+        ret = INVALID_OPERATION;
+    }
+
+    // picture size
+    params.getPictureSize(&p->picture_width, &p->picture_height);
+    LOGV("%s : new_picture_width x new_picture_height = %dx%d",
+         __func__, p->picture_width, p->picture_height);
+
+    // picture format
+    str = params.getPictureFormat();
+    LOGV("%s : new_str_picture_format %s", __func__, str);
+    if (str != NULL) {
+        p->picture_format = lookupParam(sPictureFormats, PARAM_MAP_SIZE(sPictureFormats), str, false);
+        if (p->picture_format < 0)
+            p->picture_format = V4L2_PIX_FMT_NV21; //for 3rd party
+    }
+
+    /* we ignore bad values */
+    value = params.getInt(CameraParameters::KEY_JPEG_QUALITY);
+    if (value >= 1 && value <= 100)
+        p->jpeg_quality = value;
+
+    if (0 <= params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH) &&
+        0 <= params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT)) {
+        p->thumb_width  = params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
+        p->thumb_height = params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
+    }
+
+    value = params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY);
+    if (value >= 1 && value <= 100)
+        p->thumb_quality = value;
+
+    p->frame_rate = params.getPreviewFrameRate();
+    p->rotation = params.getInt(CameraParameters::KEY_ROTATION);
+    p->zoom = params.getInt(CameraParameters::KEY_ZOOM);
+
+    value = params.getInt("brightness");
+    if (params.getInt("brightness-min") <= value && value <= params.getInt("brightness-max"))
+        p->brightness = value;
+
+    value = params.getInt("saturation");
+    if (params.getInt("saturation-min") <= value && value <= params.getInt("saturation-max"))
+        p->saturation = value;
+
+    value = params.getInt("sharpness");
+    if (params.getInt("sharpness-min") <= value && value <= params.getInt("sharpness-max"))
+        p->sharpness = value;
+
+    value = params.getInt("hue");
+    if (params.getInt("hue-min") <= value && value <= params.getInt("hue-max"))
+        p->hue = value;
+
+    value = params.getInt(CameraParameters::KEY_EXPOSURE_COMPENSATION);
+    min = params.getInt(CameraParameters::KEY_MIN_EXPOSURE_COMPENSATION);
+    max = params.getInt(CameraParameters::KEY_MAX_EXPOSURE_COMPENSATION);
+    if (min <= value && value <= max)
+        p->exposure = value;
+
+    str = params.get(CameraParameters::KEY_AUTO_EXPOSURE_LOCK);
+    if (str != NULL)
+        p->ae_lock = !strncmp(str, "true", 4);
+
+    str = params.get("iso");
+    if (str != NULL) {
+        p->iso = lookupParam(sIsoModes, PARAM_MAP_SIZE(sIsoModes), str, mUseInternalISP);
+        if (p->iso == PARAM_UNKNOWN) {
+            LOGE("ERR(%s):Invalid iso value(%s)", __func__, str);
+            ret = UNKNOWN_ERROR;
+        }
+    }
+
+    str = params.get("metering");
+    if (str != NULL) {
+        p->metering = lookupParam(sMeteringModes, PARAM_MAP_SIZE(sMeteringModes), str, mUseInternalISP);
+        if (p->metering == PARAM_UNKNOWN) {
+            LOGE("ERR(%s):Invalid metering value(%s)", __func__, str);
+            ret = UNKNOWN_ERROR;
+        }
+    }
+
+    str = params.get("burst-capture");
+    if (str != NULL) {
+        value = atoi(str);
+        if (value < -1 || BURST_MAX_SHOTS < value) {
+            LOGE("ERR(%s):Invalid burst-capture value(%s)", __func__, str);
+            ret = UNKNOWN_ERROR;
+        } else
+            p->burst = value;
+    }
+
+#ifdef ZERO_SHUTTER_LAG
+    str = params.get("zsl-frame-select");
+    if (str != NULL) {
+        if (!strcmp(str, "nearest"))
+            p->zsl_select = SecCamera::ZSL_SELECT_NEAREST;
+        else if (!strcmp(str, "sharpest"))
+            p->zsl_select = SecCamera::ZSL_SELECT_SHARPEST;
+        else {
+            LOGE("ERR(%s):Invalid zsl-frame-select value(%s)", __func__, str);
+            ret = UNKNOWN_ERROR;
+        }
+    }
+#endif
+
+    str = params.get("record-backpressure");
+    if (str != NULL) {
+        if (!strcmp(str, "drop-oldest"))
+            p->record_policy = RECORD_DROP_OLDEST;
+        else if (!strcmp(str, "drop-newest"))
+            p->record_policy = RECORD_DROP_NEWEST;
+        else if (!strcmp(str, "throttle"))
+            p->record_policy = RECORD_THROTTLE;
+        else {
+            LOGE("ERR(%s):Invalid record-backpressure value(%s)", __func__, str);
+            ret = UNKNOWN_ERROR;
+        }
+    }
+
+    str = params.get(CameraParameters::KEY_ANTIBANDING);
+    if (str != NULL) {
+        p->antibanding = lookupParam(sAntibandingModes, PARAM_MAP_SIZE(sAntibandingModes),
+                                     str, mUseInternalISP);
+        if (p->antibanding == PARAM_UNKNOWN) {
+            LOGE("ERR(%s):Invalid antibanding value(%s)", __func__, str);
+            ret = UNKNOWN_ERROR;
+        }
+    }
+
+    // scene mode
+    const char *new_scene_mode_str = params.get(CameraParameters::KEY_SCENE_MODE);
+    const char *current_scene_mode_str = mParameters.get(CameraParameters::KEY_SCENE_MODE);
+
+    // fps range
+    int new_min_fps = 0;
+    int new_max_fps = 0;
+    int current_min_fps, current_max_fps;
+    params.getPreviewFpsRange(&new_min_fps, &new_max_fps);
+    mParameters.getPreviewFpsRange(&current_min_fps, &current_max_fps);
+    /* our fps range is determined by the sensor, reject any request
+     * that isn't exactly what we're already at.
+     * but the check is performed when requesting only changing fps range
+     */
+    if (new_scene_mode_str && current_scene_mode_str) {
+        if (!strcmp(new_scene_mode_str, current_scene_mode_str)) {
+            if ((new_min_fps != current_min_fps) || (new_max_fps != current_max_fps)) {
+                LOGW("%s : requested new_min_fps = %d, new_max_fps = %d not allowed",
+                        __func__, new_min_fps, new_max_fps);
+                /* TODO : We need policy for fps. */
+                LOGW("%s : current_min_fps = %d, current_max_fps = %d",
+                        __func__, current_min_fps, current_max_fps);
+                //ret = UNKNOWN_ERROR;
+            }
+        }
+    } else {
+        /* Check basic validation if scene mode is different */
+        if ((new_min_fps > new_max_fps) ||
+            (new_min_fps < 0) || (new_max_fps < 0))
+        ret = UNKNOWN_ERROR;
     }
 
-    unsigned char *pBufEnd = pBuf + dwBufSize;
-
-    while (pBuf < pBufEnd) {
-        if (CheckEOIMarker(pBuf++))
-            return true;
+    const char *new_focus_mode_str = params.get(CameraParameters::KEY_FOCUS_MODE);
+    const char *new_flash_mode_str = params.get(CameraParameters::KEY_FLASH_MODE);
+    const char *new_white_str = params.get(CameraParameters::KEY_WHITE_BALANCE);
 
-        (*pnJPEGsize)++;
+    if (new_scene_mode_str != NULL) {
+        p->scene_mode = lookupParam(sSceneModes, PARAM_MAP_SIZE(sSceneModes),
+                                    new_scene_mode_str, mUseInternalISP);
+        if (p->scene_mode == PARAM_UNKNOWN) {
+            LOGE("%s::unmatched scene_mode(%s)", __func__, new_scene_mode_str);
+            ret = UNKNOWN_ERROR;
+        }
     }
 
-    return false;
-}
-
-bool CameraHardwareSec::SplitFrame(unsigned char *pFrame, int dwSize,
-                    int dwJPEGLineLength, int dwVideoLineLength, int dwVideoHeight,
-                    void *pJPEG, int *pdwJPEGSize,
-                    void *pVideo, int *pdwVideoSize)
-{
-    LOGV("===========SplitFrame Start==============");
-
-    if (NULL == pFrame || 0 >= dwSize) {
-        LOGE("There is no contents (pFrame=%p, dwSize=%d", pFrame, dwSize);
-        return false;
+    /* a new scene brings its own focus, flash and white balance */
+    p->scene_defaults = 0;
+    if (0 <= p->scene_mode && p->scene_mode != SCENE_MODE_NONE &&
+        current_scene_mode_str != NULL && strcmp(new_scene_mode_str, current_scene_mode_str)) {
+        p->scene_defaults = 1;
+        new_focus_mode_str = CameraParameters::FOCUS_MODE_AUTO;
+        new_flash_mode_str = CameraParameters::FLASH_MODE_OFF;
+        if (mCameraID == SecCamera::CAMERA_ID_BACK &&
+            (p->scene_mode == SCENE_MODE_PORTRAIT || p->scene_mode == SCENE_MODE_PARTY_INDOOR))
+            new_flash_mode_str = CameraParameters::FLASH_MODE_AUTO;
+        new_white_str = NULL;
     }
 
-    if (0 == dwJPEGLineLength || 0 == dwVideoLineLength) {
-        LOGE("There in no input information for decoding interleaved jpeg");
-        return false;
+    /* TODO : currently only posible focus modes at BACK camera */
+    if ((new_focus_mode_str != NULL) && (mCameraID == SecCamera::CAMERA_ID_BACK)) {
+        p->focus_mode = lookupParam(sFocusModes, PARAM_MAP_SIZE(sFocusModes),
+                                    new_focus_mode_str, mUseInternalISP);
+        if (p->focus_mode == PARAM_UNKNOWN) {
+            LOGE("%s::unmatched focus_mode(%s)", __func__, new_focus_mode_str);
+            ret = UNKNOWN_ERROR;
+        }
     }
 
-    unsigned char *pSrc = pFrame;
-    unsigned char *pSrcEnd = pFrame + dwSize;
-
-    unsigned char *pJ = (unsigned char *)pJPEG;
-    int dwJSize = 0;
-    unsigned char *pV = (unsigned char *)pVideo;
-    int dwVSize = 0;
-
-    bool bRet = false;
-    bool isFinishJpeg = false;
-
-    while (pSrc < pSrcEnd) {
-        // Check video start marker
-        if (CheckVideoStartMarker(pSrc)) {
-            int copyLength;
-
-            if (pSrc + dwVideoLineLength <= pSrcEnd)
-                copyLength = dwVideoLineLength;
-            else
-                copyLength = pSrcEnd - pSrc - VIDEO_COMMENT_MARKER_LENGTH;
-
-            // Copy video data
-            if (pV) {
-                memcpy(pV, pSrc + VIDEO_COMMENT_MARKER_LENGTH, copyLength);
-                pV += copyLength;
-                dwVSize += copyLength;
-            }
+    if (new_flash_mode_str != NULL) {
+        p->flash_mode = lookupParam(sFlashModes, PARAM_MAP_SIZE(sFlashModes),
+                                    new_flash_mode_str, mUseInternalISP);
+        if (p->flash_mode == PARAM_UNKNOWN) {
+            LOGE("%s::unmatched flash_mode(%s)", __func__, new_flash_mode_str);
+            ret = UNKNOWN_ERROR;
+        }
+    }
 
-            pSrc += copyLength + VIDEO_COMMENT_MARKER_LENGTH;
-        } else {
-            // Copy pure JPEG data
-            int size = 0;
-            int dwCopyBufLen = dwJPEGLineLength <= pSrcEnd-pSrc ? dwJPEGLineLength : pSrcEnd - pSrc;
+    /* white balance only counts with the auto scene */
+    if (new_white_str != NULL && p->scene_mode == SCENE_MODE_NONE) {
+        p->white_balance = lookupParam(sWhiteBalances, PARAM_MAP_SIZE(sWhiteBalances),
+                                       new_white_str, mUseInternalISP);
+        if (p->white_balance == PARAM_UNKNOWN) {
+            LOGE("ERR(%s):Invalid white balance(%s)", __func__, new_white_str);
+            ret = UNKNOWN_ERROR;
+        }
+    }
 
-            if (FindEOIMarkerInJPEG((unsigned char *)pSrc, dwCopyBufLen, &size)) {
-                isFinishJpeg = true;
-                size += 2;  // to count EOF marker size
-            } else {
-                if ((dwCopyBufLen == 1) && (pJPEG < pJ)) {
-                    unsigned char checkBuf[2] = { *(pJ - 1), *pSrc };
+    str = params.get(CameraParameters::KEY_AUTO_WHITEBALANCE_LOCK);
+    if (str != NULL)
+        p->awb_lock = !strncmp(str, "true", 4);
 
-                    if (CheckEOIMarker(checkBuf))
-                        isFinishJpeg = true;
-                }
-                size = dwCopyBufLen;
-            }
+    str = params.get(CameraParameters::KEY_FOCUS_AREAS);
+    LOGV("Touched rect is '%s'", str);
+    if (str != NULL) {
+        int left = 0, top = 0, right = 0, bottom = 0, touched = 0;
+        char *end;
+        char delim = ',';
 
-            memcpy(pJ, pSrc, size);
+        left = (int)strtol(str+1, &end, 10);
+        if (*end != delim) {
+            LOGE("Cannot find '%c' in str=%s", delim, str);
+            return -1;
+        }
+        top = (int)strtol(end+1, &end, 10);
+        if (*end != delim) {
+            LOGE("Cannot find '%c' in str=%s", delim, str);
+            return -1;
+        }
+        right = (int)strtol(end+1, &end, 10);
+        if (*end != delim) {
+            LOGE("Cannot find '%c' in str=%s", delim, str);
+            return -1;
+        }
+        bottom = (int)strtol(end+1, &end, 10);
+        if (*end != delim) {
+            LOGE("Cannot find '%c' in str=%s", delim, str);
+            return -1;
+        }
+        touched = (int)strtol(end+1, &end, 10);
+        if (*end != ')') {
+            LOGE("Cannot find ')' in str=%s", str);
+            return -1;
+        }
 
-            dwJSize += size;
+        /* TODO : Converting axis and  Calcurating center of rect. Because driver need (x, y) point. */
+        p->touch_x = (int)((1023 * (left + 1000)) / 2000) + 97;
+        p->touch_y = (int)((1023 * (top + 1000)) / 2000) + 128;
+        p->touched = touched;
+    }
 
-            pJ += dwCopyBufLen;
-            pSrc += dwCopyBufLen;
+    str = params.get(CameraParameters::KEY_EFFECT);
+    if (str != NULL) {
+        p->effect = lookupParam(sImageEffects, PARAM_MAP_SIZE(sImageEffects), str, mUseInternalISP);
+        if (p->effect == PARAM_UNKNOWN) {
+            LOGE("ERR(%s):Invalid effect(%s)", __func__, str);
+            ret = UNKNOWN_ERROR;
         }
-        if (isFinishJpeg)
-            break;
     }
 
-    if (isFinishJpeg) {
-        bRet = true;
-        if (pdwJPEGSize)
-            *pdwJPEGSize = dwJSize;
-        if (pdwVideoSize)
-            *pdwVideoSize = dwVSize;
-    } else {
-        LOGE("DecodeInterleaveJPEG_WithOutDT() => Can not find EOI");
-        bRet = false;
-        if (pdwJPEGSize)
-            *pdwJPEGSize = 0;
-        if (pdwVideoSize)
-            *pdwVideoSize = 0;
+    str = params.get("contrast");
+    LOGV("%s : new_contrast_str %s", __func__, str);
+    if (str != NULL) {
+        p->contrast = lookupParam(sContrasts, PARAM_MAP_SIZE(sContrasts), str, mUseInternalISP);
+        if (p->contrast == PARAM_UNKNOWN) {
+            LOGE("ERR(%s):Invalid contrast value(%s)", __func__, str);
+            ret = UNKNOWN_ERROR;
+        } else if (p->contrast < 0)
+            LOGW("WARN(%s):Invalid contrast value (%s)", __func__, str);
     }
-    LOGV("===========SplitFrame end==============");
-
-    return bRet;
-}
-
-int CameraHardwareSec::decodeInterleaveData(unsigned char *pInterleaveData,
-                                                 int interleaveDataSize,
-                                                 int yuvWidth,
-                                                 int yuvHeight,
-                                                 int *pJpegSize,
-                                                 void *pJpegData,
-                                                 void *pYuvData)
-{
-    if (pInterleaveData == NULL)
-        return false;
-
-    bool ret = true;
-    unsigned int *interleave_ptr = (unsigned int *)pInterleaveData;
-    unsigned char *jpeg_ptr = (unsigned char *)pJpegData;
-    unsigned char *yuv_ptr = (unsigned char *)pYuvData;
-    unsigned char *p;
-    int jpeg_size = 0;
-    int yuv_size = 0;
 
-    int i = 0;
+    p->wdr = params.getInt("wdr");
+    p->anti_shake = mInternalParameters.getInt("anti-shake");
 
-    LOGV("decodeInterleaveData Start~~~");
-    while (i < interleaveDataSize) {
-        if ((*interleave_ptr == 0xFFFFFFFF) || (*interleave_ptr == 0x02FFFFFF) ||
-                (*interleave_ptr == 0xFF02FFFF)) {
-            // Padding Data
-            interleave_ptr++;
-            i += 4;
-        } else if ((*interleave_ptr & 0xFFFF) == 0x05FF) {
-            // Start-code of YUV Data
-            p = (unsigned char *)interleave_ptr;
-            p += 2;
-            i += 2;
-
-            // Extract YUV Data
-            if (pYuvData != NULL) {
-                memcpy(yuv_ptr, p, yuvWidth * 2);
-                yuv_ptr += yuvWidth * 2;
-                yuv_size += yuvWidth * 2;
-            }
-            p += yuvWidth * 2;
-            i += yuvWidth * 2;
+    /* TODO */
+    /* GED application don't set different recording size before recording button is pushed */
+    params.getVideoSize(&p->recording_width, &p->recording_height);
+    LOGV("new_recording_width (%d) new_recording_height (%d)",
+            p->recording_width, p->recording_height);
 
-            // Check End-code of YUV Data
-            if ((*p == 0xFF) && (*(p + 1) == 0x06)) {
-                interleave_ptr = (unsigned int *)(p + 2);
-                i += 2;
-            } else {
-                ret = false;
-                break;
-            }
-        } else {
-            // Extract JPEG Data
-            if (pJpegData != NULL) {
-                memcpy(jpeg_ptr, interleave_ptr, 4);
-                jpeg_ptr += 4;
-                jpeg_size += 4;
-            }
-            interleave_ptr++;
-            i += 4;
+    str = mInternalParameters.get("video_recording_gamma");
+    if (str != NULL) {
+        p->gamma = lookupParam(sGammas, PARAM_MAP_SIZE(sGammas), str, mUseInternalISP);
+        if (p->gamma == PARAM_UNKNOWN) {
+            LOGE("%s::unmatched gamma(%s)", __func__, str);
+            ret = UNKNOWN_ERROR;
         }
     }
-    if (ret) {
-        if (pJpegData != NULL) {
-            // Remove Padding after EOI
-            for (i = 0; i < 3; i++) {
-                if (*(--jpeg_ptr) != 0xFF) {
-                    break;
-                }
-                jpeg_size--;
-            }
-            *pJpegSize = jpeg_size;
 
-        }
-        // Check YUV Data Size
-        if (pYuvData != NULL) {
-            if (yuv_size != (yuvWidth * yuvHeight * 2)) {
-                ret = false;
-            }
+    str = mInternalParameters.get("slow_ae");
+    if (str != NULL) {
+        p->slow_ae = lookupParam(sSlowAEs, PARAM_MAP_SIZE(sSlowAEs), str, mUseInternalISP);
+        if (p->slow_ae == PARAM_UNKNOWN) {
+            LOGE("%s::unmatched slow_ae(%s)", __func__, str);
+            ret = UNKNOWN_ERROR;
         }
     }
-    LOGV("decodeInterleaveData End~~~");
-    return ret;
-}
-
-status_t CameraHardwareSec::dump(int fd) const
-{
-    const size_t SIZE = 256;
-    char buffer[SIZE];
-    String8 result;
-    const Vector<String16> args;
-
-    if (mSecCamera != 0) {
-        mSecCamera->dump(fd);
-        mParameters.dump(fd, args);
-        mInternalParameters.dump(fd, args);
-        snprintf(buffer, 255, " preview running(%s)\n", mPreviewRunning?"true": "false");
-        result.append(buffer);
-    } else
-        result.append("No camera client yet.\n");
-    write(fd, result.string(), result.size());
-    return NO_ERROR;
-}
 
-bool CameraHardwareSec::isSupportedPreviewSize(const int width,
-                                               const int height) const
-{
-    unsigned int i;
+    /*Camcorder fix fps*/
+    p->sensor_mode = mInternalParameters.getInt("cam_mode");
+    p->shot_mode = mInternalParameters.getInt("shot_mode");
+    p->dataline = mInternalParameters.getInt("chk_dataline");
 
-    for (i = 0; i < mSupportedPreviewSizes.size(); i++) {
-        if (mSupportedPreviewSizes[i].width == width &&
-                mSupportedPreviewSizes[i].height == height)
-            return true;
+    /*
+     * These never go negative : a missing key (-1 from getInt()), an
+     * unknown string or a mode the sensor doesn't have leaves them unset.
+     */
+    int *unsigned_fields[] = {
+        &p->frame_rate, &p->rotation, &p->zoom, &p->iso, &p->metering,
+        &p->antibanding, &p->scene_mode, &p->focus_mode, &p->flash_mode,
+        &p->white_balance, &p->effect, &p->contrast, &p->wdr, &p->anti_shake,
+        &p->gamma, &p->slow_ae, &p->sensor_mode, &p->shot_mode, &p->dataline,
+    };
+    for (unsigned int i = 0; i < sizeof(unsigned_fields) / sizeof(unsigned_fields[0]); i++) {
+        if (*unsigned_fields[i] < 0)
+            *unsigned_fields[i] = PARAM_UNSET;
     }
 
-    return false;
+    return ret;
 }
 
-bool CameraHardwareSec::getVideosnapshotSize(int *width, int *height)
+/* the driver may have lost what we think it has, push everything on the next call */
+void CameraHardwareSec::invalidateParameters(void)
 {
-    unsigned int i;
-    Vector<Size> pictureSizes, videoSizes;
-    int ratio = FRM_RATIO(*width, *height);
-
-    mParameters.getSupportedPictureSizes(pictureSizes);
-    mParameters.getSupportedVideoSizes(videoSizes);
-
-    for (i = 0; i < pictureSizes.size(); i++) {
-        if (FRM_RATIO(pictureSizes[i].width, pictureSizes[i].height) == ratio) {
-            if (mRecordHint) {
-                if (pictureSizes[i].width <= videoSizes[0].width) {
-                    *width = pictureSizes[i].width;
-                    *height = pictureSizes[i].height;
-                    LOGV("%s(width(%d), height(%d))", __func__, *width, *height);
-                    return true;
-                }
-            } else {
-                *width = pictureSizes[i].width;
-                *height = pictureSizes[i].height;
-                LOGV("%s(width(%d), height(%d))", __func__, *width, *height);
-                return true;
-            }
-        }
-    }
-
-    return false;
+    clearParams(&mHalParams, sizeof(mHalParams));
 }
 
-status_t CameraHardwareSec::setParameters(const CameraParameters& params)
+/*
+ * Push the fields of p that differ from what the driver already has, in
+ * one pass. mHalParams follows every field that was applied.
+ */
+status_t CameraHardwareSec::applyParameters(const CameraParameters& params,
+                                            const struct hal_params *p)
 {
-    LOGV("%s :", __func__);
-
     status_t ret = NO_ERROR;
+    struct hal_params *cur = &mHalParams;
+    int applied = 0;
 
-    const char *new_record_hint_str = params.get(CameraParameters::KEY_RECORDING_HINT);
-    const char *curr_record_hint_str = mParameters.get(CameraParameters::KEY_RECORDING_HINT);
-    LOGV("new_record_hint_str: %s", new_record_hint_str);
-
-    if (new_record_hint_str) {
-        if (strncmp(new_record_hint_str, curr_record_hint_str, 5)) {
-            mRecordHint = !strncmp(new_record_hint_str, "true", 4);
-            if (mSecCamera->setMode(mRecordHint) < 0) {
-                LOGE("ERR(%s):fail on mSecCamera->setMode(%d)", __func__, mRecordHint);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set(CameraParameters::KEY_RECORDING_HINT, new_record_hint_str);
-            }
-
-            if (mUseInternalISP) {
-                if (mSecCamera->initSetParams() < 0) {
-                    LOGE("ERR(%s):fail on mSecCamera->initSetParams()", __func__);
-                    ret = UNKNOWN_ERROR;
-                }
-            }
-        }
-    }
-
-    /* if someone calls us while picture thread is running, it could screw
-     * up the sensor quite a bit so return error.  we can't wait because
-     * that would cause deadlock with the callbacks
-     */
-    mStateLock.lock();
-    if (mCaptureInProgress) {
-        mStateLock.unlock();
-        LOGE("%s : capture in progress, not allowed", __func__);
-        return UNKNOWN_ERROR;
-    }
-    mStateLock.unlock();
-
-    // preview size
-    int new_preview_width  = 0;
-    int new_preview_height = 0;
-    int new_preview_format = 0;
-
-    params.getPreviewSize(&new_preview_width, &new_preview_height);
-
-    if (mUseInternalISP) {
-        int videosnapshot_width = new_preview_width;
-        int videosnapshot_height = new_preview_height;
+    /* the videosnapshot size follows the preview size and the record hint */
+    if (mUseInternalISP && p->preview_format != PARAM_UNSET &&
+        (p->preview_width != cur->preview_width ||
+         p->preview_height != cur->preview_height ||
+         (int)mRecordHint != cur->videosnapshot_hint)) {
+        int videosnapshot_width = p->preview_width;
+        int videosnapshot_height = p->preview_height;
 
         if (!getVideosnapshotSize(&videosnapshot_width, &videosnapshot_height)) {
             LOGE("ERR(%s):fail on getVideosnapshotSize(width(%d), height(%d))",
@@ -1809,60 +3771,37 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
             LOGE("ERR(%s):fail on mSecCamera->setVideosnapshotSize(width(%d), height(%d))",
                     __func__, videosnapshot_width, videosnapshot_height);
             ret = UNKNOWN_ERROR;
+        } else {
+            cur->preview_width  = p->preview_width;
+            cur->preview_height = p->preview_height;
+            cur->videosnapshot_hint = mRecordHint;
         }
+        applied++;
     }
 
-    const char *new_str_preview_format = params.getPreviewFormat();
-    LOGV("%s : new_preview_width x new_preview_height = %dx%d, format = %s",
-         __func__, new_preview_width, new_preview_height, new_str_preview_format);
-
-    if (0 < new_preview_width && 0 < new_preview_height &&
-            new_str_preview_format != NULL &&
-            isSupportedPreviewSize(new_preview_width, new_preview_height)) {
-
-        mFrameSizeDelta = 16;
-        if (!strcmp(new_str_preview_format,
-                    CameraParameters::PIXEL_FORMAT_RGB565)) {
-            new_preview_format = V4L2_PIX_FMT_RGB565;
-            mFrameSizeDelta = 0;
-        }
-        else if (!strcmp(new_str_preview_format,
-                         CameraParameters::PIXEL_FORMAT_RGBA8888)) {
-            new_preview_format = V4L2_PIX_FMT_RGB32;
-            mFrameSizeDelta = 0;
-        }
-        else if (!strcmp(new_str_preview_format,
-                         CameraParameters::PIXEL_FORMAT_YUV420SP)) {
-            new_preview_format = V4L2_PIX_FMT_NV21;
-            mPreviewFmtPlane = PREVIEW_FMT_2_PLANE;
-        }
-        else if (!strcmp(new_str_preview_format,
-                         CameraParameters::PIXEL_FORMAT_YUV420P)) {
-            new_preview_format = V4L2_PIX_FMT_YVU420;
-            mPreviewFmtPlane = PREVIEW_FMT_3_PLANE;
-        }
-        else if (!strcmp(new_str_preview_format, "yuv420sp_custom"))
-            new_preview_format = V4L2_PIX_FMT_NV12T;
-        else if (!strcmp(new_str_preview_format, "yuv422i"))
-            new_preview_format = V4L2_PIX_FMT_YUYV;
-        else if (!strcmp(new_str_preview_format, "yuv422p"))
-            new_preview_format = V4L2_PIX_FMT_YUV422P;
-        else
-            new_preview_format = V4L2_PIX_FMT_NV21; //for 3rd party
-
+    // preview size
+    if (p->preview_format != PARAM_UNSET) {
         int current_preview_width, current_preview_height, current_frame_size;
         mSecCamera->getPreviewSize(&current_preview_width,
                                    &current_preview_height,
                                    &current_frame_size);
         int current_pixel_format = mSecCamera->getPreviewPixelFormat();
 
-        if (current_preview_width != new_preview_width ||
-            current_preview_height != new_preview_height ||
-            current_pixel_format != new_preview_format) {
-            if (mSecCamera->setPreviewSize(new_preview_width, new_preview_height,
-                                           new_preview_format) < 0) {
+        mFrameSizeDelta = 16;
+        if (p->preview_format == V4L2_PIX_FMT_RGB565 || p->preview_format == V4L2_PIX_FMT_RGB32)
+            mFrameSizeDelta = 0;
+        else if (p->preview_format == V4L2_PIX_FMT_NV21)
+            mPreviewFmtPlane = PREVIEW_FMT_2_PLANE;
+        else if (p->preview_format == V4L2_PIX_FMT_YVU420)
+            mPreviewFmtPlane = PREVIEW_FMT_3_PLANE;
+
+        if (current_preview_width != p->preview_width ||
+            current_preview_height != p->preview_height ||
+            current_pixel_format != p->preview_format) {
+            if (mSecCamera->setPreviewSize(p->preview_width, p->preview_height,
+                                           p->preview_format) < 0) {
                 LOGE("ERR(%s):Fail on mSecCamera->setPreviewSize(width(%d), height(%d), format(%d))",
-                     __func__, new_preview_width, new_preview_height, new_preview_format);
+                     __func__, p->preview_width, p->preview_height, p->preview_format);
                 ret = UNKNOWN_ERROR;
             } else {
                 if (mPreviewWindow) {
@@ -1871,39 +3810,26 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
                         ret = INVALID_OPERATION;
                     }
                     LOGV("%s: mPreviewWindow (%p) set_buffers_geometry", __func__, mPreviewWindow);
-                    LOGV("%s: mPreviewWindow->set_buffers_geometry (%p)", __func__,
-                         mPreviewWindow->set_buffers_geometry);
                     mPreviewWindow->set_buffers_geometry(mPreviewWindow,
-                                                         new_preview_width, new_preview_height,
-                                                         V4L2_PIX_2_HAL_PIXEL_FORMAT(new_preview_format));
-                    LOGV("%s: DONE mPreviewWindow (%p) set_buffers_geometry", __func__, mPreviewWindow);
+                                                         p->preview_width, p->preview_height,
+                                                         V4L2_PIX_2_HAL_PIXEL_FORMAT(p->preview_format));
                 }
-                mParameters.setPreviewSize(new_preview_width, new_preview_height);
-                mParameters.setPreviewFormat(new_str_preview_format);
+                mParameters.setPreviewSize(p->preview_width, p->preview_height);
+                mParameters.setPreviewFormat(params.getPreviewFormat());
             }
+            applied++;
         }
-    } else {
-        LOGE("%s: Invalid preview size(%dx%d)",
-                __func__, new_preview_width, new_preview_height);
-
-        ret = INVALID_OPERATION;
     }
 
     // picture size
-    int new_picture_width  = 0;
-    int new_picture_height = 0;
-
-    params.getPictureSize(&new_picture_width, &new_picture_height);
-    LOGV("%s : new_picture_width x new_picture_height = %dx%d", __func__, new_picture_width, new_picture_height);
-
     int current_picture_width, current_picture_height, current_picture_size;
     mSecCamera->getSnapshotSize(&current_picture_width, &current_picture_height, &current_picture_size);
 
-    if (new_picture_width != current_picture_width ||
-        new_picture_height != current_picture_height) {
-        if (mSecCamera->setSnapshotSize(new_picture_width, new_picture_height) < 0) {
+    if (p->picture_width != current_picture_width ||
+        p->picture_height != current_picture_height) {
+        if (mSecCamera->setSnapshotSize(p->picture_width, p->picture_height) < 0) {
             LOGE("ERR(%s):fail on mSecCamera->setSnapshotSize(width(%d), height(%d))",
-                    __func__, new_picture_width, new_picture_height);
+                    __func__, p->picture_width, p->picture_height);
             ret = UNKNOWN_ERROR;
         } else {
 #ifdef ZERO_SHUTTER_LAG
@@ -1912,687 +3838,368 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
                 mSecCamera->startSnapshot(NULL);
             }
 #endif
-            mParameters.setPictureSize(new_picture_width, new_picture_height);
+            mParameters.setPictureSize(p->picture_width, p->picture_height);
         }
+        applied++;
     }
 
-    // picture format
-    const char *new_str_picture_format = params.getPictureFormat();
-    LOGV("%s : new_str_picture_format %s", __func__, new_str_picture_format);
-    if (new_str_picture_format != NULL) {
-        int new_picture_format = 0;
-
-        if (!strcmp(new_str_picture_format, CameraParameters::PIXEL_FORMAT_RGB565))
-            new_picture_format = V4L2_PIX_FMT_RGB565;
-        else if (!strcmp(new_str_picture_format, CameraParameters::PIXEL_FORMAT_RGBA8888))
-            new_picture_format = V4L2_PIX_FMT_RGB32;
-        else if (!strcmp(new_str_picture_format, CameraParameters::PIXEL_FORMAT_YUV420SP))
-            new_picture_format = V4L2_PIX_FMT_NV21;
-        else if (!strcmp(new_str_picture_format, "yuv420sp_custom"))
-            new_picture_format = V4L2_PIX_FMT_NV12T;
-        else if (!strcmp(new_str_picture_format, "yuv420p"))
-            new_picture_format = V4L2_PIX_FMT_YUV420;
-        else if (!strcmp(new_str_picture_format, "yuv422i"))
-            new_picture_format = V4L2_PIX_FMT_YUYV;
-        else if (!strcmp(new_str_picture_format, "uyv422i_custom")) //Zero copy UYVY format
-            new_picture_format = V4L2_PIX_FMT_UYVY;
-        else if (!strcmp(new_str_picture_format, "uyv422i")) //Non-zero copy UYVY format
-            new_picture_format = V4L2_PIX_FMT_UYVY;
-        else if (!strcmp(new_str_picture_format, CameraParameters::PIXEL_FORMAT_JPEG))
-            new_picture_format = V4L2_PIX_FMT_YUYV;
-        else if (!strcmp(new_str_picture_format, "yuv422p"))
-            new_picture_format = V4L2_PIX_FMT_YUV422P;
-        else
-            new_picture_format = V4L2_PIX_FMT_NV21; //for 3rd party
-
-        if (mSecCamera->setSnapshotPixelFormat(new_picture_format) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setSnapshotPixelFormat(format(%d))", __func__, new_picture_format);
+    if (isDirty(p->picture_format, cur->picture_format)) {
+        if (mSecCamera->setSnapshotPixelFormat(p->picture_format) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setSnapshotPixelFormat(format(%d))", __func__, p->picture_format);
             ret = UNKNOWN_ERROR;
-        } else
-            mParameters.setPictureFormat(new_str_picture_format);
+        } else {
+            mParameters.setPictureFormat(params.getPictureFormat());
+            cur->picture_format = p->picture_format;
+        }
+        applied++;
     }
 
-    // JPEG image quality
-    int new_jpeg_quality = params.getInt(CameraParameters::KEY_JPEG_QUALITY);
-    LOGV("%s : new_jpeg_quality %d", __func__, new_jpeg_quality);
-    /* we ignore bad values */
-    if (new_jpeg_quality >=1 && new_jpeg_quality <= 100) {
-        if (mSecCamera->setJpegQuality(new_jpeg_quality) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setJpegQuality(quality(%d))", __func__, new_jpeg_quality);
+    if (isDirty(p->jpeg_quality, cur->jpeg_quality)) {
+        if (mSecCamera->setJpegQuality(p->jpeg_quality) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setJpegQuality(quality(%d))", __func__, p->jpeg_quality);
             ret = UNKNOWN_ERROR;
-        } else
-            mParameters.set(CameraParameters::KEY_JPEG_QUALITY, new_jpeg_quality);
+        } else {
+            mParameters.set(CameraParameters::KEY_JPEG_QUALITY, p->jpeg_quality);
+            cur->jpeg_quality = p->jpeg_quality;
+        }
+        applied++;
     }
 
-    // JPEG thumbnail size
-    int new_jpeg_thumbnail_width = params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH);
-    int new_jpeg_thumbnail_height= params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT);
-    if (0 <= new_jpeg_thumbnail_width && 0 <= new_jpeg_thumbnail_height) {
-        if (mSecCamera->setJpegThumbnailSize(new_jpeg_thumbnail_width, new_jpeg_thumbnail_height) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setJpegThumbnailSize(width(%d), height(%d))", __func__, new_jpeg_thumbnail_width, new_jpeg_thumbnail_height);
+    if (isDirty(p->thumb_width, cur->thumb_width) || isDirty(p->thumb_height, cur->thumb_height)) {
+        if (mSecCamera->setJpegThumbnailSize(p->thumb_width, p->thumb_height) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setJpegThumbnailSize(width(%d), height(%d))",
+                 __func__, p->thumb_width, p->thumb_height);
             ret = UNKNOWN_ERROR;
         } else {
-            mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH, new_jpeg_thumbnail_width);
-            mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT, new_jpeg_thumbnail_height);
+            mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_WIDTH, p->thumb_width);
+            mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_HEIGHT, p->thumb_height);
+            cur->thumb_width  = p->thumb_width;
+            cur->thumb_height = p->thumb_height;
         }
+        applied++;
     }
 
-    // JPEG thumbnail quality
-    int new_jpeg_thumbnail_quality = params.getInt(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY);
-    LOGV("%s : new_jpeg_thumbnail_quality %d", __func__, new_jpeg_thumbnail_quality);
-    /* we ignore bad values */
-    if (new_jpeg_thumbnail_quality >=1 && new_jpeg_thumbnail_quality <= 100) {
-        if (mSecCamera->setJpegThumbnailQuality(new_jpeg_thumbnail_quality) < 0) {
+    if (isDirty(p->thumb_quality, cur->thumb_quality)) {
+        if (mSecCamera->setJpegThumbnailQuality(p->thumb_quality) < 0) {
             LOGE("ERR(%s):Fail on mSecCamera->setJpegThumbnailQuality(quality(%d))",
-                                               __func__, new_jpeg_thumbnail_quality);
+                                               __func__, p->thumb_quality);
             ret = UNKNOWN_ERROR;
-        } else
-            mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY, new_jpeg_thumbnail_quality);
+        } else {
+            mParameters.set(CameraParameters::KEY_JPEG_THUMBNAIL_QUALITY, p->thumb_quality);
+            cur->thumb_quality = p->thumb_quality;
+        }
+        applied++;
     }
 
-    // frame rate
-    int new_frame_rate = params.getPreviewFrameRate();
     /* ignore any fps request, we're determine fps automatically based
      * on scene mode.  don't return an error because it causes CTS failure.
      */
-    if (mRecordHint) {
-        if (new_frame_rate) {
-            if (mUseInternalISP && (mSecCamera->setFrameRate(new_frame_rate) < 0)){
-                LOGE("ERR(%s):Fail on mSecCamera->setFrameRate(%d)", __func__, new_frame_rate);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.setPreviewFrameRate(new_frame_rate);
-            }
+    if (mRecordHint && isDirty(p->frame_rate, cur->frame_rate)) {
+        if (mUseInternalISP && (mSecCamera->setFrameRate(p->frame_rate) < 0)){
+            LOGE("ERR(%s):Fail on mSecCamera->setFrameRate(%d)", __func__, p->frame_rate);
+            ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.setPreviewFrameRate(p->frame_rate);
+            cur->frame_rate = p->frame_rate;
         }
+        applied++;
     }
 
-    // rotation
-    int new_rotation = params.getInt(CameraParameters::KEY_ROTATION);
-    LOGV("%s : new_rotation %d", __func__, new_rotation);
-    if (0 <= new_rotation) {
-        LOGV("%s : set orientation:%d", __func__, new_rotation);
-        if (mSecCamera->setExifOrientationInfo(new_rotation) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setExifOrientationInfo(%d)", __func__, new_rotation);
+    if (isDirty(p->rotation, cur->rotation)) {
+        LOGV("%s : set orientation:%d", __func__, p->rotation);
+        if (mSecCamera->setExifOrientationInfo(p->rotation) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setExifOrientationInfo(%d)", __func__, p->rotation);
             ret = UNKNOWN_ERROR;
-        } else
-            mParameters.set(CameraParameters::KEY_ROTATION, new_rotation);
-    }
-
-    // zoom
-    int new_zoom = params.getInt(CameraParameters::KEY_ZOOM);
-    int current_zoom = mParameters.getInt(CameraParameters::KEY_ZOOM);
-    LOGV("%s : new_zoom %d", __func__, new_zoom);
-    if (0 <= new_zoom) {
-        if (new_zoom != current_zoom) {
-            if (mSecCamera->setZoom(new_zoom) < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setZoom(zoom(%d))", __func__, new_zoom);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set(CameraParameters::KEY_ZOOM, new_zoom);
-            }
+        } else {
+            mParameters.set(CameraParameters::KEY_ROTATION, p->rotation);
+            cur->rotation = p->rotation;
         }
+        applied++;
     }
 
-    // brightness
-    int new_brightness = params.getInt("brightness");
-    int max_brightness = params.getInt("brightness-max");
-    int min_brightness = params.getInt("brightness-min");
-    LOGV("%s : new_brightness %d", __func__, new_brightness);
-    if ((min_brightness <= new_brightness) &&
-        (max_brightness >= new_brightness)) {
-        if (mSecCamera->setBrightness(new_brightness) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setBrightness(brightness(%d))", __func__, new_brightness);
+    if (isDirty(p->zoom, cur->zoom)) {
+        if (mSecCamera->setZoom(p->zoom) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setZoom(zoom(%d))", __func__, p->zoom);
             ret = UNKNOWN_ERROR;
         } else {
-            mParameters.set("brightness", new_brightness);
+            mParameters.set(CameraParameters::KEY_ZOOM, p->zoom);
+            cur->zoom = p->zoom;
         }
+        applied++;
     }
 
-    // saturation
-    int new_saturation = params.getInt("saturation");
-    int max_saturation = params.getInt("saturation-max");
-    int min_saturation = params.getInt("saturation-min");
-    LOGV("%s : new_saturation %d", __func__, new_saturation);
-    if ((min_saturation <= new_saturation) &&
-        (max_saturation >= new_saturation)) {
-        if (mSecCamera->setSaturation(new_saturation) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setSaturation(saturation(%d))", __func__, new_saturation);
+    if (isDirty(p->brightness, cur->brightness)) {
+        if (mSecCamera->setBrightness(p->brightness) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setBrightness(brightness(%d))", __func__, p->brightness);
             ret = UNKNOWN_ERROR;
         } else {
-            mParameters.set("saturation", new_saturation);
+            mParameters.set("brightness", p->brightness);
+            cur->brightness = p->brightness;
         }
+        applied++;
     }
 
-    // sharpness
-    int new_sharpness = params.getInt("sharpness");
-    int max_sharpness = params.getInt("sharpness-max");
-    int min_sharpness = params.getInt("sharpness-min");
-    LOGV("%s : new_sharpness %d", __func__, new_sharpness);
-    if ((min_sharpness <= new_sharpness) &&
-        (max_sharpness >= new_sharpness)) {
-        if (mSecCamera->setSharpness(new_sharpness) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setSharpness(sharpness(%d))", __func__, new_sharpness);
+    if (isDirty(p->saturation, cur->saturation)) {
+        if (mSecCamera->setSaturation(p->saturation) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setSaturation(saturation(%d))", __func__, p->saturation);
             ret = UNKNOWN_ERROR;
         } else {
-            mParameters.set("sharpness", new_sharpness);
+            mParameters.set("saturation", p->saturation);
+            cur->saturation = p->saturation;
         }
+        applied++;
     }
 
-    // hue
-    int new_hue = params.getInt("hue");
-    int max_hue = params.getInt("hue-max");
-    int min_hue = params.getInt("hue-min");
-    LOGV("%s : new_hue %d", __func__, new_hue);
-    if ((min_hue <= new_hue) &&
-        (max_hue >= new_hue)) {
-        if (mSecCamera->setHue(new_hue) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setHue(hue(%d))", __func__, new_hue);
+    if (isDirty(p->sharpness, cur->sharpness)) {
+        if (mSecCamera->setSharpness(p->sharpness) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setSharpness(sharpness(%d))", __func__, p->sharpness);
             ret = UNKNOWN_ERROR;
         } else {
-            mParameters.set("hue", new_hue);
+            mParameters.set("sharpness", p->sharpness);
+            cur->sharpness = p->sharpness;
         }
+        applied++;
     }
 
-    // exposure
-    int new_exposure_compensation = params.getInt(CameraParameters::KEY_EXPOSURE_COMPENSATION);
-    int max_exposure_compensation = params.getInt(CameraParameters::KEY_MAX_EXPOSURE_COMPENSATION);
-    int min_exposure_compensation = params.getInt(CameraParameters::KEY_MIN_EXPOSURE_COMPENSATION);
-    LOGV("%s : new_exposure_compensation %d", __func__, new_exposure_compensation);
-    if ((min_exposure_compensation <= new_exposure_compensation) &&
-        (max_exposure_compensation >= new_exposure_compensation)) {
-        if (mSecCamera->setExposure(new_exposure_compensation) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setExposure(exposure(%d))", __func__, new_exposure_compensation);
+    if (isDirty(p->hue, cur->hue)) {
+        if (mSecCamera->setHue(p->hue) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setHue(hue(%d))", __func__, p->hue);
             ret = UNKNOWN_ERROR;
         } else {
-            mParameters.set(CameraParameters::KEY_EXPOSURE_COMPENSATION, new_exposure_compensation);
+            mParameters.set("hue", p->hue);
+            cur->hue = p->hue;
         }
+        applied++;
     }
 
-    const char *new_AE_lock = params.get(CameraParameters::KEY_AUTO_EXPOSURE_LOCK);
-    const char *old_AE_lock = mParameters.get(CameraParameters::KEY_AUTO_EXPOSURE_LOCK);
-    if ((new_AE_lock != NULL) && mUseInternalISP && mPreviewRunning) {
-        if (strncmp(new_AE_lock, old_AE_lock, 4)) {
-            int ae_value = !strncmp(new_AE_lock, "true", 4);
-            if (mSecCamera->setAutoExposureLock(ae_value) < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setExposureLock", __func__);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set(CameraParameters::KEY_AUTO_EXPOSURE_LOCK, new_AE_lock);
-            }
+    if (isDirty(p->exposure, cur->exposure)) {
+        if (mSecCamera->setExposure(p->exposure) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setExposure(exposure(%d))", __func__, p->exposure);
+            ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set(CameraParameters::KEY_EXPOSURE_COMPENSATION, p->exposure);
+            cur->exposure = p->exposure;
         }
+        applied++;
     }
 
-    // ISO
-    const char *new_iso_str = params.get("iso");
-    LOGV("%s : new_iso_str %s", __func__, new_iso_str);
-    if (new_iso_str != NULL) {
-        int new_iso = -1;
-
-        if (!strcmp(new_iso_str, "auto")) {
-            new_iso = ISO_AUTO;
-        } else if (!strcmp(new_iso_str, "50")) {
-            new_iso = ISO_50;
-        } else if (!strcmp(new_iso_str, "100")) {
-            new_iso = ISO_100;
-        } else if (!strcmp(new_iso_str, "200")) {
-            new_iso = ISO_200;
-        } else if (!strcmp(new_iso_str, "400")) {
-            new_iso = ISO_400;
-        } else if (!strcmp(new_iso_str, "800")) {
-            new_iso = ISO_800;
-        } else if (!strcmp(new_iso_str, "1600")) {
-            new_iso = ISO_1600;
-        } else {
-            LOGE("ERR(%s):Invalid iso value(%s)", __func__, new_iso_str);
+    if (mUseInternalISP && mPreviewRunning && isDirty(p->ae_lock, cur->ae_lock)) {
+        if (mSecCamera->setAutoExposureLock(p->ae_lock) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setExposureLock", __func__);
             ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set(CameraParameters::KEY_AUTO_EXPOSURE_LOCK, params.get(CameraParameters::KEY_AUTO_EXPOSURE_LOCK));
+            cur->ae_lock = p->ae_lock;
         }
-
-        if (0 <= new_iso) {
-            if (mSecCamera->setISO(new_iso) < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setISO(iso(%d))", __func__, new_iso);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set("iso", new_iso_str);
-            }
-        }
+        applied++;
     }
 
-    // Metering
-    const char *new_metering_str = params.get("metering");
-    LOGV("%s : new_metering_str %s", __func__, new_metering_str);
-    if (new_metering_str != NULL) {
-        int new_metering = -1;
-
-        if (!strcmp(new_metering_str, "center")) {
-            new_metering = METERING_CENTER;
-        } else if (!strcmp(new_metering_str, "spot")) {
-            new_metering = METERING_SPOT;
-        } else if (!strcmp(new_metering_str, "matrix")) {
-            new_metering = METERING_MATRIX;
-        } else {
-            LOGE("ERR(%s):Invalid metering value(%s)", __func__, new_metering_str);
+    if (isDirty(p->iso, cur->iso)) {
+        if (mSecCamera->setISO(p->iso) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setISO(iso(%d))", __func__, p->iso);
             ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set("iso", params.get("iso"));
+            cur->iso = p->iso;
         }
-
-        if (0 <= new_metering) {
-            if (mSecCamera->setMetering(new_metering) < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setMetering(metering(%d))", __func__, new_metering);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set("metering", new_metering_str);
-            }
-        }
+        applied++;
     }
 
-    // AFC
-    const char *new_antibanding_str = params.get(CameraParameters::KEY_ANTIBANDING);
-    LOGV("%s : new_antibanding_str %s", __func__, new_antibanding_str);
-    if (new_antibanding_str != NULL) {
-        int new_antibanding = -1;
-
-        if (!strcmp(new_antibanding_str, CameraParameters::ANTIBANDING_AUTO)) {
-            if (mUseInternalISP)
-                new_antibanding = IS_AFC_AUTO;
-            else
-                new_antibanding = ANTI_BANDING_AUTO;
-        } else if (!strcmp(new_antibanding_str, CameraParameters::ANTIBANDING_50HZ)) {
-            if (mUseInternalISP)
-                new_antibanding = IS_AFC_MANUAL_50HZ;
-            else
-                new_antibanding = ANTI_BANDING_50HZ;
-        } else if (!strcmp(new_antibanding_str, CameraParameters::ANTIBANDING_60HZ)) {
-            if (mUseInternalISP)
-                new_antibanding = IS_AFC_MANUAL_60HZ;
-            else
-                new_antibanding = ANTI_BANDING_60HZ;
-        } else if (!strcmp(new_antibanding_str, CameraParameters::ANTIBANDING_OFF)) {
-            if (mUseInternalISP)
-                new_antibanding = IS_AFC_DISABLE;
-            else
-                new_antibanding = ANTI_BANDING_OFF;
-        } else {
-            LOGE("ERR(%s):Invalid antibanding value(%s)", __func__, new_antibanding_str);
+    if (isDirty(p->metering, cur->metering)) {
+        if (mSecCamera->setMetering(p->metering) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setMetering(metering(%d))", __func__, p->metering);
             ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set("metering", params.get("metering"));
+            cur->metering = p->metering;
         }
-
-        if (0 <= new_antibanding) {
-            if (mSecCamera->setAntiBanding(new_antibanding) < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setAntiBanding(antibanding(%d))", __func__, new_antibanding);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set(CameraParameters::KEY_ANTIBANDING, new_antibanding_str);
-            }
-        }
+        applied++;
     }
 
-    // scene mode
-    const char *new_scene_mode_str = params.get(CameraParameters::KEY_SCENE_MODE);
-    const char *current_scene_mode_str = mParameters.get(CameraParameters::KEY_SCENE_MODE);
+    /* burst is kept biased by one, -1 is a valid count */
+    if (isDirty(p->burst, cur->burst)) {
+        mParameters.set("burst-capture", p->burst);
+        cur->burst = p->burst;
+    }
 
-    // fps range
-    int new_min_fps = 0;
-    int new_max_fps = 0;
-    int current_min_fps, current_max_fps;
-    params.getPreviewFpsRange(&new_min_fps, &new_max_fps);
-    mParameters.getPreviewFpsRange(&current_min_fps, &current_max_fps);
-    /* our fps range is determined by the sensor, reject any request
-     * that isn't exactly what we're already at.
-     * but the check is performed when requesting only changing fps range
-     */
-    if (new_scene_mode_str && current_scene_mode_str) {
-        if (!strcmp(new_scene_mode_str, current_scene_mode_str)) {
-            if ((new_min_fps != current_min_fps) || (new_max_fps != current_max_fps)) {
-                LOGW("%s : requested new_min_fps = %d, new_max_fps = %d not allowed",
-                        __func__, new_min_fps, new_max_fps);
-                /* TODO : We need policy for fps. */
-                LOGW("%s : current_min_fps = %d, current_max_fps = %d",
-                        __func__, current_min_fps, current_max_fps);
-                //ret = UNKNOWN_ERROR;
-            }
-        }
-    } else {
-        /* Check basic validation if scene mode is different */
-        if ((new_min_fps > new_max_fps) ||
-            (new_min_fps < 0) || (new_max_fps < 0))
-        ret = UNKNOWN_ERROR;
+#ifdef ZERO_SHUTTER_LAG
+    if (isDirty(p->zsl_select, cur->zsl_select)) {
+        mSecCamera->setZslSelect(p->zsl_select);
+        mParameters.set("zsl-frame-select", params.get("zsl-frame-select"));
+        cur->zsl_select = p->zsl_select;
     }
+#endif
 
-    const char *new_flash_mode_str = params.get(CameraParameters::KEY_FLASH_MODE);
-    const char *new_focus_mode_str = params.get(CameraParameters::KEY_FOCUS_MODE);
-    const char *new_white_str = params.get(CameraParameters::KEY_WHITE_BALANCE);
+    /* read by the preview thread with mRecordLock held */
+    if (isDirty(p->record_policy, cur->record_policy)) {
+        mRecordLock.lock();
+        mRecordPolicy = p->record_policy;
+        mRecordLock.unlock();
+        mParameters.set("record-backpressure", params.get("record-backpressure"));
+        cur->record_policy = p->record_policy;
+    }
 
-    // fps range is (15000,30000) by default.
-    mParameters.set(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE, "(15000,30000)");
-    mParameters.set(CameraParameters::KEY_PREVIEW_FPS_RANGE, "15000,30000");
+    if (isDirty(p->antibanding, cur->antibanding)) {
+        if (mSecCamera->setAntiBanding(p->antibanding) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setAntiBanding(antibanding(%d))", __func__, p->antibanding);
+            ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set(CameraParameters::KEY_ANTIBANDING, params.get(CameraParameters::KEY_ANTIBANDING));
+            cur->antibanding = p->antibanding;
+        }
+        applied++;
+    }
 
-    if ((new_scene_mode_str != NULL) && (current_scene_mode_str != NULL) && strncmp(new_scene_mode_str, current_scene_mode_str, 5)) {
-        int  new_scene_mode = -1;
-        if (!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_AUTO)) {
-            new_scene_mode = SCENE_MODE_NONE;
+    if (isDirty(p->scene_mode, cur->scene_mode)) {
+        if (mSecCamera->setSceneMode(p->scene_mode) < 0) {
+            LOGE("%s::mSecCamera->setSceneMode(%d) fail", __func__, p->scene_mode);
+            ret = UNKNOWN_ERROR;
         } else {
-            // defaults for non-auto scene modes
-            new_focus_mode_str = CameraParameters::FOCUS_MODE_AUTO;
-            new_flash_mode_str = CameraParameters::FLASH_MODE_OFF;
-            new_white_str = CameraParameters::WHITE_BALANCE_AUTO;
-            mParameters.set(CameraParameters::KEY_WHITE_BALANCE, new_white_str);
-
-            if (!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_PORTRAIT)) {
-                new_scene_mode = SCENE_MODE_PORTRAIT;
-                if (mCameraID == SecCamera::CAMERA_ID_BACK)
-                    new_flash_mode_str = CameraParameters::FLASH_MODE_AUTO;
-            } else if (!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_LANDSCAPE)) {
-                new_scene_mode = SCENE_MODE_LANDSCAPE;
-            } else if (!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_SPORTS)) {
-                new_scene_mode = SCENE_MODE_SPORTS;
-            } else if (!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_PARTY)) {
-                new_scene_mode = SCENE_MODE_PARTY_INDOOR;
-                if (mCameraID == SecCamera::CAMERA_ID_BACK)
-                    new_flash_mode_str = CameraParameters::FLASH_MODE_AUTO;
-            } else if ((!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_BEACH)) ||
-                        (!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_SNOW))) {
-                new_scene_mode = SCENE_MODE_BEACH_SNOW;
-            } else if (!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_SUNSET)) {
-                new_scene_mode = SCENE_MODE_SUNSET;
-            } else if (!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_NIGHT)) {
-                new_scene_mode = SCENE_MODE_NIGHTSHOT;
+            mParameters.set(CameraParameters::KEY_SCENE_MODE, params.get(CameraParameters::KEY_SCENE_MODE));
+            cur->scene_mode = p->scene_mode;
+
+            // fps range is (15000,30000) but for the night scene
+            if (p->scene_mode == SCENE_MODE_NIGHTSHOT) {
                 mParameters.set(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE, "(4000,30000)");
                 mParameters.set(CameraParameters::KEY_PREVIEW_FPS_RANGE, "4000,30000");
-            } else if (!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_FIREWORKS)) {
-                new_scene_mode = SCENE_MODE_FIREWORKS;
-            } else if (!strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_CANDLELIGHT)) {
-                new_scene_mode = SCENE_MODE_CANDLE_LIGHT;
             } else {
-                LOGE("%s::unmatched scene_mode(%s)",
-                        __func__, new_scene_mode_str); //action, night-portrait, theatre, steadyphoto
-                ret = UNKNOWN_ERROR;
+                mParameters.set(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE, "(15000,30000)");
+                mParameters.set(CameraParameters::KEY_PREVIEW_FPS_RANGE, "15000,30000");
             }
-        }
 
-        if (0 <= new_scene_mode) {
-            if (mSecCamera->setSceneMode(new_scene_mode) < 0) {
-                LOGE("%s::mSecCamera->setSceneMode(%d) fail", __func__, new_scene_mode);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set(CameraParameters::KEY_SCENE_MODE, new_scene_mode_str);
-            }
+            /* the scene set them behind our back */
+            cur->focus_mode = PARAM_UNSET;
+            cur->flash_mode = PARAM_UNSET;
+            cur->white_balance = PARAM_UNSET;
         }
+        applied++;
     }
 
-    // focus mode
-    /* TODO : currently only posible focus modes at BACK camera */
-    if ((new_focus_mode_str != NULL) && (mCameraID == SecCamera::CAMERA_ID_BACK)) {
-        int  new_focus_mode = -1;
-
-        if (!strcmp(new_focus_mode_str,
-                    CameraParameters::FOCUS_MODE_AUTO)) {
-            new_focus_mode = FOCUS_MODE_AUTO;
-            mParameters.set(CameraParameters::KEY_FOCUS_DISTANCES,
-                            BACK_CAMERA_AUTO_FOCUS_DISTANCES_STR);
-        } else if (!strcmp(new_focus_mode_str,
-                         CameraParameters::FOCUS_MODE_MACRO)) {
-            new_focus_mode = FOCUS_MODE_MACRO;
-            mParameters.set(CameraParameters::KEY_FOCUS_DISTANCES,
-                            BACK_CAMERA_MACRO_FOCUS_DISTANCES_STR);
-        } else if (!strcmp(new_focus_mode_str,
-                         CameraParameters::FOCUS_MODE_INFINITY)) {
-            new_focus_mode = FOCUS_MODE_INFINITY;
-            mParameters.set(CameraParameters::KEY_FOCUS_DISTANCES,
-                            BACK_CAMERA_INFINITY_FOCUS_DISTANCES_STR);
-        } else if (!strcmp(new_focus_mode_str,
-                         CameraParameters::FOCUS_MODE_CONTINUOUS_VIDEO) ||
-                   !strcmp(new_focus_mode_str,
-                         CameraParameters::FOCUS_MODE_CONTINUOUS_PICTURE)) {
-            new_focus_mode = FOCUS_MODE_CONTINOUS;
-        } else {
-            /* TODO */
-            /* This is temperary implementation.
-               When camera support all AF mode, this code will be changing */
-            LOGE("%s::unmatched focus_mode(%s)", __func__, new_focus_mode_str);
-            ret = UNKNOWN_ERROR;
-        }
+    if (p->scene_defaults)
+        mParameters.set(CameraParameters::KEY_WHITE_BALANCE, CameraParameters::WHITE_BALANCE_AUTO);
 
-        if (0 <= new_focus_mode) {
-            if (mSecCamera->setFocusMode(new_focus_mode) < 0) {
-                LOGE("%s::mSecCamera->setFocusMode(%d) fail", __func__, new_focus_mode);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set(CameraParameters::KEY_FOCUS_MODE, new_focus_mode_str);
-            }
+    if (isDirty(p->focus_mode, cur->focus_mode)) {
+        if (mSecCamera->setFocusMode(p->focus_mode) < 0) {
+            LOGE("%s::mSecCamera->setFocusMode(%d) fail", __func__, p->focus_mode);
+            ret = UNKNOWN_ERROR;
+        } else {
+            if (p->focus_mode == FOCUS_MODE_AUTO)
+                mParameters.set(CameraParameters::KEY_FOCUS_DISTANCES,
+                                BACK_CAMERA_AUTO_FOCUS_DISTANCES_STR);
+            else if (p->focus_mode == FOCUS_MODE_MACRO)
+                mParameters.set(CameraParameters::KEY_FOCUS_DISTANCES,
+                                BACK_CAMERA_MACRO_FOCUS_DISTANCES_STR);
+            else if (p->focus_mode == FOCUS_MODE_INFINITY)
+                mParameters.set(CameraParameters::KEY_FOCUS_DISTANCES,
+                                BACK_CAMERA_INFINITY_FOCUS_DISTANCES_STR);
+
+            mParameters.set(CameraParameters::KEY_FOCUS_MODE, p->scene_defaults ?
+                            paramString(sFocusModes, PARAM_MAP_SIZE(sFocusModes), p->focus_mode) :
+                            params.get(CameraParameters::KEY_FOCUS_MODE));
+            cur->focus_mode = p->focus_mode;
         }
+        applied++;
     }
 
-    // flash..
-    if (new_flash_mode_str != NULL) {
-        int  new_flash_mode = -1;
-
-        if (!strcmp(new_flash_mode_str, CameraParameters::FLASH_MODE_OFF))
-            new_flash_mode = FLASH_MODE_OFF;
-        else if (!strcmp(new_flash_mode_str, CameraParameters::FLASH_MODE_AUTO))
-            new_flash_mode = FLASH_MODE_AUTO;
-        else if (!strcmp(new_flash_mode_str, CameraParameters::FLASH_MODE_ON))
-            new_flash_mode = FLASH_MODE_ON;
-        else if (!strcmp(new_flash_mode_str, CameraParameters::FLASH_MODE_TORCH))
-            new_flash_mode = FLASH_MODE_TORCH;
-        else {
-            LOGE("%s::unmatched flash_mode(%s)", __func__, new_flash_mode_str); //red-eye
+    if (isDirty(p->flash_mode, cur->flash_mode)) {
+        if (mSecCamera->setFlashMode(p->flash_mode) < 0) {
+            LOGE("%s::mSecCamera->setFlashMode(%d) fail", __func__, p->flash_mode);
             ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set(CameraParameters::KEY_FLASH_MODE, p->scene_defaults ?
+                            paramString(sFlashModes, PARAM_MAP_SIZE(sFlashModes), p->flash_mode) :
+                            params.get(CameraParameters::KEY_FLASH_MODE));
+            cur->flash_mode = p->flash_mode;
         }
-        if (0 <= new_flash_mode) {
-            if (mSecCamera->setFlashMode(new_flash_mode) < 0) {
-                LOGE("%s::mSecCamera->setFlashMode(%d) fail", __func__, new_flash_mode);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set(CameraParameters::KEY_FLASH_MODE, new_flash_mode_str);
-            }
-        }
+        applied++;
     }
 
-    // whitebalance
-    LOGV("%s : new_white_str %s", __func__, new_white_str);
-    if ((new_scene_mode_str != NULL) && !strcmp(new_scene_mode_str, CameraParameters::SCENE_MODE_AUTO)) {
-        if (new_white_str != NULL) {
-            int new_white = -1;
-
-            if (!strcmp(new_white_str, CameraParameters::WHITE_BALANCE_AUTO)) {
-                new_white = WHITE_BALANCE_AUTO;
-            } else if (!strcmp(new_white_str,
-                             CameraParameters::WHITE_BALANCE_DAYLIGHT)) {
-                new_white = WHITE_BALANCE_SUNNY;
-            } else if (!strcmp(new_white_str,
-                             CameraParameters::WHITE_BALANCE_CLOUDY_DAYLIGHT)) {
-                new_white = WHITE_BALANCE_CLOUDY;
-            } else if (!strcmp(new_white_str,
-                             CameraParameters::WHITE_BALANCE_FLUORESCENT)) {
-                new_white = WHITE_BALANCE_FLUORESCENT;
-            } else if (!strcmp(new_white_str,
-                             CameraParameters::WHITE_BALANCE_INCANDESCENT)) {
-                new_white = WHITE_BALANCE_TUNGSTEN;
-            } else {
-                LOGE("ERR(%s):Invalid white balance(%s)", __func__, new_white_str); //twilight, shade, warm_flourescent
-                ret = UNKNOWN_ERROR;
-            }
-
-            if (0 <= new_white) {
-                if (mSecCamera->setWhiteBalance(new_white) < 0) {
-                    LOGE("ERR(%s):Fail on mSecCamera->setWhiteBalance(white(%d))", __func__, new_white);
-                    ret = UNKNOWN_ERROR;
-                } else {
-                    mParameters.set(CameraParameters::KEY_WHITE_BALANCE, new_white_str);
-                }
-            }
+    LOGV("%s : new_white %d", __func__, p->white_balance);
+    if (isDirty(p->white_balance, cur->white_balance)) {
+        if (mSecCamera->setWhiteBalance(p->white_balance) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setWhiteBalance(white(%d))", __func__, p->white_balance);
+            ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set(CameraParameters::KEY_WHITE_BALANCE, params.get(CameraParameters::KEY_WHITE_BALANCE));
+            cur->white_balance = p->white_balance;
         }
+        applied++;
     }
 
-    const char *new_AWB_lock = params.get(CameraParameters::KEY_AUTO_WHITEBALANCE_LOCK);
-    const char *old_AWB_lock = mParameters.get(CameraParameters::KEY_AUTO_WHITEBALANCE_LOCK);
-    if (new_AWB_lock != NULL && mUseInternalISP && mPreviewRunning) {
-        if (strncmp(new_AWB_lock, old_AWB_lock, 4)) {
-            int awb_value = !strncmp(new_AWB_lock, "true", 4);
-            if (mSecCamera->setAutoWhiteBalanceLock(awb_value) < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setoAutoWhiteBalanceLock()", __func__);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set(CameraParameters::KEY_AUTO_WHITEBALANCE_LOCK, new_AWB_lock);
-            }
+    if (mUseInternalISP && mPreviewRunning && isDirty(p->awb_lock, cur->awb_lock)) {
+        if (mSecCamera->setAutoWhiteBalanceLock(p->awb_lock) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setoAutoWhiteBalanceLock()", __func__);
+            ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set(CameraParameters::KEY_AUTO_WHITEBALANCE_LOCK,
+                            params.get(CameraParameters::KEY_AUTO_WHITEBALANCE_LOCK));
+            cur->awb_lock = p->awb_lock;
         }
+        applied++;
     }
 
-    const char *new_touch_rect_str = params.get(CameraParameters::KEY_FOCUS_AREAS);
-    LOGV("Touched rect is '%s'", new_touch_rect_str);
-
-    if (new_touch_rect_str != NULL) {
-        int left = 0, top = 0, right = 0, bottom = 0, touched = 0;
-        int objx, objy;
-
-        char *end;
-        char delim = ',';
-        left = (int)strtol(new_touch_rect_str+1, &end, 10);
-        if (*end != delim) {
-            LOGE("Cannot find '%c' in str=%s", delim, new_touch_rect_str);
-            return -1;
-        }
-        top = (int)strtol(end+1, &end, 10);
-        if (*end != delim) {
-            LOGE("Cannot find '%c' in str=%s", delim, new_touch_rect_str);
-            return -1;
-        }
-        right = (int)strtol(end+1, &end, 10);
-        if (*end != delim) {
-            LOGE("Cannot find '%c' in str=%s", delim, new_touch_rect_str);
-            return -1;
-        }
-        bottom = (int)strtol(end+1, &end, 10);
-        if (*end != delim) {
-            LOGE("Cannot find '%c' in str=%s", delim, new_touch_rect_str);
-            return -1;
-        }
-        touched = (int)strtol(end+1, &end, 10);
-        if (*end != ')') {
-            LOGE("Cannot find ')' in str=%s", new_touch_rect_str);
-            return -1;
+    /* touch AF apps send the same area with every frame */
+    if (0 <= p->touched) {
+        mTouched = p->touched;
+        if (p->touch_x != cur->touch_x || p->touch_y != cur->touch_y) {
+            if (mSecCamera->setObjectPosition(p->touch_x, p->touch_y) == 0) {
+                cur->touch_x = p->touch_x;
+                cur->touch_y = p->touch_y;
+            }
+            applied++;
         }
-
-        /* TODO : Converting axis and  Calcurating center of rect. Because driver need (x, y) point. */
-        objx = (int)((1023 * (left + 1000)) / 2000) + 97;
-        objy = (int)((1023 * (top + 1000)) / 2000) + 128;
-
-        mTouched = touched;
-        mSecCamera->setObjectPosition(objx, objy);
     }
 
-    // image effect
-    const char *new_image_effect_str = params.get(CameraParameters::KEY_EFFECT);
-    if (new_image_effect_str != NULL) {
-
-        int  new_image_effect = -1;
-
-        if (!strcmp(new_image_effect_str, CameraParameters::EFFECT_NONE)) {
-            new_image_effect = IMAGE_EFFECT_NONE;
-        } else if (!strcmp(new_image_effect_str, CameraParameters::EFFECT_MONO)) {
-            new_image_effect = IMAGE_EFFECT_BNW;
-        } else if (!strcmp(new_image_effect_str, CameraParameters::EFFECT_SEPIA)) {
-            new_image_effect = IMAGE_EFFECT_SEPIA;
-        } else if (!strcmp(new_image_effect_str, CameraParameters::EFFECT_AQUA))
-            new_image_effect = IMAGE_EFFECT_AQUA;
-        else if (!strcmp(new_image_effect_str, CameraParameters::EFFECT_NEGATIVE)) {
-            new_image_effect = IMAGE_EFFECT_NEGATIVE;
-        } else {
-            //posterize, whiteboard, blackboard, solarize
-            LOGE("ERR(%s):Invalid effect(%s)", __func__, new_image_effect_str);
+    if (isDirty(p->effect, cur->effect)) {
+        if (mSecCamera->setImageEffect(p->effect) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setImageEffect(effect(%d))", __func__, p->effect);
             ret = UNKNOWN_ERROR;
-        }
-
-        if (new_image_effect >= 0) {
-            if (mSecCamera->setImageEffect(new_image_effect) < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setImageEffect(effect(%d))", __func__, new_image_effect);
-                ret = UNKNOWN_ERROR;
-            } else {
-                const char *old_image_effect_str = mParameters.get(CameraParameters::KEY_EFFECT);
+        } else {
+            const char *old_image_effect_str = mParameters.get(CameraParameters::KEY_EFFECT);
+            const char *new_image_effect_str = params.get(CameraParameters::KEY_EFFECT);
 
-                if (old_image_effect_str) {
-                    if (strcmp(old_image_effect_str, new_image_effect_str)) {
-                        setSkipFrame(EFFECT_SKIP_FRAME);
-                    }
+            if (old_image_effect_str) {
+                if (strcmp(old_image_effect_str, new_image_effect_str)) {
+                    setSkipFrame(EFFECT_SKIP_FRAME);
                 }
-
-                mParameters.set(CameraParameters::KEY_EFFECT, new_image_effect_str);
             }
+
+            mParameters.set(CameraParameters::KEY_EFFECT, new_image_effect_str);
+            cur->effect = p->effect;
         }
+        applied++;
     }
 
-    //contrast
-    const char *new_contrast_str = params.get("contrast");
-    LOGV("%s : new_contrast_str %s", __func__, new_contrast_str);
-    if (new_contrast_str != NULL) {
-        int new_contrast = -1;
-
-        if (!strcmp(new_contrast_str, "auto")) {
-            if (mUseInternalISP)
-                new_contrast = IS_CONTRAST_AUTO;
-            else
-                LOGW("WARN(%s):Invalid contrast value (%s)", __func__, new_contrast_str);
-        } else if (!strcmp(new_contrast_str, "-2")) {
-            if (mUseInternalISP)
-                new_contrast = IS_CONTRAST_MINUS_2;
-            else
-                new_contrast = CONTRAST_MINUS_2;
-        } else if (!strcmp(new_contrast_str, "-1")) {
-            if (mUseInternalISP)
-                new_contrast = IS_CONTRAST_MINUS_1;
-            else
-                new_contrast = CONTRAST_MINUS_1;
-        } else if (!strcmp(new_contrast_str, "0")) {
-            if (mUseInternalISP)
-                new_contrast = IS_CONTRAST_DEFAULT;
-            else
-                new_contrast = CONTRAST_DEFAULT;
-        } else if (!strcmp(new_contrast_str, "1")) {
-            if (mUseInternalISP)
-                new_contrast = IS_CONTRAST_PLUS_1;
-            else
-                new_contrast = CONTRAST_PLUS_1;
-        } else if (!strcmp(new_contrast_str, "2")) {
-            if (mUseInternalISP)
-                new_contrast = IS_CONTRAST_PLUS_2;
-            else
-                new_contrast = CONTRAST_PLUS_2;
-        } else {
-            LOGE("ERR(%s):Invalid contrast value(%s)", __func__, new_contrast_str);
+    if (isDirty(p->contrast, cur->contrast)) {
+        if (mSecCamera->setContrast(p->contrast) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setContrast(contrast(%d))", __func__, p->contrast);
             ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set("contrast", params.get("contrast"));
+            cur->contrast = p->contrast;
         }
-
-        if (0 <= new_contrast) {
-            if (mSecCamera->setContrast(new_contrast) < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setContrast(contrast(%d))", __func__, new_contrast);
-                ret = UNKNOWN_ERROR;
-            } else {
-                mParameters.set("contrast", new_contrast_str);
-            }
-        }
+        applied++;
     }
 
-    //WDR
-    int new_wdr = params.getInt("wdr");
-    LOGV("%s : new_wdr %d", __func__, new_wdr);
-
-    if (0 <= new_wdr) {
-        if (mSecCamera->setWDR(new_wdr) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setWDR(%d)", __func__, new_wdr);
+    if (isDirty(p->wdr, cur->wdr)) {
+        if (mSecCamera->setWDR(p->wdr) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setWDR(%d)", __func__, p->wdr);
             ret = UNKNOWN_ERROR;
-        }
+        } else
+            cur->wdr = p->wdr;
+        applied++;
     }
 
-    //anti shake
-    int new_anti_shake = mInternalParameters.getInt("anti-shake");
-
-    if (0 <= new_anti_shake) {
-        if (mSecCamera->setAntiShake(new_anti_shake) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setWDR(%d)", __func__, new_anti_shake);
+    if (isDirty(p->anti_shake, cur->anti_shake)) {
+        if (mSecCamera->setAntiShake(p->anti_shake) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setAntiShake(%d)", __func__, p->anti_shake);
             ret = UNKNOWN_ERROR;
-        }
+        } else
+            cur->anti_shake = p->anti_shake;
+        applied++;
     }
 
-    // gps latitude
+    /* gps values are only latched for Exif, they never reach the driver */
     const char *new_gps_latitude_str = params.get(CameraParameters::KEY_GPS_LATITUDE);
     if (mSecCamera->setGPSLatitude(new_gps_latitude_str) < 0) {
         LOGE("%s::mSecCamera->setGPSLatitude(%s) fail", __func__, new_gps_latitude_str);
@@ -2605,9 +4212,7 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
         }
     }
 
-    // gps longitude
     const char *new_gps_longitude_str = params.get(CameraParameters::KEY_GPS_LONGITUDE);
-
     if (mSecCamera->setGPSLongitude(new_gps_longitude_str) < 0) {
         LOGE("%s::mSecCamera->setGPSLongitude(%s) fail", __func__, new_gps_longitude_str);
         ret = UNKNOWN_ERROR;
@@ -2619,9 +4224,7 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
         }
     }
 
-    // gps altitude
     const char *new_gps_altitude_str = params.get(CameraParameters::KEY_GPS_ALTITUDE);
-
     if (mSecCamera->setGPSAltitude(new_gps_altitude_str) < 0) {
         LOGE("%s::mSecCamera->setGPSAltitude(%s) fail", __func__, new_gps_altitude_str);
         ret = UNKNOWN_ERROR;
@@ -2633,9 +4236,7 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
         }
     }
 
-    // gps timestamp
     const char *new_gps_timestamp_str = params.get(CameraParameters::KEY_GPS_TIMESTAMP);
-
     if (mSecCamera->setGPSTimeStamp(new_gps_timestamp_str) < 0) {
         LOGE("%s::mSecCamera->setGPSTimeStamp(%s) fail", __func__, new_gps_timestamp_str);
         ret = UNKNOWN_ERROR;
@@ -2647,9 +4248,7 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
         }
     }
 
-    // gps processing method
     const char *new_gps_processing_method_str = params.get(CameraParameters::KEY_GPS_PROCESSING_METHOD);
-
     if (mSecCamera->setGPSProcessingMethod(new_gps_processing_method_str) < 0) {
         LOGE("%s::mSecCamera->setGPSProcessingMethod(%s) fail", __func__, new_gps_processing_method_str);
         ret = UNKNOWN_ERROR;
@@ -2662,109 +4261,138 @@ status_t CameraHardwareSec::setParameters(const CameraParameters& params)
     }
 
     // Recording size
-    /* TODO */
-    /* GED application don't set different recording size before recording button is pushed */
-    int new_recording_width  = 0;
-    int new_recording_height = 0;
-    params.getVideoSize(&new_recording_width, &new_recording_height);
-    LOGV("new_recording_width (%d) new_recording_height (%d)",
-            new_recording_width, new_recording_height);
-
-    int current_recording_width, current_recording_height;
-    mParameters.getVideoSize(&current_recording_width, &current_recording_height);
-    LOGV("current_recording_width (%d) current_recording_height (%d)",
-            current_recording_width, current_recording_height);
-
-    if (current_recording_width != new_recording_width ||
-        current_recording_height != new_recording_height) {
-        if (0 < new_recording_width && 0 < new_recording_height) {
-            if (mSecCamera->setRecordingSize(new_recording_width, new_recording_height) < 0) {
-                LOGE("ERR(%s):Fail on mSecCamera->setRecordingSize(width(%d), height(%d))",
-                        __func__, new_recording_width, new_recording_height);
-                ret = UNKNOWN_ERROR;
-            }
-            mParameters.setVideoSize(new_recording_width, new_recording_height);
+    if (0 < p->recording_width && 0 < p->recording_height &&
+        (p->recording_width != cur->recording_width ||
+         p->recording_height != cur->recording_height)) {
+        if (mSecCamera->setRecordingSize(p->recording_width, p->recording_height) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setRecordingSize(width(%d), height(%d))",
+                    __func__, p->recording_width, p->recording_height);
+            ret = UNKNOWN_ERROR;
+        } else {
+            cur->recording_width  = p->recording_width;
+            cur->recording_height = p->recording_height;
         }
+        mParameters.setVideoSize(p->recording_width, p->recording_height);
+        applied++;
+    }
+
+    if (isDirty(p->gamma, cur->gamma)) {
+        if (mSecCamera->setGamma(p->gamma) < 0) {
+            LOGE("%s::mSecCamera->setGamma(%d) fail", __func__, p->gamma);
+            ret = UNKNOWN_ERROR;
+        } else
+            cur->gamma = p->gamma;
+        applied++;
     }
 
-    //gamma
-    const char *new_gamma_str = mInternalParameters.get("video_recording_gamma");
+    if (isDirty(p->slow_ae, cur->slow_ae)) {
+        if (mSecCamera->setSlowAE(p->slow_ae) < 0) {
+            LOGE("%s::mSecCamera->setSlowAE(%d) fail", __func__, p->slow_ae);
+            ret = UNKNOWN_ERROR;
+        } else
+            cur->slow_ae = p->slow_ae;
+        applied++;
+    }
 
-    if (new_gamma_str != NULL) {
-        int new_gamma = -1;
-        if (!strcmp(new_gamma_str, "off"))
-            new_gamma = GAMMA_OFF;
-        else if (!strcmp(new_gamma_str, "on"))
-            new_gamma = GAMMA_ON;
-        else {
-            LOGE("%s::unmatched gamma(%s)", __func__, new_gamma_str);
+    if (isDirty(p->sensor_mode, cur->sensor_mode)) {
+        if (mSecCamera->setSensorMode(p->sensor_mode) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setSensorMode(%d)", __func__, p->sensor_mode);
             ret = UNKNOWN_ERROR;
-        }
+        } else
+            cur->sensor_mode = p->sensor_mode;
+        applied++;
+    }
 
-        if (0 <= new_gamma) {
-            if (mSecCamera->setGamma(new_gamma) < 0) {
-                LOGE("%s::mSecCamera->setGamma(%d) fail", __func__, new_gamma);
-                ret = UNKNOWN_ERROR;
-            }
-        }
+    if (isDirty(p->shot_mode, cur->shot_mode)) {
+        if (mSecCamera->setShotMode(p->shot_mode) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setShotMode(%d)", __func__, p->shot_mode);
+            ret = UNKNOWN_ERROR;
+        } else
+            cur->shot_mode = p->shot_mode;
+        applied++;
+    }
+
+    if (isDirty(p->dataline, cur->dataline)) {
+        if (mSecCamera->setDataLineCheck(p->dataline) < 0) {
+            LOGE("ERR(%s):Fail on mSecCamera->setDataLineCheck(%d)", __func__, p->dataline);
+            ret = UNKNOWN_ERROR;
+        } else
+            cur->dataline = p->dataline;
+        applied++;
     }
 
-    //slow ae
-    const char *new_slow_ae_str = mInternalParameters.get("slow_ae");
+    mParamApplied += applied;
+    LOGV("%s: %d fields applied", __func__, applied);
 
-    if (new_slow_ae_str != NULL) {
-        int new_slow_ae = -1;
+    return ret;
+}
 
-        if (!strcmp(new_slow_ae_str, "off"))
-            new_slow_ae = SLOW_AE_OFF;
-        else if (!strcmp(new_slow_ae_str, "on"))
-            new_slow_ae = SLOW_AE_ON;
-        else {
-            LOGE("%s::unmatched slow_ae(%s)", __func__, new_slow_ae_str);
+status_t CameraHardwareSec::setParameters(const CameraParameters& params)
+{
+    LOGV("%s :", __func__);
+
+    struct hal_params next;
+    status_t ret;
+
+    mParamCalls++;
+
+    ret = parseParameters(params, &next);
+    if (ret == -1)
+        return ret;
+
+    /* the mode switch and every changed control reach the sensor at once */
+    bool batched = (mSecCamera->beginControls() == 0);
+
+    if (0 <= next.record_hint && next.record_hint != (int)mRecordHint) {
+        mRecordHint = next.record_hint;
+        if (mSecCamera->setMode(mRecordHint) < 0) {
+            LOGE("ERR(%s):fail on mSecCamera->setMode(%d)", __func__, mRecordHint);
             ret = UNKNOWN_ERROR;
+        } else {
+            mParameters.set(CameraParameters::KEY_RECORDING_HINT,
+                            params.get(CameraParameters::KEY_RECORDING_HINT));
         }
 
-        if (0 <= new_slow_ae) {
-            if (mSecCamera->setSlowAE(new_slow_ae) < 0) {
-                LOGE("%s::mSecCamera->setSlowAE(%d) fail", __func__, new_slow_ae);
+        if (mUseInternalISP) {
+            if (mSecCamera->initSetParams() < 0) {
+                LOGE("ERR(%s):fail on mSecCamera->initSetParams()", __func__);
                 ret = UNKNOWN_ERROR;
             }
-        }
-    }
-
-    /*Camcorder fix fps*/
-    int new_sensor_mode = mInternalParameters.getInt("cam_mode");
 
-    if (0 <= new_sensor_mode) {
-        if (mSecCamera->setSensorMode(new_sensor_mode) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setSensorMode(%d)", __func__, new_sensor_mode);
-            ret = UNKNOWN_ERROR;
+            /* the driver went back to its defaults */
+            invalidateParameters();
         }
-    } else {
-        new_sensor_mode=0;
     }
 
-    /*Shot mode*/
-    int new_shot_mode = mInternalParameters.getInt("shot_mode");
-
-    if (0 <= new_shot_mode) {
-        if (mSecCamera->setShotMode(new_shot_mode) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setShotMode(%d)", __func__, new_shot_mode);
-            ret = UNKNOWN_ERROR;
-        }
-    } else {
-        new_shot_mode=0;
+    /* if someone calls us while picture thread is running, it could screw
+     * up the sensor quite a bit so return error.  we can't wait because
+     * that would cause deadlock with the callbacks
+     */
+    mStateLock.lock();
+    if (mCaptureInProgress) {
+        mStateLock.unlock();
+        LOGE("%s : capture in progress, not allowed", __func__);
+        if (batched)
+            mSecCamera->commitControls();
+        return UNKNOWN_ERROR;
     }
+    mStateLock.unlock();
 
-    // chk_dataline
-    int new_dataline = mInternalParameters.getInt("chk_dataline");
+    /* the setters only queued their controls, applyParameters() took them for done */
+    CameraParameters applied = mParameters;
 
-    if (0 <= new_dataline) {
-        if (mSecCamera->setDataLineCheck(new_dataline) < 0) {
-            LOGE("ERR(%s):Fail on mSecCamera->setDataLineCheck(%d)", __func__, new_dataline);
-            ret = UNKNOWN_ERROR;
-        }
+    status_t apply_ret = applyParameters(params, &next);
+    if (ret == NO_ERROR)
+        ret = apply_ret;
+
+    if (batched && mSecCamera->commitControls() < 0) {
+        LOGE("ERR(%s):Fail on mSecCamera->commitControls()", __func__);
+        /* the driver kept some of them, we can't tell which */
+        mParameters = applied;
+        invalidateParameters();
+        ret = UNKNOWN_ERROR;
     }
+
     LOGV("%s return ret = %d", __func__, ret);
 
     return ret;
@@ -2836,9 +4464,39 @@ void CameraHardwareSec::release()
         mAutoFocusThread.clear();
     }
     if (mPictureThread != NULL) {
+        mBurstLock.lock();
+        mBurstCancel = true;
+        mBurstCondition.broadcast();
+        mBurstLock.unlock();
         mPictureThread->requestExitAndWait();
         mPictureThread.clear();
     }
+    /* preview and picture threads are gone, nothing feeds the stages any more */
+    for (int i = 0; i < PIPE_MAX; i++) {
+        if (mStageThread[i] != NULL) {
+            mStageThread[i]->requestExit();
+            mPipeQueue[i]->abort();
+            mStageThread[i]->requestExitAndWait();
+            mStageThread[i].clear();
+        }
+        if (mPipeQueue[i] != NULL) {
+            delete mPipeQueue[i];
+            mPipeQueue[i] = NULL;
+        }
+    }
+    if (mPreviewTrace != NULL) {
+        delete mPreviewTrace;
+        mPreviewTrace = NULL;
+    }
+    if (mRecordTrace != NULL) {
+        delete mRecordTrace;
+        mRecordTrace = NULL;
+    }
+    if (mBench != NULL) {
+        mBench->save();
+        delete mBench;
+        mBench = NULL;
+    }
 #ifdef IS_FW_DEBUG
     if (mDebugThread != NULL) {
         mDebugThread->requestExitAndWait();
@@ -2850,10 +4508,15 @@ void CameraHardwareSec::release()
         mRawHeap->release(mRawHeap);
         mRawHeap = 0;
     }
+    freeBurstHeaps();
     if (mPreviewHeap) {
         mPreviewHeap->release(mPreviewHeap);
         mPreviewHeap = 0;
     }
+    if (mFaceDataHeap) {
+        mFaceDataHeap->release(mFaceDataHeap);
+        mFaceDataHeap = 0;
+    }
     for(int i = 0; i < BUFFER_COUNT_FOR_ARRAY; i++) {
         if (mRecordHeap[i]) {
             mRecordHeap[i]->release(mRecordHeap[i]);
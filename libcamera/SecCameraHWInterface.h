@@ -20,6 +20,9 @@
 #define ANDROID_HARDWARE_CAMERA_HARDWARE_SEC_H
 
 #include "SecCamera.h"
+#include "SecFrameQueue.h"
+#include "SecFrameTrace.h"
+#include "SecCameraBench.h"
 #include <utils/threads.h>
 #include <utils/RefBase.h>
 #include <binder/MemoryBase.h>
@@ -29,6 +32,13 @@
 #include <camera/CameraParameters.h>
 #define  BUFFER_COUNT_FOR_GRALLOC (MAX_BUFFERS)
 #define  BUFFER_COUNT_FOR_ARRAY (1)
+#define  BURST_RING_DEPTH (3)
+#define  BURST_MAX_SHOTS (100)
+/* record buffers kept in the driver before the policy steps in */
+#define  RECORD_MIN_QUEUED (2)
+#define  RECORD_THROTTLE_MS (33)
+/* face metadata waiting for or inside the application callback */
+#define  FACE_META_SLOTS (4)
 
 namespace android {
     class CameraHardwareSec : public virtual RefBase {
@@ -87,6 +97,20 @@ private:
         }
     };
 
+    /* display, callback and record stages fed by the preview thread */
+    class StageThread : public Thread {
+        CameraHardwareSec *mHardware;
+        int mStage;
+    public:
+        StageThread(CameraHardwareSec *hw, int stage):
+        Thread(false),
+        mHardware(hw),
+        mStage(stage) { }
+        virtual bool threadLoop() {
+            return mHardware->stageThread(mStage);
+        }
+    };
+
     class PictureThread : public Thread {
         CameraHardwareSec *mHardware;
     public:
@@ -94,7 +118,7 @@ private:
         Thread(false),
         mHardware(hw) { }
         virtual bool threadLoop() {
-            mHardware->pictureThread();
+            mHardware->pictureThreadWrapper();
             return false;
         }
     };
@@ -132,12 +156,108 @@ private:
             int         previewThread();
             int         previewThreadWrapper();
 
+    enum PIPE_STAGE {
+        PIPE_DISPLAY = 0,
+        PIPE_CALLBACK,
+        PIPE_RECORD,
+        PIPE_PREVIEW_MAX,
+        /*
+         * burst : the picture thread captures, scales the thumbnail and
+         * writes the Exif, these encode the main image and deliver
+         */
+        PIPE_BURST_ENCODE = PIPE_PREVIEW_MAX,
+        PIPE_BURST_DELIVER,
+        /* thumbnail and Exif next to the main encode */
+        PIPE_THUMBNAIL,
+        /* keeps the ZSL ring fed while recording, off the record path */
+        PIPE_VIDEO_SNAPSHOT,
+        PIPE_MAX,
+    };
+
+    /* CPU time is benchmarked per pipeline stage and for the threads feeding them */
+    enum BENCH_STAGE {
+        BENCH_PREVIEW = PIPE_MAX,
+        BENCH_PICTURE,
+        BENCH_STAGE_MAX,
+    };
+
+    sp<StageThread>     mStageThread[PIPE_MAX];
+    SecFrameQueue       *mPipeQueue[PIPE_MAX];
+    /* preview and record buffers, from capture until given back */
+    SecFrameTrace       *mPreviewTrace;
+    SecFrameTrace       *mRecordTrace;
+    SecCameraBench      *mBench;
+            bool        stageThread(int stage);
+            void        displayFrame(int index, nsecs_t timestamp);
+            void        deliverFrame(int index);
+            void        deliverRecordFrame(int index, nsecs_t timestamp);
+            void        feedVideoSnapshot(void);
+            void        releasePreviewFrame(int index);
+            void        stopPipeline(void);
+            bool        queueFaceData(int index);
+
     sp<AutoFocusThread> mAutoFocusThread;
             int         autoFocusThread();
 
     sp<PictureThread>   mPictureThread;
+            int         pictureThreadWrapper();
             int         pictureThread();
             bool        mCaptureInProgress;
+            nsecs_t     mShutterTime;
+
+    struct thumb_job {
+        char            *src;           /* NULL : thumb is already scaled */
+        int             src_width;
+        int             src_height;
+        char            *thumb;
+        int             thumb_width;
+        int             thumb_height;
+        int             thumb_size;
+        unsigned char   *exif;          /* NULL : no Exif wanted */
+        int             exif_max;       /* room for the Exif at exif */
+        int             exif_size;
+    };
+
+            void        makeThumbnail(struct thumb_job *job);
+            void        startThumbnail(const struct thumb_job *job);
+            int         waitThumbnail(void);
+            void        thumbnailFrame(void);
+
+    mutable Mutex       mThumbLock;
+    mutable Condition   mThumbCondition;
+    struct thumb_job    mThumbJob;
+            bool        mThumbBusy;
+
+    struct burst_slot {
+        bool    busy;
+        int     cap_index;
+        nsecs_t timestamp;
+        int     jpeg_size;
+        bool    exif_done;
+        int     exif_size;
+    };
+
+            int         burstCapture(void);
+            void        encodeBurstFrame(int slot);
+            void        deliverBurstFrame(int slot);
+            bool        allocBurstHeaps(int jpegSize, int thumbSize);
+            void        freeBurstHeaps(void);
+
+    /* slots are reused in order, the capture stage waits for a free one */
+    mutable Mutex       mBurstLock;
+    mutable Condition   mBurstCondition;
+            int         mBurstCount;    /* shots, < 0 : until cancelPicture() */
+            bool        mBurstCancel;
+            bool        mBurstJpeg;     /* CAMERA_MSG_COMPRESSED_IMAGE at takePicture() */
+    struct burst_slot   mBurstSlot[BURST_RING_DEPTH];
+    /* a new picture heap per shot, the application may still hold the last one */
+    sp<MemoryHeapBase>  mBurstJpegHeap[BURST_RING_DEPTH];
+    camera_memory_t     *mBurstThumbHeap[BURST_RING_DEPTH];
+            int         mBurstExifReserve;
+            int         mBurstJpegSize;
+            int         mBurstThumbSize;
+            int         mBurstShots;
+            nsecs_t     mBurstTime;
 
 #ifdef IS_FW_DEBUG
     sp<DebugThread>     mDebugThread;
@@ -150,6 +270,20 @@ private:
    unsigned int         mDebugVaddr;
 #endif
 
+    /* a run of one stream inside an interleaved JPEG/YUV capture */
+    struct interleave_segment {
+        int offset;         /* from the start of the interleaved buffer */
+        int size;
+    };
+
+    /* scatter lists of both streams, contiguous runs are merged */
+    struct interleave_map {
+        Vector<interleave_segment> jpeg;
+        Vector<interleave_segment> yuv;
+        int jpeg_size;
+        int yuv_size;
+    };
+
             int         save_jpeg(unsigned char *real_jpeg, int jpeg_size);
             void        save_postview(const char *fname, uint8_t *buf,
                                         uint32_t size);
@@ -164,6 +298,25 @@ private:
             bool        scaleDownYuv422(char *srcBuf, uint32_t srcWidth,
                                         uint32_t srcHight, char *dstBuf,
                                         uint32_t dstWidth, uint32_t dstHight);
+            bool        scaleDownYuv422toNV21(char *srcBuf, uint32_t srcWidth,
+                                              uint32_t srcHeight, char *dstBuf,
+                                              uint32_t dstWidth, uint32_t dstHeight);
+
+            bool        demuxInterleaveData(unsigned char *pInterleaveData,
+                                                int interleaveDataSize,
+                                                int yuvWidth,
+                                                struct interleave_map *map);
+            bool        demuxSplitFrame(unsigned char *pFrame, int dwSize,
+                                        int dwJPEGLineLength, int dwVideoLineLength,
+                                        struct interleave_map *map);
+    static  void        addSegment(Vector<interleave_segment> *segments, int *total,
+                                   int offset, int size);
+            int         gatherSegments(unsigned char *pBase,
+                                       const Vector<interleave_segment> &segments,
+                                       void *pDst);
+            unsigned char *mapInterleaveJpeg(unsigned char *pBase,
+                                             struct interleave_map *map,
+                                             void *pJpegData);
 
             bool        CheckVideoStartMarker(unsigned char *pBuf);
             bool        CheckEOIMarker(unsigned char *pBuf);
@@ -178,6 +331,71 @@ private:
             bool        isSupportedPreviewSize(const int width,
                                                const int height) const;
             bool        getVideosnapshotSize(int *width, int *height);
+            void        negotiatePreviewLayout(int stride);
+            void        copyPreviewFrame(char *frame, void **virAddr);
+
+    /* setParameters() in driver values, PARAM_UNSET : not given or not applied yet */
+    struct hal_params {
+        int record_hint;
+        int preview_width;
+        int preview_height;
+        int preview_format;
+        int videosnapshot_hint;
+        int picture_width;
+        int picture_height;
+        int picture_format;
+        int jpeg_quality;
+        int thumb_width;
+        int thumb_height;
+        int thumb_quality;
+        int frame_rate;
+        int rotation;
+        int zoom;
+        int brightness;
+        int saturation;
+        int sharpness;
+        int hue;
+        int exposure;
+        int ae_lock;
+        int awb_lock;
+        int iso;
+        int metering;
+        int burst;
+        int zsl_select;
+        int record_policy;
+        int antibanding;
+        int scene_mode;
+        int scene_defaults; /* focus and flash come from the new scene */
+        int focus_mode;
+        int flash_mode;
+        int white_balance;
+        int touch_x;
+        int touch_y;
+        int touched;
+        int effect;
+        int contrast;
+        int wdr;
+        int anti_shake;
+        int recording_width;
+        int recording_height;
+        int gamma;
+        int slow_ae;
+        int sensor_mode;
+        int shot_mode;
+        int dataline;
+    };
+
+            status_t    parseParameters(const CameraParameters& params,
+                                        struct hal_params *p);
+            status_t    applyParameters(const CameraParameters& params,
+                                        const struct hal_params *p);
+            void        invalidateParameters(void);
+#ifdef USE_PREVIEW_USERPTR
+            bool        registerPreviewBuffers(void);
+            int         queuePreviewBuffer(int index);
+            void        cancelPreviewBuffers(void);
+            void        copyCallbackFrame(int index, buffer_handle_t *buf_handle);
+#endif
 
     /* used by auto focus thread to block until it's told to run */
     mutable Mutex       mFocusLock;
@@ -206,9 +424,35 @@ private:
 
             int         mPreviewFmtPlane;
 
+    /* where each plane of a preview frame goes in a window buffer */
+    struct preview_plane {
+        int src_offset;     /* from the start of the camera frame */
+        int src_stride;     /* bytes */
+        int dst_stride;     /* bytes */
+        int line;           /* bytes copied per line */
+        int lines;
+    };
+
+    struct preview_layout {
+        int planes;         /* 0 : unknown layout, copy luma as is */
+        int convert;        /* packed 422 frame into a YV12 window */
+        int width;
+        int height;
+        int format;         /* v4l2 */
+        int stride;         /* window stride in pixels it was built for */
+        struct preview_plane plane[3];
+    };
+
+    struct preview_layout mPreviewLayout;
+
     CameraParameters    mParameters;
     CameraParameters    mInternalParameters;
 
+    /* what the driver got from the last setParameters() */
+    struct hal_params   mHalParams;
+            unsigned int mParamCalls;
+            unsigned int mParamApplied;
+
     int                 mFrameSizeDelta;
     camera_memory_t     *mPreviewHeap;
     camera_memory_t     *mRawHeap;
@@ -216,12 +460,45 @@ private:
     sp<MemoryHeapBase>  mThumbnailHeap;
     camera_memory_t     *mRecordHeap[BUFFER_COUNT_FOR_ARRAY];
 
-    camera_frame_metadata_t     *mFaceData;
+    /* preview buffers stay out of the sensor until every stage let go */
+    mutable Mutex       mPipeLock;
+            int         mPipeRef[MAX_BUFFERS];
+            bool        mPipeStopping;
+
+    /*
+     * Face metadata handed to the application. A slot is taken only when
+     * the faces changed and stays busy until its callback returned.
+     */
+    struct face_slot {
+        camera_frame_metadata_t meta;
+        camera_face_t   face[FD_MAX_FACES];
+        bool            busy;
+    };
+
+    struct face_slot    mFaceSlot[FACE_META_SLOTS];
+            int         mPipeFaceSlot[MAX_BUFFERS];     /* -1 : nothing new with the frame */
+    camera_frame_metadata_t mFaceScan;                  /* preview thread only */
+    camera_face_t       mFaceScanFace[FD_MAX_FACES];
+    camera_face_t       mFaceLast[FD_MAX_FACES];
+            int         mFaceLastCount;                 /* -1 : publish the next faces whatever */
+    unsigned int        mFaceDelivered;
+    unsigned int        mFaceUnchanged;
+    unsigned int        mFaceNoSlot;
     camera_memory_t     *mFaceDataHeap;
 
     buffer_handle_t *mBufferHandle[BUFFER_COUNT_FOR_ARRAY];
     int mStride[BUFFER_COUNT_FOR_ARRAY];
 
+#ifdef USE_PREVIEW_USERPTR
+    /* window buffers the sensor writes into, by v4l2 index */
+            bool        mPreviewZeroCopy;
+            int         mPreviewBufCount;
+            int         mPreviewMinUndequeued;
+    buffer_handle_t     *mPreviewBufHandle[MAX_BUFFERS];
+    unsigned int        mPreviewRefilling;              /* slots a release dequeues a buffer for */
+            bool        mPipeCopy[MAX_BUFFERS];         /* display copies it for the callback first */
+#endif
+
 
     SecCamera           *mSecCamera;
             const __u8  *mCameraSensorName;
@@ -241,6 +518,43 @@ private:
             bool        mRecordRunning;
             bool        mRecordHint;
     mutable Mutex       mRecordLock;
+
+    /* who holds each record buffer, see setRecordOwner() */
+    enum RECORD_OWNER {
+        RECORD_DRIVER = 0,
+        RECORD_HAL,         /* dequeued, waiting for the record stage */
+        RECORD_ENCODER,     /* until releaseRecordingFrame() */
+        RECORD_OWNER_MAX,
+    };
+
+    /* what gives when the encoder holds on to its frames */
+    enum RECORD_POLICY {
+        RECORD_DROP_OLDEST = 0, /* the oldest frame not delivered yet */
+        RECORD_DROP_NEWEST,     /* the frame just captured */
+        RECORD_THROTTLE,        /* the preview thread waits for a frame to come back */
+    };
+
+    struct record_hold {
+        unsigned int    count;
+        nsecs_t         sum;
+        nsecs_t         max;
+    };
+
+    mutable Mutex       mRecordBufLock;
+    mutable Condition   mRecordBufCondition;
+            int         mRecordOwner[MAX_BUFFERS];
+            nsecs_t     mRecordSince[MAX_BUFFERS];
+    struct record_hold  mRecordHold[RECORD_OWNER_MAX];
+            int         mRecordPolicy;
+            unsigned int mRecordDrops;      /* frames lost to a late encoder */
+            unsigned int mRecordThrottled;
+            nsecs_t     mRecordThrottleTime;
+
+            void        resetRecordOwners(void);
+            void        setRecordOwner(int index, int owner);
+            int         countRecordOwner(int owner);
+            void        returnRecordFrame(int index);
+            bool        makeRecordRoom(int want);
             int         mPostViewWidth;
             int         mPostViewHeight;
             int         mPostViewSize;
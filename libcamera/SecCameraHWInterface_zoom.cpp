@@ -25,6 +25,8 @@
 #include <sys/mman.h>
 #include <camera/Camera.h>
 #include <media/stagefright/MetadataBufferType.h>
+#include "swconverter.h"
+#include "SecVirtualSensor.h"
 
 #define VIDEO_COMMENT_MARKER_H          0xFFBE
 #define VIDEO_COMMENT_MARKER_L          0xFFBF
@@ -78,6 +80,7 @@ gralloc_module_t const* CameraHardwareSec::mGrallocHal;
 CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
         :
           mCaptureInProgress(false),
+          mShutterTime(0),
           mParameters(),
           mFrameSizeDelta(0),
           mCameraSensorName(NULL),
@@ -106,6 +109,17 @@ CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
     memset(&mCapBuffer, 0, sizeof(struct SecBuffer));
     int ret = 0;
 
+    /* times the open from here, the stage threads start below */
+    mBench = new SecCameraBench("SecCamera_zoom", cameraId);
+    {
+        static const char *stage[BENCH_STAGE_MAX] = {
+            "preview", "fimc_preview", "fimc_record", "callback", "picture",
+        };
+
+        for (int i = 0; i < BENCH_STAGE_MAX; i++)
+            mBench->setStageName(i, stage[i]);
+    }
+
     mPreviewWindow = NULL;
     mSecCamera = SecCamera::createInstance();
 
@@ -130,6 +144,8 @@ CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
 
     mExitAutoFocusThread = false;
     mExitPreviewThread = false;
+    mExitFimcThread = false;
+    mExitCallbackThread = false;
     /* whether the PreviewThread is active in preview or stopped.  we
      * create the thread but it is initially in stopped state.
      */
@@ -153,6 +169,12 @@ CameraHardwareSec::CameraHardwareSec(int cameraId, camera_device_t *dev)
         mDebugThread->run("debugThread", PRIORITY_DEFAULT);
     }
 #endif
+
+    if (SecVirtualSensor::enabled())
+        mBench->setSensor("virtual");
+    else if (mCameraSensorName != NULL)
+        mBench->setSensor((const char *)mCameraSensorName);
+    mBench->opened();
 }
 
 int CameraHardwareSec::getCameraId() const
@@ -476,6 +498,9 @@ CameraHardwareSec::~CameraHardwareSec()
 {
     LOGV("%s", __func__);
     mSecCamera->DestroyCamera();
+    /* the stage threads report to mBench, none may be left when it goes */
+    stopStageThreads();
+    delete mBench;
 }
 
 status_t CameraHardwareSec::setPreviewWindow(preview_stream_ops *w)
@@ -652,13 +677,42 @@ int CameraHardwareSec::previewThreadWrapper()
             return 0;
         }
 
+        nsecs_t cpu = SecCameraBench::threadTime();
         if (mUseInternalISP)
             previewThreadForZoom();
         else
             previewThread();
+        mBench->stageDone(BENCH_PREVIEW, cpu);
     }
 }
 
+bool CameraHardwareSec::benchThread(int stage)
+{
+    nsecs_t cpu = SecCameraBench::threadTime();
+    bool ret = false;
+
+    switch (stage) {
+    case BENCH_FIMC_PREVIEW:
+        ret = previewFimcThread();
+        break;
+    case BENCH_FIMC_RECORD:
+        ret = recordFimcThread();
+        break;
+    case BENCH_CALLBACK:
+        ret = callbackThread();
+        break;
+    case BENCH_PICTURE:
+        pictureThread();
+        break;
+    default:
+        break;
+    }
+
+    mBench->stageDone(stage, cpu);
+
+    return ret;
+}
+
 int CameraHardwareSec::previewThreadForZoom()
 {
     int index;
@@ -700,6 +754,7 @@ int CameraHardwareSec::previewThreadForZoom()
     }
     mSkipFrameLock.unlock();
 
+    mBench->previewFrame();
     mCurrentIndex = index;
     if (!mCaptureInProgress)
         mCapIndex = index;
@@ -756,6 +811,7 @@ int CameraHardwareSec::previewThread()
     mSkipFrameLock.unlock();
 
     timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+    mBench->previewFrame();
 
     int width, height, frame_size, offset;
 
@@ -900,10 +956,14 @@ status_t CameraHardwareSec::previewFimcThread()
 
     if (mUseInternalISP) {
         mPreviewFimcLock.lock();
-        mPreviewFimcCondition.wait(mPreviewFimcLock);
+        if (!mExitFimcThread)
+            mPreviewFimcCondition.wait(mPreviewFimcLock);
         mPreviewFimcLock.unlock();
     }
 
+    if (mExitFimcThread)
+        return false;
+
     int width, height, frame_size, offset;
 
     mSecCamera->getPreviewSize(&width, &height, &frame_size);
@@ -995,7 +1055,7 @@ status_t CameraHardwareSec::recordFimcThread()
 
 
     Mutex::Autolock lock(mRecordLock);
-    if (mRecordRunning == true) {
+    if (mRecordRunning == true && !mExitFimcThread) {
         if (mCurrentIndex < 0) {
             LOGV("%s: doing nothing mCurrent index < 0", __func__);
             return true;
@@ -1056,7 +1116,12 @@ status_t CameraHardwareSec::callbackThread()
 
     mCallbackLock.lock();
 
-    mCallbackCondition.wait(mCallbackLock);
+    if (!mExitCallbackThread)
+        mCallbackCondition.wait(mCallbackLock);
+    if (mExitCallbackThread) {
+        mCallbackLock.unlock();
+        return false;
+    }
 
     if (mUseInternalISP && (mMsgEnabled & CAMERA_MSG_PREVIEW_METADATA) && mPreviewRunning && !mRecordRunning) {
         mDataCb(CAMERA_MSG_PREVIEW_METADATA, mFaceDataHeap, 0, &mFaceData, mCallbackCookie);
@@ -1164,6 +1229,8 @@ status_t CameraHardwareSec::startPreviewInternal()
     LOGV("%s", __func__);
     int width, height, frame_size;
 
+    mBench->previewStart();
+
     mSecCamera->getPreviewSize(&width, &height, &frame_size);
     LOGD("mPreviewHeap(fd(%d), size(%d), width(%d), height(%d))",
          mSecCamera->getCameraFd(SecCamera::PREVIEW), frame_size + mFrameSizeDelta, width, height);
@@ -1647,31 +1714,12 @@ bool CameraHardwareSec::fileDump(char *filename, void *srcBuf, uint32_t size)
 
 bool CameraHardwareSec::YUY2toNV21(void *srcBuf, void *dstBuf, uint32_t srcWidth, uint32_t srcHeight)
 {
-    int32_t        x, y, src_y_start_pos, dst_cbcr_pos, dst_pos, src_pos;
-    unsigned char *srcBufPointer = (unsigned char *)srcBuf;
-    unsigned char *dstBufPointer = (unsigned char *)dstBuf;
+    unsigned char *dst = (unsigned char *)dstBuf;
 
-    dst_pos = 0;
-    dst_cbcr_pos = srcWidth*srcHeight;
-    for (uint32_t y = 0; y < srcHeight; y++) {
-        src_y_start_pos = (y * (srcWidth * 2));
-
-        for (uint32_t x = 0; x < (srcWidth * 2); x += 2) {
-            src_pos = src_y_start_pos + x;
-
-            dstBufPointer[dst_pos++] = srcBufPointer[src_pos];
-        }
-    }
-    for (uint32_t y = 0; y < srcHeight; y += 2) {
-        src_y_start_pos = (y * (srcWidth * 2));
-
-        for (uint32_t x = 0; x < (srcWidth * 2); x += 4) {
-            src_pos = src_y_start_pos + x;
-
-            dstBufPointer[dst_cbcr_pos++] = srcBufPointer[src_pos + 3];
-            dstBufPointer[dst_cbcr_pos++] = srcBufPointer[src_pos + 1];
-        }
-    }
+    csc_YUV422I_to_YUV420(dst, dst + srcWidth * srcHeight, NULL,
+                          (unsigned char *)srcBuf, srcWidth, srcHeight,
+                          srcWidth * 2, srcWidth, srcWidth,
+                          CSC_YUV422I_YUYV | CSC_YUV420_NV21);
 
     return true;
 }
@@ -1727,6 +1775,7 @@ int CameraHardwareSec::pictureThread()
 
             if (mMsgEnabled & CAMERA_MSG_SHUTTER)
                 mNotifyCb(CAMERA_MSG_SHUTTER, 0, 0, mCallbackCookie);
+            mBench->shutter(mShutterTime);
 
             jpeg_data = mSecCamera->getJpeg(&JpegImageSize, &mThumbSize, &thumb_addr, &phyAddr);
             if (jpeg_data == NULL) {
@@ -1739,6 +1788,7 @@ int CameraHardwareSec::pictureThread()
         } else {
             if (mMsgEnabled & CAMERA_MSG_SHUTTER)
                 mNotifyCb(CAMERA_MSG_SHUTTER, 0, 0, mCallbackCookie);
+            mBench->shutter(mShutterTime);
 
 #ifdef ZERO_SHUTTER_LAG
             if (mSecCamera->getSnapshotAddr(mCapIndex, &mCapBuffer) < 0) {
@@ -1810,6 +1860,7 @@ int CameraHardwareSec::pictureThread()
         memcpy(ImageStart, JpegHeap->data + 2, JpegImageSize - 2);
 
         mDataCb(CAMERA_MSG_COMPRESSED_IMAGE, JpegHeap_out, 0, NULL, mCallbackCookie);
+        mBench->pictureDone();
 
         if (ExifHeap) {
             ExifHeap->release(ExifHeap);
@@ -1845,6 +1896,8 @@ status_t CameraHardwareSec::takePicture()
 {
     LOGV("%s :", __func__);
 
+    mShutterTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
 #ifdef ZERO_SHUTTER_LAG
     if (!mUseInternalISP && mPreviewRunning)
         stopPreview();
@@ -2128,6 +2181,15 @@ status_t CameraHardwareSec::dump(int fd) const
         mInternalParameters.dump(fd, args);
         snprintf(buffer, 255, " preview running(%s)\n", mPreviewRunning?"true": "false");
         result.append(buffer);
+        if (mBench != NULL) {
+            char report[BENCH_REPORT_SIZE];
+
+            if (mBench->json(report, sizeof(report)) > 0) {
+                result.append(" bench: ");
+                result.append(report);
+                result.append("\n");
+            }
+        }
     } else
         result.append("No camera client yet.\n");
     write(fd, result.string(), result.size());
@@ -3460,6 +3522,7 @@ void CameraHardwareSec::release()
         mPictureThread->requestExitAndWait();
         mPictureThread.clear();
     }
+    stopStageThreads();
 
 #ifdef IS_FW_DEBUG
     mStopDebugging = true;
@@ -3489,6 +3552,34 @@ void CameraHardwareSec::release()
      * could have dup'd our file descriptor.
      */
     mSecCamera->DestroyCamera();
+
+    mBench->save();
+}
+
+/* the fimc and callback threads run from the constructor, they are stopped here */
+void CameraHardwareSec::stopStageThreads()
+{
+    mPreviewFimcLock.lock();
+    mExitFimcThread = true;
+    mPreviewFimcCondition.signal();
+    mPreviewFimcLock.unlock();
+    if (mPreviewFimcThread != NULL) {
+        mPreviewFimcThread->requestExitAndWait();
+        mPreviewFimcThread.clear();
+    }
+    if (mRecordFimcThread != NULL) {
+        mRecordFimcThread->requestExitAndWait();
+        mRecordFimcThread.clear();
+    }
+
+    mCallbackLock.lock();
+    mExitCallbackThread = true;
+    mCallbackCondition.signal();
+    mCallbackLock.unlock();
+    if (mCallbackThread != NULL) {
+        mCallbackThread->requestExitAndWait();
+        mCallbackThread.clear();
+    }
 }
 
 static CameraInfo sCameraInfo[] = {
@@ -20,6 +20,7 @@
 #define ANDROID_HARDWARE_CAMERA_HARDWARE_SEC_H
 
 #include "SecCamera_zoom.h"
+#include "SecCameraBench.h"
 #include <utils/threads.h>
 #include <utils/RefBase.h>
 #include <binder/MemoryBase.h>
@@ -97,7 +98,7 @@ private:
             run("CameraPreviewThread", PRIORITY_URGENT_DISPLAY);
         }
         virtual bool threadLoop() {
-            return mHardware->previewFimcThread();
+            return mHardware->benchThread(BENCH_FIMC_PREVIEW);
         }
     };
 
@@ -111,7 +112,7 @@ private:
             run("CameraPreviewThread", PRIORITY_URGENT_DISPLAY);
         }
         virtual bool threadLoop() {
-            return mHardware->recordFimcThread();
+            return mHardware->benchThread(BENCH_FIMC_RECORD);
         }
     };
 
@@ -125,7 +126,7 @@ private:
             run("CameraPreviewThread", PRIORITY_URGENT_DISPLAY);
         }
         virtual bool threadLoop() {
-            return mHardware->callbackThread();
+            return mHardware->benchThread(BENCH_CALLBACK);
         }
     };
 
@@ -136,7 +137,7 @@ private:
         Thread(false),
         mHardware(hw) { }
         virtual bool threadLoop() {
-            mHardware->pictureThread();
+            mHardware->benchThread(BENCH_PICTURE);
             return false;
         }
     };
@@ -184,6 +185,7 @@ private:
 
     sp<CallbackThread>   mCallbackThread;
             int         callbackThread();
+            void        stopStageThreads();
 
     sp<AutoFocusThread> mAutoFocusThread;
             int         autoFocusThread();
@@ -191,6 +193,20 @@ private:
     sp<PictureThread>   mPictureThread;
             int         pictureThread();
             bool        mCaptureInProgress;
+            nsecs_t     mShutterTime;
+
+    /* the threads CPU time is benchmarked for */
+    enum BENCH_STAGE {
+        BENCH_PREVIEW = 0,
+        BENCH_FIMC_PREVIEW,
+        BENCH_FIMC_RECORD,
+        BENCH_CALLBACK,
+        BENCH_PICTURE,
+        BENCH_STAGE_MAX,
+    };
+
+    SecCameraBench      *mBench;
+            bool        benchThread(int stage);
 
 #ifdef IS_FW_DEBUG
     sp<DebugThread>     mDebugThread;
@@ -254,6 +270,8 @@ private:
             bool        mPreviewRunning;
             bool        mPreviewStartDeferred;
             bool        mExitPreviewThread;
+            bool        mExitFimcThread;
+            bool        mExitCallbackThread;
     mutable Mutex       mFimcLock;
     mutable Condition   mFimcStoppedCondition;
     mutable Mutex       mCallbackLock;
@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <sys/poll.h>
 #include "SecCamera_zoom.h"
+#include "SecVirtualSensor.h"
 #include "cutils/properties.h"
 
 using namespace android;
@@ -74,6 +75,66 @@ unsigned long measure_time_camera(struct timeval *start, struct timeval *stop)
 }
 #endif
 
+/*
+ * The capture node is only reached through these : a node opened by
+ * SecVirtualSensor (camera.virtual.enable) answers instead of the kernel.
+ * The fimc m2m nodes behind it are always the real ones.
+ */
+static int cam_open(const char *node)
+{
+    if (SecVirtualSensor::enabled())
+        return SecVirtualSensor::openNode(node);
+
+    return open(node, O_RDWR);
+}
+
+static int cam_close(int fd)
+{
+    if (SecVirtualSensor::find(fd) != NULL)
+        return SecVirtualSensor::closeNode(fd);
+
+    return close(fd);
+}
+
+static int cam_ioctl(int fd, unsigned long request, void *arg)
+{
+    SecVirtualSensor *sensor = SecVirtualSensor::find(fd);
+
+    if (sensor != NULL)
+        return sensor->ioctl(request, arg);
+
+    return ioctl(fd, request, arg);
+}
+
+static int cam_poll(struct pollfd *events, nfds_t nfds, int timeout)
+{
+    SecVirtualSensor *sensor = SecVirtualSensor::find(events->fd);
+
+    if (sensor != NULL && nfds == 1)
+        return sensor->poll(events, timeout);
+
+    return poll(events, nfds, timeout);
+}
+
+static void *cam_mmap(size_t length, int fd, off_t offset)
+{
+    SecVirtualSensor *sensor = SecVirtualSensor::find(fd);
+
+    if (sensor != NULL)
+        return sensor->mmap(length, offset);
+
+    return mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+}
+
+/* the virtual buffers go with their node */
+static int cam_munmap(void *addr, size_t length)
+{
+    if (SecVirtualSensor::owns(addr))
+        return 0;
+
+    return munmap(addr, length);
+}
+
 static int close_buffers(struct SecBuffer *buffers, int num_of_buf)
 {
     int ret;
@@ -81,7 +142,7 @@ static int close_buffers(struct SecBuffer *buffers, int num_of_buf)
     for (int i = 0; i < num_of_buf; i++) {
         for(int j = 0; j < MAX_PLANES; j++) {
             if (buffers[i].virt.extP[j]) {
-                ret = munmap(buffers[i].virt.extP[j], buffers[i].size.extS[j]);
+                ret = cam_munmap(buffers[i].virt.extP[j], buffers[i].size.extS[j]);
                 LOGV("munmap():buffers[%d].virt.extP[%d]: 0x%x size = %d",
                         i, j, (unsigned int) buffers[i].virt.extP[j],
                         buffers[i].size.extS[j]);
@@ -133,7 +194,7 @@ static int fimc_poll(struct pollfd *events)
     /* 10 second delay is because sensor can take a long time
      * to do auto focus and capture in dark settings
      */
-    ret = poll(events, 1, 10000);
+    ret = cam_poll(events, 1, 10000);
     if (ret < 0) {
         LOGE("ERR(%s):poll error", __func__);
         return ret;
@@ -151,7 +212,7 @@ static int fimc_v4l2_querycap(int fp)
 {
     struct v4l2_capability cap;
 
-    if (ioctl(fp, VIDIOC_QUERYCAP, &cap) < 0) {
+    if (cam_ioctl(fp, VIDIOC_QUERYCAP, &cap) < 0) {
         LOGE("ERR(%s):VIDIOC_QUERYCAP failed", __func__);
         return -1;
     }
@@ -168,7 +229,7 @@ static int fimc_v4l2_querycap_m2m(int fp)
 {
     struct v4l2_capability cap;
 
-    if (ioctl(fp, VIDIOC_QUERYCAP, &cap) < 0) {
+    if (cam_ioctl(fp, VIDIOC_QUERYCAP, &cap) < 0) {
         LOGE("ERR(%s):VIDIOC_QUERYCAP failed", __func__);
         return -1;
     }
@@ -191,7 +252,7 @@ static const __u8* fimc_v4l2_enuminput(int fp, int index)
     static struct v4l2_input input;
 
     input.index = index;
-    if (ioctl(fp, VIDIOC_ENUMINPUT, &input) != 0) {
+    if (cam_ioctl(fp, VIDIOC_ENUMINPUT, &input) != 0) {
         LOGE("ERR(%s):No matching index found", __func__);
         return NULL;
     }
@@ -206,7 +267,7 @@ static int fimc_v4l2_s_input(int fp, int index)
 
     input.index = index;
 
-    if (ioctl(fp, VIDIOC_S_INPUT, &input) < 0) {
+    if (cam_ioctl(fp, VIDIOC_S_INPUT, &input) < 0) {
         LOGE("ERR(%s):VIDIOC_S_INPUT failed", __func__);
         return -1;
     }
@@ -234,7 +295,7 @@ static int fimc_v4l2_s_fmt(int fp, int width, int height, unsigned int fmt, enum
     LOGV("fimc_v4l2_s_fmt : width(%d) height(%d)", width, height);
 
     /* Set up for capture */
-    if (ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
+    if (cam_ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
         LOGE("ERR(%s):VIDIOC_S_FMT failed", __func__);
         return -1;
     }
@@ -261,7 +322,7 @@ static int fimc_v4l2_s_fmt_cap(int fp, int width, int height, unsigned int fmt)
     LOGV("fimc_v4l2_s_fmt_cap : width(%d) height(%d)", width, height);
 
     /* Set up for capture */
-    if (ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
+    if (cam_ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
         LOGE("ERR(%s):VIDIOC_S_FMT failed", __func__);
         return -1;
     }
@@ -287,7 +348,7 @@ int fimc_v4l2_s_fmt_is(int fp, int width, int height, unsigned int fmt, enum v4l
     LOGV("fimc_v4l2_s_fmt_is : width(%d) height(%d)", width, height);
 
     /* Set up for capture */
-    if (ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
+    if (cam_ioctl(fp, VIDIOC_S_FMT, &v4l2_fmt) < 0) {
         LOGE("ERR(%s):VIDIOC_S_FMT failed", __func__);
         return -1;
     }
@@ -303,7 +364,7 @@ static int fimc_v4l2_enum_fmt(int fp, unsigned int fmt)
     fmtdesc.type = V4L2_BUF_TYPE;
     fmtdesc.index = 0;
 
-    while (ioctl(fp, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
+    while (cam_ioctl(fp, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
         if (fmtdesc.pixelformat == fmt) {
             LOGV("passed fmt = %#x found pixel format[%d]: %s", fmt, fmtdesc.index, fmtdesc.description);
             found = 1;
@@ -329,7 +390,7 @@ static int fimc_v4l2_reqbufs(int fp, enum v4l2_buf_type type, int nr_bufs)
     req.type = type;
     req.memory = V4L2_MEMORY_TYPE;
 
-    if (ioctl(fp, VIDIOC_REQBUFS, &req) < 0) {
+    if (cam_ioctl(fp, VIDIOC_REQBUFS, &req) < 0) {
         LOGE("ERR(%s):VIDIOC_REQBUFS failed", __func__);
         return -1;
     }
@@ -347,7 +408,7 @@ static int fimc_v4l2_querybuf(int fp, struct SecBuffer *buffers, enum v4l2_buf_t
         v4l2_buf.memory = V4L2_MEMORY_TYPE;
         v4l2_buf.index = i;
 
-        ret = ioctl(fp, VIDIOC_QUERYBUF, &v4l2_buf);
+        ret = cam_ioctl(fp, VIDIOC_QUERYBUF, &v4l2_buf);
         if (ret < 0) {
             LOGE("ERR(%s):VIDIOC_QUERYBUF failed", __func__);
             return -1;
@@ -355,8 +416,7 @@ static int fimc_v4l2_querybuf(int fp, struct SecBuffer *buffers, enum v4l2_buf_t
 
         buffers[i].size.s = v4l2_buf.length;
 
-        if ((buffers[i].virt.p = (char *)mmap(0, v4l2_buf.length, PROT_READ | PROT_WRITE, MAP_SHARED,
-                    fp, v4l2_buf.m.offset)) < 0) {
+        if ((buffers[i].virt.p = (char *)cam_mmap(v4l2_buf.length, fp, v4l2_buf.m.offset)) == MAP_FAILED) {
             LOGE("%s %d] mmap() failed",__func__, __LINE__);
             return -1;
         }
@@ -370,7 +430,7 @@ static int fimc_v4l2_streamon(int fp)
     enum v4l2_buf_type type = V4L2_BUF_TYPE;
     int ret;
 
-    ret = ioctl(fp, VIDIOC_STREAMON, &type);
+    ret = cam_ioctl(fp, VIDIOC_STREAMON, &type);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_STREAMON failed", __func__);
         return ret;
@@ -385,7 +445,7 @@ static int fimc_v4l2_streamoff(int fp)
     int ret;
 
     LOGV("%s :", __func__);
-    ret = ioctl(fp, VIDIOC_STREAMOFF, &type);
+    ret = cam_ioctl(fp, VIDIOC_STREAMOFF, &type);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_STREAMOFF failed", __func__);
         return ret;
@@ -399,7 +459,7 @@ static int fimc_v4l2_streamon_userptr(int fp)
     enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
     int ret;
 
-    ret = ioctl(fp, VIDIOC_STREAMON, &type);
+    ret = cam_ioctl(fp, VIDIOC_STREAMON, &type);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_STREAMON failed", __func__);
         return ret;
@@ -414,7 +474,7 @@ static int fimc_v4l2_streamoff_userptr(int fp)
     int ret;
 
 //    LOGV("%s :", __func__);
-    ret = ioctl(fp, VIDIOC_STREAMOFF, &type);
+    ret = cam_ioctl(fp, VIDIOC_STREAMOFF, &type);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_STREAMOFF failed", __func__);
         return ret;
@@ -434,7 +494,7 @@ static int fimc_v4l2_qbuf(int fp, int width, int height, struct SecBuffer *vaddr
     v4l2_buf.memory = V4L2_MEMORY_TYPE;
     v4l2_buf.index = index;
 
-    ret = ioctl(fp, VIDIOC_QBUF, &v4l2_buf);
+    ret = cam_ioctl(fp, VIDIOC_QBUF, &v4l2_buf);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_QBUF failed", __func__);
         return ret;
@@ -454,7 +514,7 @@ static int fimc_v4l2_qbuf_userptr(int fp, struct fimc_buf *fimc_buf, int index)
     buf.index       = index;
     buf.type        = V4L2_BUF_TYPE_VIDEO_OUTPUT;
 
-    ret = ioctl(fp, VIDIOC_QBUF, &buf);
+    ret = cam_ioctl(fp, VIDIOC_QBUF, &buf);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_QBUF failed", __func__);
         return ret;
@@ -471,7 +531,7 @@ static int fimc_v4l2_dqbuf(int fp, int num_plane)
     v4l2_buf.type = V4L2_BUF_TYPE;
     v4l2_buf.memory = V4L2_MEMORY_TYPE;
 
-    ret = ioctl(fp, VIDIOC_DQBUF, &v4l2_buf);
+    ret = cam_ioctl(fp, VIDIOC_DQBUF, &v4l2_buf);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_DQBUF failed, dropped frame", __func__);
         return ret;
@@ -488,7 +548,7 @@ static int fimc_v4l2_dqbuf_userptr(int fp)
     v4l2_buf.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
     v4l2_buf.memory = V4L2_MEMORY_USERPTR;
 
-    ret = ioctl(fp, VIDIOC_DQBUF, &v4l2_buf);
+    ret = cam_ioctl(fp, VIDIOC_DQBUF, &v4l2_buf);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_DQBUF failed, dropped frame", __func__);
         return ret;
@@ -504,7 +564,7 @@ static int fimc_v4l2_g_ctrl(int fp, unsigned int id)
 
     ctrl.id = id;
 
-    ret = ioctl(fp, VIDIOC_G_CTRL, &ctrl);
+    ret = cam_ioctl(fp, VIDIOC_G_CTRL, &ctrl);
     if (ret < 0) {
         LOGE("ERR(%s): VIDIOC_G_CTRL(id = 0x%x (%d)) failed, ret = %d",
              __func__, id, id-V4L2_CID_PRIVATE_BASE, ret);
@@ -522,7 +582,7 @@ static int fimc_v4l2_s_ctrl(int fp, unsigned int id, unsigned int value)
     ctrl.id = id;
     ctrl.value = value;
 
-    ret = ioctl(fp, VIDIOC_S_CTRL, &ctrl);
+    ret = cam_ioctl(fp, VIDIOC_S_CTRL, &ctrl);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_S_CTRL(id = %#x (%d), value = %d) failed ret = %d",
              __func__, id, id-V4L2_CID_PRIVATE_BASE, value, ret);
@@ -545,7 +605,7 @@ static int fimc_v4l2_s_ext_ctrl(int fp, unsigned int id, void *value)
     ctrls.count = 1;
     ctrls.controls = &ctrl;
 
-    ret = ioctl(fp, VIDIOC_S_EXT_CTRLS, &ctrls);
+    ret = cam_ioctl(fp, VIDIOC_S_EXT_CTRLS, &ctrls);
     if (ret < 0)
         LOGE("ERR(%s):VIDIOC_S_EXT_CTRLS failed", __func__);
 
@@ -591,7 +651,7 @@ static int fimc_v4l2_s_ext_ctrl_face_detection(int fp, unsigned int id, void *va
     ext_ctrls_fd.controls = ext_ctrl_fd;
     ctrls = &ext_ctrls_fd;
 
-    ret = ioctl(fp, VIDIOC_G_EXT_CTRLS, &ext_ctrls_fd);
+    ret = cam_ioctl(fp, VIDIOC_G_EXT_CTRLS, &ext_ctrls_fd);
 
     facedata->number_of_faces = ext_ctrls_fd.controls[0].value;
 
@@ -620,7 +680,7 @@ static int fimc_v4l2_g_parm(int fp, struct v4l2_streamparm *streamparm)
 
     streamparm->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
-    ret = ioctl(fp, VIDIOC_G_PARM, streamparm);
+    ret = cam_ioctl(fp, VIDIOC_G_PARM, streamparm);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_G_PARM failed", __func__);
         return -1;
@@ -639,7 +699,7 @@ static int fimc_v4l2_s_parm(int fp, struct v4l2_streamparm *streamparm)
 
     streamparm->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
-    ret = ioctl(fp, VIDIOC_S_PARM, streamparm);
+    ret = cam_ioctl(fp, VIDIOC_S_PARM, streamparm);
     if (ret < 0) {
         LOGE("ERR(%s):VIDIOC_S_PARM failed", __func__);
         return ret;
@@ -728,9 +788,25 @@ SecCamera::SecCamera() :
     initParameters(0);
     memset(&mExifInfo, 0, sizeof(mExifInfo));
 
+    m_fimc_dev_mask = 0;
+    m_fimc_m2m_mask = 0;
+    m_fimc_lease_mask = 0;
+    for (int dev = 0; dev < FIMC_DEV_MAX; dev++)
+        m_fimc_fd[dev] = -1;
+    memset(m_fimc_lease_count, 0, sizeof(m_fimc_lease_count));
+    memset(m_fimc_dst, 0, sizeof(m_fimc_dst));
+
     memset(&m_events_c, 0, sizeof(m_events_c));
     memset(&m_events_c2, 0, sizeof(m_events_c2));
     memset(&m_events_c3, 0, sizeof(m_events_c3));
+
+    for (int pos = 0; pos < ZOOM_POSITIONS; pos++)
+        m_zoom_ratio[pos] = 1.0f + ZOOM_LEVEL_STEP * pos / ZOOM_SUBSTEPS;
+    memset(m_zoom_table, 0, sizeof(m_zoom_table));
+    m_zoom_pos = 0;
+    m_zoom_target = 0;
+    m_zoom_crop_set = 0;
+    m_zoom_crop_kept = 0;
 }
 
 SecCamera::~SecCamera()
@@ -813,18 +889,48 @@ bool SecCamera::CreateCamera(int index)
     return 0;
 }
 
+static int fimcNode(const char *dev_name)
+{
+    int dev;
+    char tail;
+
+    if (sscanf(dev_name, "/dev/video%d%c", &dev, &tail) != 1)
+        return -1;
+    if (dev < 0 || FIMC_DEV_MAX <= dev)
+        return -1;
+
+    return dev;
+}
+
 int SecCamera::createFimc(int *fp, char *dev_name, int mode, int index)
 {
     struct v4l2_format fmt;
     int ret = 0;
+    int dev = fimcNode(dev_name);
 
-    *fp = open(dev_name, O_RDWR);
-    if (fp < 0) {
+    if (dev < 0) {
+        LOGE("ERR(%s):%s is no FIMC node", __func__, dev_name);
+        return -1;
+    }
+    /* only the sensor can be virtual, the m2m nodes do the real scaling */
+    if (mode == V4L2_BUF_TYPE_VIDEO_CAPTURE)
+        *fp = cam_open(dev_name);
+    else
+        *fp = open(dev_name, O_RDWR);
+    if (*fp < 0) {
         LOGE("ERR(%s):Cannot open %s (error : %s)", __func__, dev_name, strerror(errno));
         return -1;
     }
     LOGV("%s: open(%s) --> fp %d", __func__, dev_name, *fp);
 
+    /* a streamed node is leased by m_leaseFimc(), an m2m one by FimcLease */
+    m_fimc_fd[dev] = *fp;
+    if (mode == V4L2_BUF_TYPE_VIDEO_CAPTURE)
+        m_fimc_dev_mask |= FIMC_DEV_MASK(dev);
+    else
+        m_fimc_m2m_mask |= FIMC_DEV_MASK(dev);
+    m_fimc_dst[dev].width = 0;
+
     if (mode == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
         ret = fimc_v4l2_querycap(*fp);
         CHECK(ret);
@@ -842,7 +948,7 @@ int SecCamera::createFimc(int *fp, char *dev_name, int mode, int index)
 
         /* malloc fimc_outinfo structure */
         fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-        if (ioctl(*fp, VIDIOC_G_FMT, &fmt) < 0) {
+        if (cam_ioctl(*fp, VIDIOC_G_FMT, &fmt) < 0) {
             LOGE("%s::Error in video VIDIOC_G_FMT", __func__);
             return -1;
         }
@@ -887,25 +993,31 @@ bool SecCamera::DestroyCamera()
          */
         LOGI("DestroyCamera: m_cam_fd(%d)", m_cam_fd);
         if (m_cam_fd > -1) {
-            if (close(m_cam_fd) < 0)
+            if (cam_close(m_cam_fd) < 0)
                 LOGE("++ fail close fd %d", m_cam_fd);
             m_cam_fd = -1;
         }
 
         LOGI("DestroyCamera: m_cam_fd2(%d)", m_cam_fd2);
         if (m_cam_fd2 > -1) {
-            if (close(m_cam_fd2) < 0)
+            if (cam_close(m_cam_fd2) < 0)
                 LOGE("++ fail close fd %d", m_cam_fd2);
             m_cam_fd2 = -1;
         }
 
         LOGI("DestroyCamera: m_cam_fd3(%d)", m_cam_fd3);
         if (m_cam_fd3 > -1) {
-            if (close(m_cam_fd3) < 0)
+            if (cam_close(m_cam_fd3) < 0)
                 LOGE("++ fail close fd %d", m_cam_fd3);
             m_cam_fd3 = -1;
         }
 
+        m_releaseFimc(true);
+        m_fimc_dev_mask = 0;
+        m_fimc_m2m_mask = 0;
+        for (int dev = 0; dev < FIMC_DEV_MAX; dev++)
+            m_fimc_fd[dev] = -1;
+
 #ifdef IS_FW_DEBUG
         if (m_camera_use_ISP) {
             munmap((void *)m_debug_paddr, FIMC_IS_FW_DEBUG_REGION_SIZE);
@@ -1019,6 +1131,9 @@ int SecCamera::startPreview(void)
         return -1;
     }
 
+    ret = m_leaseFimc(m_cam_fd);
+    CHECK(ret);
+
     ret = setFimc();
     CHECK(ret);
 
@@ -1026,6 +1141,9 @@ int SecCamera::startPreview(void)
     CHECK(ret);
 
     if (m_camera_use_ISP) {
+        FimcLease lease(this, m_prev_fd);
+        CHECK(lease.status());
+
         ret = setFimcForPreview();
         CHECK(ret);
     }
@@ -1038,10 +1156,20 @@ int SecCamera::startPreview(void)
 #endif
 
 #ifdef ZERO_SHUTTER_LAG
-    if (m_camera_use_ISP)
-        setFimcForSnapshot();
+    if (m_camera_use_ISP) {
+        FimcLease lease(this, m_cap_fd);
+        if (lease.status() == 0)
+            setFimcForSnapshot();
+    }
 #endif
 
+    /* every crop of the session up front, the frames only look them up */
+    m_zoomReset();
+    m_zoom_pos = m_zoom_target;
+    m_zoomCrop(ZOOM_PREVIEW, m_snapshot_width, m_snapshot_height, 0);
+    m_zoomCrop(ZOOM_RECORD, m_snapshot_width, m_snapshot_height, 0);
+    m_zoomCrop(ZOOM_SNAPSHOT, m_snapshot_width, m_snapshot_height, 0);
+
     m_flag_camera_start = 1;
 
     LOGV("%s: got the first frame of the preview", __func__);
@@ -1156,7 +1284,7 @@ int SecCamera::setFimcForPreview(void)
 
     vc.id = V4L2_CID_RESERVED_MEM_BASE_ADDR;
     vc.value = 0;
-    ret = ioctl(m_prev_fd, VIDIOC_G_CTRL, &vc);
+    ret = cam_ioctl(m_prev_fd, VIDIOC_G_CTRL, &vc);
     if (ret < 0) {
         LOGE("Err(%s): VIDIOC_G_CTRL - V4L2_CID_RESERVED_MEM_BAES_ADDR (%d)", __func__, ret);
         return false;
@@ -1191,7 +1319,7 @@ int SecCamera::setFimcForRecord()
 
     vc.id = V4L2_CID_RESERVED_MEM_BASE_ADDR;
     vc.value = 0;
-    ret = ioctl(m_rec_fd, VIDIOC_G_CTRL, &vc);
+    ret = cam_ioctl(m_rec_fd, VIDIOC_G_CTRL, &vc);
     if (ret < 0) {
         LOGE("Err(%s): VIDIOC_G_CTRL - V4L2_CID_RESERVED_MEM_BAES_ADDR (%d)", __func__, ret);
         return false;
@@ -1239,7 +1367,7 @@ int SecCamera::setFimcForSnapshot()
 
     vc.id = V4L2_CID_RESERVED_MEM_BASE_ADDR;
     vc.value = 0;
-    ret = ioctl(m_cap_fd, VIDIOC_G_CTRL, &vc);
+    ret = cam_ioctl(m_cap_fd, VIDIOC_G_CTRL, &vc);
     if (ret < 0) {
         LOGE("Err(%s): VIDIOC_G_CTRL - V4L2_CID_RESERVED_MEM_BAES_ADDR (%d)", __func__, ret);
         return false;
@@ -1278,8 +1406,14 @@ int SecCamera::runPreviewFimcOneshot(int index, camera_frame_metadata_t *facedat
     LOGV("%s", __func__);
 
     ret = getShareBufferAddr(index, &src_buf);
+    CHECK(ret);
 
-    ret = setFimcSrc(m_prev_fd, m_snapshot_width, m_snapshot_height, facedata);
+    FimcLease lease(this, m_prev_fd);
+    CHECK(lease.status());
+
+    m_zoomStep();
+
+    ret = setFimcSrc(m_prev_fd, ZOOM_PREVIEW, m_snapshot_width, m_snapshot_height, facedata);
     CHECK(ret);
 
     exynos_mem_flush_range mem;
@@ -1294,7 +1428,7 @@ int SecCamera::runPreviewFimcOneshot(int index, camera_frame_metadata_t *facedat
 
     vc.id = V4L2_CID_RESERVED_MEM_BASE_ADDR;
     vc.value = 0;
-    ret = ioctl(m_prev_fd, VIDIOC_G_CTRL, &vc);
+    ret = cam_ioctl(m_prev_fd, VIDIOC_G_CTRL, &vc);
     if (ret < 0) {
         LOGE("Err(%s): VIDIOC_G_CTRL - V4L2_CID_RESERVED_MEM_BAES_ADDR (%d)", __func__, ret);
         return false;
@@ -1350,8 +1484,12 @@ int SecCamera::runRecordFimcOneshot(int index)
     int uvSize = m_recording_width * m_recording_height / 2;
 
     ret = getShareBufferAddr(index, &src_buf);
+    CHECK(ret);
 
-    ret = setFimcSrc(m_rec_fd, m_snapshot_width, m_snapshot_height, NULL);
+    FimcLease lease(this, m_rec_fd);
+    CHECK(lease.status());
+
+    ret = setFimcSrc(m_rec_fd, ZOOM_RECORD, m_snapshot_width, m_snapshot_height, NULL);
     CHECK(ret);
 
     paddr = (char *)m_buffers_record[index].phys.extP[0];
@@ -1414,10 +1552,14 @@ int SecCamera::runSnapshotFimcOneshot(int index)
     LOGV("%s", __func__);
 
     ret = getShareBufferAddr(index, &src_buf);
+    CHECK(ret);
 
     if (m_flag_record_start == 0) {
         /* H/W scaler - FIMC */
-        ret = setFimcSrc(m_cap_fd, m_snapshot_width, m_snapshot_height, NULL);
+        FimcLease lease(this, m_cap_fd);
+        CHECK(lease.status());
+
+        ret = setFimcSrc(m_cap_fd, ZOOM_SNAPSHOT, m_snapshot_width, m_snapshot_height, NULL);
         CHECK(ret);
 
         ret = fimc_v4l2_streamon_userptr(m_cap_fd);
@@ -1463,31 +1605,16 @@ int SecCamera::runSnapshotFimcOneshot(int index)
 
         int pictureSize = m_snapshot_width * m_snapshot_height;
 
-        /* crop input size
-         * '*3/4' : 4x zoom
-         * '/31' : 31 steps
-         */
-        int step = 31;
-        float zoom[step];
-        float inc = 0.1;
-        zoom[0] = 1.0;
-        for (int n = 0; n < (step - 1); n++) {
-            zoom[n+1] = zoom[n] + inc;
-        }
+        const struct zoom_crop *zc = m_zoomCrop(ZOOM_SNAPSHOT, m_snapshot_width,
+                                                m_snapshot_height, m_zoom_target);
 
-        int src_width    = (int)((float)m_snapshot_width / zoom[m_zoom_level]);
-        src_width = ALIGN(src_width, 4);
-
-        int src_height   = (int)((float)m_snapshot_height / zoom[m_zoom_level]);
-        src_height = ALIGN(src_height, 4);
+        int src_width    = zc->width;
+        int src_height   = zc->height;
 
         int dst_width    = m_snapshot_width;
         int dst_height   = m_snapshot_height;
 
-        int src_left    = (dst_width - src_width) / 2;
-        int src_top     = (dst_height - src_height) / 2;
-
-        int offset = (dst_width * src_top) + src_left;
+        int offset = (dst_width * zc->top) + zc->left;
 
         src_y_addr = (unsigned char *)(m_buffers_share[index].virt.p + offset);
         src_cbcr_addr = (unsigned char *)(src_y_addr + ALIGN(pictureSize, SIZE_4K));
@@ -1504,7 +1631,12 @@ int SecCamera::runSnapshotFimcOneshot(int index)
     return 0;
 }
 
-int SecCamera::setFimcSrc(int fd, int width, int height, camera_frame_metadata_t *facedata)
+/*
+ * stream is one of ZOOM_STREAM, given by the caller : the fds alias each
+ * other (preview and snapshot share one node without the ISP, snapshot
+ * and record with it).
+ */
+int SecCamera::setFimcSrc(int fd, int stream, int width, int height, camera_frame_metadata_t *facedata)
 {
     LOGV("%s", __func__);
     struct v4l2_format  fmt;
@@ -1514,48 +1646,56 @@ int SecCamera::setFimcSrc(int fd, int width, int height, camera_frame_metadata_t
     int croppedFaceInfo[CAMERA_MAX_FACES];
     int num_croppedFace = 0;
 
-    fmt.fmt.pix.width       = width;
-    fmt.fmt.pix.height      = height;
-    fmt.fmt.pix.pixelformat = m_snapshot_v4lformat;
-    fmt.fmt.pix.field       = V4L2_FIELD_NONE;
-    fmt.type                = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-
-    if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
-        LOGE("%s::VIDIOC_S_FMT failed : errno=%d (%s)"
-                " : fd=%d\n", __func__, errno, strerror(errno), fd);
-        return -1;
-    }
-
-    /* crop input size
-     * '*3/4' : 4x zoom
-     * '/31' : 31 steps
-     */
-    int step = 31;
-    float zoom[step];
-    float inc = 0.1;
-    zoom[0] = 1.0;
-    for (int n = 0; n < (step - 1); n++) {
-        zoom[n+1] = zoom[n] + inc;
-    }
+    /* a snapshot is taken at the level asked for, not where the glide is */
+    int pos = (stream == ZOOM_SNAPSHOT) ? m_zoom_target : m_zoom_pos;
+    struct zoom_table *table = &m_zoom_table[stream];
+    const struct zoom_crop *zc = m_zoomCrop(stream, width, height, pos);
+    float zoom = m_zoom_ratio[pos];
 
     crop.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
-    crop.c.width    = (int)((float)width / zoom[m_zoom_level]);
-    crop.c.height   = (int)((float)height / zoom[m_zoom_level]);
+    crop.c.left     = zc->left;
+    crop.c.top      = zc->top;
+    crop.c.width    = zc->width;
+    crop.c.height   = zc->height;
+
+    /* the node keeps format and crop over REQBUFS, same ones : nothing to send */
+    if (table->applied_width == width && table->applied_height == height
+        && !memcmp(&table->applied, zc, sizeof(*zc))) {
+        m_zoom_crop_kept++;
+    } else {
+        table->applied_width = 0;
 
-    if (crop.c.width % 2)
-        crop.c.width -= 1;
+        fmt.fmt.pix.width       = width;
+        fmt.fmt.pix.height      = height;
+        fmt.fmt.pix.pixelformat = m_snapshot_v4lformat;
+        fmt.fmt.pix.field       = V4L2_FIELD_NONE;
+        fmt.type                = V4L2_BUF_TYPE_VIDEO_OUTPUT;
 
-    if (crop.c.height % 2)
-        crop.c.height -= 1;
+        if (cam_ioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
+            LOGE("%s::VIDIOC_S_FMT failed : errno=%d (%s)"
+                    " : fd=%d\n", __func__, errno, strerror(errno), fd);
+            return -1;
+        }
 
-    crop.c.left     = (width - crop.c.width) / 2;
-    crop.c.top      = (height - crop.c.height) / 2;
+        if (cam_ioctl(fd, VIDIOC_S_CROP, &crop) < 0) {
+            LOGE("%s::Error in video VIDIOC_S_CROP :"
+                    "crop.c.left : (%d), crop.c.top : (%d), crop.c.width : (%d), crop.c.height : (%d)",
+                    __func__, crop.c.left, crop.c.top, crop.c.width, crop.c.height);
+            return -1;
+        }
 
-    if (crop.c.left % 2)
-        crop.c.left -= 1;
+        table->applied_width  = width;
+        table->applied_height = height;
+        table->applied        = *zc;
+        m_zoom_crop_set++;
 
-    if (crop.c.top % 2)
-        crop.c.top -= 1;
+        /* a stream sharing the node finds it set up for this one */
+        int stream_fd[ZOOM_STREAM_MAX] = { m_prev_fd, m_rec_fd, m_cap_fd };
+        for (int i = 0; i < ZOOM_STREAM_MAX; i++) {
+            if (i != stream && stream_fd[i] == fd)
+                m_zoom_table[i].applied_width = 0;
+        }
+    }
 
     int facerect[4];
 
@@ -1627,10 +1767,10 @@ int SecCamera::setFimcSrc(int fd, int width, int height, camera_frame_metadata_t
                     break;
                 }
             }
-            facedata->faces[i].rect[0]      = (int)((float)facedata->faces[croppedIndex].rect[0] * zoom[m_zoom_level]);
-            facedata->faces[i].rect[1]      = (int)((float)facedata->faces[croppedIndex].rect[1] * zoom[m_zoom_level]);
-            facedata->faces[i].rect[2]      = (int)((float)facedata->faces[croppedIndex].rect[2] * zoom[m_zoom_level]);
-            facedata->faces[i].rect[3]      = (int)((float)facedata->faces[croppedIndex].rect[3] * zoom[m_zoom_level]);
+            facedata->faces[i].rect[0]      = (int)((float)facedata->faces[croppedIndex].rect[0] * zoom);
+            facedata->faces[i].rect[1]      = (int)((float)facedata->faces[croppedIndex].rect[1] * zoom);
+            facedata->faces[i].rect[2]      = (int)((float)facedata->faces[croppedIndex].rect[2] * zoom);
+            facedata->faces[i].rect[3]      = (int)((float)facedata->faces[croppedIndex].rect[3] * zoom);
             facedata->faces[i].score        = facedata->faces[croppedIndex].score;
             facedata->faces[i].id           = 0;
             facedata->faces[i].left_eye[0]  = facedata->faces[croppedIndex].left_eye[0];
@@ -1642,19 +1782,12 @@ int SecCamera::setFimcSrc(int fd, int width, int height, camera_frame_metadata_t
         }
     }
 
-    if (ioctl(fd, VIDIOC_S_CROP, &crop) < 0) {
-        LOGE("%s::Error in video VIDIOC_S_CROP :"
-                "crop.c.left : (%d), crop.c.top : (%d), crop.c.width : (%d), crop.c.height : (%d)",
-                __func__, crop.c.left, crop.c.top, crop.c.width, crop.c.height);
-        return -1;
-    }
-
     /* input buffer type */
     req.count       = 1;
     req.memory      = V4L2_MEMORY_USERPTR;
     req.type        = V4L2_BUF_TYPE_VIDEO_OUTPUT;
 
-    if (ioctl(fd, VIDIOC_REQBUFS, &req) < 0) {
+    if (cam_ioctl(fd, VIDIOC_REQBUFS, &req) < 0) {
         LOGE("%s::Error in VIDIOC_REQBUFS", __func__);
         return -1;
     }
@@ -1662,6 +1795,178 @@ int SecCamera::setFimcSrc(int fd, int width, int height, camera_frame_metadata_t
     return 0;
 }
 
+/*
+ * Crop of the source for a zoom position, the table of the stream is built
+ * again only when its source size changed. Sizes and offsets stay even, the
+ * FIMC input rule for YUV (see SecFimc::m_widthOfFimc()). The NEON scaler of
+ * the snapshot path walks 4 pixels at a time.
+ */
+const struct SecCamera::zoom_crop *SecCamera::m_zoomCrop(int stream, int width, int height, int pos)
+{
+    struct zoom_table *table = &m_zoom_table[stream];
+    int align = (stream == ZOOM_SNAPSHOT) ? 4 : 2;
+
+    if (table->width != width || table->height != height) {
+        for (int i = 0; i < ZOOM_POSITIONS; i++) {
+            struct zoom_crop *zc = &table->crop[i];
+
+            zc->width  = (int)((float)width / m_zoom_ratio[i]);
+            zc->height = (int)((float)height / m_zoom_ratio[i]);
+            zc->width  -= zc->width % align;
+            zc->height -= zc->height % align;
+
+            zc->left = (width - zc->width) / 2;
+            zc->top  = (height - zc->height) / 2;
+            zc->left -= zc->left % 2;
+            zc->top  -= zc->top % 2;
+        }
+
+        table->width  = width;
+        table->height = height;
+        table->applied_width = 0;
+    }
+
+    if (pos < 0)
+        pos = 0;
+    if (ZOOM_POSITIONS <= pos)
+        pos = ZOOM_POSITIONS - 1;
+
+    return &table->crop[pos];
+}
+
+/* the nodes may have been set up again, send the crops on the next frame */
+void SecCamera::m_zoomReset(void)
+{
+    for (int i = 0; i < ZOOM_STREAM_MAX; i++)
+        m_zoom_table[i].applied_width = 0;
+}
+
+/* once per preview frame : move the zoom toward m_zoom_target, fast then slow */
+void SecCamera::m_zoomStep(void)
+{
+    int left = m_zoom_target - m_zoom_pos;
+    int step;
+
+    if (left == 0)
+        return;
+
+    step = left / ZOOM_EASE_FRAMES;
+    if (step == 0)
+        step = (0 < left) ? 1 : -1;
+
+    m_zoom_pos += step;
+}
+
+int SecCamera::m_fimcDev(int fd)
+{
+    if (fd < 0)
+        return -1;
+
+    for (int dev = 0; dev < FIMC_DEV_MAX; dev++) {
+        if (m_fimc_fd[dev] == fd)
+            return dev;
+    }
+
+    return -1;
+}
+
+/*
+ * Lease the node fd streams from, for as long as preview, snapshot or
+ * record streams from it. The m2m nodes are not held here, FimcLease takes
+ * them for each frame so csc gets them in between.
+ */
+int SecCamera::m_leaseFimc(int fd)
+{
+    int dev = m_fimcDev(fd);
+
+    if (dev < 0 || !(m_fimc_dev_mask & FIMC_DEV_MASK(dev)))
+        return 0;
+    if (m_fimc_lease_mask & FIMC_DEV_MASK(dev))
+        return 0;
+
+    /* the camera has the highest priority, other clients hand it over */
+    if (SecFimcBroker::getInstance()->acquire(SecFimcBroker::CLIENT_CAMERA, FIMC_DEV_MASK(dev),
+                                              CAMERA_FIMC_LEASE_TIMEOUT_MS) < 0) {
+        LOGE("ERR(%s):Cannot lease /dev/video%d", __func__, dev);
+        return -1;
+    }
+    m_fimc_lease_mask |= FIMC_DEV_MASK(dev);
+
+    /* somebody else may have set the node up in between */
+    m_zoomReset();
+
+    return 0;
+}
+
+/* hand back the streamed nodes no running stream uses, all of them on force */
+void SecCamera::m_releaseFimc(bool force)
+{
+    unsigned int keep = 0;
+    int dev;
+
+    if (!force) {
+        if (m_flag_camera_start && 0 <= (dev = m_fimcDev(m_cam_fd)))
+            keep |= FIMC_DEV_MASK(dev);
+        if (m_snapshot_state && 0 <= (dev = m_fimcDev(m_cap_fd)))
+            keep |= FIMC_DEV_MASK(dev);
+        if (m_flag_record_start && 0 <= (dev = m_fimcDev(m_rec_fd)))
+            keep |= FIMC_DEV_MASK(dev);
+    }
+
+    for (dev = 0; dev < FIMC_DEV_MAX; dev++) {
+        if ((m_fimc_lease_mask & ~keep) & FIMC_DEV_MASK(dev))
+            SecFimcBroker::getInstance()->release(dev);
+    }
+    m_fimc_lease_mask &= keep;
+}
+
+/*
+ * Lease the m2m node behind fd for one frame. When another client had it
+ * since our last lease, it was programmed its own way : the crops and the
+ * destination are sent again.
+ */
+int SecCamera::m_leaseNode(int fd)
+{
+    SecFimcBroker *broker = SecFimcBroker::getInstance();
+    int dev = m_fimcDev(fd);
+    unsigned int count;
+
+    if (dev < 0 || !(m_fimc_m2m_mask & FIMC_DEV_MASK(dev)))
+        return 0;
+
+    if (broker->acquire(SecFimcBroker::CLIENT_CAMERA, FIMC_DEV_MASK(dev),
+                        CAMERA_FIMC_LEASE_TIMEOUT_MS) < 0) {
+        LOGE("ERR(%s):Cannot lease /dev/video%d", __func__, dev);
+        return -1;
+    }
+
+    count = broker->getLeaseCount(dev);
+    if (count != m_fimc_lease_count[dev] + 1) {
+        struct fimc_node_dst *dst = &m_fimc_dst[dev];
+
+        m_zoomReset();
+        if (dst->width != 0
+            && setFimcDst(fd, dst->width, dst->height, dst->pix_fmt, dst->addr) < 0) {
+            LOGE("ERR(%s):Cannot set /dev/video%d up again", __func__, dev);
+            broker->release(dev);
+            return -1;
+        }
+    }
+    m_fimc_lease_count[dev] = count;
+
+    return 0;
+}
+
+void SecCamera::m_releaseNode(int fd)
+{
+    int dev = m_fimcDev(fd);
+
+    if (dev < 0 || !(m_fimc_m2m_mask & FIMC_DEV_MASK(dev)))
+        return;
+
+    SecFimcBroker::getInstance()->release(dev);
+}
+
 int SecCamera::setFimcDst(int fd, int width, int height, int pix_fmt, unsigned int addr)
 {
     struct v4l2_format      sFormat;
@@ -1674,7 +1979,7 @@ int SecCamera::setFimcDst(int fd, int width, int height, int pix_fmt, unsigned i
     LOGV("%s", __func__);
 
     /* set size, format & address for destination image (DMA-OUTPUT) */
-    ret = ioctl(fd, VIDIOC_G_FBUF, &fbuf);
+    ret = cam_ioctl(fd, VIDIOC_G_FBUF, &fbuf);
     if (ret < 0) {
         LOGE("%s::Error in video VIDIOC_G_FBUF (%d)", __func__, ret);
         return -1;
@@ -1685,7 +1990,7 @@ int SecCamera::setFimcDst(int fd, int width, int height, int pix_fmt, unsigned i
     fbuf.fmt.height      = height;
     fbuf.fmt.pixelformat = pix_fmt;
 
-    ret = ioctl(fd, VIDIOC_S_FBUF, &fbuf);
+    ret = cam_ioctl(fd, VIDIOC_S_FBUF, &fbuf);
     if (ret < 0) {
         LOGE("%s::Error in video VIDIOC_S_FBUF (%d)", __func__, ret);
         return -1;
@@ -1698,12 +2003,20 @@ int SecCamera::setFimcDst(int fd, int width, int height, int pix_fmt, unsigned i
     sFormat.fmt.win.w.width  = width;
     sFormat.fmt.win.w.height = height;
 
-    ret = ioctl(fd, VIDIOC_S_FMT, &sFormat);
+    ret = cam_ioctl(fd, VIDIOC_S_FMT, &sFormat);
     if (ret < 0) {
         LOGE("%s::Error in video VIDIOC_S_FMT (%d)", __func__, ret);
         return -1;
     }
 
+    int dev = m_fimcDev(fd);
+    if (0 <= dev) {
+        m_fimc_dst[dev].width   = width;
+        m_fimc_dst[dev].height  = height;
+        m_fimc_dst[dev].pix_fmt = pix_fmt;
+        m_fimc_dst[dev].addr    = addr;
+    }
+
     return 0;
 }
 
@@ -1715,7 +2028,7 @@ int SecCamera::clearFimcBuf(int fd)
     req.memory  = V4L2_MEMORY_USERPTR;
     req.type    = V4L2_BUF_TYPE_VIDEO_OUTPUT;
 
-    if (ioctl(fd, VIDIOC_REQBUFS, &req) == -1) {
+    if (cam_ioctl(fd, VIDIOC_REQBUFS, &req) == -1) {
         LOGE("Error in VIDIOC_REQBUFS");
     }
 
@@ -1772,6 +2085,7 @@ int SecCamera::stopPreview(void)
     fimc_v4l2_reqbufs(m_cam_fd, V4L2_BUF_TYPE, 0);
 
     m_flag_camera_start = 0;
+    m_releaseFimc(false);
 
     return ret;
 }
@@ -1792,6 +2106,10 @@ int SecCamera::startSnapshot(SecBuffer *yuv_buf)
         return -1;
     }
 
+    ret = m_leaseFimc(m_cap_fd);
+    CHECK(ret);
+
+    m_zoomReset();
     m_snapshot_state = 1;
 
     memset(&m_events_c2, 0, sizeof(m_events_c2));
@@ -1822,7 +2140,10 @@ int SecCamera::startSnapshot(SecBuffer *yuv_buf)
 #endif
 
     if (m_camera_use_ISP) {
-        ret = setFimcSrc(m_cap_fd, m_sensor_width, m_sensor_height, NULL);
+        FimcLease lease(this, m_cap_fd);
+        CHECK(lease.status());
+
+        ret = setFimcSrc(m_cap_fd, ZOOM_SNAPSHOT, m_sensor_width, m_sensor_height, NULL);
         CHECK(ret);
 
         ret = setFimcDst(m_cap_fd, m_snapshot_width, m_snapshot_height, m_snapshot_v4lformat, (unsigned int)(yuv_buf->virt.extP[0]));
@@ -1881,6 +2202,7 @@ int SecCamera::stopSnapshot(void)
     endSnapshot();
 
     m_snapshot_state = 0;
+    m_releaseFimc(false);
 
     return ret;
 }
@@ -1903,6 +2225,14 @@ int SecCamera::startRecord(bool recordHint)
         return -1;
     }
 
+    ret = m_leaseFimc(m_rec_fd);
+    CHECK(ret);
+
+    FimcLease lease(this, m_rec_fd);
+    CHECK(lease.status());
+
+    m_zoomReset();
+
     /* enum_fmt, s_fmt sample */
     ret = fimc_v4l2_enum_fmt(m_rec_fd, RECORD_PIX_FMT);
     CHECK(ret);
@@ -1994,6 +2324,8 @@ int SecCamera::stopRecord(void)
         fimc_v4l2_reqbufs(m_rec_fd, V4L2_BUF_TYPE, 0);
     }
 
+    m_releaseFimc(false);
+
     return 0;
 }
 
@@ -2030,8 +2362,11 @@ int SecCamera::getPreviewAddr(int index, SecBuffer *buffer)
 
 int SecCamera::getShareBufferAddr(int index, struct fimc_buf *src_buf)
 {
+    /* a virtual sensor has no physical memory to feed the fimc with */
     src_buf->base[0] = fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_PADDR_Y, index);
+    CHECK((int)src_buf->base[0]);
     src_buf->base[1] = fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_PADDR_CBCR, index);
+    CHECK((int)src_buf->base[1]);
 
     LOGV("%s: Y %p, CbCr %p,index %d",
         __func__, src_buf->base[0], src_buf->base[1], index);
@@ -3869,6 +4204,10 @@ int SecCamera::setZoom(int zoom_level)
                 }
             }
             m_zoom_level = zoom_level;
+            m_zoom_target = zoom_level * ZOOM_SUBSTEPS;
+            /* nothing on screen to glide over */
+            if (m_flag_camera_start == 0)
+                m_zoom_pos = m_zoom_target;
         }
     }
 
@@ -4201,24 +4540,15 @@ int SecCamera::setObjectPosition(int x, int y)
 {
     LOGV("%s(setObjectPosition(x=%d, y=%d))", __func__, x, y);
 
-    /* crop input size
-     * '*3/4' : 4x zoom
-     * '/31' : 31 steps
-     */
-    int step = 31;
-    float zoom[step];
-    float inc = 0.1;
+    /* the zoom on screen, it may still be gliding toward m_zoom_level */
+    float zoom = m_zoom_ratio[m_zoom_pos];
     int new_x, new_y;
-    zoom[0] = 1.0;
-    for (int n = 0; n < (step - 1); n++) {
-        zoom[n+1] = zoom[n] + inc;
-    }
 
     /* Converting axis and Calcurating x,y position.
      * Because driver need (x, y) point.
      */
-    new_x = (int)(((x / zoom[m_zoom_level]) + 1000) * 1023 / 2000);
-    new_y = (int)(((y / zoom[m_zoom_level]) + 1000) * 1023 / 2000);
+    new_x = (int)(((x / zoom) + 1000) * 1023 / 2000);
+    new_y = (int)(((y / zoom) + 1000) * 1023 / 2000);
 
     if (m_flag_camera_start) {
         if (fimc_v4l2_s_ctrl(m_cam_fd, V4L2_CID_CAMERA_OBJECT_POSITION_X, new_x) < 0) {
@@ -5117,6 +5447,9 @@ status_t SecCamera::dump(int fd)
     String8 result;
     snprintf(buffer, 255, "dump(%d)\n", fd);
     result.append(buffer);
+    snprintf(buffer, 255, " zoom level(%d) position(%d/%d) crops sent(%u) kept(%u)\n",
+             m_zoom_level, m_zoom_pos, m_zoom_target, m_zoom_crop_set, m_zoom_crop_kept);
+    result.append(buffer);
     ::write(fd, result.string(), result.size());
     return NO_ERROR;
 }
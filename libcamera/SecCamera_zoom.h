@@ -41,6 +41,7 @@
 #include "s5p_fimc.h"
 
 #include "SecBuffer.h"
+#include "SecFimcBroker.h"
 #include "exynos_mem.h"
 
 #include <utils/String8.h>
@@ -179,6 +180,9 @@ namespace android {
 #endif
 #endif
 
+/* how long starting a stream waits for other FIMC clients to hand a node over */
+#define CAMERA_FIMC_LEASE_TIMEOUT_MS    1000
+
 #define DEV_EXYNOS_MEM    "/dev/exynos-mem"
 #define PFX_NODE_MEM   "/dev/exynos-mem"
 
@@ -247,6 +251,17 @@ namespace android {
 #define RECORD_MODE 3
 #define CAMERA_MAX_FACES 5
 
+/*
+ * Digital zoom through the FIMC source crop, 1.0x to 4.0x in 0.1x levels.
+ * Each level is split in sub steps so a zoom change can glide over a few
+ * preview frames instead of jumping.
+ */
+#define ZOOM_LEVEL_STEP         (0.1f)
+#define ZOOM_SUBSTEPS           (4)
+#define ZOOM_POSITIONS          ((ZOOM_LEVEL_MAX - 1) * ZOOM_SUBSTEPS + 1)
+/* a zoom change covers 1/ZOOM_EASE_FRAMES of what is left every frame */
+#define ZOOM_EASE_FRAMES        (4)
+
 #ifdef IS_FW_DEBUG
 #define FIMC_IS_FW_DEBUG_REGION_SIZE 512000
 #define FIMC_IS_FW_DEBUG_REGION_ADDR 0x84B000
@@ -361,7 +376,7 @@ public:
     int             setFimcForPreview(void);
     int             setFimcForRecord(void);
     int             setFimcForSnapshot(void);
-    int             setFimcSrc(int fd, int width, int height, camera_frame_metadata_t *facedata);
+    int             setFimcSrc(int fd, int stream, int width, int height, camera_frame_metadata_t *facedata);
     int             setFimcDst(int fd, int width, int heifht, int pix_fmt, unsigned int addr);
     int             clearFimcBuf(int fd);
     int             runPreviewFimcOneshot(int index, camera_frame_metadata_t *facedata);
@@ -621,6 +636,15 @@ private:
     struct pollfd   m_events_c3;
     int             m_flag_record_start;
 
+    /*
+     * FIMC nodes the camera opened. A node it streams from is leased while
+     * a stream uses it, an m2m node only for each frame it scales.
+     */
+    unsigned int    m_fimc_dev_mask;
+    unsigned int    m_fimc_m2m_mask;
+    unsigned int    m_fimc_lease_mask;
+    int             m_fimc_fd[FIMC_DEV_MAX];
+
 #ifdef IS_FW_DEBUG
     int             m_mem_fd;
     off_t           m_debug_paddr;
@@ -735,6 +759,78 @@ private:
                                         bool useMainbufForThumb);
     void            resetCamera();
 
+    enum ZOOM_STREAM {
+        ZOOM_PREVIEW = 0,
+        ZOOM_RECORD,
+        ZOOM_SNAPSHOT,
+        ZOOM_STREAM_MAX,
+    };
+
+    struct zoom_crop {
+        int         left;
+        int         top;
+        int         width;
+        int         height;
+    };
+
+    /* crops of one stream for every zoom position, and what its node has now */
+    struct zoom_table {
+        int         width;          /* source the crops are for, 0 : not built */
+        int         height;
+        struct zoom_crop crop[ZOOM_POSITIONS];
+        int         applied_width;  /* 0 : the node needs S_FMT and S_CROP */
+        int         applied_height;
+        struct zoom_crop applied;
+    };
+
+    float           m_zoom_ratio[ZOOM_POSITIONS];
+    struct zoom_table m_zoom_table[ZOOM_STREAM_MAX];
+    int             m_zoom_pos;     /* sub step shown by preview and record */
+    int             m_zoom_target;  /* sub step of m_zoom_level */
+    unsigned int    m_zoom_crop_set;
+    unsigned int    m_zoom_crop_kept;
+
+    const struct zoom_crop *m_zoomCrop(int stream, int width, int height, int pos);
+    void            m_zoomReset(void);
+    void            m_zoomStep(void);
+
+    /* destination an m2m node was given, sent again when another client had it */
+    struct fimc_node_dst {
+        int             width;      /* 0 : none yet */
+        int             height;
+        int             pix_fmt;
+        unsigned int    addr;
+    };
+
+    unsigned int    m_fimc_lease_count[FIMC_DEV_MAX];
+    struct fimc_node_dst m_fimc_dst[FIMC_DEV_MAX];
+
+    int             m_fimcDev(int fd);
+    int             m_leaseFimc(int fd);
+    void            m_releaseFimc(bool force);
+    int             m_leaseNode(int fd);
+    void            m_releaseNode(int fd);
+
+    /* holds the m2m node behind fd for a scope, the way Mutex::Autolock does */
+    class FimcLease {
+    public:
+        FimcLease(SecCamera *camera, int fd) : mCamera(camera), mFd(fd)
+        {
+            mStatus = camera->m_leaseNode(fd);
+        }
+        ~FimcLease()
+        {
+            if (mStatus == 0)
+                mCamera->m_releaseNode(mFd);
+        }
+        int status(void) { return mStatus; }
+
+    private:
+        SecCamera      *mCamera;
+        int             mFd;
+        int             mStatus;
+    };
+
     static double   jpeg_ratio;
     static int      interleaveDataSize;
     static int      jpegLineLength;
@@ -0,0 +1,213 @@
+/*
+**
+** Copyright 2010, Samsung Electronics Co. LTD
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SecFrameQueue"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "SecFrameQueue.h"
+
+namespace android {
+
+SecFrameQueue::SecFrameQueue(const char *name, int depth, enum POLICY policy)
+{
+    strncpy(mName, name, sizeof(mName) - 1);
+    mName[sizeof(mName) - 1] = '\0';
+
+    if (depth < 1 || FRAME_QUEUE_MAX_DEPTH < depth) {
+        LOGW("%s: %s depth(%d) out of range, using %d",
+             __func__, mName, depth, FRAME_QUEUE_MAX_DEPTH);
+        depth = FRAME_QUEUE_MAX_DEPTH;
+    }
+
+    mPolicy   = policy;
+    mDepth    = depth;
+    mHead     = 0;
+    mCount    = 0;
+    mMaxCount = 0;
+    mBusy     = false;
+    mAbort    = false;
+    mBusyTimestamp = 0;
+
+    mPushCount   = 0;
+    mDropCount   = 0;
+    mPopCount    = 0;
+    mDoneCount   = 0;
+    mWaitTime    = 0;
+    mMaxWaitTime = 0;
+    mLatency     = 0;
+    mMaxLatency  = 0;
+}
+
+SecFrameQueue::~SecFrameQueue()
+{
+}
+
+bool SecFrameQueue::push(int index, nsecs_t timestamp, int *dropped)
+{
+    struct entry *entry;
+
+    *dropped = -1;
+
+    Mutex::Autolock lock(mLock);
+
+    mPushCount++;
+
+    if (mCount == mDepth) {
+        mDropCount++;
+
+        if (mPolicy == DROP_NEWEST)
+            return false;
+
+        *dropped = mEntry[mHead].index;
+        mHead = (mHead + 1) % mDepth;
+        mCount--;
+    }
+
+    entry = &mEntry[(mHead + mCount) % mDepth];
+    entry->index     = index;
+    entry->timestamp = timestamp;
+    entry->queued    = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    mCount++;
+    if (mMaxCount < mCount)
+        mMaxCount = mCount;
+
+    mCondition.broadcast();
+
+    return true;
+}
+
+int SecFrameQueue::pop(nsecs_t *timestamp)
+{
+    struct entry *entry;
+    nsecs_t waited;
+
+    Mutex::Autolock lock(mLock);
+
+    while (mCount == 0 && !mAbort)
+        mCondition.wait(mLock);
+
+    if (mAbort)
+        return -1;
+
+    entry = &mEntry[mHead];
+    mHead = (mHead + 1) % mDepth;
+    mCount--;
+    mPopCount++;
+
+    waited = systemTime(SYSTEM_TIME_MONOTONIC) - entry->queued;
+    mWaitTime += waited;
+    if (mMaxWaitTime < waited)
+        mMaxWaitTime = waited;
+
+    mBusy = true;
+    mBusyTimestamp = entry->timestamp;
+
+    if (timestamp)
+        *timestamp = entry->timestamp;
+
+    return entry->index;
+}
+
+void SecFrameQueue::done(void)
+{
+    nsecs_t latency;
+
+    Mutex::Autolock lock(mLock);
+
+    if (!mBusy)
+        return;
+
+    /* from capture to the end of this stage */
+    latency = systemTime(SYSTEM_TIME_MONOTONIC) - mBusyTimestamp;
+    mLatency += latency;
+    if (mMaxLatency < latency)
+        mMaxLatency = latency;
+
+    mDoneCount++;
+    mBusy = false;
+
+    mCondition.broadcast();
+}
+
+int SecFrameQueue::flush(int *index, int max)
+{
+    int count = 0;
+
+    Mutex::Autolock lock(mLock);
+
+    while (0 < mCount && count < max) {
+        index[count++] = mEntry[mHead].index;
+        mHead = (mHead + 1) % mDepth;
+        mCount--;
+    }
+
+    return count;
+}
+
+void SecFrameQueue::waitIdle(void)
+{
+    Mutex::Autolock lock(mLock);
+
+    while (mBusy && !mAbort)
+        mCondition.wait(mLock);
+}
+
+void SecFrameQueue::abort(void)
+{
+    Mutex::Autolock lock(mLock);
+
+    mAbort = true;
+    mCondition.broadcast();
+}
+
+int SecFrameQueue::getCount(void)
+{
+    Mutex::Autolock lock(mLock);
+
+    return mCount;
+}
+
+int SecFrameQueue::dump(char *buf, int bufSize)
+{
+    int len;
+
+    if (buf == NULL || bufSize <= 0)
+        return 0;
+
+    Mutex::Autolock lock(mLock);
+
+    len = snprintf(buf, bufSize,
+                   " %-8s: depth(%d/%d max %d) pushed(%u) dropped(%u) done(%u)"
+                   " wait avg(%lld us) max(%lld us) latency avg(%lld us) max(%lld us)\n",
+                   mName, mCount, mDepth, mMaxCount,
+                   mPushCount, mDropCount, mDoneCount,
+                   mPopCount ? ns2us(mWaitTime) / mPopCount : 0,
+                   ns2us(mMaxWaitTime),
+                   mDoneCount ? ns2us(mLatency) / mDoneCount : 0,
+                   ns2us(mMaxLatency));
+    if (bufSize <= len)
+        return bufSize - 1;
+
+    return len;
+}
+
+}; // namespace android
@@ -0,0 +1,108 @@
+/*
+**
+** Copyright 2010, Samsung Electronics Co. LTD
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*!
+ * \file      SecFrameQueue.h
+ * \brief     bounded frame queue between two preview pipeline stages
+ *
+ * One thread pushes buffer indexes, one thread pops them. When the queue
+ * is full the policy decides which frame is dropped : the one being pushed
+ * (DROP_NEWEST) or the oldest one still waiting (DROP_OLDEST). Dropped
+ * indexes are handed back to the producer, which owns returning them.
+ */
+
+#ifndef ANDROID_HARDWARE_SEC_FRAME_QUEUE_H
+#define ANDROID_HARDWARE_SEC_FRAME_QUEUE_H
+
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+#define FRAME_QUEUE_MAX_DEPTH   (8)
+
+namespace android {
+
+class SecFrameQueue
+{
+public:
+    enum POLICY {
+        DROP_NEWEST = 0,
+        DROP_OLDEST,
+    };
+
+    SecFrameQueue(const char *name, int depth, enum POLICY policy);
+    ~SecFrameQueue();
+
+    /*
+     * Queue index captured at timestamp.
+     * Returns false when index itself was dropped. With DROP_OLDEST the
+     * evicted index is stored in *dropped, otherwise *dropped is -1.
+     */
+    bool push(int index, nsecs_t timestamp, int *dropped);
+
+    /* Block for the next index, -1 once the queue is aborted */
+    int  pop(nsecs_t *timestamp);
+
+    /* The consumer is through with the frame it popped last */
+    void done(void);
+
+    /* Take every waiting index out of the queue, returns how many */
+    int  flush(int *index, int max);
+
+    /* Wait until the consumer finished the frame it is working on */
+    void waitIdle(void);
+
+    void abort(void);
+
+    int  getCount(void);
+    int  dump(char *buf, int bufSize);
+
+private:
+    struct entry {
+        int     index;
+        nsecs_t timestamp;
+        nsecs_t queued;
+    };
+
+    Mutex           mLock;
+    Condition       mCondition;
+
+    char            mName[16];
+    enum POLICY     mPolicy;
+    int             mDepth;
+
+    struct entry    mEntry[FRAME_QUEUE_MAX_DEPTH];
+    int             mHead;
+    int             mCount;
+    int             mMaxCount;
+
+    bool            mBusy;
+    bool            mAbort;
+    nsecs_t         mBusyTimestamp;
+
+    unsigned int    mPushCount;
+    unsigned int    mDropCount;
+    unsigned int    mPopCount;
+    unsigned int    mDoneCount;
+    nsecs_t         mWaitTime;
+    nsecs_t         mMaxWaitTime;
+    nsecs_t         mLatency;
+    nsecs_t         mMaxLatency;
+};
+
+}; // namespace android
+
+#endif // ANDROID_HARDWARE_SEC_FRAME_QUEUE_H
@@ -0,0 +1,197 @@
+/*
+**
+** Copyright 2010, Samsung Electronics Co. LTD
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SecFrameTrace"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "SecFrameTrace.h"
+
+namespace android {
+
+/* upper bound of each histogram bucket in ms, the last one takes the rest */
+static const int sBucketMs[FRAME_TRACE_BUCKETS - 1] = {
+    5, 10, 20, 33, 50, 66, 100, 200, 500,
+};
+
+static const char *sEventName[SecFrameTrace::EVENT_MAX] = {
+    "dequeued", "displayed", "delivered", "recorded", "released",
+};
+
+static const char *sEventTag[SecFrameTrace::EVENT_MAX] = {
+    "dq", "disp", "cb", "enc", "rel",
+};
+
+SecFrameTrace::SecFrameTrace(const char *name)
+{
+    strncpy(mName, name, sizeof(mName) - 1);
+    mName[sizeof(mName) - 1] = '\0';
+
+    reset();
+}
+
+SecFrameTrace::~SecFrameTrace()
+{
+}
+
+void SecFrameTrace::begin(int slot, unsigned int sequence, nsecs_t capture)
+{
+    struct record *record;
+
+    if (slot < 0 || FRAME_TRACE_SLOTS <= slot)
+        return;
+
+    Mutex::Autolock lock(mLock);
+
+    if (mFrames && mLastSequence + 1 < sequence)
+        mGaps += sequence - mLastSequence - 1;
+    mLastSequence = sequence;
+    mFrames++;
+
+    record = &mSlot[slot];
+    memset(record, 0, sizeof(*record));
+    record->sequence = sequence;
+    record->capture  = capture;
+    record->event[DEQUEUED] = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    account(DEQUEUED, record->event[DEQUEUED] - capture);
+}
+
+void SecFrameTrace::mark(int slot, enum EVENT event)
+{
+    struct record *record;
+
+    if (slot < 0 || FRAME_TRACE_SLOTS <= slot || event <= DEQUEUED || EVENT_MAX <= event)
+        return;
+
+    Mutex::Autolock lock(mLock);
+
+    record = &mSlot[slot];
+    /* not begun, or this already happened to the frame */
+    if (record->capture == 0 || record->event[event] != 0)
+        return;
+
+    record->event[event] = systemTime(SYSTEM_TIME_MONOTONIC);
+    account(event, record->event[event] - record->capture);
+
+    if (event == RELEASED) {
+        mHistoryHead = (mHistoryHead + 1) % FRAME_TRACE_HISTORY;
+        mHistory[mHistoryHead] = *record;
+        record->capture = 0;
+    }
+}
+
+/* mLock held */
+void SecFrameTrace::account(enum EVENT event, nsecs_t latency)
+{
+    struct histogram *hist = &mHist[event];
+    int i;
+
+    for (i = 0; i < FRAME_TRACE_BUCKETS - 1; i++) {
+        if (latency < ms2ns(sBucketMs[i]))
+            break;
+    }
+
+    hist->bucket[i]++;
+    hist->count++;
+    hist->sum += latency;
+    if (hist->max < latency)
+        hist->max = latency;
+}
+
+void SecFrameTrace::reset(void)
+{
+    Mutex::Autolock lock(mLock);
+
+    memset(mSlot, 0, sizeof(mSlot));
+    memset(mHistory, 0, sizeof(mHistory));
+    memset(mHist, 0, sizeof(mHist));
+    mHistoryHead  = 0;
+    mFrames       = 0;
+    mGaps         = 0;
+    mLastSequence = 0;
+}
+
+/* upper bound in ms of the bucket holding the percentile, -1 : above them all */
+int SecFrameTrace::percentile(const struct histogram *hist, int percent)
+{
+    unsigned int want = (hist->count * percent + 99) / 100;
+    unsigned int seen = 0;
+
+    for (int i = 0; i < FRAME_TRACE_BUCKETS - 1; i++) {
+        seen += hist->bucket[i];
+        if (want <= seen)
+            return sBucketMs[i];
+    }
+
+    return -1;
+}
+
+int SecFrameTrace::dump(char *buf, int bufSize)
+{
+    int len = 0;
+
+    if (buf == NULL || bufSize <= 0)
+        return 0;
+
+    Mutex::Autolock lock(mLock);
+
+    len += snprintf(buf + len, bufSize - len, " %-8s: frames(%u) sequence gaps(%u)\n",
+                    mName, mFrames, mGaps);
+
+    for (int i = 0; i < EVENT_MAX && len < bufSize; i++) {
+        struct histogram *hist = &mHist[i];
+
+        if (hist->count == 0)
+            continue;
+
+        len += snprintf(buf + len, bufSize - len,
+                        "   %-9s n(%u) avg(%lld us) max(%lld us) p50(%d ms) p90(%d ms) p99(%d ms)\n",
+                        sEventName[i], hist->count,
+                        ns2us(hist->sum) / hist->count, ns2us(hist->max),
+                        percentile(hist, 50), percentile(hist, 90), percentile(hist, 99));
+    }
+
+    /* newest first, every event in ms after the capture, - : didn't happen */
+    for (int i = 0; i < FRAME_TRACE_HISTORY && len < bufSize; i++) {
+        struct record *record = &mHistory[(mHistoryHead + FRAME_TRACE_HISTORY - i) % FRAME_TRACE_HISTORY];
+
+        if (record->capture == 0)
+            break;
+
+        len += snprintf(buf + len, bufSize - len, "   #%u", record->sequence);
+        for (int j = 0; j < EVENT_MAX && len < bufSize; j++) {
+            if (record->event[j] == 0)
+                len += snprintf(buf + len, bufSize - len, " %s(-)", sEventTag[j]);
+            else
+                len += snprintf(buf + len, bufSize - len, " %s(%lld)", sEventTag[j],
+                                ns2ms(record->event[j] - record->capture));
+        }
+        if (len < bufSize)
+            len += snprintf(buf + len, bufSize - len, "\n");
+    }
+
+    if (bufSize <= len)
+        return bufSize - 1;
+
+    return len;
+}
+
+}; // namespace android
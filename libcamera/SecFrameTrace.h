@@ -0,0 +1,96 @@
+/*
+**
+** Copyright 2010, Samsung Electronics Co. LTD
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*!
+ * \file      SecFrameTrace.h
+ * \brief     per frame latency trace of the camera pipeline
+ *
+ * A slot per buffer index follows one frame from the sensor to the moment
+ * the buffer is given back. Each event is timed against the capture
+ * timestamp of the frame and lands in a histogram, the last released
+ * frames are kept whole for dump().
+ */
+
+#ifndef ANDROID_HARDWARE_SEC_FRAME_TRACE_H
+#define ANDROID_HARDWARE_SEC_FRAME_TRACE_H
+
+#include <utils/threads.h>
+#include <utils/Timers.h>
+
+#define FRAME_TRACE_SLOTS       (8)
+#define FRAME_TRACE_HISTORY     (8)
+#define FRAME_TRACE_BUCKETS     (10)
+
+namespace android {
+
+class SecFrameTrace
+{
+public:
+    enum EVENT {
+        DEQUEUED = 0,
+        DISPLAYED,
+        DELIVERED,
+        RECORDED,
+        RELEASED,
+        EVENT_MAX,
+    };
+
+    SecFrameTrace(const char *name);
+    ~SecFrameTrace();
+
+    /* Buffer slot holds the frame the sensor captured at timestamp */
+    void begin(int slot, unsigned int sequence, nsecs_t capture);
+
+    /* Something happened to the frame in slot, RELEASED ends the frame */
+    void mark(int slot, enum EVENT event);
+
+    void reset(void);
+    int  dump(char *buf, int bufSize);
+
+private:
+    struct record {
+        unsigned int    sequence;
+        nsecs_t         capture;    /* 0 : slot unused */
+        nsecs_t         event[EVENT_MAX];
+    };
+
+    struct histogram {
+        unsigned int    count;
+        nsecs_t         sum;
+        nsecs_t         max;
+        unsigned int    bucket[FRAME_TRACE_BUCKETS];
+    };
+
+    void account(enum EVENT event, nsecs_t latency);
+    int  percentile(const struct histogram *hist, int percent);
+
+    Mutex               mLock;
+    char                mName[16];
+
+    struct record       mSlot[FRAME_TRACE_SLOTS];
+    struct record       mHistory[FRAME_TRACE_HISTORY];
+    int                 mHistoryHead;
+    struct histogram    mHist[EVENT_MAX];
+
+    unsigned int        mFrames;
+    unsigned int        mGaps;      /* frames the sensor sequence skipped */
+    unsigned int        mLastSequence;
+};
+
+}; // namespace android
+
+#endif // ANDROID_HARDWARE_SEC_FRAME_TRACE_H
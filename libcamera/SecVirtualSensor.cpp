@@ -0,0 +1,883 @@
+/*
+**
+** Copyright 2010, Samsung Electronics Co. LTD
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SecVirtualSensor"
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cutils/ashmem.h>
+#include <videodev2.h>
+#include <videodev2_samsung.h>
+
+#include "SecVirtualSensor.h"
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE               (4096)
+#endif
+
+#define VSENSOR_STRIPE_LINES    (8)
+
+namespace android {
+
+Mutex SecVirtualSensor::sLock;
+SecVirtualSensor *SecVirtualSensor::sNode[VSENSOR_MAX_NODES];
+
+/* the formats SecCamera asks the fimc nodes for */
+static const struct {
+    unsigned int    pixelformat;
+    const char      *description;
+} sFormats[] = {
+    { V4L2_PIX_FMT_NV21,    "YUV 4:2:0 CrCb" },
+    { V4L2_PIX_FMT_NV12,    "YUV 4:2:0 CbCr" },
+    { V4L2_PIX_FMT_NV12T,   "YUV 4:2:0 CbCr tiled" },
+    { V4L2_PIX_FMT_YUV420,  "YUV 4:2:0 planar" },
+    { V4L2_PIX_FMT_YVU420,  "YVU 4:2:0 planar" },
+    { V4L2_PIX_FMT_YVU420M, "YVU 4:2:0 planar, planes apart" },
+    { V4L2_PIX_FMT_YUYV,    "YUV 4:2:2 YCbYCr" },
+    { V4L2_PIX_FMT_UYVY,    "YUV 4:2:2 CbYCrY" },
+    { V4L2_PIX_FMT_RGB565,  "RGB565" },
+    { V4L2_PIX_FMT_JPEG,    "JPEG" },
+};
+
+/* 75% colour bars, white to black */
+static const unsigned char sBarY[8] = { 180, 162, 131, 112,  84,  65,  35,  16 };
+static const unsigned char sBarU[8] = { 128,  44, 156,  72, 184, 100, 212, 128 };
+static const unsigned char sBarV[8] = { 128, 142,  44,  58, 198, 212, 114, 128 };
+
+bool SecVirtualSensor::enabled(void)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get("camera.virtual.enable", value, "0");
+
+    return atoi(value) != 0;
+}
+
+void SecVirtualSensor::readConfig(struct config *config)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    property_get("camera.virtual.pattern", value, "bars");
+    if (!strcmp(value, "ramp"))
+        config->pattern = PATTERN_RAMP;
+    else if (!strcmp(value, "gray"))
+        config->pattern = PATTERN_GRAY;
+    else if (!strcmp(value, "file"))
+        config->pattern = PATTERN_FILE;
+    else
+        config->pattern = PATTERN_BARS;
+
+    property_get("camera.virtual.file", config->file, "");
+
+    property_get("camera.virtual.fps", value, "0");
+    config->fps = atoi(value);
+    property_get("camera.virtual.jitter_us", value, "0");
+    config->jitter_us = atoi(value);
+    property_get("camera.virtual.drop", value, "0");
+    config->drop_permille = atoi(value);
+    property_get("camera.virtual.stall", value, "0");
+    config->stall_permille = atoi(value);
+    property_get("camera.virtual.stall_ms", value, "1000");
+    config->stall_ms = atoi(value);
+    if (config->stall_ms <= 0)
+        config->stall_ms = VSENSOR_DEFAULT_STALL_MS;
+    property_get("camera.virtual.seed", value, "1");
+    config->seed = (unsigned int)strtoul(value, NULL, 0);
+    property_get("camera.virtual.isp", value, "1");
+    config->isp = atoi(value) != 0;
+}
+
+int SecVirtualSensor::openNode(const char *node)
+{
+    SecVirtualSensor *sensor;
+    int fd, i;
+
+    fd = ashmem_create_region("camera-virtual", VSENSOR_REGION_SIZE);
+    if (fd < 0) {
+        LOGE("ERR(%s):Cannot create the buffer region of %s", __func__, node);
+        return -1;
+    }
+
+    Mutex::Autolock lock(sLock);
+
+    for (i = 0; i < VSENSOR_MAX_NODES; i++) {
+        if (sNode[i] == NULL)
+            break;
+    }
+    if (i == VSENSOR_MAX_NODES) {
+        LOGE("ERR(%s):%d nodes are open already", __func__, VSENSOR_MAX_NODES);
+        ::close(fd);
+        errno = EBUSY;
+        return -1;
+    }
+
+    sensor = new SecVirtualSensor(fd, node);
+    sNode[i] = sensor;
+
+    LOGI("%s: %s is virtual, fd(%d) pattern(%d) fps(%d) jitter(%d us) drop(%d/1000) stall(%d/1000)",
+         __func__, node, fd, sensor->mConfig.pattern, sensor->mConfig.fps,
+         sensor->mConfig.jitter_us, sensor->mConfig.drop_permille,
+         sensor->mConfig.stall_permille);
+
+    return fd;
+}
+
+int SecVirtualSensor::closeNode(int fd)
+{
+    SecVirtualSensor *sensor = NULL;
+
+    sLock.lock();
+    for (int i = 0; i < VSENSOR_MAX_NODES; i++) {
+        if (sNode[i] != NULL && sNode[i]->mFd == fd) {
+            sensor = sNode[i];
+            sNode[i] = NULL;
+            break;
+        }
+    }
+    sLock.unlock();
+
+    if (sensor == NULL) {
+        errno = EBADF;
+        return -1;
+    }
+
+    delete sensor;
+
+    return 0;
+}
+
+SecVirtualSensor *SecVirtualSensor::find(int fd)
+{
+    Mutex::Autolock lock(sLock);
+
+    if (fd < 0)
+        return NULL;
+
+    for (int i = 0; i < VSENSOR_MAX_NODES; i++) {
+        if (sNode[i] != NULL && sNode[i]->mFd == fd)
+            return sNode[i];
+    }
+
+    return NULL;
+}
+
+bool SecVirtualSensor::owns(const void *addr)
+{
+    Mutex::Autolock lock(sLock);
+
+    for (int i = 0; i < VSENSOR_MAX_NODES; i++) {
+        SecVirtualSensor *sensor = sNode[i];
+
+        if (sensor != NULL && sensor->mBase != NULL &&
+            sensor->mBase <= (const char *)addr &&
+            (const char *)addr < sensor->mBase + sensor->mBufCount * sensor->mStride)
+            return true;
+    }
+
+    return false;
+}
+
+SecVirtualSensor::SecVirtualSensor(int fd, const char *node) :
+        mFd(fd),
+        mBase(NULL),
+        mBufCount(0),
+        mStride(0),
+        mQueuedCount(0),
+        mDoneCount(0),
+        mStreaming(false),
+        mSequence(0),
+        mDue(0),
+        mPattern(NULL),
+        mPatternSize(0),
+        mFile(-1),
+        mFileFrames(0),
+        mFrames(0),
+        mDropped(0),
+        mOverruns(0),
+        mStalls(0)
+{
+    strncpy(mNode, node, sizeof(mNode) - 1);
+    mNode[sizeof(mNode) - 1] = '\0';
+
+    readConfig(&mConfig);
+    mRand = mConfig.seed;
+
+    memset(&mFormat, 0, sizeof(mFormat));
+    memset(&mParm, 0, sizeof(mParm));
+    mParm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    mParm.parm.capture.timeperframe.numerator = 1;
+    mParm.parm.capture.timeperframe.denominator = VSENSOR_DEFAULT_FPS;
+
+    mThread = new FrameThread(this);
+    mThread->run("CameraVirtualSensor", PRIORITY_URGENT_DISPLAY);
+}
+
+SecVirtualSensor::~SecVirtualSensor()
+{
+    mThread->requestExit();
+    mLock.lock();
+    mStreaming = false;
+    mCondition.broadcast();
+    mLock.unlock();
+    mThread->requestExitAndWait();
+    mThread.clear();
+
+    if (mBase != NULL)
+        ::munmap(mBase, (mBufCount * mStride + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    if (mFile >= 0)
+        ::close(mFile);
+    free(mPattern);
+
+    ::close(mFd);
+}
+
+int SecVirtualSensor::ioctl(unsigned long request, void *arg)
+{
+    int ret = 0;
+
+    switch (request) {
+    case VIDIOC_QUERYCAP:
+    {
+        struct v4l2_capability *cap = (struct v4l2_capability *)arg;
+
+        memset(cap, 0, sizeof(*cap));
+        strncpy((char *)cap->driver, "virtual", sizeof(cap->driver) - 1);
+        strncpy((char *)cap->card, mNode, sizeof(cap->card) - 1);
+        cap->capabilities = V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_STREAMING;
+        break;
+    }
+    case VIDIOC_ENUMINPUT:
+    {
+        struct v4l2_input *input = (struct v4l2_input *)arg;
+
+        /* back and front */
+        if (1 < input->index) {
+            errno = EINVAL;
+            return -1;
+        }
+        /* an ISP Camera gets the internal ISP paths of SecCamera, ZSL included */
+        strncpy((char *)input->name, mConfig.isp ? "ISP Camera" : "Virtual Sensor",
+                sizeof(input->name) - 1);
+        input->type = V4L2_INPUT_TYPE_CAMERA;
+        break;
+    }
+    case VIDIOC_S_INPUT:
+        break;
+    case VIDIOC_S_FMT:
+        ret = setFormat((struct v4l2_format *)arg);
+        break;
+    case VIDIOC_G_FMT:
+    {
+        struct v4l2_format *fmt = (struct v4l2_format *)arg;
+
+        Mutex::Autolock lock(mLock);
+        fmt->fmt.pix = mFormat;
+        break;
+    }
+    case VIDIOC_ENUM_FMT:
+    {
+        struct v4l2_fmtdesc *fmtdesc = (struct v4l2_fmtdesc *)arg;
+
+        if (sizeof(sFormats) / sizeof(sFormats[0]) <= fmtdesc->index) {
+            errno = EINVAL;
+            return -1;
+        }
+        fmtdesc->pixelformat = sFormats[fmtdesc->index].pixelformat;
+        strncpy((char *)fmtdesc->description, sFormats[fmtdesc->index].description,
+                sizeof(fmtdesc->description) - 1);
+        break;
+    }
+    case VIDIOC_REQBUFS:
+        ret = reqbufs((struct v4l2_requestbuffers *)arg);
+        break;
+    case VIDIOC_QUERYBUF:
+        ret = querybuf((struct v4l2_buffer *)arg);
+        break;
+    case VIDIOC_QBUF:
+        ret = qbuf((struct v4l2_buffer *)arg);
+        break;
+    case VIDIOC_DQBUF:
+        ret = dqbuf((struct v4l2_buffer *)arg);
+        break;
+    case VIDIOC_STREAMON:
+        ret = streamon();
+        break;
+    case VIDIOC_STREAMOFF:
+        ret = streamoff();
+        break;
+    case VIDIOC_G_CTRL:
+    {
+        struct v4l2_control *ctrl = (struct v4l2_control *)arg;
+
+        ctrl->value = getCtrl(ctrl->id);
+        break;
+    }
+    case VIDIOC_S_CTRL:
+    {
+        struct v4l2_control *ctrl = (struct v4l2_control *)arg;
+
+        /*
+         * No physical memory behind a virtual node : handing out the CPU
+         * address would let MFC or the JPEG block DMA into nowhere.
+         */
+        if (ctrl->id == V4L2_CID_PADDR_Y || ctrl->id == V4L2_CID_PADDR_CBCR) {
+            errno = EINVAL;
+            return -1;
+        }
+        setCtrl(ctrl->id, ctrl->value);
+        break;
+    }
+    case VIDIOC_G_EXT_CTRLS:
+    case VIDIOC_S_EXT_CTRLS:
+    {
+        struct v4l2_ext_controls *ctrls = (struct v4l2_ext_controls *)arg;
+
+        for (unsigned int i = 0; i < ctrls->count; i++) {
+            if (request == VIDIOC_G_EXT_CTRLS)
+                ctrls->controls[i].value = getCtrl(ctrls->controls[i].id);
+            else
+                setCtrl(ctrls->controls[i].id, ctrls->controls[i].value);
+        }
+        break;
+    }
+    case VIDIOC_G_PARM:
+    {
+        Mutex::Autolock lock(mLock);
+        *(struct v4l2_streamparm *)arg = mParm;
+        break;
+    }
+    case VIDIOC_S_PARM:
+    {
+        Mutex::Autolock lock(mLock);
+        mParm = *(struct v4l2_streamparm *)arg;
+        break;
+    }
+    default:
+        /* crop, priority and the like : nothing to emulate */
+        LOGV("%s: %s ignores ioctl(%#lx)", __func__, mNode, request);
+        break;
+    }
+
+    return ret;
+}
+
+int SecVirtualSensor::poll(struct pollfd *events, int timeout)
+{
+    Mutex::Autolock lock(mLock);
+    nsecs_t until = systemTime(SYSTEM_TIME_MONOTONIC) + ms2ns(timeout);
+
+    events->revents = 0;
+
+    while (mDoneCount == 0) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        if (timeout == 0 || (0 < timeout && until <= now))
+            return 0;
+
+        if (timeout < 0)
+            mCondition.wait(mLock);
+        else
+            mCondition.waitRelative(mLock, until - now);
+    }
+
+    events->revents = events->events & (POLLIN | POLLRDNORM);
+
+    return 1;
+}
+
+void *SecVirtualSensor::mmap(size_t length, off_t offset)
+{
+    Mutex::Autolock lock(mLock);
+
+    if (mBase == NULL || mBufCount * mStride < offset + (off_t)length) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+
+    return mBase + offset;
+}
+
+int SecVirtualSensor::dump(char *buf, int bufSize)
+{
+    Mutex::Autolock lock(mLock);
+    int len;
+
+    len = snprintf(buf, bufSize,
+                   " virtual %s: %dx%d %.4s %s frames(%u) dropped(%u) overruns(%u) stalls(%u)"
+                   " queued(%d) done(%d)\n",
+                   mNode, mFormat.width, mFormat.height, (const char *)&mFormat.pixelformat,
+                   mStreaming ? "streaming" : "stopped",
+                   mFrames, mDropped, mOverruns, mStalls, mQueuedCount, mDoneCount);
+
+    return (bufSize <= len) ? bufSize - 1 : len;
+}
+
+int SecVirtualSensor::frameSize(void) const
+{
+    int pixels = mFormat.width * mFormat.height;
+
+    switch (mFormat.pixelformat) {
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV12T:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YVU420:
+    case V4L2_PIX_FMT_YVU420M:
+        return pixels * 3 / 2;
+    case V4L2_PIX_FMT_RGB32:
+        return pixels * 4;
+    default:
+        return pixels * 2;
+    }
+}
+
+int SecVirtualSensor::setFormat(struct v4l2_format *fmt)
+{
+    /* the IS mode goes through V4L2_BUF_TYPE_PRIVATE, nothing to keep */
+    if (fmt->type != V4L2_BUF_TYPE_VIDEO_CAPTURE)
+        return 0;
+
+    Mutex::Autolock lock(mLock);
+
+    if (mStreaming) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    mFormat = fmt->fmt.pix;
+    mFormat.sizeimage = frameSize();
+    mFormat.bytesperline = mFormat.width;
+    fmt->fmt.pix = mFormat;
+
+    return 0;
+}
+
+int SecVirtualSensor::reqbufs(struct v4l2_requestbuffers *req)
+{
+    int count = req->count;
+    int length;
+
+    if (req->memory != V4L2_MEMORY_MMAP) {
+        LOGE("ERR(%s):%s only has mmap buffers", __func__, mNode);
+        errno = EINVAL;
+        return -1;
+    }
+
+    Mutex::Autolock lock(mLock);
+
+    if (mStreaming) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    if (mBase != NULL) {
+        ::munmap(mBase, (mBufCount * mStride + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+        mBase = NULL;
+    }
+    mBufCount = 0;
+    mQueuedCount = 0;
+    mDoneCount = 0;
+
+    if (count <= 0)
+        return 0;
+    if (VSENSOR_MAX_BUFFERS < count)
+        count = VSENSOR_MAX_BUFFERS;
+
+    mStride = frameSize() + VSENSOR_FRAME_PAD;
+    length = (count * mStride + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (VSENSOR_REGION_SIZE < length) {
+        LOGE("ERR(%s):%d buffers of %d bytes do not fit", __func__, count, mStride);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    mBase = (char *)::mmap(0, length, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+    if (mBase == MAP_FAILED) {
+        LOGE("ERR(%s):mmap of %d bytes failed (%s)", __func__, length, strerror(errno));
+        mBase = NULL;
+        return -1;
+    }
+
+    mBufCount = count;
+    req->count = count;
+
+    return 0;
+}
+
+int SecVirtualSensor::querybuf(struct v4l2_buffer *buf)
+{
+    Mutex::Autolock lock(mLock);
+
+    if (buf->index >= (unsigned int)mBufCount) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    buf->length   = frameSize();
+    buf->m.offset = buf->index * mStride;
+    buf->flags    = 0;
+
+    return 0;
+}
+
+int SecVirtualSensor::qbuf(struct v4l2_buffer *buf)
+{
+    Mutex::Autolock lock(mLock);
+
+    if (buf->memory != V4L2_MEMORY_MMAP || buf->index >= (unsigned int)mBufCount) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (int i = 0; i < mQueuedCount; i++) {
+        if (mQueued[i] == (int)buf->index) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    mQueued[mQueuedCount++] = buf->index;
+    mCondition.broadcast();
+
+    return 0;
+}
+
+int SecVirtualSensor::dqbuf(struct v4l2_buffer *buf)
+{
+    int index;
+
+    Mutex::Autolock lock(mLock);
+
+    /* a blocking node, like the fimc ones are opened */
+    while (mDoneCount == 0) {
+        if (!mStreaming) {
+            errno = EINVAL;
+            return -1;
+        }
+        mCondition.wait(mLock);
+    }
+
+    index = mDone[0];
+    mDoneCount--;
+    memmove(&mDone[0], &mDone[1], sizeof(mDone[0]) * mDoneCount);
+
+    buf->index     = index;
+    buf->bytesused = frameSize();
+    buf->sequence  = mSeq[index];
+    buf->flags     = 0;
+    buf->timestamp.tv_sec  = mStamp[index] / 1000000000LL;
+    buf->timestamp.tv_usec = (mStamp[index] % 1000000000LL) / 1000;
+
+    return 0;
+}
+
+int SecVirtualSensor::streamon(void)
+{
+    struct stat st;
+
+    Mutex::Autolock lock(mLock);
+
+    if (mBase == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (mStreaming)
+        return 0;
+
+    if (mPattern == NULL || mPatternSize != frameSize())
+        buildPattern();
+
+    if (mConfig.pattern == PATTERN_FILE && mFile < 0 && mConfig.file[0] != '\0') {
+        mFile = ::open(mConfig.file, O_RDONLY);
+        if (mFile < 0 || fstat(mFile, &st) < 0 || st.st_size < frameSize()) {
+            LOGE("ERR(%s):%s holds no %dx%d frame, bars instead", __func__,
+                 mConfig.file, mFormat.width, mFormat.height);
+            if (0 <= mFile)
+                ::close(mFile);
+            mFile = -1;
+        } else
+            mFileFrames = st.st_size / frameSize();
+    }
+
+    mStreaming = true;
+    mSequence = 0;
+    mDue = systemTime(SYSTEM_TIME_MONOTONIC);
+    mCondition.broadcast();
+
+    return 0;
+}
+
+int SecVirtualSensor::streamoff(void)
+{
+    Mutex::Autolock lock(mLock);
+
+    /* every buffer is back with the caller, as with the real nodes */
+    mStreaming = false;
+    mQueuedCount = 0;
+    mDoneCount = 0;
+    if (mFile >= 0) {
+        ::close(mFile);
+        mFile = -1;
+    }
+    mCondition.broadcast();
+
+    return 0;
+}
+
+int SecVirtualSensor::getCtrl(unsigned int id)
+{
+    Mutex::Autolock lock(mLock);
+    ssize_t index;
+
+    /* focus always lands */
+    if (id == V4L2_CID_CAMERA_AUTO_FOCUS_RESULT)
+        return 0x02;
+
+    index = mCtrl.indexOfKey(id);
+
+    return (index < 0) ? 0 : mCtrl.valueAt(index);
+}
+
+void SecVirtualSensor::setCtrl(unsigned int id, int value)
+{
+    Mutex::Autolock lock(mLock);
+
+    mCtrl.add(id, value);
+}
+
+/* mLock held */
+bool SecVirtualSensor::chance(int permille)
+{
+    return 0 < permille && (int)(rand_r(&mRand) % 1000) < permille;
+}
+
+/*
+ * One pass per frame : wait for the frame to be due, then fill the oldest
+ * queued buffer. The fill happens with mLock held, a qbuf meanwhile waits
+ * for a memcpy of one frame.
+ */
+bool SecVirtualSensor::frameLoop(void)
+{
+    Mutex::Autolock lock(mLock);
+    nsecs_t now, interval;
+    unsigned int sequence;
+    int index;
+
+    if (!mStreaming) {
+        mCondition.wait(mLock);
+        return true;
+    }
+
+    now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (now < mDue) {
+        mCondition.waitRelative(mLock, mDue - now);
+        return true;
+    }
+
+    if (0 < mConfig.fps)
+        interval = seconds(1) / mConfig.fps;
+    else if (mParm.parm.capture.timeperframe.numerator &&
+             mParm.parm.capture.timeperframe.denominator)
+        interval = seconds(mParm.parm.capture.timeperframe.numerator) /
+                   mParm.parm.capture.timeperframe.denominator;
+    else
+        interval = seconds(1) / VSENSOR_DEFAULT_FPS;
+
+    if (0 < mConfig.jitter_us)
+        interval += us2ns((int)(rand_r(&mRand) % (2 * mConfig.jitter_us + 1)) - mConfig.jitter_us);
+
+    /* late by more than a frame : start over from now, no burst to catch up */
+    mDue += interval;
+    if (mDue < now - interval)
+        mDue = now + interval;
+
+    if (chance(mConfig.stall_permille)) {
+        mStalls++;
+        mDue = now + ms2ns(mConfig.stall_ms);
+        return true;
+    }
+
+    sequence = mSequence++;
+
+    if (chance(mConfig.drop_permille)) {
+        mDropped++;
+        return true;
+    }
+
+    if (mQueuedCount == 0) {
+        mOverruns++;
+        return true;
+    }
+
+    index = mQueued[0];
+    mQueuedCount--;
+    memmove(&mQueued[0], &mQueued[1], sizeof(mQueued[0]) * mQueuedCount);
+
+    mSeq[index] = sequence;
+    fillFrame(mBase + index * mStride);
+    mStamp[index] = now;
+
+    mDone[mDoneCount++] = index;
+    mFrames++;
+    mCondition.broadcast();
+
+    return true;
+}
+
+void SecVirtualSensor::buildPattern(void)
+{
+    int width = mFormat.width;
+    int height = mFormat.height;
+    unsigned char *y, *u, *v;
+    int step = 1;
+
+    free(mPattern);
+    mPatternSize = frameSize();
+    mPattern = (char *)malloc(mPatternSize);
+    if (mPattern == NULL) {
+        mPatternSize = 0;
+        return;
+    }
+
+    if (mConfig.pattern == PATTERN_GRAY || width < 8 || height < 2) {
+        memset(mPattern, 0x80, mPatternSize);
+        return;
+    }
+
+    switch (mFormat.pixelformat) {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_UYVY:
+        for (int row = 0; row < height; row++) {
+            unsigned char *p = (unsigned char *)mPattern + row * width * 2;
+
+            for (int x = 0; x < width; x += 2, p += 4) {
+                int bar = x * 8 / width;
+
+                if (mFormat.pixelformat == V4L2_PIX_FMT_YUYV) {
+                    p[0] = sBarY[bar]; p[1] = sBarU[bar]; p[2] = sBarY[bar]; p[3] = sBarV[bar];
+                } else {
+                    p[0] = sBarU[bar]; p[1] = sBarY[bar]; p[2] = sBarV[bar]; p[3] = sBarY[bar];
+                }
+            }
+        }
+        return;
+
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV12T:
+        y = (unsigned char *)mPattern;
+        u = y + width * height;
+        v = u + 1;
+        step = 2;
+        break;
+    case V4L2_PIX_FMT_NV21:
+        y = (unsigned char *)mPattern;
+        v = y + width * height;
+        u = v + 1;
+        step = 2;
+        break;
+    case V4L2_PIX_FMT_YUV420:
+        y = (unsigned char *)mPattern;
+        u = y + width * height;
+        v = u + width * height / 4;
+        break;
+    case V4L2_PIX_FMT_YVU420:
+    case V4L2_PIX_FMT_YVU420M:
+        y = (unsigned char *)mPattern;
+        v = y + width * height;
+        u = v + width * height / 4;
+        break;
+    default:
+        memset(mPattern, 0x80, mPatternSize);
+        return;
+    }
+
+    for (int row = 0; row < height; row++) {
+        for (int x = 0; x < width; x++)
+            y[row * width + x] = sBarY[x * 8 / width];
+    }
+
+    /* chroma rows are width bytes apart for both layouts : width / 2 samples of step */
+    for (int row = 0; row < height / 2; row++) {
+        int line = row * (width / 2) * step;
+
+        for (int x = 0; x < width / 2; x++) {
+            u[line + x * step] = sBarU[x * 16 / width];
+            v[line + x * step] = sBarV[x * 16 / width];
+        }
+    }
+}
+
+/* mLock held */
+void SecVirtualSensor::fillFrame(char *dst)
+{
+    int size = frameSize();
+    int width = mFormat.width;
+    int top;
+
+    if (mFile >= 0 && 0 < mFileFrames) {
+        off_t offset = (off_t)(mSeq[(dst - mBase) / mStride] % mFileFrames) * size;
+
+        if (pread(mFile, dst, size, offset) == size)
+            return;
+        LOGE("ERR(%s):short read of %s, bars instead", __func__, mConfig.file);
+        ::close(mFile);
+        mFile = -1;
+    }
+
+    if (mPattern == NULL)
+        return;
+
+    memcpy(dst, mPattern, mPatternSize < size ? mPatternSize : size);
+
+    if (mConfig.pattern != PATTERN_RAMP || mFormat.height < VSENSOR_STRIPE_LINES)
+        return;
+
+    /* a white stripe walking down, shows dropped and repeated frames */
+    top = (mSeq[(dst - mBase) / mStride] * 4) % (mFormat.height - VSENSOR_STRIPE_LINES + 1);
+
+    switch (mFormat.pixelformat) {
+    case V4L2_PIX_FMT_YUYV:
+    case V4L2_PIX_FMT_UYVY:
+        for (int row = top; row < top + VSENSOR_STRIPE_LINES; row++) {
+            char *p = dst + row * width * 2 + (mFormat.pixelformat == V4L2_PIX_FMT_UYVY);
+
+            for (int x = 0; x < width; x++)
+                p[x * 2] = 235;
+        }
+        break;
+    case V4L2_PIX_FMT_NV12:
+    case V4L2_PIX_FMT_NV12T:
+    case V4L2_PIX_FMT_NV21:
+    case V4L2_PIX_FMT_YUV420:
+    case V4L2_PIX_FMT_YVU420:
+    case V4L2_PIX_FMT_YVU420M:
+        memset(dst + top * width, 235, width * VSENSOR_STRIPE_LINES);
+        break;
+    default:
+        break;
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,196 @@
+/*
+**
+** Copyright 2010, Samsung Electronics Co. LTD
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+/*!
+ * \file      SecVirtualSensor.h
+ * \brief     capture node made up in software, the HAL runs without a sensor
+ *
+ * Stands in for the fimc capture nodes SecCamera opens when
+ * camera.virtual.enable is set. Frames are a test pattern or a looped raw
+ * file in the format the node was set to, paced at the configured rate
+ * with the configured jitter, drops and stalls. The fd handed out is an
+ * ashmem region holding the buffers one after the other, so anything
+ * mapping the node sees the frames. Everything else the HAL asks from the
+ * node (controls, parameters) is answered from what it set before.
+ * There is no physical memory behind the buffers, V4L2_CID_PADDR_* fails
+ * with EINVAL : recording and the hardware JPEG input are not available.
+ *
+ * SecCamera_zoom.cpp opens only its capture node here. Its fimc m2m nodes
+ * stay real and need a physical source, so with a virtual sensor the zoom
+ * variant runs capture and callbacks while its fimc stages fail per frame.
+ *
+ * Host build, still to do : this file, SecFrameQueue, SecFrameTrace and
+ * SecCameraBench only need libutils, libcutils and liblog, which all have
+ * host variants. What is missing is
+ *  1. a BUILD_HOST_STATIC_LIBRARY of those four files,
+ *  2. the buffer region from the host ashmem of libcutils (a tmp file) and
+ *     camera.virtual.* read from the environment when there is no
+ *     property service,
+ *  3. a small driver standing in for CameraService : open a node, set the
+ *     format, stream and write the SecCameraBench report.
+ * SecCamera.cpp itself stays device only, jpeghal, exynos-mem, ion and
+ * gralloc have no host side.
+ *
+ * camera.virtual.pattern     bars, ramp (bars with a moving stripe), gray, file
+ * camera.virtual.file        raw frames in the node format, played in a loop
+ * camera.virtual.fps         frame rate, 0 : what S_PARM asked, 30 without
+ * camera.virtual.jitter_us   each frame interval moves by up to that much
+ * camera.virtual.drop        frames lost per thousand, the sequence skips them
+ * camera.virtual.stall       stalls per thousand frames
+ * camera.virtual.stall_ms    how long a stall lasts
+ * camera.virtual.seed        same seed, same faults at the same frames
+ * camera.virtual.isp         1 : reports an internal ISP sensor (default)
+ */
+
+#ifndef ANDROID_HARDWARE_SEC_VIRTUAL_SENSOR_H
+#define ANDROID_HARDWARE_SEC_VIRTUAL_SENSOR_H
+
+#include <sys/poll.h>
+#include <cutils/properties.h>
+#include <utils/threads.h>
+#include <utils/Timers.h>
+#include <utils/KeyedVector.h>
+#include <videodev2.h>
+
+#define VSENSOR_MAX_NODES       (3)
+#define VSENSOR_MAX_BUFFERS     (16)
+/* what fimc leaves between two frames, the preview heap of the HAL counts on it */
+#define VSENSOR_FRAME_PAD       (16)
+/* address room of each node, only the buffers REQBUFS asks for get pages */
+#define VSENSOR_REGION_SIZE     (256 << 20)
+#define VSENSOR_DEFAULT_FPS     (30)
+#define VSENSOR_DEFAULT_STALL_MS (1000)
+
+namespace android {
+
+class SecVirtualSensor
+{
+public:
+    enum PATTERN {
+        PATTERN_BARS = 0,
+        PATTERN_RAMP,
+        PATTERN_GRAY,
+        PATTERN_FILE,
+    };
+
+    /* camera.virtual.enable is set : the nodes are to be opened here */
+    static bool enabled(void);
+
+    /* fd of a new node standing for the device node, -1 on failure */
+    static int  openNode(const char *node);
+    static int  closeNode(int fd);
+
+    /* the node behind fd, NULL : a real device */
+    static SecVirtualSensor *find(int fd);
+
+    /* addr is inside the buffers of one of the nodes */
+    static bool owns(const void *addr);
+
+    int   ioctl(unsigned long request, void *arg);
+    int   poll(struct pollfd *events, int timeout);
+    void *mmap(size_t length, off_t offset);
+    int   dump(char *buf, int bufSize);
+
+private:
+    class FrameThread : public Thread {
+        SecVirtualSensor *mSensor;
+    public:
+        FrameThread(SecVirtualSensor *sensor) :
+            Thread(false),
+            mSensor(sensor) { }
+        virtual bool threadLoop() {
+            return mSensor->frameLoop();
+        }
+    };
+
+    struct config {
+        int     pattern;
+        char    file[PROPERTY_VALUE_MAX];
+        int     fps;
+        int     jitter_us;
+        int     drop_permille;
+        int     stall_permille;
+        int     stall_ms;
+        unsigned int seed;
+        bool    isp;
+    };
+
+    SecVirtualSensor(int fd, const char *node);
+    ~SecVirtualSensor();
+
+    static void readConfig(struct config *config);
+
+    int   frameSize(void) const;
+    int   setFormat(struct v4l2_format *fmt);
+    int   reqbufs(struct v4l2_requestbuffers *req);
+    int   querybuf(struct v4l2_buffer *buf);
+    int   qbuf(struct v4l2_buffer *buf);
+    int   dqbuf(struct v4l2_buffer *buf);
+    int   streamon(void);
+    int   streamoff(void);
+    int   getCtrl(unsigned int id);
+    void  setCtrl(unsigned int id, int value);
+
+    bool  frameLoop(void);
+    void  buildPattern(void);
+    void  fillFrame(char *dst);
+    bool  chance(int permille);
+
+    Mutex               mLock;
+    Condition           mCondition;     /* frame done, queue changed, stream stopped */
+    sp<FrameThread>     mThread;
+
+    int                 mFd;
+    char                mNode[32];
+    struct config       mConfig;
+
+    struct v4l2_pix_format mFormat;
+    struct v4l2_streamparm mParm;
+    KeyedVector<unsigned int, int> mCtrl;
+
+    char                *mBase;         /* mapping of the buffers, NULL : none */
+    int                 mBufCount;
+    int                 mStride;
+    int                 mQueued[VSENSOR_MAX_BUFFERS];   /* fifo of queued indexes */
+    int                 mQueuedCount;
+    int                 mDone[VSENSOR_MAX_BUFFERS];     /* fifo of filled indexes */
+    int                 mDoneCount;
+    nsecs_t             mStamp[VSENSOR_MAX_BUFFERS];
+    unsigned int        mSeq[VSENSOR_MAX_BUFFERS];
+
+    bool                mStreaming;
+    unsigned int        mSequence;
+    nsecs_t             mDue;
+    unsigned int        mRand;
+
+    char                *mPattern;      /* one frame of the pattern, in the node format */
+    int                 mPatternSize;
+    int                 mFile;          /* camera.virtual.file, -1 : none */
+    int                 mFileFrames;
+
+    unsigned int        mFrames;
+    unsigned int        mDropped;       /* faults asked for */
+    unsigned int        mOverruns;      /* nothing queued when a frame was due */
+    unsigned int        mStalls;
+
+    static Mutex        sLock;
+    static SecVirtualSensor *sNode[VSENSOR_MAX_NODES];
+};
+
+}; // namespace android
+
+#endif // ANDROID_HARDWARE_SEC_VIRTUAL_SENSOR_H
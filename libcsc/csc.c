@@ -337,13 +337,17 @@ static CSC_ERRORCODE conv_hw(
         dst_addr[1] = handle->dst_buffer.planes[CSC_U_PLANE];
         dst_addr[2] = handle->dst_buffer.planes[CSC_V_PLANE];
         omx_format = hal_2_omx_pixel_format(handle->dst_format.color_format);
-        csc_hwconverter_convert_nv12t(
-            handle->csc_hw_handle,
-            dst_addr,
-            src_addr,
-            handle->dst_format.width,
-            handle->dst_format.height,
-            omx_format);
+        /* the fimc may be held by the camera, the frame is not converted then */
+        if (csc_hwconverter_convert_nv12t(
+                handle->csc_hw_handle,
+                dst_addr,
+                src_addr,
+                handle->dst_format.width,
+                handle->dst_format.height,
+                omx_format) != HWCONVERTER_RET_OK) {
+            LOGE("%s:: hwconverter failed", __func__);
+            return CSC_Error;
+        }
         break;
     }
 #endif
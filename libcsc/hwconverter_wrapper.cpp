@@ -118,10 +118,14 @@ HWCONVERTER_ERROR_CODE csc_hwconverter_convert_nv12t(
         goto EXIT;
     }
 
-    hw_converter->convert(
+    /* the fimc may be leased to a higher priority client, tell the caller */
+    if (hw_converter->convert(
             (void *)src_addr, (void *)dst_addr,
             (OMX_COLOR_FORMATTYPE)OMX_SEC_COLOR_FormatNV12TPhysicalAddress,
-            width, height, omxformat);
+            width, height, omxformat) == false) {
+        ret = HWCONVERTER_RET_FAIL;
+        goto EXIT;
+    }
 
     ret = HWCONVERTER_RET_OK;
 
@@ -42,7 +42,7 @@ LOCAL_C_INCLUDES := \
 	$(LOCAL_PATH)/../include \
 	framework/base/include
 
-LOCAL_SRC_FILES := SecFimc.cpp
+LOCAL_SRC_FILES := SecFimc.cpp SecFimcBroker.cpp SecFimcStat.cpp
 
 LOCAL_MODULE_TAGS := eng
 LOCAL_MODULE := libfimc
@@ -33,6 +33,7 @@
 #include <cutils/log.h>
 
 #include "SecFimc.h"
+#include "SecFimcStat.h"
 
 #define  FIMC2_DEV_NAME  "/dev/video2"
 
@@ -196,7 +197,7 @@ int fimc_v4l2_s_ctrl(int fd, int id, int value)
     vc.id    = id;
     vc.value = value;
 
-    if (ioctl(fd, VIDIOC_S_CTRL, &vc) < 0) {
+    if (fimc_stat_ioctl(fd, FIMC_STAT_S_CTRL, VIDIOC_S_CTRL, &vc) < 0) {
         LOGE("%s::VIDIOC_S_CTRL (id=%d,value=%d) failed", __func__, id, value);
         return -1;
     }
@@ -253,7 +254,7 @@ int fimc_v4l2_set_fmt(int fd, enum v4l2_buf_type type, enum v4l2_field field, s5
         vc.id    = V4L2_CID_DST_INFO;
         vc.value = (unsigned int)&fimc_dst_buf.base[0];
 
-        if (ioctl(fd, VIDIOC_S_CTRL, &vc) < 0) {
+        if (fimc_stat_ioctl(fd, FIMC_STAT_S_CTRL, VIDIOC_S_CTRL, &vc) < 0) {
             LOGE("%s::VIDIOC_S_CTRL (id=%d,value=%d) failed", __func__, vc.id, vc.value);
             return -1;
         }
@@ -269,7 +270,7 @@ int fimc_v4l2_set_fmt(int fd, enum v4l2_buf_type type, enum v4l2_field field, s5
         break;
     }
 
-    if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
+    if (fimc_stat_ioctl(fd, FIMC_STAT_S_FMT, VIDIOC_S_FMT, &fmt) < 0) {
         LOGE("%s::VIDIOC_S_FMT failed", __func__);
         return -1;
     }
@@ -297,7 +298,7 @@ int fimc_v4l2_set_fmt(int fd, enum v4l2_buf_type type, enum v4l2_field field, s5
 
 int fimc_v4l2_stream_on(int fd, enum v4l2_buf_type type)
 {
-    if (ioctl(fd, VIDIOC_STREAMON, &type) < 0) {
+    if (fimc_stat_ioctl(fd, FIMC_STAT_STREAMON, VIDIOC_STREAMON, &type) < 0) {
         LOGE("%s::VIDIOC_STREAMON failed", __func__);
         return -1;
     }
@@ -324,7 +325,7 @@ int fimc_v4l2_queue(int fd, SecBuffer *secBuf, enum v4l2_buf_type type, enum v4l
     buf.m.userptr = (unsigned long)(&fimcbuf);
     //buf.m.userptr = secBuf->phys.p;
 
-    if (ioctl(fd, VIDIOC_QBUF, &buf) < 0) {
+    if (fimc_stat_ioctl(fd, FIMC_STAT_QBUF, VIDIOC_QBUF, &buf) < 0) {
         LOGE("%s::VIDIOC_QBUF failed", __func__);
         return -1;
     }
@@ -340,7 +341,7 @@ int fimc_v4l2_dequeue(int fd, enum v4l2_buf_type type, enum v4l2_memory memory,
     buf.type     = type;
     buf.memory   = memory;
     buf.length   = num_plane;
-    if (ioctl(fd, VIDIOC_DQBUF, &buf) < 0) {
+    if (fimc_stat_ioctl(fd, FIMC_STAT_DQBUF, VIDIOC_DQBUF, &buf) < 0) {
         LOGE("%s::VIDIOC_DQBUF failed", __func__);
         return -1;
     }
@@ -429,6 +430,7 @@ SecFimc::SecFimc()
     mFd = 0;
     mDev = 0;
     mColorKey = 0x0;
+    mClient = -1;
 }
 
 SecFimc::~SecFimc()
@@ -528,9 +530,11 @@ bool SecFimc::create(enum DEV dev, enum MODE mode, int numOfBuf)
 
     mHwVersion = vc.value;
 
+    fimc_stat_attach(mFd, mRealDev, mClient);
+
     vc.id = V4L2_CID_OVLY_MODE;
     vc.value = mFimcMode;
-    if (ioctl(mFd, VIDIOC_S_CTRL, &vc) < 0) {
+    if (fimc_stat_ioctl(mFd, FIMC_STAT_S_CTRL, VIDIOC_S_CTRL, &vc) < 0) {
         LOGE("%s::VIDIOC_S_CTRL - V4L2_CID_OVLY_MODE failed", __func__);
         goto err;
     }
@@ -540,8 +544,10 @@ bool SecFimc::create(enum DEV dev, enum MODE mode, int numOfBuf)
     return true;
 
 err :
-    if (0 < mFd)
+    if (0 < mFd) {
+        fimc_stat_detach(mFd);
         close(mFd);
+    }
     mFd = 0;
 
     return false;
@@ -574,8 +580,10 @@ bool SecFimc::destroy()
         mS5pFimc.out_buf.length = 0;
     }
 
-    if (0 < mFd)
+    if (0 < mFd) {
+        fimc_stat_detach(mFd);
         close(mFd);
+    }
     mFd = 0;
 
     mFlagCreate = false;
@@ -603,6 +611,23 @@ SecBuffer * SecFimc::getMemAddr(int index)
     return &mDstBuffer[index];
 }
 
+void SecFimc::setClient(int client)
+{
+    mClient = client;
+
+    if (mFlagCreate == true)
+        fimc_stat_attach(mFd, mRealDev, mClient);
+}
+
+int SecFimc::dump(char *buf, int bufSize)
+{
+    if (mFlagCreate == false)
+        return 0;
+
+    return fimc_stat_dump(buf, bufSize, mRealDev,
+                          (mClient < 0) ? FIMC_STAT_CLIENT_NONE : mClient);
+}
+
 int SecFimc::getHWVersion(void)
 {
     if (mFlagCreate == false) {
@@ -743,6 +768,14 @@ bool SecFimc::getSrcParams(unsigned int *width, unsigned int *height,
     return true;
 }
 
+void SecFimc::invalidateSrcParams(void)
+{
+    s5p_fimc_params_t *params = &(mS5pFimc.params);
+
+    params->src.full_width  = 0;
+    params->src.full_height = 0;
+}
+
 bool SecFimc::setSrcAddr(unsigned int physYAddr,
                          unsigned int physCbAddr,
                          unsigned int physCrAddr,
@@ -991,6 +1024,72 @@ bool SecFimc::setDstAddr(unsigned int physYAddr, unsigned int physCbAddr, unsign
     return true;
 }
 
+/*
+ * Only swap the destination address of an already configured overlay
+ * destination : no rotation, G_FMT or S_FMT round trip. While a stream is
+ * running (see streamOn) FIMC_OVLY_NONE_MULTI_BUF picks the address up from
+ * V4L2_CID_DST_INFO alone, otherwise the frame buffer base is updated too.
+ */
+bool SecFimc::updateDstAddr(unsigned int physYAddr, unsigned int physCbAddr, unsigned int physCrAddr, int buf_index)
+{
+#ifdef DEBUG_LIB_FIMC
+    LOGD("%s", __func__);
+#endif
+
+    s5p_fimc_params_t *params = &(mS5pFimc.params);
+    struct v4l2_framebuffer fbuf;
+    struct v4l2_control     vc;
+    struct fimc_buf         fimc_dst_buf;
+
+    if (mFlagCreate == false) {
+        LOGE("%s::Not yet created", __func__);
+        return false;
+    }
+
+    if (mFlagSetDstParam == false) {
+        LOGE("%s::mFlagSetDstParam == false fail", __func__);
+        return false;
+    }
+
+    mS5pFimc.out_buf.phys_addr = (void *)physYAddr;
+
+    mDstBuffer[buf_index].phys.extP[0] = physYAddr;
+    mDstBuffer[buf_index].phys.extP[1] = physCbAddr;
+    mDstBuffer[buf_index].phys.extP[2] = physCrAddr;
+
+    params->dst.buf_addr_phy_rgb_y = physYAddr;
+    params->dst.buf_addr_phy_cb    = physCbAddr;
+    params->dst.buf_addr_phy_cr    = physCrAddr;
+
+    if (mFlagStreamOn == false) {
+        if (ioctl(mFd, VIDIOC_G_FBUF, &fbuf) < 0) {
+            LOGE("%s::VIDIOC_G_FBUF failed", __func__);
+            return false;
+        }
+
+        fbuf.base = (void *)physYAddr;
+
+        if (ioctl(mFd, VIDIOC_S_FBUF, &fbuf) < 0) {
+            LOGE("%s::VIDIOC_S_FBUF failed", __func__);
+            return false;
+        }
+    }
+
+    fimc_dst_buf.base[0] = physYAddr;
+    fimc_dst_buf.base[1] = physCbAddr;
+    fimc_dst_buf.base[2] = physCrAddr;
+
+    vc.id    = V4L2_CID_DST_INFO;
+    vc.value = (unsigned int)&fimc_dst_buf.base[0];
+
+    if (fimc_stat_ioctl(mFd, FIMC_STAT_S_CTRL, VIDIOC_S_CTRL, &vc) < 0) {
+        LOGE("%s::VIDIOC_S_CTRL(V4L2_CID_DST_INFO) failed", __func__);
+        return false;
+    }
+
+    return true;
+}
+
 bool SecFimc::setRotVal(unsigned int rotVal)
 {
     struct v4l2_control vc;
@@ -1167,12 +1266,15 @@ bool SecFimc::draw(int src_index, int dst_index)
     src_planes  = (src_planes == -1) ? 1 : src_planes;
     dst_planes  = (dst_planes == -1) ? 1 : dst_planes;
 
-    if (fimc_v4l2_stream_on(mFd, V4L2_BUF_TYPE_SRC) < 0) {
-        LOGE("%s::fimc_v4l2_stream_on() failed", __func__);
-        goto err;
-    }
+    /* inside streamOn() / streamOff() the caller owns the stream */
+    if (mFlagStreamOn == false) {
+        if (fimc_v4l2_stream_on(mFd, V4L2_BUF_TYPE_SRC) < 0) {
+            LOGE("%s::fimc_v4l2_stream_on() failed", __func__);
+            goto err;
+        }
 
-    flagStreamOn = true;
+        flagStreamOn = true;
+    }
 
     if (fimc_v4l2_queue(mFd, &(mSrcBuffer), V4L2_BUF_TYPE_SRC, V4L2_MEMORY_TYPE_SRC, src_index, src_planes) < 0) {
         LOGE("%s::fimc_v4l2_queue(index : %d) (mNumOfBuf : %d) failed", __func__, 0, mNumOfBuf);
@@ -1195,6 +1297,42 @@ err :
     return true;
 }
 
+bool SecFimc::streamOn(void)
+{
+    if (mFlagCreate == false) {
+        LOGE("%s::Not yet created", __func__);
+        return false;
+    }
+
+    if (mFlagStreamOn == true)
+        return true;
+
+    if (m_streamOn() == false)
+        return false;
+
+    mFlagStreamOn = true;
+    return true;
+}
+
+bool SecFimc::streamOff(void)
+{
+    if (mFlagCreate == false) {
+        LOGE("%s::Not yet created", __func__);
+        return false;
+    }
+
+    if (mFlagStreamOn == false)
+        return true;
+
+    if (fimc_v4l2_stream_off(mFd, V4L2_BUF_TYPE_SRC) < 0) {
+        LOGE("%s::fimc_v4l2_stream_off() failed", __func__);
+        return false;
+    }
+
+    mFlagStreamOn = false;
+    return true;
+}
+
 bool SecFimc::m_streamOn()
 {
 #ifdef DEBUG_LIB_FIMC
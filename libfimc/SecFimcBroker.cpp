@@ -0,0 +1,339 @@
+/*
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      SecFimcBroker.cpp
+ * \brief     source file for Fimc instance broker
+ */
+
+#define LOG_TAG "libfimc"
+#include <cutils/log.h>
+
+#include <stdio.h>
+
+#include "SecFimc.h"
+#include "SecFimcBroker.h"
+
+//#define DEBUG_LIB_FIMC_BROKER
+
+namespace android {
+
+/* the header keeps its own count so users don't pull SecFimc.h in */
+typedef char fimc_dev_max_check[(FIMC_DEV_MAX == SecFimc::DEV_MAX) ? 1 : -1];
+
+static const char *client_name[SecFimcBroker::CLIENT_MAX] = {
+    "camera",
+    "overlay",
+    "hdmi",
+    "csc",
+};
+
+static Mutex gBrokerLock;
+static SecFimcBroker *gBroker = NULL;
+
+SecFimcBroker *SecFimcBroker::getInstance(void)
+{
+    Mutex::Autolock lock(gBrokerLock);
+
+    if (gBroker == NULL)
+        gBroker = new SecFimcBroker();
+
+    return gBroker;
+}
+
+SecFimcBroker::SecFimcBroker()
+{
+    memset(mNode, 0, sizeof(mNode));
+    memset(mClient, 0, sizeof(mClient));
+    memset(mWaiter, 0, sizeof(mWaiter));
+
+    for (int i = 0; i < FIMC_DEV_MAX; i++)
+        mNode[i].owner = -1;
+
+    mSeq = 0;
+    mStartTime = systemTime();
+}
+
+SecFimcBroker::~SecFimcBroker()
+{
+}
+
+int SecFimcBroker::acquire(enum CLIENT client, unsigned int devMask, int timeoutMs)
+{
+    int dev;
+    int slot = -1;
+    nsecs_t waitStart;
+    nsecs_t waited;
+
+    if (client < CLIENT_CAMERA || CLIENT_MAX <= client) {
+        LOGE("%s::invalid client(%d)", __func__, client);
+        return -1;
+    }
+
+    devMask &= FIMC_DEV_MASK(FIMC_DEV_MAX) - 1;
+    if (devMask == 0) {
+        LOGE("%s::%s asked for no node", __func__, client_name[client]);
+        return -1;
+    }
+
+    Mutex::Autolock lock(mLock);
+
+    mClient[client].acquireCount++;
+
+    /* fast path : a node is free and nobody is queued in front of us */
+    dev = m_findFreeDev(client, mSeq, -1, devMask);
+    if (0 <= dev) {
+        m_grant(client, dev);
+        return dev;
+    }
+
+    if (timeoutMs == 0)
+        return -1;
+
+    for (int i = 0; i < FIMC_BROKER_MAX_WAITERS; i++) {
+        if (mWaiter[i].inUse == false) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (slot < 0) {
+        LOGE("%s::too many waiters, %s rejected", __func__, client_name[client]);
+        return -1;
+    }
+
+    mWaiter[slot].inUse   = true;
+    mWaiter[slot].client  = client;
+    mWaiter[slot].devMask = devMask;
+    mWaiter[slot].seq     = mSeq++;
+
+    mClient[client].waitCount++;
+    for (int i = 0; i < FIMC_DEV_MAX; i++) {
+        if (devMask & FIMC_DEV_MASK(i))
+            mNode[i].waitCount++;
+    }
+
+    waitStart = systemTime();
+
+    while (1) {
+        dev = m_findFreeDev(client, mWaiter[slot].seq, slot, devMask);
+        if (0 <= dev)
+            break;
+
+        if (timeoutMs < 0) {
+            mCondition.wait(mLock);
+        } else {
+            nsecs_t remain = milliseconds(timeoutMs) - (systemTime() - waitStart);
+            if (remain <= 0 || mCondition.waitRelative(mLock, remain) == TIMED_OUT) {
+                dev = m_findFreeDev(client, mWaiter[slot].seq, slot, devMask);
+                break;
+            }
+        }
+    }
+
+    mWaiter[slot].inUse = false;
+
+    waited = systemTime() - waitStart;
+    mClient[client].waitTime += waited;
+    if (mClient[client].maxWaitTime < waited)
+        mClient[client].maxWaitTime = waited;
+
+    if (dev < 0) {
+        mClient[client].timeoutCount++;
+        LOGW("%s::%s timed out after %d ms (mask 0x%x)",
+             __func__, client_name[client], timeoutMs, devMask);
+        /* the head of the line may have changed */
+        mCondition.broadcast();
+        return -1;
+    }
+
+    m_grant(client, dev);
+
+    /* we left the queue, the next one in line may be able to run now */
+    mCondition.broadcast();
+
+    return dev;
+}
+
+bool SecFimcBroker::release(int dev)
+{
+    if (dev < 0 || FIMC_DEV_MAX <= dev) {
+        LOGE("%s::invalid dev(%d)", __func__, dev);
+        return false;
+    }
+
+    Mutex::Autolock lock(mLock);
+
+    if (mNode[dev].owner < 0) {
+        LOGE("%s::dev(%d) is not leased", __func__, dev);
+        return false;
+    }
+
+#ifdef DEBUG_LIB_FIMC_BROKER
+    LOGD("%s::%s releases dev(%d)", __func__, client_name[mNode[dev].owner], dev);
+#endif
+
+    mNode[dev].busyTime += systemTime() - mNode[dev].leaseStart;
+    mNode[dev].owner = -1;
+
+    mCondition.broadcast();
+
+    return true;
+}
+
+int SecFimcBroker::getOwner(int dev)
+{
+    if (dev < 0 || FIMC_DEV_MAX <= dev)
+        return -1;
+
+    Mutex::Autolock lock(mLock);
+
+    return mNode[dev].owner;
+}
+
+unsigned int SecFimcBroker::getLeaseCount(int dev)
+{
+    if (dev < 0 || FIMC_DEV_MAX <= dev)
+        return 0;
+
+    Mutex::Autolock lock(mLock);
+
+    return mNode[dev].leaseCount;
+}
+
+int SecFimcBroker::getUtilization(int dev)
+{
+    nsecs_t now;
+    nsecs_t busy;
+    nsecs_t total;
+
+    if (dev < 0 || FIMC_DEV_MAX <= dev)
+        return -1;
+
+    Mutex::Autolock lock(mLock);
+
+    now = systemTime();
+    busy = mNode[dev].busyTime;
+    if (0 <= mNode[dev].owner)
+        busy += now - mNode[dev].leaseStart;
+
+    total = now - mStartTime;
+    if (total <= 0)
+        return 0;
+
+    return (int)((busy * 100) / total);
+}
+
+int SecFimcBroker::dump(char *buf, int bufSize)
+{
+    int len = 0;
+    int waiters = 0;
+
+    if (buf == NULL || bufSize <= 0)
+        return 0;
+
+    for (int i = 0; i < FIMC_DEV_MAX; i++) {
+        int util = getUtilization(i);
+
+        Mutex::Autolock lock(mLock);
+        len += snprintf(buf + len, bufSize - len,
+                "fimc%d: owner(%s) util(%d%%) leases(%u) contended(%u) busy(%lld ms)\n",
+                i,
+                (0 <= mNode[i].owner) ? client_name[mNode[i].owner] : "none",
+                util,
+                mNode[i].leaseCount,
+                mNode[i].waitCount,
+                ns2ms(mNode[i].busyTime));
+        if (bufSize <= len)
+            return bufSize - 1;
+    }
+
+    Mutex::Autolock lock(mLock);
+
+    for (int i = 0; i < CLIENT_MAX; i++) {
+        struct client_info *info = &mClient[i];
+        len += snprintf(buf + len, bufSize - len,
+                "%-8s: acquire(%u) waited(%u) timeout(%u) wait avg(%lld us) max(%lld us)\n",
+                client_name[i],
+                info->acquireCount,
+                info->waitCount,
+                info->timeoutCount,
+                info->waitCount ? ns2us(info->waitTime) / info->waitCount : 0,
+                ns2us(info->maxWaitTime));
+        if (bufSize <= len)
+            return bufSize - 1;
+    }
+
+    for (int i = 0; i < FIMC_BROKER_MAX_WAITERS; i++) {
+        if (mWaiter[i].inUse == true)
+            waiters++;
+    }
+
+    len += snprintf(buf + len, bufSize - len, "queued jobs : %d\n", waiters);
+    if (bufSize <= len)
+        return bufSize - 1;
+
+    return len;
+}
+
+int SecFimcBroker::m_findFreeDev(int client, unsigned int seq, int slot, unsigned int devMask)
+{
+    for (int i = 0; i < FIMC_DEV_MAX; i++) {
+        if (!(devMask & FIMC_DEV_MASK(i)) || 0 <= mNode[i].owner)
+            continue;
+
+        if (m_isFirstInLine(client, seq, slot, i) == true)
+            return i;
+    }
+
+    return -1;
+}
+
+/*
+ * A request may take dev only when no queued request that could also use
+ * dev is ahead of it : higher priority, or same priority and older.
+ */
+bool SecFimcBroker::m_isFirstInLine(int client, unsigned int seq, int slot, int dev)
+{
+    for (int i = 0; i < FIMC_BROKER_MAX_WAITERS; i++) {
+        if (i == slot || mWaiter[i].inUse == false)
+            continue;
+
+        if (!(mWaiter[i].devMask & FIMC_DEV_MASK(dev)))
+            continue;
+
+        if (mWaiter[i].client < client)
+            return false;
+
+        if (mWaiter[i].client == client && (int)(mWaiter[i].seq - seq) < 0)
+            return false;
+    }
+
+    return true;
+}
+
+void SecFimcBroker::m_grant(int client, int dev)
+{
+#ifdef DEBUG_LIB_FIMC_BROKER
+    LOGD("%s::%s leases dev(%d)", __func__, client_name[client], dev);
+#endif
+
+    mNode[dev].owner = client;
+    mNode[dev].leaseStart = systemTime();
+    mNode[dev].leaseCount++;
+}
+
+}; // namespace android
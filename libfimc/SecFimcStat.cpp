@@ -0,0 +1,323 @@
+/*
+ * Copyright@ Samsung Electronics Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*!
+ * \file      SecFimcStat.cpp
+ * \brief     latency histograms for the FIMC V4L2 ioctls
+ */
+
+#define LOG_TAG "libfimc"
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <utils/threads.h>
+
+#include "SecFimcStat.h"
+
+using namespace android;
+
+/*
+ * One slot per attached fd, with its own lock and counters. fimc_stat_add()
+ * finds the slot through gStatSlot without a search and only takes the
+ * slot lock, so ioctls on different fds don't serialize on the stats.
+ */
+struct fimc_stat_fd {
+    Mutex                  lock;
+    int                    fd;      /* 0 : free, changed under lock and gStatLock */
+    int                    dev;
+    int                    client;
+    struct fimc_stat_entry entry[FIMC_STAT_OP_MAX];
+};
+
+static const char *op_name[FIMC_STAT_OP_MAX] = {
+    "S_FMT",
+    "QBUF",
+    "DQBUF",
+    "STREAMON",
+    "S_CTRL",
+};
+
+static const char *client_name[FIMC_STAT_CLIENT_MAX] = {
+    "camera",
+    "overlay",
+    "hdmi",
+    "csc",
+    "none",
+};
+
+/* gStatLock : attach, detach and the readers, gStat keeps what detached fds counted */
+static Mutex                     gStatLock;
+static struct fimc_stat_fd       gStatFd[FIMC_STAT_MAX_FDS];
+static volatile int32_t          gStatSlot[FIMC_STAT_FD_LIMIT];     /* fd -> slot + 1 */
+static struct fimc_stat_snapshot gStat;
+
+static inline int fimc_stat_bucket(nsecs_t latency)
+{
+    int us = (int)ns2us(latency);
+    int bucket = 0;
+
+    while (bucket < FIMC_STAT_BUCKETS - 1 && (16 << bucket) <= us)
+        bucket++;
+
+    return bucket;
+}
+
+static void fimc_stat_merge(struct fimc_stat_entry *dst, const struct fimc_stat_entry *src)
+{
+    dst->count    += src->count;
+    dst->error    += src->error;
+    for (int b = 0; b < FIMC_STAT_BUCKETS; b++)
+        dst->hist[b] += src->hist[b];
+    dst->total_ns += src->total_ns;
+    if (dst->max_ns < src->max_ns)
+        dst->max_ns = src->max_ns;
+}
+
+/* gStatLock and slot->lock held : the slot counters go to gStat */
+static void fimc_stat_fold(struct fimc_stat_fd *slot)
+{
+    for (int op = 0; op < FIMC_STAT_OP_MAX; op++)
+        fimc_stat_merge(&gStat.entry[slot->dev][slot->client][op], &slot->entry[op]);
+
+    memset(slot->entry, 0, sizeof(slot->entry));
+}
+
+/* gStatLock held : gStat plus what the attached fds counted so far */
+static void fimc_stat_collect(struct fimc_stat_snapshot *snapshot)
+{
+    memcpy(snapshot, &gStat, sizeof(struct fimc_stat_snapshot));
+
+    for (int i = 0; i < FIMC_STAT_MAX_FDS; i++) {
+        struct fimc_stat_fd *slot = &gStatFd[i];
+
+        if (slot->fd == 0)
+            continue;
+
+        Mutex::Autolock lock(slot->lock);
+        for (int op = 0; op < FIMC_STAT_OP_MAX; op++)
+            fimc_stat_merge(&snapshot->entry[slot->dev][slot->client][op], &slot->entry[op]);
+    }
+}
+
+void fimc_stat_attach(int fd, int dev, int client)
+{
+    int slot = -1;
+
+    if (fd <= 0 || dev < 0 || FIMC_STAT_DEV_MAX <= dev)
+        return;
+
+    if (FIMC_STAT_FD_LIMIT <= fd) {
+        LOGW("%s::fd(%d) is past the stats table", __func__, fd);
+        return;
+    }
+
+    if (client < 0 || FIMC_STAT_CLIENT_MAX <= client)
+        client = FIMC_STAT_CLIENT_NONE;
+
+    Mutex::Autolock lock(gStatLock);
+
+    for (int i = 0; i < FIMC_STAT_MAX_FDS; i++) {
+        if (gStatFd[i].fd == fd) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && gStatFd[i].fd == 0)
+            slot = i;
+    }
+
+    if (slot < 0) {
+        LOGW("%s::no free slot for fd(%d)", __func__, fd);
+        return;
+    }
+
+    {
+        Mutex::Autolock slotLock(gStatFd[slot].lock);
+
+        /* attached again with another key : what it counted stays with the old one */
+        if (gStatFd[slot].fd == fd)
+            fimc_stat_fold(&gStatFd[slot]);
+
+        gStatFd[slot].fd     = fd;
+        gStatFd[slot].dev    = dev;
+        gStatFd[slot].client = client;
+    }
+
+    android_atomic_release_store(slot + 1, &gStatSlot[fd]);
+}
+
+void fimc_stat_detach(int fd)
+{
+    Mutex::Autolock lock(gStatLock);
+
+    if (0 < fd && fd < FIMC_STAT_FD_LIMIT)
+        android_atomic_release_store(0, &gStatSlot[fd]);
+
+    for (int i = 0; i < FIMC_STAT_MAX_FDS; i++) {
+        if (gStatFd[i].fd != fd)
+            continue;
+
+        Mutex::Autolock slotLock(gStatFd[i].lock);
+        fimc_stat_fold(&gStatFd[i]);
+        gStatFd[i].fd = 0;
+    }
+}
+
+void fimc_stat_add(int fd, int op, nsecs_t latency, int error)
+{
+    struct fimc_stat_fd *slot;
+    struct fimc_stat_entry *entry;
+    int index;
+
+    if (op < 0 || FIMC_STAT_OP_MAX <= op || fd <= 0 || FIMC_STAT_FD_LIMIT <= fd)
+        return;
+
+    /* fd nobody attached : nothing to key it with */
+    index = android_atomic_acquire_load(&gStatSlot[fd]) - 1;
+    if (index < 0)
+        return;
+
+    slot = &gStatFd[index];
+
+    Mutex::Autolock lock(slot->lock);
+
+    /* detached or handed to another fd since the lookup */
+    if (slot->fd != fd)
+        return;
+
+    entry = &slot->entry[op];
+
+    entry->count++;
+    if (error)
+        entry->error++;
+    entry->hist[fimc_stat_bucket(latency)]++;
+    entry->total_ns += latency;
+    if (entry->max_ns < latency)
+        entry->max_ns = latency;
+}
+
+void fimc_stat_reset(void)
+{
+    Mutex::Autolock lock(gStatLock);
+
+    memset(gStat.entry, 0, sizeof(gStat.entry));
+
+    for (int i = 0; i < FIMC_STAT_MAX_FDS; i++) {
+        Mutex::Autolock slotLock(gStatFd[i].lock);
+        memset(gStatFd[i].entry, 0, sizeof(gStatFd[i].entry));
+    }
+}
+
+int fimc_stat_dump(char *buf, int bufSize, int dev, int client)
+{
+    static struct fimc_stat_snapshot stat;
+    int len = 0;
+
+    if (buf == NULL || bufSize <= 0)
+        return 0;
+
+    /* stat is only used under gStatLock */
+    Mutex::Autolock lock(gStatLock);
+
+    fimc_stat_collect(&stat);
+
+    for (int d = 0; d < FIMC_STAT_DEV_MAX; d++) {
+        if (0 <= dev && d != dev)
+            continue;
+
+        for (int c = 0; c < FIMC_STAT_CLIENT_MAX; c++) {
+            if (0 <= client && c != client)
+                continue;
+
+            for (int op = 0; op < FIMC_STAT_OP_MAX; op++) {
+                struct fimc_stat_entry *entry = &stat.entry[d][c][op];
+
+                if (entry->count == 0)
+                    continue;
+
+                len += snprintf(buf + len, bufSize - len,
+                        "fimc%d %-7s %-8s: n(%u) err(%u) avg(%lld us) max(%lld us) |",
+                        d, client_name[c], op_name[op],
+                        entry->count, entry->error,
+                        ns2us(entry->total_ns) / entry->count,
+                        ns2us(entry->max_ns));
+                if (bufSize <= len)
+                    return bufSize - 1;
+
+                for (int b = 0; b < FIMC_STAT_BUCKETS; b++) {
+                    len += snprintf(buf + len, bufSize - len, " %u", entry->hist[b]);
+                    if (bufSize <= len)
+                        return bufSize - 1;
+                }
+
+                len += snprintf(buf + len, bufSize - len, "\n");
+                if (bufSize <= len)
+                    return bufSize - 1;
+            }
+        }
+    }
+
+    return len;
+}
+
+int fimc_stat_snapshot(struct fimc_stat_snapshot *snapshot)
+{
+    if (snapshot == NULL)
+        return -1;
+
+    Mutex::Autolock lock(gStatLock);
+
+    fimc_stat_collect(snapshot);
+
+    snapshot->header.magic      = FIMC_STAT_MAGIC;
+    snapshot->header.version    = FIMC_STAT_VERSION;
+    snapshot->header.dev_max    = FIMC_STAT_DEV_MAX;
+    snapshot->header.client_max = FIMC_STAT_CLIENT_MAX;
+    snapshot->header.op_max     = FIMC_STAT_OP_MAX;
+    snapshot->header.buckets    = FIMC_STAT_BUCKETS;
+    snapshot->header.timestamp  = systemTime();
+
+    return sizeof(struct fimc_stat_snapshot);
+}
+
+int fimc_stat_save(const char *path)
+{
+    struct fimc_stat_snapshot snapshot;
+    int fd;
+    int ret;
+
+    fimc_stat_snapshot(&snapshot);
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOGE("%s::open(%s) failed", __func__, path);
+        return -1;
+    }
+
+    ret = write(fd, &snapshot, sizeof(snapshot));
+    close(fd);
+
+    if (ret != (int)sizeof(snapshot)) {
+        LOGE("%s::write(%s) failed", __func__, path);
+        return -1;
+    }
+
+    return 0;
+}
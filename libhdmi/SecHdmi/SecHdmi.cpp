@@ -357,6 +357,7 @@ bool SecHdmi::create(int width, int height)
 
     BufNum = 1;
 
+    mSecFimc.setClient(SecFimcBroker::CLIENT_HDMI);
     if (mSecFimc.create(SecFimc::DEV_3, SecFimc::MODE_SINGLE_BUF, BufNum) == false) {
         LOGE("%s::SecFimc create() fail", __func__);
         goto CREATE_FAIL;
@@ -668,9 +669,17 @@ bool SecHdmi::flush(int srcW, int srcH, int srcColorFormat,
                     srcYAddr, srcCbAddr,
                     mHdmiDstWidth, mHdmiDstHeight);
         } else {
+            SecFimcBroker *broker = SecFimcBroker::getInstance();
+            if (broker->acquire(SecFimcBroker::CLIENT_HDMI, FIMC_DEV_MASK(SecFimc::DEV_3),
+                                HDMI_FIMC_LEASE_TIMEOUT_MS) < 0) {
+                LOGE("%s::fimc lease timeout, skip this frame", __func__);
+                return true;
+            }
+
             if (mSecFimc.setSrcAddr(srcYAddr, srcCbAddr, srcCrAddr, srcColorFormat) == false) {
                 LOGE("%s::setSrcAddr(%d, %d, %d) fail",
                         __func__, srcYAddr, srcCbAddr, srcCrAddr);
+                broker->release(SecFimc::DEV_3);
                 return false;
             }
 
@@ -685,13 +694,17 @@ bool SecHdmi::flush(int srcW, int srcH, int srcColorFormat,
             if (mSecFimc.setDstAddr(mHdmiSrcYAddr, mHdmiSrcCbCrAddr, 0, mFimcCurrentOutBufIndex) == false) {
                 LOGE("%s::mSecFimc.setDstAddr(%d, %d) fail \n",
                         __func__, mHdmiSrcYAddr, mHdmiSrcCbCrAddr);
+                broker->release(SecFimc::DEV_3);
                 return false;
             }
 
             if (mSecFimc.draw(0, mFimcCurrentOutBufIndex) == false) {
                 LOGE("%s::mSecFimc.draw() fail \n", __func__);
+                broker->release(SecFimc::DEV_3);
                 return false;
             }
+            broker->release(SecFimc::DEV_3);
+
             if (mUIRotVal == 0 || mUIRotVal == 180)
                 hdmi_set_v_param(hdmiLayer,
                         srcW, srcH, V4L2_PIX_FMT_NV12T,
@@ -711,16 +724,27 @@ bool SecHdmi::flush(int srcW, int srcH, int srcColorFormat,
         if (srcColorFormat != HAL_PIXEL_FORMAT_BGRA_8888 &&
             srcColorFormat != HAL_PIXEL_FORMAT_RGBA_8888 &&
             srcColorFormat != HAL_PIXEL_FORMAT_RGB_565) {
+            SecFimcBroker *broker = SecFimcBroker::getInstance();
+            if (broker->acquire(SecFimcBroker::CLIENT_HDMI, FIMC_DEV_MASK(SecFimc::DEV_3),
+                                HDMI_FIMC_LEASE_TIMEOUT_MS) < 0) {
+                LOGE("%s::fimc lease timeout, skip this frame", __func__);
+                return true;
+            }
+
             if (mSecFimc.setSrcAddr(srcYAddr, srcCbAddr, srcCrAddr, srcColorFormat) == false) {
                 LOGE("%s::setSrcAddr(%d, %d, %d) fail",
                      __func__, srcYAddr, srcCbAddr, srcCrAddr);
+                broker->release(SecFimc::DEV_3);
                 return false;
             }
 
             if (mSecFimc.draw(0, mFimcCurrentOutBufIndex) == false) {
                 LOGE("%s::mSecFimc.draw() failed", __func__);
+                broker->release(SecFimc::DEV_3);
                 return false;
             }
+            broker->release(SecFimc::DEV_3);
+
             if (hdmi_gl_set_param(hdmiLayer,
                             HAL_PIXEL_FORMAT_BGRA_8888,
                             mDstRect.width, mDstRect.height,
@@ -57,6 +57,7 @@
 #define SIZE_1K                     (1024)
 
 #define HDMI_FIMC_OUTPUT_BUF_NUM    (4)
+#define HDMI_FIMC_LEASE_TIMEOUT_MS  (33)    //drop the mirrored frame rather than stall the caller
 #define HDMI_G2D_OUTPUT_BUF_NUM     (2)
 #define HDMI_FIMC_BUFFER_BPP_SIZE   (1.5)   //NV12 Tiled is 1.5 bytes, RGB565 is 2, RGB888 is 4, Default is NV12 Tiled
 #define HDMI_G2D_BUFFER_BPP_SIZE    (4)     //NV12 Tiled is 1.5 bytes, RGB565 is 2, RGB888 is 4
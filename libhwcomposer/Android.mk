@@ -20,8 +20,8 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 LOCAL_PRELINK_MODULE := false
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
-LOCAL_SHARED_LIBRARIES := liblog libcutils libEGL \
-			  libGLESv1_CM
+LOCAL_SHARED_LIBRARIES := liblog libcutils libutils libEGL \
+			  libGLESv1_CM libfimc
 
 LOCAL_C_INCLUDES := \
 	$(LOCAL_PATH)/../include
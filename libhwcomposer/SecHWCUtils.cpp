@@ -25,6 +25,10 @@
  */
 
 #include "SecHWCUtils.h"
+#include "SecFimcBroker.h"
+#include "SecFimcStat.h"
+
+using namespace android;
 
 #define V4L2_BUF_TYPE_OUTPUT V4L2_BUF_TYPE_VIDEO_OUTPUT
 #define V4L2_BUF_TYPE_CAPTURE V4L2_BUF_TYPE_VIDEO_CAPTURE
@@ -299,7 +303,7 @@ int fimc_v4l2_set_src(int fd, unsigned int hw_ver, s5p_fimc_img_info *src)
     fmt.fmt.pix.field       = V4L2_FIELD_NONE;
     fmt.type                = V4L2_BUF_TYPE_OUTPUT;
 
-    if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
+    if (fimc_stat_ioctl(fd, FIMC_STAT_S_FMT, VIDIOC_S_FMT, &fmt) < 0) {
         SEC_HWC_Log(HWC_LOG_ERROR, "%s::VIDIOC_S_FMT failed : errno=%d (%s)"
                 " : fd=%d\n", __func__, errno, strerror(errno), fd);
         return -1;
@@ -349,7 +353,7 @@ int fimc_v4l2_set_dst(int fd, s5p_fimc_img_info *dst,
     vc.id = V4L2_CID_ROTATION;
     vc.value = rotation;
 
-    ret = ioctl(fd, VIDIOC_S_CTRL, &vc);
+    ret = fimc_stat_ioctl(fd, FIMC_STAT_S_CTRL, VIDIOC_S_CTRL, &vc);
     if (ret < 0) {
         SEC_HWC_Log(HWC_LOG_ERROR,
                 "%s::Error in video VIDIOC_S_CTRL - rotation (%d)"
@@ -360,7 +364,7 @@ int fimc_v4l2_set_dst(int fd, s5p_fimc_img_info *dst,
     vc.id = V4L2_CID_HFLIP;
     vc.value = hflip;
 
-    ret = ioctl(fd, VIDIOC_S_CTRL, &vc);
+    ret = fimc_stat_ioctl(fd, FIMC_STAT_S_CTRL, VIDIOC_S_CTRL, &vc);
     if (ret < 0) {
         SEC_HWC_Log(HWC_LOG_ERROR,
                 "%s::Error in video VIDIOC_S_CTRL - hflip (%d)"
@@ -371,7 +375,7 @@ int fimc_v4l2_set_dst(int fd, s5p_fimc_img_info *dst,
     vc.id = V4L2_CID_VFLIP;
     vc.value = vflip;
 
-    ret = ioctl(fd, VIDIOC_S_CTRL, &vc);
+    ret = fimc_stat_ioctl(fd, FIMC_STAT_S_CTRL, VIDIOC_S_CTRL, &vc);
     if (ret < 0) {
         SEC_HWC_Log(HWC_LOG_ERROR,
                 "%s::Error in video VIDIOC_S_CTRL - vflip (%d)"
@@ -404,7 +408,7 @@ int fimc_v4l2_set_dst(int fd, s5p_fimc_img_info *dst,
     sFormat.fmt.win.w.width  = dst->width;
     sFormat.fmt.win.w.height = dst->height;
 
-    ret = ioctl(fd, VIDIOC_S_FMT, &sFormat);
+    ret = fimc_stat_ioctl(fd, FIMC_STAT_S_FMT, VIDIOC_S_FMT, &sFormat);
     if (ret < 0) {
         SEC_HWC_Log(HWC_LOG_ERROR, "%s::Error in video VIDIOC_S_FMT (%d)", __func__, ret);
         return -1;
@@ -415,7 +419,7 @@ int fimc_v4l2_set_dst(int fd, s5p_fimc_img_info *dst,
 
 int fimc_v4l2_stream_on(int fd, enum v4l2_buf_type type)
 {
-    if (-1 == ioctl(fd, VIDIOC_STREAMON, &type)) {
+    if (-1 == fimc_stat_ioctl(fd, FIMC_STAT_STREAMON, VIDIOC_STREAMON, &type)) {
         SEC_HWC_Log(HWC_LOG_ERROR, "Error in VIDIOC_STREAMON\n");
         return -1;
     }
@@ -434,7 +438,7 @@ int fimc_v4l2_queue(int fd, struct fimc_buf *fimc_buf, enum v4l2_buf_type type,
     buf.index       = index;
     buf.type        = type;
 
-    ret = ioctl(fd, VIDIOC_QBUF, &buf);
+    ret = fimc_stat_ioctl(fd, FIMC_STAT_QBUF, VIDIOC_QBUF, &buf);
     if (0 > ret) {
         SEC_HWC_Log(HWC_LOG_ERROR, "Error in VIDIOC_QBUF : (%d)", ret);
         return -1;
@@ -450,7 +454,7 @@ int fimc_v4l2_dequeue(int fd, struct fimc_buf *fimc_buf, enum v4l2_buf_type type
     buf.memory      = V4L2_MEMORY_USERPTR;
     buf.type        = type;
 
-    if (-1 == ioctl(fd, VIDIOC_DQBUF, &buf)) {
+    if (-1 == fimc_stat_ioctl(fd, FIMC_STAT_DQBUF, VIDIOC_DQBUF, &buf)) {
         SEC_HWC_Log(HWC_LOG_ERROR, "Error in VIDIOC_DQBUF\n");
         return -1;
     }
@@ -490,7 +494,7 @@ int fimc_v4l2_S_ctrl(int fd)
     vc.id = V4L2_CID_CACHEABLE;
     vc.value = 1;
 
-    if (ioctl(fd, VIDIOC_S_CTRL, &vc) < 0) {
+    if (fimc_stat_ioctl(fd, FIMC_STAT_S_CTRL, VIDIOC_S_CTRL, &vc) < 0) {
         SEC_HWC_Log(HWC_LOG_ERROR, "Error in VIDIOC_S_CTRL");
         return -1;
     }
@@ -1165,6 +1169,8 @@ int createFimc(s5p_fimc_t *fimc)
     }
     fimc->hw_ver = vc.value;
 
+    fimc_stat_attach(fimc->dev_fd, PP_DEVICE_DEV_NUM, SecFimcBroker::CLIENT_OVERLAY);
+
     return 0;
 
 err:
@@ -1183,8 +1189,10 @@ int destroyFimc(s5p_fimc_t *fimc)
     }
 
     // close
-    if (0 < fimc->dev_fd)
+    if (0 < fimc->dev_fd) {
+        fimc_stat_detach(fimc->dev_fd);
         close(fimc->dev_fd);
+    }
     fimc->dev_fd = 0;
 
     return 0;
@@ -1221,10 +1229,24 @@ int runFimc(struct hwc_context_t *ctx,
     if (0 > dst_color_space)
         return -4;
 
-    /* 4. FIMC: src_rect of src_img => dst_rect of dst_img */
-    if (runFimcCore(ctx, src_phys_addr, src_img, src_rect,
+    /* 4. lease the post processor from the fimc broker */
+    SecFimcBroker *broker = SecFimcBroker::getInstance();
+    int dev = broker->acquire(SecFimcBroker::CLIENT_OVERLAY,
+                              FIMC_DEV_MASK(PP_DEVICE_DEV_NUM),
+                              PP_DEVICE_LEASE_TIMEOUT_MS);
+    if (dev < 0) {
+        SEC_HWC_Log(HWC_LOG_ERROR, "%s::fimc%d is busy", __func__, PP_DEVICE_DEV_NUM);
+        return -6;
+    }
+
+    /* 5. FIMC: src_rect of src_img => dst_rect of dst_img */
+    int ret = runFimcCore(ctx, src_phys_addr, src_img, src_rect,
                 (uint32_t)src_color_space, dst_phys_addr, dst_img, dst_rect,
-                (uint32_t)dst_color_space, transform) < 0)
+                (uint32_t)dst_color_space, transform);
+
+    broker->release(dev);
+
+    if (ret < 0)
         return -5;
 
     return 0;
@@ -72,12 +72,17 @@
 
 #ifdef SAMSUNG_EXYNOS4x12
 #define PP_DEVICE_DEV_NAME  "/dev/video3"
+#define PP_DEVICE_DEV_NUM   (3)
 #endif
 
 #ifdef SAMSUNG_EXYNOS4210
 #define PP_DEVICE_DEV_NAME  "/dev/video1"
+#define PP_DEVICE_DEV_NUM   (1)
 #endif
 
+/* how long an overlay job waits for the post processor (one frame) */
+#define PP_DEVICE_LEASE_TIMEOUT_MS  (16)
+
 struct sec_rect {
     int32_t x;
     int32_t y;
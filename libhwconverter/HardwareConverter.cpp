@@ -14,17 +14,35 @@
  * limitations under the License.
  */
 
+#include <string.h>
 #include <utils/Log.h>
 
 #include "SEC_OMX_Def.h"
 #include "SecFimc.h"
+#include "SecFimcBroker.h"
 #include "HardwareConverter.h"
 
+/*
+ * How long a conversion waits for the fimc. The camera takes DEV_2 for one
+ * frame at a time, but on a board where it streams from the node it holds
+ * it for the whole stream. On a timeout the conversion fails and reports
+ * it : the source is only known by its physical address, there is no
+ * software path to fall back to.
+ */
+#define HW_CONVERTER_LEASE_TIMEOUT_MS   (100)
+
+using namespace android;
+
 HardwareConverter::HardwareConverter()
 {
     SecFimc* handle_fimc = new SecFimc();
     mSecFimc = (void *)handle_fimc;
 
+    memset(&mSession, 0, sizeof(mSession));
+    mFlagSession = false;
+    mLeaseCount = 0;
+
+    handle_fimc->setClient(SecFimcBroker::CLIENT_CSC);
     if (handle_fimc->create(SecFimc::DEV_2, SecFimc::MODE_MULTI_BUF, 1) == false)
         bHWconvert_flag = 0;
     else
@@ -34,10 +52,146 @@ HardwareConverter::HardwareConverter()
 HardwareConverter::~HardwareConverter()
 {
     SecFimc* handle_fimc = (SecFimc*)mSecFimc;
+    closeSession();
     handle_fimc->destroy();
     delete (SecFimc*)mSecFimc;
 }
 
+bool HardwareConverter::openSession(HardwareConverterSession *session)
+{
+    SecFimcBroker *broker = SecFimcBroker::getInstance();
+    bool ret;
+
+    if (session == NULL || session->src_width <= 0 || session->src_height <= 0
+        || session->dst_width <= 0 || session->dst_height <= 0) {
+        LOGE("%s:: invalid session", __func__);
+        return false;
+    }
+
+    /* the old session is gone whether the new one can be set or not */
+    mFlagSession = false;
+
+    int dev = m_lease();
+    if (dev < 0)
+        return false;
+
+    ret = m_applySession(session);
+
+    broker->release(dev);
+
+    if (ret == false) {
+        mFlagSession = false;
+        return false;
+    }
+
+    mSession = *session;
+    mFlagSession = true;
+
+    return true;
+}
+
+void HardwareConverter::closeSession(void)
+{
+    mFlagSession = false;
+}
+
+bool HardwareConverter::convert(void *src_addr, void *dst_addr)
+{
+    SecFimc* handle_fimc = (SecFimc*)mSecFimc;
+    SecFimcBroker *broker = SecFimcBroker::getInstance();
+    bool ret = false;
+
+    if (mFlagSession == false) {
+        LOGE("%s:: no session", __func__);
+        return false;
+    }
+
+    int dev = m_lease();
+    if (dev < 0)
+        return false;
+
+    if (!m_setSrcAddr(src_addr))
+        goto done;
+
+    if (!m_setDstAddr(dst_addr))
+        goto done;
+
+    if (!handle_fimc->draw(0, 0)) {
+        LOGE("%s:: handleOneShot() failed", __func__);
+        goto done;
+    }
+
+    ret = true;
+
+done:
+    broker->release(dev);
+
+    return ret;
+}
+
+/*
+ * One lease and one STREAMON/STREAMOFF for the whole batch, each frame
+ * costs a DST_INFO update and a QBUF/DQBUF pair.
+ */
+bool HardwareConverter::convertMany(void **src_addr, void **dst_addr, int count)
+{
+    SecFimc* handle_fimc = (SecFimc*)mSecFimc;
+    SecFimcBroker *broker = SecFimcBroker::getInstance();
+    bool ret = false;
+    int i;
+
+    if (mFlagSession == false) {
+        LOGE("%s:: no session", __func__);
+        return false;
+    }
+
+    if (src_addr == NULL || dst_addr == NULL || count <= 0) {
+        LOGE("%s:: invalid buffers", __func__);
+        return false;
+    }
+
+    if (count == 1)
+        return convert(src_addr[0], dst_addr[0]);
+
+    int dev = m_lease();
+    if (dev < 0)
+        return false;
+
+    /* the first destination goes through the frame buffer as usual */
+    if (!m_setDstAddr(dst_addr[0]))
+        goto done;
+
+    if (!handle_fimc->streamOn()) {
+        LOGE("%s:: streamOn() failed", __func__);
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (!m_setSrcAddr(src_addr[i]))
+            break;
+
+        if (0 < i && !m_setDstAddr(dst_addr[i]))
+            break;
+
+        if (!handle_fimc->draw(0, 0)) {
+            LOGE("%s:: handleOneShot() failed at %d/%d", __func__, i, count);
+            break;
+        }
+    }
+
+    if (!handle_fimc->streamOff()) {
+        LOGE("%s:: streamOff() failed", __func__);
+        goto done;
+    }
+
+    ret = (i == count);
+
+done:
+    broker->release(dev);
+
+    return ret;
+}
+
 bool HardwareConverter::convert(
     void * src_addr,
     void *dst_addr,
@@ -46,78 +200,150 @@ bool HardwareConverter::convert(
     int32_t height,
     OMX_COLOR_FORMATTYPE dst_format)
 {
-    SecFimc* handle_fimc = (SecFimc*)mSecFimc;
+    HardwareConverterSession session;
 
-    int rotate_value = 0;
-    unsigned int src_crop_x = 0;
-    unsigned int src_crop_y = 0;
-    unsigned int src_crop_width = width;
-    unsigned int src_crop_height = height;
+    memset(&session, 0, sizeof(session));
+    session.src_format = src_format;
+    session.src_width  = width;
+    session.src_height = height;
+    session.dst_format = dst_format;
+    session.dst_width  = width;
+    session.dst_height = height;
 
-    unsigned int dst_crop_x = 0;
-    unsigned int dst_crop_y = 0;
-    unsigned int dst_crop_width = width;
-    unsigned int dst_crop_height = height;
+    /* only reprogram the fimc when the stream changes */
+    if (mFlagSession == false || memcmp(&session, &mSession, sizeof(session)) != 0) {
+        if (!openSession(&session))
+            return false;
+    }
 
-    void **src_addr_array = (void **)src_addr;
-    void **dst_addr_array = (void **)dst_addr;
+    return convert(src_addr, dst_addr);
+}
 
-    unsigned int src_har_format = OMXtoHarPixelFomrat(src_format);
-    unsigned int dst_har_format = OMXtoHarPixelFomrat(dst_format);
+/*
+ * Background csc has the lowest priority, wait a while for our turn. Other
+ * clients of DEV_2 program it their own way, when the node had another
+ * lease since ours the session is set up again before it is used.
+ */
+int HardwareConverter::m_lease(void)
+{
+    SecFimc* handle_fimc = (SecFimc*)mSecFimc;
+    SecFimcBroker *broker = SecFimcBroker::getInstance();
+    unsigned int count;
 
-    // set post processor configuration
-    if (!handle_fimc->setSrcParams(width, height, src_crop_x, src_crop_y,
-                                   &src_crop_width, &src_crop_height,
-                                   src_har_format)) {
-        LOGE("%s:: setSrcParms() failed", __func__);
-        return false;
+    int dev = broker->acquire(SecFimcBroker::CLIENT_CSC, FIMC_DEV_MASK(SecFimc::DEV_2),
+                              HW_CONVERTER_LEASE_TIMEOUT_MS);
+    if (dev < 0) {
+        LOGW("%s:: fimc busy, no lease in %d ms", __func__, HW_CONVERTER_LEASE_TIMEOUT_MS);
+        return -1;
     }
 
-    if (!handle_fimc->setSrcAddr((unsigned int)src_addr_array[0],
-                                 (unsigned int)src_addr_array[1],
-                                 (unsigned int)src_addr_array[1],
-                                 src_har_format)) {
-        LOGE("%s:: setSrcPhyAddr() failed", __func__);
-        return false;
+    count = broker->getLeaseCount(dev);
+    if (mFlagSession == true && count != mLeaseCount + 1) {
+        handle_fimc->invalidateSrcParams();
+        if (!m_applySession(&mSession)) {
+            LOGE("%s:: session lost to another client", __func__);
+            mFlagSession = false;
+            broker->release(dev);
+            return -1;
+        }
     }
+    mLeaseCount = count;
+
+    return dev;
+}
+
+bool HardwareConverter::m_applySession(HardwareConverterSession *session)
+{
+    SecFimc* handle_fimc = (SecFimc*)mSecFimc;
+
+    unsigned int src_crop_width  = session->src_crop_width  ? session->src_crop_width  : session->src_width;
+    unsigned int src_crop_height = session->src_crop_height ? session->src_crop_height : session->src_height;
+    unsigned int dst_crop_width  = session->dst_crop_width  ? session->dst_crop_width  : session->dst_width;
+    unsigned int dst_crop_height = session->dst_crop_height ? session->dst_crop_height : session->dst_height;
+
+    unsigned int src_har_format = OMXtoHarPixelFomrat(session->src_format);
+    unsigned int dst_har_format = OMXtoHarPixelFomrat(session->dst_format);
 
-    if (!handle_fimc->setRotVal(rotate_value)) {
+    // set post processor configuration
+    if (!handle_fimc->setRotVal(session->rotation)) {
         LOGE("%s:: setRotVal() failed", __func__);
         return false;
     }
 
-    if (!handle_fimc->setDstParams(width, height, dst_crop_x, dst_crop_y,
+    if (!handle_fimc->setSrcParams(session->src_width, session->src_height,
+                                   session->src_crop_x, session->src_crop_y,
+                                   &src_crop_width, &src_crop_height,
+                                   src_har_format)) {
+        LOGE("%s:: setSrcParms() failed", __func__);
+        return false;
+    }
+
+    if (!handle_fimc->setDstParams(session->dst_width, session->dst_height,
+                                   session->dst_crop_x, session->dst_crop_y,
                                    &dst_crop_width, &dst_crop_height,
                                    dst_har_format)) {
         LOGE("%s:: setDstParams() failed", __func__);
         return false;
     }
 
-    switch (dst_format) {
+    return true;
+}
+
+bool HardwareConverter::m_setSrcAddr(void *src_addr)
+{
+    SecFimc* handle_fimc = (SecFimc*)mSecFimc;
+    void **src_addr_array = (void **)src_addr;
+    unsigned int src_har_format = OMXtoHarPixelFomrat(mSession.src_format);
+
+    switch (mSession.src_format) {
+    case OMX_COLOR_FormatYUV420Planar:
+        if (!handle_fimc->setSrcAddr((unsigned int)src_addr_array[0],
+                                     (unsigned int)src_addr_array[1],
+                                     (unsigned int)src_addr_array[2],
+                                     src_har_format)) {
+            LOGE("%s:: setSrcPhyAddr() failed", __func__);
+            return false;
+        }
+        break;
+    default:
+        if (!handle_fimc->setSrcAddr((unsigned int)src_addr_array[0],
+                                     (unsigned int)src_addr_array[1],
+                                     (unsigned int)src_addr_array[1],
+                                     src_har_format)) {
+            LOGE("%s:: setSrcPhyAddr() failed", __func__);
+            return false;
+        }
+        break;
+    }
+
+    return true;
+}
+
+bool HardwareConverter::m_setDstAddr(void *dst_addr)
+{
+    SecFimc* handle_fimc = (SecFimc*)mSecFimc;
+    void **dst_addr_array = (void **)dst_addr;
+
+    switch (mSession.dst_format) {
     case OMX_COLOR_FormatYUV420SemiPlanar:
-        if (!handle_fimc->setDstAddr((unsigned int)(dst_addr_array[0]),
-                                     (unsigned int)(dst_addr_array[1]),
-                                     (unsigned int)(dst_addr_array[1]))) {
+        if (!handle_fimc->updateDstAddr((unsigned int)(dst_addr_array[0]),
+                                        (unsigned int)(dst_addr_array[1]),
+                                        (unsigned int)(dst_addr_array[1]))) {
             LOGE("%s:: setDstPhyAddr() failed", __func__);
             return false;
         }
         break;
     case OMX_COLOR_FormatYUV420Planar:
     default:
-        if (!handle_fimc->setDstAddr((unsigned int)(dst_addr_array[0]),
-                                     (unsigned int)(dst_addr_array[1]),
-                                     (unsigned int)(dst_addr_array[2]))) {
+        if (!handle_fimc->updateDstAddr((unsigned int)(dst_addr_array[0]),
+                                        (unsigned int)(dst_addr_array[1]),
+                                        (unsigned int)(dst_addr_array[2]))) {
             LOGE("%s:: setDstPhyAddr() failed", __func__);
             return false;
         }
         break;
     }
 
-    if (!handle_fimc->draw(0, 0)) {
-        LOGE("%s:: handleOneShot() failed", __func__);
-        return false;
-    }
-
     return true;
 }
 
@@ -20,10 +20,51 @@
 
 #include <OMX_Video.h>
 
+/*
+ * Everything about a conversion except the buffer addresses.
+ * A crop width/height of 0 means the full frame.
+ */
+typedef struct {
+    OMX_COLOR_FORMATTYPE src_format;
+    int32_t              src_width;
+    int32_t              src_height;
+    uint32_t             src_crop_x;
+    uint32_t             src_crop_y;
+    uint32_t             src_crop_width;
+    uint32_t             src_crop_height;
+
+    OMX_COLOR_FORMATTYPE dst_format;
+    int32_t              dst_width;
+    int32_t              dst_height;
+    uint32_t             dst_crop_x;
+    uint32_t             dst_crop_y;
+    uint32_t             dst_crop_width;
+    uint32_t             dst_crop_height;
+
+    int32_t              rotation;
+} HardwareConverterSession;
+
 class HardwareConverter {
 public:
     HardwareConverter();
     ~HardwareConverter();
+
+    /*
+     * Program geometry, formats and rotation once. convert() and
+     * convertMany() then only hand buffer addresses to the hardware.
+     */
+    bool openSession(HardwareConverterSession *session);
+    void closeSession(void);
+
+    /*
+     * src_addr / dst_addr point to the plane addresses of one frame.
+     * Returns false, among others, when the fimc stays busy with a higher
+     * priority client; convert in software then.
+     */
+    bool convert(void *src_addr, void *dst_addr);
+    /* src_addr[i] / dst_addr[i] as for convert(), one stream for all */
+    bool convertMany(void **src_addr, void **dst_addr, int count);
+
     bool convert(
         void * src_addr,
         void * dst_addr,
@@ -34,6 +75,16 @@ public:
     bool bHWconvert_flag;
 private:
     void *mSecFimc;
+
+    HardwareConverterSession mSession;
+    bool                     mFlagSession;
+    /* leases DEV_2 had up to ours, another one in between reprograms it */
+    unsigned int             mLeaseCount;
+
+    int  m_lease(void);
+    bool m_applySession(HardwareConverterSession *session);
+    bool m_setSrcAddr(void *src_addr);
+    bool m_setDstAddr(void *dst_addr);
     unsigned int OMXtoHarPixelFomrat(OMX_COLOR_FORMATTYPE omx_format);
 };
 
@@ -516,6 +516,35 @@ int jpeghal_enc_exe(int fd, struct jpeg_buf *in_buf, struct jpeg_buf *out_buf)
     return ret;
 }
 
+/*
+ * Stop both queues after jpeghal_enc_exe/jpeghal_dec_exe so that the same
+ * fd, format and buffers can run the next frame without a new init.
+ */
+int jpeghal_stop(int fd, struct jpeg_buf *in_buf, struct jpeg_buf *out_buf)
+{
+    int ret = 0;
+
+    if (jpeg_v4l2_streamoff(fd, in_buf->buf_type) < 0)
+        ret = -1;
+
+    if (jpeg_v4l2_streamoff(fd, out_buf->buf_type) < 0)
+        ret = -1;
+
+    return ret;
+}
+
+/* Undo jpeghal_set_inbuf/jpeghal_set_outbuf, the fd stays open */
+int jpeghal_release_buf(int fd, struct jpeg_buf *buf)
+{
+    int i = 0;
+
+    if (buf->memory == V4L2_MEMORY_MMAP)
+        for (i = 0; i < buf->num_planes; i++)
+            munmap((char *)(buf->start[i]), buf->length[i]);
+
+    return jpeg_v4l2_reqbufs(fd, 0, buf);
+}
+
 int jpeghal_deinit(int fd, struct jpeg_buf *in_buf, struct jpeg_buf *out_buf)
 {
     int ret = 0;
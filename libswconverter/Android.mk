@@ -11,7 +11,8 @@ LOCAL_SRC_FILES := \
 	csc_tiled_to_linear_crop_neon.s \
 	csc_tiled_to_linear_deinterleave_crop_neon.s \
 	csc_interleave_memcpy_neon.s \
-	csc_ARGB8888_to_YUV420SP_NEON.s
+	csc_ARGB8888_to_YUV420SP_NEON.s \
+	csc_YUV422I_to_YUV420_neon.s
 
 LOCAL_C_INCLUDES := \
 	$(LOCAL_PATH)/../include \
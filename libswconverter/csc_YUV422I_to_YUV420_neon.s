@@ -0,0 +1,267 @@
+/*
+ *
+ * Copyright 2012 Samsung Electronics S.LSI Co. LTD
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License")
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * @file    csc_YUV422I_to_YUV420_neon.s
+ * @brief   packed YUV422 to YUV420, luma and chroma in one pass
+ */
+
+/*
+ * mode bits, see swconverter.h
+ *   bit 0    : source is UYVY instead of YUYV
+ *   bit 1..2 : 0 NV12, 1 NV21, 2 planar (c0 = U, c1 = V)
+ *
+ * vld4.8 splits 16 YUYV pixels into d0 = even Y, d1 = U, d2 = odd Y,
+ * d3 = V. UYVY lands with luma and chroma swapped, a vswp per pair
+ * brings it back so the rest of the loop is shared.
+ */
+
+    .macro LOAD_422I uyvy, d0, d1, d2, d3, src
+    vld4.8      {\d0, \d1, \d2, \d3}, [\src]!
+    .if \uyvy
+    vswp        \d0, \d1
+    vswp        \d2, \d3
+    .endif
+    .endm
+
+    @ d16 = U, d17 = V
+    .macro STORE_420C dst
+    .if \dst == 0
+    vst2.8      {d16, d17}, [r1]!
+    .elseif \dst == 1
+    vswp        d16, d17
+    vst2.8      {d16, d17}, [r1]!
+    .else
+    vst1.8      {d16}, [r1]!
+    vst1.8      {d17}, [r2]!
+    .endif
+    .endm
+
+    .macro LOOP_FULL_16 uyvy, dst, done
+1:
+    pld         [r3, #256]              @ stay ahead of the loads
+    pld         [r5, #256]
+    LOAD_422I   \uyvy, d0, d1, d2, d3, r3
+    LOAD_422I   \uyvy, d4, d5, d6, d7, r5
+    vst2.8      {d0, d2}, [r0]!         @ luma of both lines
+    vst2.8      {d4, d6}, [r4]!
+    vrhadd.u8   d16, d1, d5             @ chroma of the line pair
+    vrhadd.u8   d17, d3, d7
+    STORE_420C  \dst
+    subs        r6, r6, #16
+    bgt         1b
+    b           \done
+    .endm
+
+    .macro LOOP_HALF_16 uyvy, dst, done
+1:
+    pld         [r3, #256]              @ stay ahead of the loads
+    pld         [r5, #256]
+    LOAD_422I   \uyvy, d0, d1, d2, d3, r3
+    LOAD_422I   \uyvy, d4, d5, d6, d7, r3
+    LOAD_422I   \uyvy, d16, d17, d18, d19, r5
+    LOAD_422I   \uyvy, d20, d21, d22, d23, r5
+    vaddl.u8    q12, d0, d2             @ 2x2 luma box
+    vaddl.u8    q13, d4, d6
+    vaddl.u8    q14, d16, d18
+    vaddl.u8    q15, d20, d22
+    vadd.u16    q12, q12, q14
+    vadd.u16    q13, q13, q15
+    vrshrn.u16  d24, q12, #2
+    vrshrn.u16  d25, q13, #2
+    vst1.8      {d24, d25}, [r0]!
+    cmp         r1, #0                  @ odd output line, luma only
+    beq         2f
+    vaddl.u8    q12, d1, d17            @ chroma of both lines
+    vaddl.u8    q13, d5, d21
+    vaddl.u8    q14, d3, d19
+    vaddl.u8    q15, d7, d23
+    vpadd.u16   d24, d24, d25           @ and of two neighbour pairs
+    vpadd.u16   d25, d26, d27
+    vpadd.u16   d26, d28, d29
+    vpadd.u16   d27, d30, d31
+    vrshrn.u16  d16, q12, #2
+    vrshrn.u16  d17, q13, #2
+    STORE_420C  \dst
+2:
+    subs        r6, r6, #16
+    bgt         1b
+    b           \done
+    .endm
+
+/*
+ * Converts two lines of packed YUV422 to two lines of luma and one line
+ * of YUV420 chroma
+ *
+ * @param y_dst
+ *   Y address of the first line[out]
+ *
+ * @param c0_dst
+ *   UV address for NV12/NV21, U address for planar[out]
+ *
+ * @param c1_dst
+ *   V address for planar[out]
+ *
+ * @param src
+ *   YUV422 address of the first line[in]
+ *
+ * @param y_stride
+ *   Y line to line in bytes, 0 repeats the first line
+ *
+ * @param src_stride
+ *   src line to line in bytes, 0 repeats the first line
+ *
+ * @param width
+ *   pixels, multiple of 16
+ *
+ * @param mode
+ *   layouts
+ */
+
+    .arch armv7-a
+    .fpu neon
+    .text
+    .global csc_YUV422I_to_YUV420_neon
+    .type   csc_YUV422I_to_YUV420_neon, %function
+csc_YUV422I_to_YUV420_neon:
+    .fnstart
+
+    @r0     y_dst
+    @r1     c0_dst
+    @r2     c1_dst
+    @r3     src
+    @r4     y_dst of the second line
+    @r5     src of the second line
+    @r6     width
+    @r7     mode
+
+    stmfd       sp!, {r4-r7,r14}        @ backup registers
+    ldr         r4, [sp, #20]
+    ldr         r5, [sp, #24]
+    ldr         r6, [sp, #28]
+    ldr         r7, [sp, #32]
+    add         r4, r0, r4
+    add         r5, r3, r5
+
+    cmp         r6, #16
+    blt         FULL_RESTORE_REG
+
+    and         r7, r7, #7
+    cmp         r7, #1
+    beq         FULL_UYVY_NV12
+    cmp         r7, #2
+    beq         FULL_YUYV_NV21
+    cmp         r7, #3
+    beq         FULL_UYVY_NV21
+    cmp         r7, #4
+    beq         FULL_YUYV_I420
+    cmp         r7, #5
+    beq         FULL_UYVY_I420
+
+FULL_YUYV_NV12:
+    LOOP_FULL_16 0, 0, FULL_RESTORE_REG
+FULL_UYVY_NV12:
+    LOOP_FULL_16 1, 0, FULL_RESTORE_REG
+FULL_YUYV_NV21:
+    LOOP_FULL_16 0, 1, FULL_RESTORE_REG
+FULL_UYVY_NV21:
+    LOOP_FULL_16 1, 1, FULL_RESTORE_REG
+FULL_YUYV_I420:
+    LOOP_FULL_16 0, 2, FULL_RESTORE_REG
+FULL_UYVY_I420:
+    LOOP_FULL_16 1, 2, FULL_RESTORE_REG
+
+FULL_RESTORE_REG:
+    ldmfd       sp!, {r4-r7,r15}        @ restore registers
+    .fnend
+
+/*
+ * Converts two lines of packed YUV422 to one line of luma and, when
+ * c0_dst is set, one line of YUV420 chroma at half the size
+ *
+ * @param y_dst
+ *   Y address[out]
+ *
+ * @param c0_dst
+ *   UV address for NV12/NV21, U address for planar, 0 for luma only[out]
+ *
+ * @param c1_dst
+ *   V address for planar[out]
+ *
+ * @param src
+ *   YUV422 address of the first line[in]
+ *
+ * @param src_stride
+ *   src line to line in bytes
+ *
+ * @param width
+ *   destination pixels, multiple of 16
+ *
+ * @param mode
+ *   layouts
+ */
+
+    .global csc_YUV422I_to_YUV420_half_neon
+    .type   csc_YUV422I_to_YUV420_half_neon, %function
+csc_YUV422I_to_YUV420_half_neon:
+    .fnstart
+
+    @r0     y_dst
+    @r1     c0_dst
+    @r2     c1_dst
+    @r3     src
+    @r5     src of the second line
+    @r6     width
+    @r7     mode
+
+    stmfd       sp!, {r4-r7,r14}        @ backup registers
+    ldr         r5, [sp, #20]
+    ldr         r6, [sp, #24]
+    ldr         r7, [sp, #28]
+    add         r5, r3, r5
+
+    cmp         r6, #16
+    blt         HALF_RESTORE_REG
+
+    and         r7, r7, #7
+    cmp         r7, #1
+    beq         HALF_UYVY_NV12
+    cmp         r7, #2
+    beq         HALF_YUYV_NV21
+    cmp         r7, #3
+    beq         HALF_UYVY_NV21
+    cmp         r7, #4
+    beq         HALF_YUYV_I420
+    cmp         r7, #5
+    beq         HALF_UYVY_I420
+
+HALF_YUYV_NV12:
+    LOOP_HALF_16 0, 0, HALF_RESTORE_REG
+HALF_UYVY_NV12:
+    LOOP_HALF_16 1, 0, HALF_RESTORE_REG
+HALF_YUYV_NV21:
+    LOOP_HALF_16 0, 1, HALF_RESTORE_REG
+HALF_UYVY_NV21:
+    LOOP_HALF_16 1, 1, HALF_RESTORE_REG
+HALF_YUYV_I420:
+    LOOP_HALF_16 0, 2, HALF_RESTORE_REG
+HALF_UYVY_I420:
+    LOOP_HALF_16 1, 2, HALF_RESTORE_REG
+
+HALF_RESTORE_REG:
+    ldmfd       sp!, {r4-r7,r15}        @ restore registers
+    .fnend
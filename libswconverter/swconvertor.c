@@ -1825,4 +1825,161 @@ void csc_ARGB8888_to_YUV420SP(
             }
         }
     }
-}
\ No newline at end of file
+}
+/*
+ * Converts two lines of YUV422I to two lines of Y and a line of chroma
+ * Width is a multiple of 16, strides of 0 repeat the first line
+ */
+void csc_YUV422I_to_YUV420_neon(
+    unsigned char *y_dst,
+    unsigned char *c0_dst,
+    unsigned char *c1_dst,
+    unsigned char *src,
+    unsigned int y_stride,
+    unsigned int src_stride,
+    unsigned int width,
+    unsigned int mode);
+
+/*
+ * Converts two lines of YUV422I to a line of Y at half width and, when
+ * c0_dst is set, a line of chroma. Width of the destination is a
+ * multiple of 16
+ */
+void csc_YUV422I_to_YUV420_half_neon(
+    unsigned char *y_dst,
+    unsigned char *c0_dst,
+    unsigned char *c1_dst,
+    unsigned char *src,
+    unsigned int src_stride,
+    unsigned int width,
+    unsigned int mode);
+
+/*
+ * Stores the chroma pair of pixel x in a YUV420 chroma line
+ */
+static void csc_store_YUV420_chroma(
+    unsigned char *c0_dst,
+    unsigned char *c1_dst,
+    unsigned int x,
+    unsigned char u,
+    unsigned char v,
+    unsigned int mode)
+{
+    switch (mode & (CSC_YUV420_NV21 | CSC_YUV420_PLANAR)) {
+    case CSC_YUV420_PLANAR:
+        c0_dst[x / 2] = u;
+        c1_dst[x / 2] = v;
+        break;
+    case CSC_YUV420_NV21:
+        c0_dst[x]     = v;
+        c0_dst[x + 1] = u;
+        break;
+    default:
+        c0_dst[x]     = u;
+        c0_dst[x + 1] = v;
+        break;
+    }
+}
+
+void csc_YUV422I_to_YUV420(
+    unsigned char *y_dst,
+    unsigned char *u_dst,
+    unsigned char *v_dst,
+    unsigned char *src,
+    unsigned int width,
+    unsigned int height,
+    unsigned int src_stride,
+    unsigned int y_stride,
+    unsigned int uv_stride,
+    unsigned int mode)
+{
+    unsigned int i, j, k;
+    unsigned int neon_width;
+    unsigned int y_pos, c_pos;
+    unsigned char *src0, *src1;
+    unsigned char *y0, *y1;
+    unsigned char *c0, *c1;
+
+    /* byte offsets of Y and U in a YUYV or UYVY pixel pair, V follows U by 2 */
+    y_pos = (mode & CSC_YUV422I_UYVY) ? 1 : 0;
+    c_pos = (mode & CSC_YUV422I_UYVY) ? 0 : 1;
+
+    width = width & ~1;
+
+    if (!(mode & CSC_YUV420_HALF)) {
+        neon_width = width & ~15;
+
+        for (j = 0; j < height; j += 2) {
+            src0 = src + j * src_stride;
+            y0 = y_dst + j * y_stride;
+
+            /* an odd last line pairs with itself */
+            src1 = (j + 1 < height) ? src0 + src_stride : src0;
+            y1 = (j + 1 < height) ? y0 + y_stride : y0;
+
+            c0 = u_dst + (j / 2) * uv_stride;
+            c1 = (mode & CSC_YUV420_PLANAR) ? v_dst + (j / 2) * uv_stride : NULL;
+
+            if (neon_width)
+                csc_YUV422I_to_YUV420_neon(y0, c0, c1, src0,
+                                           y1 - y0, src1 - src0, neon_width, mode);
+
+            for (i = neon_width; i < width; i += 2) {
+                k = i * 2;
+                y0[i]     = src0[k + y_pos];
+                y0[i + 1] = src0[k + y_pos + 2];
+                y1[i]     = src1[k + y_pos];
+                y1[i + 1] = src1[k + y_pos + 2];
+                csc_store_YUV420_chroma(c0, c1, i,
+                    (src0[k + c_pos] + src1[k + c_pos] + 1) >> 1,
+                    (src0[k + c_pos + 2] + src1[k + c_pos + 2] + 1) >> 1,
+                    mode);
+            }
+        }
+    } else {
+        unsigned int dst_width = width / 2;
+        unsigned int dst_height = height / 2;
+        unsigned int last_pair = width / 2 - 1;
+        unsigned int p0, p1, sum_u, sum_v;
+
+        neon_width = dst_width & ~15;
+
+        for (j = 0; j < dst_height; j++) {
+            src0 = src + (j * 2) * src_stride;
+            src1 = src0 + src_stride;
+            y0 = y_dst + j * y_stride;
+
+            /* one chroma line for every two destination lines */
+            c0 = NULL;
+            c1 = NULL;
+            if ((j & 1) == 0) {
+                c0 = u_dst + (j / 2) * uv_stride;
+                if (mode & CSC_YUV420_PLANAR)
+                    c1 = v_dst + (j / 2) * uv_stride;
+            }
+
+            if (neon_width)
+                csc_YUV422I_to_YUV420_half_neon(y0, c0, c1, src0,
+                                                src_stride, neon_width, mode);
+
+            for (i = neon_width; i < dst_width; i++) {
+                k = i * 4;
+                y0[i] = (src0[k + y_pos] + src0[k + y_pos + 2] +
+                         src1[k + y_pos] + src1[k + y_pos + 2] + 2) >> 2;
+
+                if (c0 == NULL || (i & 1))
+                    continue;
+
+                /* the pixel pairs under destination pixels i and i + 1 */
+                p0 = i * 4;
+                p1 = ((i + 1 <= last_pair) ? i + 1 : last_pair) * 4;
+                sum_u = src0[p0 + c_pos] + src0[p1 + c_pos] +
+                        src1[p0 + c_pos] + src1[p1 + c_pos];
+                sum_v = src0[p0 + c_pos + 2] + src0[p1 + c_pos + 2] +
+                        src1[p0 + c_pos + 2] + src1[p1 + c_pos + 2];
+                csc_store_YUV420_chroma(c0, c1, i,
+                                        (sum_u + 2) >> 2, (sum_v + 2) >> 2, mode);
+            }
+        }
+    }
+}
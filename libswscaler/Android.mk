@@ -5,7 +5,9 @@ LOCAL_SRC_FILES:= \
 	swscaler.c \
 	SW_Scale_up_Y_NEON.S \
 	SW_Scale_up_CbCr_NEON.S \
-	SW_Memcpy_NEON.S
+	SW_Memcpy_NEON.S \
+	SW_Copy_Plane_NEON.S \
+	SW_Accumulate_Line_NEON.S
 
 LOCAL_SHARED_LIBRARIES := \
 	libutils
@@ -25,8 +25,13 @@
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 #include "swscaler.h"
 
+/* sizes SW_Scale_down_YUYV keeps the tap tables of */
+#define SW_SCALE_TAPS_CACHE     (4)
+
 long get_result_time(struct timeval *start, struct timeval *end)
 {
     long sec, time, usec;
@@ -94,3 +99,329 @@ void SW_Scale_up_crop(unsigned int cropImageWidth, unsigned int cropImageHeight,
         SW_Scale_up_CbCr(dstImageWidth, dstImageHeight, dstImageWidth, dstImageHeight, MainHorRatio, MainVerRatio, srcCbCr, dstCbCr);
     }
 }
+
+/*
+ *  SW_Copy_Plane(dst, dstStride, src, srcStride, width, height)
+ *  Copy width bytes of height lines between buffers of different strides.
+ *  A plane without padding on either side is copied as one long line.
+ */
+void SW_Copy_Plane(unsigned char *dst, unsigned int dstStride, unsigned char *src, unsigned int srcStride, unsigned int width, unsigned int height)
+{
+    if (dstStride == width && srcStride == width) {
+        width *= height;
+        height = 1;
+    }
+
+    SW_Copy_Plane_NEON(dst, dstStride, src, srcStride, width, height);
+}
+
+/*
+ * Area filter taps of src samples to dst samples, src >= dst.
+ * Output sample i covers [i * src / dst, (i + 1) * src / dst) of the
+ * source; every source sample it touches is weighted by its coverage.
+ * The weights of one output sample are Q7 and always add up to 128.
+ */
+static void SW_Make_Taps(unsigned int src, unsigned int dst, unsigned int maxTaps,
+                         unsigned int *start, unsigned int *count, unsigned char *weight)
+{
+    unsigned int ratio = (src << 16) / dst;
+    unsigned int i, s, n;
+
+    for (i = 0; i < dst; i++) {
+        unsigned int begin = i * ratio;
+        unsigned int end = (i == dst - 1) ? (src << 16) : (i + 1) * ratio;
+        unsigned char *w = weight + i * maxTaps;
+        int sum = 0;
+        unsigned int big = 0;
+
+        start[i] = begin >> 16;
+
+        for (s = start[i], n = 0; (s << 16) < end && n < maxTaps; s++, n++) {
+            unsigned int lo = (begin > (s << 16)) ? begin : (s << 16);
+            unsigned int hi = (end < ((s + 1) << 16)) ? end : ((s + 1) << 16);
+
+            w[n] = ((hi - lo) * 128 + (end - begin) / 2) / (end - begin);
+            sum += w[n];
+            if (w[big] < w[n])
+                big = n;
+        }
+
+        /* rounding leftovers go to the largest tap */
+        w[big] = (unsigned char)(w[big] + 128 - sum);
+        count[i] = n;
+    }
+}
+
+/*
+ * Tap tables and line buffers of one source to destination size. An entry
+ * belongs to one caller from SW_Get_Taps() to SW_Put_Taps(), so scalers on
+ * several threads never share the line buffers.
+ */
+struct SW_Scale_Taps {
+    unsigned int srcWidth, srcHeight;
+    unsigned int dstWidth, dstHeight;
+    int busy;
+    int own;                /* not in the cache, freed by SW_Put_Taps() */
+    unsigned int used;      /* last SW_Get_Taps() tick, 0 : never */
+    unsigned int hTaps, vTaps;
+    unsigned int *yStart, *yCount, *cStart, *cCount, *vStart, *vCount;
+    unsigned char *yWeight, *cWeight, *vWeight;
+    unsigned short *acc;
+    unsigned int *chroma;
+    void *mem;
+};
+
+static struct SW_Scale_Taps sw_taps_cache[SW_SCALE_TAPS_CACHE];
+static unsigned int sw_taps_tick;
+static pthread_mutex_t sw_taps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int SW_Build_Taps(struct SW_Scale_Taps *t,
+                         unsigned int srcWidth, unsigned int srcHeight,
+                         unsigned int dstWidth, unsigned int dstHeight)
+{
+    unsigned int hTaps = ((srcWidth << 16) / dstWidth >> 16) + 2;
+    unsigned int vTaps = ((srcHeight << 16) / dstHeight >> 16) + 2;
+    unsigned int halfWidth = dstWidth / 2;
+    unsigned int srcStride = srcWidth * 2;
+    size_t size;
+
+    size = srcStride * sizeof(unsigned short)
+         + halfWidth * 2 * sizeof(unsigned int)
+         + (dstWidth + halfWidth + dstHeight) * 2 * sizeof(unsigned int)
+         + dstWidth * hTaps + halfWidth * hTaps + dstHeight * vTaps;
+    t->mem = malloc(size);
+    if (t->mem == NULL) {
+        LOGE("%s: no memory for %d bytes", __func__, (int)size);
+        return -1;
+    }
+
+    t->srcWidth  = srcWidth;
+    t->srcHeight = srcHeight;
+    t->dstWidth  = dstWidth;
+    t->dstHeight = dstHeight;
+    t->hTaps     = hTaps;
+    t->vTaps     = vTaps;
+
+    t->acc     = (unsigned short *)t->mem;
+    t->chroma  = (unsigned int *)(t->acc + srcStride);
+    t->yStart  = t->chroma + halfWidth * 2;
+    t->yCount  = t->yStart + dstWidth;
+    t->cStart  = t->yCount + dstWidth;
+    t->cCount  = t->cStart + halfWidth;
+    t->vStart  = t->cCount + halfWidth;
+    t->vCount  = t->vStart + dstHeight;
+    t->yWeight = (unsigned char *)(t->vCount + dstHeight);
+    t->cWeight = t->yWeight + dstWidth * hTaps;
+    t->vWeight = t->cWeight + halfWidth * hTaps;
+
+    SW_Make_Taps(srcWidth, dstWidth, hTaps, t->yStart, t->yCount, t->yWeight);
+    SW_Make_Taps(srcWidth / 2, halfWidth, hTaps, t->cStart, t->cCount, t->cWeight);
+    SW_Make_Taps(srcHeight, dstHeight, vTaps, t->vStart, t->vCount, t->vWeight);
+
+    return 0;
+}
+
+static void SW_Put_Taps(struct SW_Scale_Taps *t)
+{
+    if (t->own) {
+        free(t->mem);
+        free(t);
+        return;
+    }
+
+    pthread_mutex_lock(&sw_taps_lock);
+    t->busy = 0;
+    pthread_mutex_unlock(&sw_taps_lock);
+}
+
+/*
+ * An idle cache entry of that size, else the least recently used idle one
+ * rebuilt for it. With every entry busy the caller gets tables of its own,
+ * freed again by SW_Put_Taps().
+ */
+static struct SW_Scale_Taps *SW_Get_Taps(unsigned int srcWidth, unsigned int srcHeight,
+                                         unsigned int dstWidth, unsigned int dstHeight)
+{
+    struct SW_Scale_Taps *t = NULL;
+    int i;
+
+    pthread_mutex_lock(&sw_taps_lock);
+
+    for (i = 0; i < SW_SCALE_TAPS_CACHE; i++) {
+        struct SW_Scale_Taps *e = &sw_taps_cache[i];
+
+        if (e->busy)
+            continue;
+        if (e->mem != NULL &&
+            e->srcWidth == srcWidth && e->srcHeight == srcHeight &&
+            e->dstWidth == dstWidth && e->dstHeight == dstHeight) {
+            t = e;
+            break;
+        }
+        if (t == NULL || e->used < t->used)
+            t = e;
+    }
+
+    if (t != NULL) {
+        t->busy = 1;
+        t->used = ++sw_taps_tick;
+    }
+
+    pthread_mutex_unlock(&sw_taps_lock);
+
+    if (t == NULL) {
+        t = (struct SW_Scale_Taps *)calloc(1, sizeof(*t));
+        if (t == NULL) {
+            LOGE("%s: no memory", __func__);
+            return NULL;
+        }
+        t->own = 1;
+    } else if (t->mem != NULL &&
+               t->srcWidth == srcWidth && t->srcHeight == srcHeight &&
+               t->dstWidth == dstWidth && t->dstHeight == dstHeight) {
+        return t;
+    }
+
+    free(t->mem);
+    t->mem = NULL;
+
+    if (SW_Build_Taps(t, srcWidth, srcHeight, dstWidth, dstHeight) < 0) {
+        SW_Put_Taps(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+/*
+ *  SW_Scale_down_YUYV(srcWidth, srcHeight, src, dstWidth, dstHeight, dst, dstFormat)
+ *  Area filter down scaler for packed YUYV, any ratio of 1 or more on each axis.
+ *  Lines are summed vertically by SW_Accumulate_Line_NEON, then each output
+ *  line is filtered horizontally : luma per pixel, chroma per pixel pair.
+ *
+ *  @param srcWidth, srcHeight
+ *      source size, even
+ *
+ *  @param dstWidth, dstHeight
+ *      result size, even and not larger than the source
+ *
+ *  @param dstFormat
+ *      SW_SCALE_FMT_YUYV : packed, dstWidth * 2 bytes per line
+ *      SW_SCALE_FMT_NV21 : Y plane then VU plane, chroma of two lines averaged
+ *
+ *  @return
+ *      0 on success, -1 on bad sizes or no memory
+ *
+ *  Weights are Q7 : past a ratio of 128 some source lines get no weight.
+ *  The tables of the last SW_SCALE_TAPS_CACHE sizes are kept, a preview or
+ *  thumbnail size seen before scales without building them again.
+ */
+int SW_Scale_down_YUYV(unsigned int srcWidth, unsigned int srcHeight, unsigned char *src,
+                       unsigned int dstWidth, unsigned int dstHeight, unsigned char *dst,
+                       int dstFormat)
+{
+    unsigned int halfWidth = dstWidth / 2;
+    unsigned int srcStride = srcWidth * 2;
+    struct SW_Scale_Taps *t;
+    unsigned int *yStart, *yCount, *cStart, *cCount, *vStart, *vCount;
+    unsigned char *yWeight, *cWeight, *vWeight;
+    unsigned int hTaps, vTaps;
+    unsigned short *acc;
+    unsigned int *chroma;
+    unsigned char *dstY, *dstVU;
+    unsigned int x, y, k, n;
+
+    if (srcWidth % 2 || srcHeight % 2 || dstWidth % 2 || dstHeight % 2 ||
+        dstWidth == 0 || dstHeight == 0 ||
+        srcWidth < dstWidth || srcHeight < dstHeight) {
+        LOGE("%s: can not scale %dx%d to %dx%d", __func__,
+             srcWidth, srcHeight, dstWidth, dstHeight);
+        return -1;
+    }
+
+    t = SW_Get_Taps(srcWidth, srcHeight, dstWidth, dstHeight);
+    if (t == NULL)
+        return -1;
+
+    hTaps   = t->hTaps;
+    vTaps   = t->vTaps;
+    acc     = t->acc;
+    chroma  = t->chroma;
+    yStart  = t->yStart;
+    yCount  = t->yCount;
+    cStart  = t->cStart;
+    cCount  = t->cCount;
+    vStart  = t->vStart;
+    vCount  = t->vCount;
+    yWeight = t->yWeight;
+    cWeight = t->cWeight;
+    vWeight = t->vWeight;
+
+    dstY = dst;
+    dstVU = dst + dstWidth * dstHeight;
+
+    for (y = 0; y < dstHeight; y++) {
+        unsigned char *w = vWeight + y * vTaps;
+        int first = 1;
+
+        /* Q7 sums of the source lines, at most 255 * 128 */
+        for (k = 0; k < vCount[y]; k++) {
+            if (w[k] == 0)
+                continue;
+            SW_Accumulate_Line_NEON(acc, src + (vStart[y] + k) * srcStride,
+                                    srcStride, w[k], first);
+            first = 0;
+        }
+
+        for (x = 0; x < dstWidth; x++) {
+            unsigned short *a = acc + yStart[x] * 2;
+            unsigned char *hw = yWeight + x * hTaps;
+            unsigned int sum = 0;
+
+            for (n = 0; n < yCount[x]; n++)
+                sum += hw[n] * a[n * 2];
+
+            sum = (sum + (1 << 13)) >> 14;
+            if (dstFormat == SW_SCALE_FMT_NV21)
+                dstY[x] = sum;
+            else
+                dst[x * 2] = sum;
+        }
+
+        for (x = 0; x < halfWidth; x++) {
+            unsigned short *a = acc + cStart[x] * 4;
+            unsigned char *hw = cWeight + x * hTaps;
+            unsigned int u = 0, v = 0;
+
+            for (n = 0; n < cCount[x]; n++) {
+                u += hw[n] * a[n * 4 + 1];
+                v += hw[n] * a[n * 4 + 3];
+            }
+
+            if (dstFormat == SW_SCALE_FMT_NV21) {
+                if (y % 2 == 0) {
+                    chroma[x * 2]     = v;
+                    chroma[x * 2 + 1] = u;
+                } else {
+                    dstVU[x * 2]     = (chroma[x * 2]     + v + (1 << 14)) >> 15;
+                    dstVU[x * 2 + 1] = (chroma[x * 2 + 1] + u + (1 << 14)) >> 15;
+                }
+            } else {
+                dst[x * 4 + 1] = (u + (1 << 13)) >> 14;
+                dst[x * 4 + 3] = (v + (1 << 13)) >> 14;
+            }
+        }
+
+        if (dstFormat == SW_SCALE_FMT_NV21) {
+            dstY += dstWidth;
+            if (y % 2)
+                dstVU += dstWidth;
+        } else {
+            dst += dstWidth * 2;
+        }
+    }
+
+    SW_Put_Taps(t);
+
+    return 0;
+}